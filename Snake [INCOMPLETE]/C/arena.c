@@ -0,0 +1,489 @@
+/*
+ * Name: Snake in C
+ * Author: Michael T. Kloos
+ *
+ * Copyright:
+ * (C) Copyright 2022 Michael T. Kloos (http://www.michaelkloos.com/).
+ * All Rights Reserved.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "snake.h"
+
+unsigned int arena_default_side(unsigned int snake_count) {
+  // How many Grid spaces a side a square arena for [snake_count] snakes 
+  // should be, to have ARENA_SPACES_PER_SNAKE spaces for each
+  
+  unsigned long the_grid_space = (unsigned long)snake_count * ARENA_SPACES_PER_SNAKE;
+  unsigned int side = STARTING_LENGTH * 2;
+  while ((unsigned long)side * side < the_grid_space && side < GRID_MAX_SIDE) {
+    side++;
+  }
+  return side;
+}
+
+signed int arena_init(struct Arena *arena, unsigned int width, unsigned int height, unsigned int snake_count, unsigned int seed, unsigned int worker_count) {
+  // Set up an arena of [snake_count] snakes on a [width] by [height] Grid, 
+  // with ARENA_FOOD_PER_SNAKE units of food for each, to be played by 
+  // [worker_count] threads
+  // The calling thread is one of the workers.  [snake_count] must be no 
+  // more than ARENA_MAX_SNAKES.  Returns -1 if the memory could not be 
+  // allocated or the threads could not be started.
+  
+  unsigned long the_grid_space = (unsigned long)width * height;
+  arena->width = width;
+  arena->height = height;
+  arena->snake_count = snake_count;
+  arena->food_count = snake_count * ARENA_FOOD_PER_SNAKE;
+  arena->random_state = game_seed(seed, 0);
+  arena->ticks = 0;
+  arena->failed = 0;
+  if (worker_pool_init(&arena->pool, worker_count) == -1) {
+    return -1;
+  }
+  arena->snakes = calloc(snake_count, sizeof(struct ArenaSnake));
+  arena->foods = malloc(arena->food_count * sizeof(struct GridCell));
+  arena->owners = calloc(the_grid_space, sizeof(uint16_t));
+  arena->claims = calloc(the_grid_space, sizeof(unsigned char));
+  arena->blocks_across = (width + ARENA_BLOCK_SIDE - 1) / ARENA_BLOCK_SIDE;
+  arena->blocks_down = (height + ARENA_BLOCK_SIDE - 1) / ARENA_BLOCK_SIDE;
+  arena->block_food = calloc((unsigned long)arena->blocks_across * arena->blocks_down, sizeof(unsigned int));
+  signed int failed = (arena->snakes == NULL || arena->foods == NULL || arena->owners == NULL ||
+                       arena->claims == NULL || arena->block_food == NULL);
+  
+  // Each snake has a random number generator of its own to steer with, so 
+  // that it steers the same whichever worker it is given to
+  unsigned int capacity = (the_grid_space < ARENA_BODY_INITIAL_CAPACITY) ? the_grid_space : ARENA_BODY_INITIAL_CAPACITY;
+  for (unsigned int n = 0; n < snake_count && !failed; n++) {
+    struct Snake *snake = &arena->snakes[n].snake;
+    if (snake_init_body(snake, capacity) == -1) {
+      failed = 1;
+      break;
+    }
+    snake->width = width;
+    snake->height = height;
+    snake->random_state = game_seed(seed, n + 1);
+  }
+  if (failed) {
+    worker_pool_destroy(&arena->pool);
+    if (arena->snakes != NULL) {
+      for (unsigned int n = 0; n < snake_count; n++) {
+        snake_destroy(&arena->snakes[n].snake);
+      }
+    }
+    free(arena->snakes);
+    free(arena->foods);
+    free(arena->owners);
+    free(arena->claims);
+    free(arena->block_food);
+    return -1;
+  }
+  
+  // Put down every snake, then the food around them
+  for (unsigned int n = 0; n < snake_count; n++) {
+    arena_spawn(arena, n);
+  }
+  for (unsigned int food = 0; food < arena->food_count; food++) {
+    arena_place_food(arena, food);
+  }
+  
+  return 0;
+}
+
+signed int arena_step(struct Arena *arena) {
+  // Move every snake of the arena on by one tick
+  // Snakes that die are taken off the Grid, and put back on as new 
+  // snakes where there is room.  Food that is eaten is put back down 
+  // somewhere else.  Returns -1 if the memory for a snake to grow could 
+  // not be allocated.
+  
+  arena_run(arena, ARENA_JOB_STEER);
+  arena_run(arena, ARENA_JOB_JUDGE);
+  arena_run(arena, ARENA_JOB_VACATE);
+  arena_run(arena, ARENA_JOB_ADVANCE);
+  if (arena->failed) {
+    return -1;
+  }
+  
+  // Only now, with every snake moved, is it known where there is room
+  for (unsigned int food = 0; food < arena->food_count; food++) {
+    if (arena->foods[food].x < 0) {
+      arena_place_food(arena, food);
+    }
+  }
+  for (unsigned int n = 0; n < arena->snake_count; n++) {
+    if (!arena->snakes[n].alive) {
+      arena_spawn(arena, n);
+    }
+  }
+  arena->ticks++;
+  
+  return 0;
+}
+
+void arena_destroy(struct Arena *arena) {
+  // Stop the worker threads, and free all of the memory owned by the arena
+  
+  worker_pool_destroy(&arena->pool);
+  for (unsigned int n = 0; n < arena->snake_count; n++) {
+    snake_destroy(&arena->snakes[n].snake);
+  }
+  free(arena->snakes);
+  free(arena->foods);
+  free(arena->owners);
+  free(arena->claims);
+  free(arena->block_food);
+  return;
+}
+
+void arena_run(struct Arena *arena, unsigned int job) {
+  // Do phase [job] to every snake of the arena on the pool, chunk by chunk
+  
+  arena->job = job;
+  arena->next_chunk = 0;
+  
+  worker_pool_run(&arena->pool, &arena_run_job, (void*)arena);
+  return;
+}
+
+void arena_run_job(void *arena_job, unsigned int worker) {
+  // Do the job of the arena at [arena_job] for chunks of its snakes until there are none left
+  // Each phase only changes the snakes it is given, and the Grid spaces 
+  // under them, so the snakes can be taken in any order.  Every worker 
+  // takes from the same count of chunks, whichever [worker] it is.
+  
+  struct Arena *arena = (struct Arena*)arena_job;
+  (void)worker;
+  unsigned int chunk_count = (arena->snake_count + ARENA_CHUNK_SIZE - 1) / ARENA_CHUNK_SIZE;
+  while (1) {
+    unsigned int chunk = __atomic_fetch_add(&arena->next_chunk, 1, __ATOMIC_RELAXED);
+    if (chunk >= chunk_count) {
+      break;
+    }
+    unsigned int first = chunk * ARENA_CHUNK_SIZE;
+    unsigned int last = first + ARENA_CHUNK_SIZE;
+    if (last > arena->snake_count) {
+      last = arena->snake_count;
+    }
+    for (unsigned int n = first; n < last; n++) {
+      if        (arena->job == ARENA_JOB_STEER) {
+        arena_steer(arena, n);
+      } else if (arena->job == ARENA_JOB_JUDGE) {
+        arena_judge(arena, n);
+      } else if (arena->job == ARENA_JOB_VACATE) {
+        arena_vacate(arena, n);
+      } else {                  // ARENA_JOB_ADVANCE
+        arena_advance(arena, n);
+      }
+    }
+  }
+  
+  return;
+}
+
+unsigned int arena_distance(struct Arena *arena, struct GridCell *from, struct GridCell *to) {
+  // How many steps [from] is from [to], the shorter way around each axis of the Grid
+  
+  unsigned int dx = (from->x > to->x) ? from->x - to->x : to->x - from->x;
+  unsigned int dy = (from->y > to->y) ? from->y - to->y : to->y - from->y;
+  dx = (dx < arena->width - dx) ? dx : arena->width - dx;
+  dy = (dy < arena->height - dy) ? dy : arena->height - dy;
+  return dx + dy;
+}
+
+unsigned int arena_space_open(struct Arena *arena, struct GridCell *cell) {
+  // Can a head move onto the Grid space [cell] this tick, without running into a snake?
+  // A tail moves off its space this tick, unless its snake is still 
+  // growing.  Another head could still move onto the same space.  That 
+  // is not ruled out here.
+  
+  unsigned int owner = arena->owners[cell->y * arena->width + cell->x];
+  if (owner == 0 || (owner & ARENA_FOOD)) {
+    return 1;
+  }
+  struct Snake *other = &arena->snakes[owner - 1].snake;
+  struct GridCell *tail = snake_tail(other);
+  return (tail->x == cell->x && tail->y == cell->y && other->pending_growth == 0);
+}
+
+void arena_pick_target(struct Arena *arena, struct ArenaSnake *arena_snake) {
+  // Have [arena_snake] head for the unit of food closest to its head, if 
+  // there is one within about ARENA_SIGHT steps
+  // The blocks of the Grid are looked at in square rings around the 
+  // block of the head, going out one block at a time, and only the blocks 
+  // with food in them are looked through.  So finding food takes about as 
+  // long however many snakes and how much food there are.
+  
+  struct GridCell *head = snake_head(&arena_snake->snake);
+  signed int across = arena->blocks_across;
+  signed int down = arena->blocks_down;
+  signed int head_x = head->x / ARENA_BLOCK_SIDE;
+  signed int head_y = head->y / ARENA_BLOCK_SIDE;
+  // No ring wraps around onto itself
+  signed int last_ring = ARENA_SIGHT / ARENA_BLOCK_SIDE;
+  if (last_ring > (across - 1) / 2) {
+    last_ring = (across - 1) / 2;
+  }
+  if (last_ring > (down - 1) / 2) {
+    last_ring = (down - 1) / 2;
+  }
+  
+  unsigned int closest = UINT32_MAX;
+  arena_snake->target_cell.x = -1;
+  arena_snake->target_cell.y = -1;
+  for (signed int ring = 0; ring <= last_ring; ring++) {
+    // Every space in this ring is more than this many steps from the head
+    if (ring > 0 && closest <= (unsigned int)(ring - 1) * ARENA_BLOCK_SIDE) {
+      break;
+    }
+    for (signed int dy = -ring; dy <= ring; dy++) {
+      // Only the first and last rows of the ring are all in it
+      signed int step = (dy == -ring || dy == ring) ? 1 : 2 * ring;
+      for (signed int dx = -ring; dx <= ring; dx += step) {
+        signed int block_x = (head_x + dx + across) % across;
+        signed int block_y = (head_y + dy + down) % down;
+        if (arena->block_food[block_y * across + block_x] == 0) {
+          continue;
+        }
+        unsigned int x_end = (block_x + 1) * ARENA_BLOCK_SIDE;
+        unsigned int y_end = (block_y + 1) * ARENA_BLOCK_SIDE;
+        x_end = (x_end < arena->width) ? x_end : arena->width;
+        y_end = (y_end < arena->height) ? y_end : arena->height;
+        for (unsigned int y = block_y * ARENA_BLOCK_SIDE; y < y_end; y++) {
+          for (unsigned int x = block_x * ARENA_BLOCK_SIDE; x < x_end; x++) {
+            unsigned int owner = arena->owners[y * arena->width + x];
+            if (!(owner & ARENA_FOOD)) {
+              continue;
+            }
+            struct GridCell cell = {x, y};
+            unsigned int distance = arena_distance(arena, head, &cell);
+            if (distance < closest) {
+              closest = distance;
+              arena_snake->target = owner & ~ARENA_FOOD;
+              arena_snake->target_cell = cell;
+            }
+          }
+        }
+      }
+    }
+  }
+  
+  return;
+}
+
+void arena_steer(struct Arena *arena, unsigned int n) {
+  // Steer phase: Pick the way for snake [n] to go, and claim the Grid space it is going to
+  // Three times in four, it goes a way that is closer to its food, if 
+  // there is one that does not run into a snake.  Otherwise it goes any 
+  // way that does not, at random.  With nowhere safe to go, it carries 
+  // straight on.
+  
+  struct ArenaSnake *arena_snake = &arena->snakes[n];
+  if (!arena_snake->alive) {
+    return;
+  }
+  struct Snake *snake = &arena_snake->snake;
+  struct GridCell *head = snake_head(snake);
+  
+  struct GridCell *target = &arena->foods[arena_snake->target];
+  if (arena_snake->target_cell.x < 0 || target->x != arena_snake->target_cell.x || target->y != arena_snake->target_cell.y) {
+    arena_pick_target(arena, arena_snake);
+  }
+  
+  uint64_t random = random_next(&snake->random_state);
+  unsigned int distance = UINT32_MAX;
+  if (arena_snake->target_cell.x >= 0) {
+    distance = arena_distance(arena, head, &arena_snake->target_cell);
+  }
+  unsigned int safe[3];
+  unsigned int safe_count = 0;
+  unsigned int closer[3];
+  unsigned int closer_count = 0;
+  for (unsigned int direction = 0; direction < 4; direction++) {
+    if (LINK_OPPOSITE(1 << direction) == (1u << snake->direction)) {
+      continue;
+    }
+    struct GridCell cell = *head;
+    grid_cell_step(snake, &cell, direction);
+    if (!arena_space_open(arena, &cell)) {
+      continue;
+    }
+    safe[safe_count++] = direction;
+    if (distance != UINT32_MAX && arena_distance(arena, &cell, &arena_snake->target_cell) < distance) {
+      closer[closer_count++] = direction;
+    }
+  }
+  if        (closer_count != 0 && (random & 0x3) != 0) {
+    snake->new_direction = closer[(random >> 2) % closer_count];
+  } else if (safe_count != 0) {
+    snake->new_direction = safe[(random >> 2) % safe_count];
+  }
+  
+  arena_snake->next_cell = *head;
+  grid_cell_step(snake, &arena_snake->next_cell, snake->new_direction);
+  __atomic_fetch_add(&arena->claims[arena_snake->next_cell.y * arena->width + arena_snake->next_cell.x], 1, __ATOMIC_RELAXED);
+  return;
+}
+
+void arena_judge(struct Arena *arena, unsigned int n) {
+  // Judge phase: Find out whether snake [n] dies moving onto its next
+  // Grid space, and what it eats there
+  // It dies if the space is not open, or if any other head is moving onto 
+  // it too.  In that case, every one of them dies.
+  
+  struct ArenaSnake *arena_snake = &arena->snakes[n];
+  if (!arena_snake->alive) {
+    return;
+  }
+  unsigned int index = arena_snake->next_cell.y * arena->width + arena_snake->next_cell.x;
+  arena_snake->dies = (arena->claims[index] > 1 || !arena_space_open(arena, &arena_snake->next_cell));
+  arena_snake->eats = -1;
+  if (!arena_snake->dies && (arena->owners[index] & ARENA_FOOD)) {
+    arena_snake->eats = arena->owners[index] & ~ARENA_FOOD;
+  }
+  return;
+}
+
+void arena_vacate(struct Arena *arena, unsigned int n) {
+  // Vacate phase: Take snake [n] off the Grid if it dies, or otherwise 
+  // its tail if that moves on this tick
+  // This has to be done for every snake before any head moves, as a head 
+  // can move onto the space a tail is leaving.
+  
+  struct ArenaSnake *arena_snake = &arena->snakes[n];
+  if (!arena_snake->alive) {
+    return;
+  }
+  struct Snake *snake = &arena_snake->snake;
+  // Other heads may have claimed the same space, and they all clear it
+  __atomic_store_n(&arena->claims[arena_snake->next_cell.y * arena->width + arena_snake->next_cell.x], 0, __ATOMIC_RELAXED);
+  
+  if (arena_snake->dies) {
+    struct SnakeWalk walk;
+    snake_walk_start(snake, &walk);
+    while (1) {
+      arena->owners[walk.cell.y * arena->width + walk.cell.x] = 0;
+      if (walk.i + 1 == snake->length) {
+        break;
+      }
+      snake_walk_next(snake, &walk);
+    }
+    if (snake->score > arena_snake->best_score) {
+      arena_snake->best_score = snake->score;
+    }
+    arena_snake->deaths++;
+    arena_snake->alive = 0;
+  } else if (snake->pending_growth == 0) {
+    struct GridCell *tail = snake_tail(snake);
+    arena->owners[tail->y * arena->width + tail->x] = 0;
+  }
+  
+  return;
+}
+
+void arena_advance(struct Arena *arena, unsigned int n) {
+  // Advance phase: Move snake [n] onto its next Grid space, and eat the food there
+  // The cells added for the food are fed out at the tail from the next 
+  // tick on, so that whether a tail moves is always known before the 
+  // heads do.
+  
+  struct ArenaSnake *arena_snake = &arena->snakes[n];
+  if (!arena_snake->alive) {
+    return;
+  }
+  struct Snake *snake = &arena_snake->snake;
+  
+  snake->direction = snake->new_direction;
+  if (snake->pending_growth > 0) {
+    if (snake->length == snake->capacity && snake_grow_body(snake) == -1) {
+      __atomic_store_n(&arena->failed, 1, __ATOMIC_RELAXED);
+      return;
+    }
+    snake->pending_growth--;
+  } else {
+    snake_pop_tail(snake);
+  }
+  snake_push_head(snake, &arena_snake->next_cell);
+  arena->owners[arena_snake->next_cell.y * arena->width + arena_snake->next_cell.x] = n + 1;
+  
+  if (arena_snake->eats >= 0) {
+    snake->score += 1;
+    snake->pending_growth += snake->grow_by;
+    snake->grow_by += GROW_BY_INCREMENT;
+    // Put back down once every snake has moved
+    struct GridCell *food = &arena->foods[arena_snake->eats];
+    __atomic_fetch_sub(&arena->block_food[(food->y / ARENA_BLOCK_SIDE) * arena->blocks_across + food->x / ARENA_BLOCK_SIDE], 1, __ATOMIC_RELAXED);
+    arena->foods[arena_snake->eats].x = -1;
+    arena->foods[arena_snake->eats].y = -1;
+  }
+  
+  return;
+}
+
+unsigned int arena_spawn(struct Arena *arena, unsigned int n) {
+  // Put snake [n] down as a new snake, laid out straight, on empty Grid 
+  // spaces picked at random
+  // Returns 0 if no room was found for it in ARENA_PLACE_TRIES tries.
+  
+  struct ArenaSnake *arena_snake = &arena->snakes[n];
+  struct Snake *snake = &arena_snake->snake;
+  struct GridCell cells[STARTING_LENGTH];
+  for (unsigned int tries = 0; tries < ARENA_PLACE_TRIES; tries++) {
+    // Lay it out back from the head, against the way it is going
+    unsigned int direction = random_below(&arena->random_state, 4);
+    cells[0].x = random_below(&arena->random_state, arena->width);
+    cells[0].y = random_below(&arena->random_state, arena->height);
+    unsigned int empty = (arena->owners[cells[0].y * arena->width + cells[0].x] == 0);
+    for (unsigned int i = 1; i < STARTING_LENGTH && empty; i++) {
+      cells[i] = cells[i - 1];
+      grid_cell_step(snake, &cells[i], __builtin_ctz(LINK_OPPOSITE(1 << direction)));
+      empty = (arena->owners[cells[i].y * arena->width + cells[i].x] == 0);
+    }
+    if (!empty) {
+      continue;
+    }
+    
+    snake->score = 0;
+    snake->new_direction = direction;
+    snake->direction = direction;
+    snake->pending_growth = 0;
+    snake->grow_by = STARTING_GROW_BY;
+    snake->length = 0;
+    snake->head = 0;
+    for (unsigned int i = STARTING_LENGTH; i > 0; i--) {
+      snake_push_head(snake, &cells[i - 1]);
+      arena->owners[cells[i - 1].y * arena->width + cells[i - 1].x] = n + 1;
+    }
+    arena_snake->alive = 1;
+    arena_snake->eats = -1;
+    arena_snake->target_cell.x = -1;
+    arena_snake->target_cell.y = -1;
+    return 1;
+  }
+  
+  return 0;
+}
+
+unsigned int arena_place_food(struct Arena *arena, unsigned int food) {
+  // Put unit of food [food] down on an empty Grid space picked at random
+  // Returns 0 if no room was found for it in ARENA_PLACE_TRIES tries, 
+  // in which case it is left off the Grid.
+  
+  for (unsigned int tries = 0; tries < ARENA_PLACE_TRIES; tries++) {
+    unsigned int x = random_below(&arena->random_state, arena->width);
+    unsigned int y = random_below(&arena->random_state, arena->height);
+    if (arena->owners[y * arena->width + x] == 0) {
+      arena->foods[food].x = x;
+      arena->foods[food].y = y;
+      arena->owners[y * arena->width + x] = ARENA_FOOD | food;
+      arena->block_food[(y / ARENA_BLOCK_SIDE) * arena->blocks_across + x / ARENA_BLOCK_SIDE]++;
+      return 1;
+    }
+  }
+  
+  arena->foods[food].x = -1;
+  arena->foods[food].y = -1;
+  return 0;
+}
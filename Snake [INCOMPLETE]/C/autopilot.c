@@ -0,0 +1,409 @@
+/*
+ * Name: Snake in C
+ * Author: Michael T. Kloos
+ *
+ * Copyright:
+ * (C) Copyright 2022 Michael T. Kloos (http://www.michaelkloos.com/).
+ * All Rights Reserved.
+ */
+
+#include <time.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "snake.h"
+
+signed int autopilot_init(struct Autopilot *autopilot) {
+  // Set up an Autopilot, with scratch space for the biggest window it searches
+  // Returns -1 if the memory for it could not be allocated.
+  
+  unsigned int spaces = AUTOPILOT_WINDOW_SIDE * AUTOPILOT_WINDOW_SIDE;
+  memset(autopilot, 0, sizeof(struct Autopilot));
+  autopilot->links = malloc(spaces * sizeof(unsigned char));
+  autopilot->first_step = malloc(spaces * sizeof(unsigned char));
+  autopilot->steps = malloc(spaces * sizeof(uint16_t));
+  autopilot->seen = calloc(spaces, sizeof(unsigned int));
+  autopilot->queue = malloc(spaces * 8 * sizeof(uint32_t));
+  if (autopilot->links == NULL || autopilot->first_step == NULL || autopilot->steps == NULL || 
+      autopilot->seen == NULL || autopilot->queue == NULL) {
+    autopilot_destroy(autopilot);
+    return -1;
+  }
+  
+  return 0;
+}
+
+void autopilot_destroy(struct Autopilot *autopilot) {
+  // Free all of the memory owned by [autopilot]
+  
+  free(autopilot->links);
+  free(autopilot->first_step);
+  free(autopilot->steps);
+  free(autopilot->seen);
+  free(autopilot->queue);
+  return;
+}
+
+unsigned int grid_cycle_direction(unsigned int width, unsigned int height, unsigned int x, unsigned int y) {
+  // Find the DIR_* to take from Grid space ([x], [y]) to follow a cycle 
+  // through every space of a [width] by [height] Grid
+  // The rows are snaked through in pairs, right along one and back left 
+  // along the next, leaving column 0 to climb back up to the top.  That 
+  // needs an even number of rows.  With an odd number, the last row is 
+  // a loop of its own around the wrap, spliced in off the row above it.  
+  // A snake that keeps to the cycle can never run into itself.
+  
+  unsigned int rows = height & ~1u;
+  if (y >= rows) {
+    return (x == 1) ? DIR_UP : DIR_RIGHT;
+  }
+  if (x == 0) {
+    return (y == 0) ? DIR_RIGHT : DIR_UP;
+  }
+  if (rows < height && y == rows - 1 && x == 2) {
+    return DIR_DOWN;
+  }
+  if (y % 2 == 0) {
+    return (x == width - 1) ? DIR_DOWN : DIR_RIGHT;
+  }
+  return (x == 1 && y < rows - 1) ? DIR_DOWN : DIR_LEFT;
+}
+
+void autopilot_load_window(struct Autopilot *autopilot, struct Snake *snake) {
+  // Centre the window of [autopilot] on the head of [snake], and copy in 
+  // what is on each space of it
+  // The tail is left out if it moves on next tick, as the snake can 
+  // then move onto it.
+  
+  struct GridCell *head = snake_head(snake);
+  autopilot->wraps_x = (snake->width <= AUTOPILOT_WINDOW_SIDE);
+  autopilot->wraps_y = (snake->height <= AUTOPILOT_WINDOW_SIDE);
+  if (autopilot->wraps_x) {
+    autopilot->width = snake->width;
+    autopilot->origin_x = 0;
+  } else {
+    autopilot->width = AUTOPILOT_WINDOW_SIDE;
+    autopilot->origin_x = (head->x + snake->width - AUTOPILOT_WINDOW_SIDE / 2) % snake->width;
+  }
+  if (autopilot->wraps_y) {
+    autopilot->height = snake->height;
+    autopilot->origin_y = 0;
+  } else {
+    autopilot->height = AUTOPILOT_WINDOW_SIDE;
+    autopilot->origin_y = (head->y + snake->height - AUTOPILOT_WINDOW_SIDE / 2) % snake->height;
+  }
+  
+  // The links are side by side in memory up to the end of each tile, or 
+  // the end of the Grid, where the window wraps around
+  for (unsigned int y = 0; y < autopilot->height; y++) {
+    unsigned int grid_y = (autopilot->origin_y + y) % snake->height;
+    unsigned int grid_x = autopilot->origin_x;
+    unsigned int x = 0;
+    while (x < autopilot->width) {
+      unsigned int run = GRID_TILE_SIDE - grid_x % GRID_TILE_SIDE;
+      if (run > snake->width - grid_x) {
+        run = snake->width - grid_x;
+      }
+      if (run > autopilot->width - x) {
+        run = autopilot->width - x;
+      }
+      memcpy(&autopilot->links[y * autopilot->width + x], grid_space_links(snake, grid_x, grid_y), run);
+      x += run;
+      grid_x += run;
+      if (grid_x == snake->width) {
+        grid_x = 0;
+      }
+    }
+  }
+  
+  autopilot->head = ((head->x + snake->width - autopilot->origin_x) % snake->width) | 
+                    (((head->y + snake->height - autopilot->origin_y) % snake->height) << 16);
+  if (snake->pending_growth == 0) {
+    struct GridCell *tail = snake_tail(snake);
+    unsigned int x = (tail->x + snake->width - autopilot->origin_x) % snake->width;
+    unsigned int y = (tail->y + snake->height - autopilot->origin_y) % snake->height;
+    if (x < autopilot->width && y < autopilot->height) {
+      autopilot->links[y * autopilot->width + x] = 0;
+    }
+  }
+  
+  return;
+}
+
+uint32_t autopilot_step(struct Autopilot *autopilot, uint32_t space, unsigned int direction) {
+  // Find the window space one step in [direction] from window [space], 
+  // both as x | (y << 16)
+  // Returns UINT32_MAX if that is off the edge of the window.
+  
+  unsigned int x = space & 0xFFFF;
+  unsigned int y = space >> 16;
+  if        (direction == DIR_UP) {
+    if (y == 0) {
+      if (!autopilot->wraps_y) {
+        return UINT32_MAX;
+      }
+      y = autopilot->height;
+    }
+    y--;
+  } else if (direction == DIR_DOWN) {
+    y++;
+    if (y == autopilot->height) {
+      if (!autopilot->wraps_y) {
+        return UINT32_MAX;
+      }
+      y = 0;
+    }
+  } else if (direction == DIR_LEFT) {
+    if (x == 0) {
+      if (!autopilot->wraps_x) {
+        return UINT32_MAX;
+      }
+      x = autopilot->width;
+    }
+    x--;
+  } else {                    // DIR_RIGHT
+    x++;
+    if (x == autopilot->width) {
+      if (!autopilot->wraps_x) {
+        return UINT32_MAX;
+      }
+      x = 0;
+    }
+  }
+  
+  return x | (y << 16);
+}
+
+void autopilot_new_search(struct Autopilot *autopilot) {
+  // Start a search over the window, with none of its spaces reached yet
+  // Spaces are marked with the number of the search that reached them, 
+  // so the marks only have to be cleared when that number wraps around.
+  
+  autopilot->search++;
+  if (autopilot->search == 0) {
+    memset(autopilot->seen, 0, AUTOPILOT_WINDOW_SIDE * AUTOPILOT_WINDOW_SIDE * sizeof(unsigned int));
+    autopilot->search = 1;
+  }
+  return;
+}
+
+unsigned int autopilot_room(struct Autopilot *autopilot, uint32_t start, unsigned int region, unsigned int enough, const unsigned int *rooms) {
+  // Count the empty window spaces that can be reached from window space 
+  // [start], stopping once there are [enough], as part of the current search
+  // Reaching the edge of the window counts as [enough], as the Grid goes 
+  // on past it.  The spaces reached are marked as [region].  Running into 
+  // one marked as an earlier region means they are one and the same, so 
+  // that region's room, from [rooms], is returned instead.
+  
+  unsigned int width = autopilot->width;
+  unsigned int head = 0;
+  unsigned int tail = 0;
+  unsigned int start_index = (start >> 16) * width + (start & 0xFFFF);
+  autopilot->seen[start_index] = autopilot->search;
+  autopilot->steps[start_index] = region;
+  autopilot->queue[tail++] = start;
+  while (head < tail) {
+    if (head >= enough) {
+      return enough;
+    }
+    uint32_t space = autopilot->queue[head++];
+    for (unsigned int direction = 0; direction < 4; direction++) {
+      uint32_t next = autopilot_step(autopilot, space, direction);
+      if (next == UINT32_MAX) {
+        return enough;
+      }
+      unsigned int index = (next >> 16) * width + (next & 0xFFFF);
+      if (autopilot->links[index] != 0) {
+        continue;
+      }
+      if (autopilot->seen[index] != autopilot->search) {
+        autopilot->seen[index] = autopilot->search;
+        autopilot->steps[index] = region;
+        autopilot->queue[tail++] = next;
+      } else if (autopilot->steps[index] != region) {
+        return rooms[autopilot->steps[index]];
+      }
+    }
+  }
+  
+  return head;
+}
+
+unsigned int autopilot_food_distance(struct Autopilot *autopilot, struct Snake *snake, struct GridCell *food, uint32_t space) {
+  // How many steps window [space] is from the food, the shorter way 
+  // around each axis of the Grid
+  
+  unsigned int x = autopilot->origin_x + (space & 0xFFFF);
+  unsigned int y = autopilot->origin_y + (space >> 16);
+  if (x >= snake->width) {
+    x -= snake->width;
+  }
+  if (y >= snake->height) {
+    y -= snake->height;
+  }
+  unsigned int dx = (x > (unsigned int)food->x) ? x - food->x : food->x - x;
+  unsigned int dy = (y > (unsigned int)food->y) ? y - food->y : food->y - y;
+  dx = (dx < snake->width - dx) ? dx : snake->width - dx;
+  dy = (dy < snake->height - dy) ? dy : snake->height - dy;
+  return dx + dy;
+}
+
+unsigned int autopilot_axis_gap(unsigned int origin, unsigned int size, unsigned int wraps, unsigned int grid_size, unsigned int target) {
+  // How many steps [target] is from the nearest of the [size] spaces 
+  // from [origin] on, along an axis [grid_size] spaces around
+  
+  unsigned int offset = (target + grid_size - origin) % grid_size;
+  if (wraps || offset < size) {
+    return 0;
+  }
+  unsigned int after = offset - (size - 1);
+  unsigned int before = grid_size - offset;
+  return (after < before) ? after : before;
+}
+
+signed int autopilot_search(struct Autopilot *autopilot, struct Snake *snake, struct GridCell *food) {
+  // Search the window from the head for the shortest way to the food 
+  // across the wrapping Grid, by A* with the steps to the food as the guide
+  // The window must have been loaded with autopilot_load_window().  
+  // If the food is outside the window, it heads for whichever space it 
+  // can reach that is the fewest steps from the food.  Returns the DIR_* 
+  // of the first step, or -1 if there is no food or nowhere to go.
+  
+  if (food->x < 0) {
+    return -1;
+  }
+  
+  // No space in the window can be any closer to the food than this
+  unsigned int closest = autopilot_axis_gap(autopilot->origin_x, autopilot->width, autopilot->wraps_x, snake->width, food->x) + 
+                         autopilot_axis_gap(autopilot->origin_y, autopilot->height, autopilot->wraps_y, snake->height, food->y);
+  
+  // Each step changes the steps to the food by 1 either way, so the 
+  // estimate of a whole way through a space only ever stays the same or 
+  // goes up by 2.  The spaces to search are kept in two stacks: Those on 
+  // as short a way as the one being searched from, and those on a way 2 
+  // longer.  A space can be stacked more than once, if a shorter way to 
+  // it turns up, but it is only searched from the first time it comes off.
+  autopilot_new_search(autopilot);
+  unsigned int width = autopilot->width;
+  uint32_t head_space = autopilot->head;
+  uint32_t *now = autopilot->queue;
+  uint32_t *later = autopilot->queue + AUTOPILOT_WINDOW_SIDE * AUTOPILOT_WINDOW_SIDE * 4;
+  unsigned int now_count = 0;
+  unsigned int later_count = 0;
+  unsigned int head_index = (head_space >> 16) * width + (head_space & 0xFFFF);
+  autopilot->seen[head_index] = autopilot->search;
+  autopilot->steps[head_index] = 0;
+  autopilot->first_step[head_index] = 0;
+  now[now_count++] = head_space;
+  
+  signed int best_step = -1;
+  unsigned int best_distance = UINT32_MAX;
+  unsigned int searched = 0;
+  while ((now_count > 0 || later_count > 0) && searched < AUTOPILOT_SEARCH_LIMIT) {
+    if (now_count == 0) {
+      uint32_t *swap = now;
+      now = later;
+      later = swap;
+      now_count = later_count;
+      later_count = 0;
+    }
+    uint32_t space = now[--now_count];
+    unsigned int index = (space >> 16) * width + (space & 0xFFFF);
+    if (autopilot->first_step[index] & AUTOPILOT_SEARCHED) {
+      continue;
+    }
+    autopilot->first_step[index] |= AUTOPILOT_SEARCHED;
+    searched++;
+    
+    unsigned int distance = autopilot_food_distance(autopilot, snake, food, space);
+    if (space != head_space && distance < best_distance) {
+      best_distance = distance;
+      best_step = autopilot->first_step[index] & 0x3;
+      if (distance == closest) {
+        break;
+      }
+    }
+    for (unsigned int direction = 0; direction < 4; direction++) {
+      uint32_t next = autopilot_step(autopilot, space, direction);
+      if (next == UINT32_MAX) {
+        continue;
+      }
+      unsigned int next_index = (next >> 16) * width + (next & 0xFFFF);
+      unsigned int steps = autopilot->steps[index] + 1;
+      if (autopilot->links[next_index] != 0 || 
+          (autopilot->seen[next_index] == autopilot->search && autopilot->steps[next_index] <= steps)) {
+        continue;
+      }
+      autopilot->seen[next_index] = autopilot->search;
+      autopilot->steps[next_index] = steps;
+      autopilot->first_step[next_index] = (space == head_space) ? direction : (autopilot->first_step[index] & 0x3);
+      if (autopilot_food_distance(autopilot, snake, food, next) < distance) {
+        now[now_count++] = next;
+      } else {
+        later[later_count++] = next;
+      }
+    }
+  }
+  
+  return best_step;
+}
+
+void autopilot_steer(struct Autopilot *autopilot, struct Snake *snake, struct GridCell *food) {
+  // Decide which way [snake] goes next tick, and steer it that way
+  // The way to the food is only taken if it leaves the snake room for 
+  // all of itself afterwards.  Otherwise the cycle is followed if that 
+  // does, or failing that, whichever way has the most room.
+  
+  struct timespec decision_start;
+  if (autopilot->profile != NULL) {
+    clock_gettime(CLOCK_MONOTONIC, &decision_start);
+  }
+  autopilot->decisions++;
+  
+  autopilot_load_window(autopilot, snake);
+  struct GridCell *head_cell = snake_head(snake);
+  uint32_t head_space = autopilot->head;
+  unsigned int enough = snake->length + snake->pending_growth;
+  signed int direction = autopilot_search(autopilot, snake, food);
+  
+  // The room each way from the head is counted in one search, so that 
+  // ways into the same region are only counted once.  Each way is a 
+  // region of its own, numbered by its DIR_*.
+  unsigned int rooms[4] = {0, 0, 0, 0};
+  autopilot_new_search(autopilot);
+  if (direction != -1) {
+    rooms[direction] = autopilot_room(autopilot, autopilot_step(autopilot, head_space, direction), direction, enough, rooms);
+  }
+  if (direction == -1 || rooms[direction] < enough) {
+    autopilot->fallbacks++;
+    unsigned int cycle_direction = grid_cycle_direction(snake->width, snake->height, head_cell->x, head_cell->y);
+    unsigned int best_room = 0;
+    direction = -1;
+    for (unsigned int i = 0; i < 4; i++) {
+      // The cycle goes first, so that it wins a tie
+      unsigned int way = (cycle_direction + i) % 4;
+      uint32_t next = autopilot_step(autopilot, head_space, way);
+      unsigned int index = (next >> 16) * autopilot->width + (next & 0xFFFF);
+      if (next == UINT32_MAX || autopilot->links[index] != 0) {
+        continue;
+      }
+      if (autopilot->seen[index] == autopilot->search) {
+        rooms[way] = rooms[autopilot->steps[index]];
+      } else {
+        rooms[way] = autopilot_room(autopilot, next, way, enough, rooms);
+      }
+      if (rooms[way] > best_room) {
+        best_room = rooms[way];
+        direction = way;
+      }
+    }
+  }
+  if (direction != -1) {
+    snake_steer(snake, direction);
+  }
+  
+  if (autopilot->profile != NULL) {
+    profile_record_since(autopilot->profile, PROFILE_AUTOPILOT, &decision_start);
+  }
+  return;
+}
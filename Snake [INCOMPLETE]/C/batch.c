@@ -0,0 +1,173 @@
+/*
+ * Name: Snake in C
+ * Author: Michael T. Kloos
+ *
+ * Copyright:
+ * (C) Copyright 2022 Michael T. Kloos (http://www.michaelkloos.com/).
+ * All Rights Reserved.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "snake.h"
+
+signed int batch_init(struct GameBatch *batch, unsigned int count, unsigned int width, unsigned int height, unsigned int seed, unsigned int worker_count) {
+  // Set up [count] games on [width] by [height] Grids, to be played by [worker_count] threads
+  // The calling thread is one of the workers.  Game [n] of the batch 
+  // starts from game_seed(seed, n), the next game in the same slot from 
+  // game_seed(seed, n + count), and so on.  So the games come out the 
+  // same however many workers there are.  Returns -1 if the memory could 
+  // not be allocated or the threads could not be started.
+  
+  batch->count = count;
+  batch->width = width;
+  batch->height = height;
+  batch->seed = seed;
+  if (worker_pool_init(&batch->pool, worker_count) == -1) {
+    return -1;
+  }
+  batch->games = malloc(count * sizeof(struct BatchGame));
+  void *queues = NULL;
+  if (posix_memalign(&queues, 64, worker_count * sizeof(struct BatchQueue)) != 0) {
+    queues = NULL;
+  }
+  batch->queues = queues;
+  if (batch->games == NULL || batch->queues == NULL) {
+    worker_pool_destroy(&batch->pool);
+    free(batch->games);
+    free(batch->queues);
+    return -1;
+  }
+  
+  // Each game is set up by the worker that will usually play it, so that 
+  // its memory ends up close to that worker
+  batch->failed = 0;
+  batch_run(batch, BATCH_JOB_INIT);
+  if (batch->failed) {
+    batch_destroy(batch);
+    return -1;
+  }
+  
+  return 0;
+}
+
+signed int batch_step(struct GameBatch *batch, const unsigned char *turns, unsigned int ticks, unsigned char *observations) {
+  // Play every game of the batch on by [ticks] ticks
+  // If [turns] is not NULL, [turns][tick * count + n] is the DIR_* for 
+  // game [n] to turn to at the start of [tick], or BATCH_NO_TURN.  Every 
+  // Game Over starts a new game in the same slot straight away.  If 
+  // [observations] is not NULL, what is on the Grid of each game at the 
+  // end is written to it by game_observe(), one game after another.  
+  // Returns -1 if the memory for a snake to crawl on with could not be 
+  // allocated, in which case the games are left part of the way through.
+  
+  batch->turns = turns;
+  batch->ticks = ticks;
+  batch->observations = observations;
+  batch_run(batch, BATCH_JOB_STEP);
+  return __atomic_load_n(&batch->failed, __ATOMIC_RELAXED) ? -1 : 0;
+}
+
+void batch_destroy(struct GameBatch *batch) {
+  // Stop the worker threads, and free all of the memory owned by the batch
+  
+  worker_pool_destroy(&batch->pool);
+  for (unsigned int n = 0; n < batch->count; n++) {
+    snake_destroy(&batch->games[n].snake);
+  }
+  free(batch->games);
+  free(batch->queues);
+  return;
+}
+
+void batch_run(struct GameBatch *batch, unsigned int job) {
+  // Do [job] to every game of the batch on the pool, chunk by chunk
+  
+  // Hand out the chunks evenly to start with
+  unsigned int worker_count = batch->pool.worker_count;
+  unsigned int chunk_count = (batch->count + BATCH_CHUNK_SIZE - 1) / BATCH_CHUNK_SIZE;
+  for (unsigned int w = 0; w < worker_count; w++) {
+    batch->queues[w].next = (unsigned long)chunk_count * w / worker_count;
+    batch->queues[w].end = (unsigned long)chunk_count * (w + 1) / worker_count;
+  }
+  batch->job = job;
+  
+  worker_pool_run(&batch->pool, &batch_run_job, (void*)batch);
+  return;
+}
+
+void batch_run_job(void *batch_job, unsigned int worker) {
+  // Play chunks of the batch at [batch_job] as worker [worker] until there are none left
+  // Take from its own queue first, then steal from the others in turn.  
+  // Games end and restart at different times, so some chunks take longer 
+  // than others.
+  
+  struct GameBatch *batch = (struct GameBatch*)batch_job;
+  unsigned int worker_count = batch->pool.worker_count;
+  for (unsigned int i = 0; i < worker_count; i++) {
+    struct BatchQueue *queue = &batch->queues[(worker + i) % worker_count];
+    while (1) {
+      unsigned int chunk = __atomic_fetch_add(&queue->next, 1, __ATOMIC_RELAXED);
+      if (chunk >= queue->end) {
+        break;
+      }
+      batch_play_chunk(batch, chunk);
+    }
+  }
+  
+  return;
+}
+
+void batch_play_chunk(struct GameBatch *batch, unsigned int chunk) {
+  // Do the job of the batch for the games in chunk [chunk]
+  
+  unsigned int first = chunk * BATCH_CHUNK_SIZE;
+  unsigned int last = first + BATCH_CHUNK_SIZE;
+  if (last > batch->count) {
+    last = batch->count;
+  }
+  unsigned int the_grid_space = batch->width * batch->height;
+  
+  for (unsigned int n = first; n < last; n++) {
+    struct BatchGame *game = &batch->games[n];
+    
+    if (batch->job == BATCH_JOB_INIT) {
+      game->games = 1;
+      game->best_score = 0;
+      if (game_init(&game->snake, &game->food, batch->width, batch->height, game_seed(batch->seed, n)) == -1) {
+        // Leave nothing for batch_destroy() to free
+        memset(&game->snake, 0, sizeof(struct Snake));
+        __atomic_store_n(&batch->failed, 1, __ATOMIC_RELAXED);
+      }
+      continue;
+    }
+    
+    for (unsigned int tick = 0; tick < batch->ticks; tick++) {
+      if (batch->turns != NULL && batch->turns[tick * batch->count + n] != BATCH_NO_TURN) {
+        snake_steer(&game->snake, batch->turns[tick * batch->count + n]);
+      }
+      unsigned int collided = snake_crawl(&game->snake, &game->food);
+      if (collided == 2) {
+        // Out of memory, which is no Game Over.  Leave the rest of the 
+        // chunk as it is.
+        __atomic_store_n(&batch->failed, 1, __ATOMIC_RELAXED);
+        return;
+      }
+      if (collided) {
+        // Game Over: Start the next game in this slot
+        if (game->snake.score > game->best_score) {
+          game->best_score = game->snake.score;
+        }
+        game_restart(&game->snake, &game->food, game_seed(batch->seed, game->games * batch->count + n));
+        game->games++;
+      }
+    }
+    
+    if (batch->observations != NULL) {
+      game_observe(&game->snake, &game->food, &batch->observations[(unsigned long)n * the_grid_space]);
+    }
+  }
+  
+  return;
+}
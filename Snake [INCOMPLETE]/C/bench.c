@@ -0,0 +1,874 @@
+/*
+ * Name: Snake in C
+ * Author: Michael T. Kloos
+ *
+ * Copyright:
+ * (C) Copyright 2022 Michael T. Kloos (http://www.michaelkloos.com/).
+ * All Rights Reserved.
+ */
+
+#include <time.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include "snake.h"
+
+// START: Benchmark Configuration Definitions
+
+// How many timed samples should be taken of each case by default?
+#define BENCH_SAMPLES 201
+// How many untimed samples should be run first to warm up the caches?
+#define BENCH_WARMUP_SAMPLES 20
+// How long should a sample take at least, in nanoseconds?  Fast functions 
+// are called in batches that take at least this long.  Otherwise reading 
+// the clock would cost more than what is being timed.
+#define BENCH_MIN_SAMPLE_NS 20000
+// How many rollouts should each timed lookahead search play?
+#define BENCH_LOOKAHEAD_ROLLOUTS 768
+// Up to how many Grid spaces should lookahead searches be timed on?  
+// Every rollout copies the whole game, so they get slow on big Grids.
+#define BENCH_LOOKAHEAD_MAX_GRID_SPACE 20000
+// How many ticks should an arena play before its ticks are timed?  The 
+// snakes are all new to start with, so the first ticks are cheaper.
+#define BENCH_ARENA_WARMUP_TICKS 200
+// How many spectators should the game be streamed to?
+#define BENCH_SPECTATORS 100
+// How many bytes can be left waiting for each spectator?  Far less than 
+// SPECTATE_BACKLOG_LIMIT, so that the slow spectators fill it up, have 
+// messages skipped, and are dropped within the ticks that are timed, 
+// even on the smallest Grid.
+#define BENCH_SPECTATE_BACKLOG_LIMIT 128
+// On how big a Grid should multiplayer games be played?
+#define BENCH_MULTIPLAYER_WIDTH 500
+#define BENCH_MULTIPLAYER_HEIGHT 200
+
+// END: Benchmark Configuration Definitions
+
+// One board with a snake on it for the benchmarks to run against
+struct BenchBoard {
+  struct Snake snake;
+  struct GridCell food;
+  struct Screen screen;
+  char *display_content;
+  // The DIR_* from each Grid space on to the next around a loop through 
+  // every space on the Grid.  The snake follows this loop, so it never 
+  // runs into itself however long it is.  
+  // Indexed by: y * width + x
+  unsigned char *loop_directions;
+  // The damage log left behind by one crawl, to be replayed by bench_regen_buffer_changes()
+  unsigned int damaged_cells[DAMAGE_LOG_SIZE];
+  unsigned int damage_count;
+  // Steers towards food put across the Grid from the head, without it 
+  // being put down
+  struct Autopilot autopilot;
+  struct GridCell target;
+};
+
+// A function to time, which runs what it times [count] times over on [board]
+typedef void (*BenchFunction)(struct BenchBoard *board, unsigned long count);
+
+signed int bench_board_init(struct BenchBoard *board, unsigned int width, unsigned int height, unsigned int length);
+void bench_board_destroy(struct BenchBoard *board);
+void bench_snake_crawl(struct BenchBoard *board, unsigned long count);
+void bench_rand_food_location(struct BenchBoard *board, unsigned long count);
+void bench_regen_buffer(struct BenchBoard *board, unsigned long count);
+void bench_regen_buffer_changes(struct BenchBoard *board, unsigned long count);
+void bench_reference_regen_buffer(struct BenchBoard *board, unsigned long count);
+void bench_reference_regen_buffer_changes(struct BenchBoard *board, unsigned long count);
+void bench_snake_build_grid_state(struct BenchBoard *board, unsigned long count);
+void bench_autopilot_steer(struct BenchBoard *board, unsigned long count);
+signed int compare_doubles(const void *a, const void *b);
+signed int bench_run(const char *name, BenchFunction function, struct BenchBoard *board, unsigned int samples);
+signed int bench_lookahead(struct BenchBoard *board, unsigned int samples, unsigned int max_threads);
+signed int bench_arena(unsigned int snake_count, unsigned int samples, unsigned int max_threads);
+signed int bench_spectate(struct BenchBoard *board, unsigned int spectator_count, unsigned int slow_count, unsigned int samples);
+signed int bench_multiplayer(unsigned int width, unsigned int height, unsigned int player_count, unsigned int samples);
+signed int main(signed int argc, char *argv[]);
+
+signed int bench_board_init(struct BenchBoard *board, unsigned int width, unsigned int height, unsigned int length) {
+  // Set up a [width] by [height] Grid with a snake [length] cells long on it
+  // One of [width] or [height] must be even, for there to be a loop through 
+  // every Grid space.  Returns -1 if the memory for it could not be allocated.
+  
+  unsigned int the_grid_space = width * height;
+  
+  // Lay out the loop.  Along the first row, then back and forth over the 
+  // rest of the rows leaving out the first column, then back up the first 
+  // column to the start.  With an odd number of rows, do the same with 
+  // rows and columns swapped.
+  unsigned int *loop = malloc(the_grid_space * sizeof(unsigned int));
+  board->loop_directions = malloc(the_grid_space * sizeof(unsigned char));
+  if (loop == NULL || board->loop_directions == NULL) {
+    free(loop);
+    free(board->loop_directions);
+    return -1;
+  }
+  {
+    unsigned int across = width;
+    unsigned int down = height;
+    if (height % 2 != 0) {
+      across = height;
+      down = width;
+    }
+    
+    unsigned int i = 0;
+    for (unsigned int a = 0; a < across; a++) {
+      loop[i] = a;
+      i++;
+    }
+    for (unsigned int d = 1; d < down; d++) {
+      for (unsigned int a = 1; a < across; a++) {
+        loop[i] = d * across + ((d % 2 != 0) ? across - a : a);
+        i++;
+      }
+    }
+    for (unsigned int d = down - 1; d > 0; d--) {
+      loop[i] = d * across;
+      i++;
+    }
+    
+    // Map the loop back onto the Grid if the rows and columns were swapped
+    if (height % 2 != 0) {
+      for (i = 0; i < the_grid_space; i++) {
+        loop[i] = (loop[i] % across) * width + (loop[i] / across);
+      }
+    }
+  }
+  for (unsigned int i = 0; i < the_grid_space; i++) {
+    struct GridCell from = {loop[i] % width, loop[i] / width};
+    unsigned int next = loop[(i + 1) % the_grid_space];
+    struct GridCell to = {next % width, next / width};
+    board->loop_directions[loop[i]] = __builtin_ctz(grid_cell_link(&from, &to));
+  }
+  
+  // Lay the snake out along the start of the loop, from the tail up to the head
+  struct Snake *snake = &board->snake;
+  snake->score = 0;
+  snake->pending_growth = 0;
+  snake->grow_by = STARTING_GROW_BY;
+  // Fixed seed, so that every run picks the same food places
+  snake->random_state = game_seed(1, 0);
+  if (snake_init_body(snake, the_grid_space) == -1) {
+    free(loop);
+    free(board->loop_directions);
+    return -1;
+  }
+  for (unsigned int i = 0; i < length; i++) {
+    struct GridCell cell = {loop[i] % width, loop[i] / width};
+    snake_push_head(snake, &cell);
+  }
+  free(loop);
+  
+  struct GridCell *head = snake_head(snake);
+  snake->direction = board->loop_directions[head->y * width + head->x];
+  snake->new_direction = snake->direction;
+  
+  // The food is kept off the Grid, so that the snake stays the same length
+  board->food.x = -1;
+  board->food.y = -1;
+  
+  board->display_content = malloc((width + 3) * (height + 3) * sizeof(char) * 4);
+  if (board->display_content == NULL ||
+      snake_init_grid_state(snake, width, height) == -1) {
+    free(board->display_content);
+    free(board->loop_directions);
+    snake_destroy(snake);
+    return -1;
+  }
+  if (snake_build_grid_state(snake) == -1 || screen_init(&board->screen, width, height) == -1) {
+    free(board->display_content);
+    free(board->loop_directions);
+    snake_destroy(snake);
+    return -1;
+  }
+  if (autopilot_init(&board->autopilot) == -1) {
+    free(board->display_content);
+    free(board->loop_directions);
+    snake_destroy(snake);
+    screen_destroy(&board->screen);
+    return -1;
+  }
+  board->target.x = (head->x + width / 2) % width;
+  board->target.y = (head->y + height / 2) % height;
+  
+  // Crawl once to record what a typical tick leaves in the damage log
+  regen_buffer(board->display_content, &board->screen, snake, &board->food);
+  bench_snake_crawl(board, 1);
+  board->damage_count = snake->damage_count;
+  memcpy(board->damaged_cells, snake->damaged_cells, sizeof(board->damaged_cells));
+  
+  return 0;
+}
+
+void bench_board_destroy(struct BenchBoard *board) {
+  // Free all of the memory owned by the board
+  
+  snake_destroy(&board->snake);
+  screen_destroy(&board->screen);
+  autopilot_destroy(&board->autopilot);
+  free(board->display_content);
+  free(board->loop_directions);
+  return;
+}
+
+void bench_snake_crawl(struct BenchBoard *board, unsigned long count) {
+  // Crawl the snake on around the loop
+  
+  struct Snake *snake = &board->snake;
+  for (unsigned long i = 0; i < count; i++) {
+    struct GridCell *head = snake_head(snake);
+    snake->new_direction = board->loop_directions[head->y * snake->width + head->x];
+    snake_crawl(snake, &board->food);
+  }
+  return;
+}
+
+void bench_rand_food_location(struct BenchBoard *board, unsigned long count) {
+  // Pick places for food, without putting any of it down
+  
+  struct GridCell food;
+  for (unsigned long i = 0; i < count; i++) {
+    rand_food_location(&food, &board->snake);
+  }
+  return;
+}
+
+void bench_regen_buffer(struct BenchBoard *board, unsigned long count) {
+  // Render the whole Grid
+  
+  for (unsigned long i = 0; i < count; i++) {
+    regen_buffer(board->display_content, &board->screen, &board->snake, &board->food);
+  }
+  return;
+}
+
+void bench_regen_buffer_changes(struct BenchBoard *board, unsigned long count) {
+  // Render the changes left behind by one crawl
+  
+  struct Snake *snake = &board->snake;
+  for (unsigned long i = 0; i < count; i++) {
+    // Put the damage log back, and make out that none of those Grid spaces 
+    // have been drawn, so that every one of them is rendered again
+    snake->damage_count = board->damage_count;
+    memcpy(snake->damaged_cells, board->damaged_cells, board->damage_count * sizeof(unsigned int));
+    for (unsigned int j = 0; j < board->damage_count; j++) {
+      board->screen.glyphs[board->damaged_cells[j]] = GLYPH_COUNT;
+    }
+    regen_buffer_changes(board->display_content, &board->screen, snake, &board->food);
+  }
+  return;
+}
+
+void bench_reference_regen_buffer(struct BenchBoard *board, unsigned long count) {
+  // Render the whole Grid with the renderer from before the glyph tables, 
+  // to set bench_regen_buffer() against
+  
+  for (unsigned long i = 0; i < count; i++) {
+    reference_regen_buffer(board->display_content, &board->screen, &board->snake, &board->food);
+  }
+  return;
+}
+
+void bench_reference_regen_buffer_changes(struct BenchBoard *board, unsigned long count) {
+  // Render the changes left behind by one crawl with the renderer from 
+  // before the glyph tables, to set bench_regen_buffer_changes() against
+  
+  struct Snake *snake = &board->snake;
+  for (unsigned long i = 0; i < count; i++) {
+    snake->damage_count = board->damage_count;
+    memcpy(snake->damaged_cells, board->damaged_cells, board->damage_count * sizeof(unsigned int));
+    for (unsigned int j = 0; j < board->damage_count; j++) {
+      board->screen.glyphs[board->damaged_cells[j]] = GLYPH_COUNT;
+    }
+    reference_regen_buffer_changes(board->display_content, &board->screen, snake, &board->food);
+  }
+  return;
+}
+
+void bench_snake_build_grid_state(struct BenchBoard *board, unsigned long count) {
+  // Rebuild the per Grid space state by walking the whole snake, as 
+  // starting a game or seeking in a game log does
+  
+  for (unsigned long i = 0; i < count; i++) {
+    snake_build_grid_state(&board->snake);
+  }
+  return;
+}
+
+void bench_autopilot_steer(struct BenchBoard *board, unsigned long count) {
+  // Decide which way to go, as the autopilot does before every tick
+  
+  struct Snake *snake = &board->snake;
+  unsigned int direction = snake->new_direction;
+  for (unsigned long i = 0; i < count; i++) {
+    autopilot_steer(&board->autopilot, snake, &board->target);
+  }
+  snake->new_direction = direction;
+  return;
+}
+
+signed int compare_doubles(const void *a, const void *b) {
+  // Order doubles from smallest to largest for qsort()
+  
+  double x = *(const double*)a;
+  double y = *(const double*)b;
+  return (x > y) - (x < y);
+}
+
+signed int bench_run(const char *name, BenchFunction function, struct BenchBoard *board, unsigned int samples) {
+  // Time [function] on [board] and print a line of results, as CSV on STDOUT
+  // Returns -1 if the memory for it could not be allocated
+  
+  double *sample_ns = malloc(samples * sizeof(double));
+  if (sample_ns == NULL) {
+    return -1;
+  }
+  
+  // Find how many calls it takes to fill up a sample
+  unsigned long batch = 1;
+  while (batch < (1ul << 30)) {
+    struct timespec start;
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    function(board, batch);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    if (elapsed_ns(&start, &end) >= BENCH_MIN_SAMPLE_NS) {
+      break;
+    }
+    batch *= 2;
+  }
+  
+  for (unsigned int i = 0; i < BENCH_WARMUP_SAMPLES; i++) {
+    function(board, batch);
+  }
+  
+  for (unsigned int i = 0; i < samples; i++) {
+    struct timespec start;
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    function(board, batch);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    sample_ns[i] = (double)elapsed_ns(&start, &end) / batch;
+  }
+  
+  qsort(sample_ns, samples, sizeof(double), &compare_doubles);
+  double median = sample_ns[samples / 2];
+  double p99 = sample_ns[(samples * 99 + 99) / 100 - 1];
+  
+  dprintf(STDOUT, "%s,%u,%u,%u,%lu,%u,%.1f,%.1f\n", name, board->snake.width, board->snake.height, board->snake.length, batch, samples, median, p99);
+  
+  free(sample_ns);
+  return 0;
+}
+
+signed int bench_lookahead(struct BenchBoard *board, unsigned int samples, unsigned int max_threads) {
+  // Time lookahead searches from the game on [board] with 1 thread, then 
+  // twice as many each time up to [max_threads], and print a line of 
+  // results for each, as CSV on STDOUT
+  // The food is put down on the Grid for the rollouts to go after.  
+  // Returns -1 if the memory for it could not be allocated, or the threads 
+  // could not be started.
+  
+  struct Snake *snake = &board->snake;
+  double *sample_ns = malloc(samples * sizeof(double));
+  struct GameState *root = game_state_new(snake->width, snake->height);
+  if (sample_ns == NULL || root == NULL) {
+    free(sample_ns);
+    game_state_destroy(root);
+    return -1;
+  }
+  game_state_load(root, snake, &board->food);
+  rand_food_location(&root->food, &root->snake);
+  
+  double one_thread_ns = 0;
+  unsigned int threads = 1;
+  while (1) {
+    struct Lookahead lookahead;
+    if (lookahead_init(&lookahead, snake->width, snake->height, threads) == -1) {
+      free(sample_ns);
+      game_state_destroy(root);
+      return -1;
+    }
+    
+    for (unsigned int i = 0; i < BENCH_WARMUP_SAMPLES; i++) {
+      lookahead_search(&lookahead, root, BENCH_LOOKAHEAD_ROLLOUTS, i);
+    }
+    for (unsigned int i = 0; i < samples; i++) {
+      struct timespec start;
+      struct timespec end;
+      clock_gettime(CLOCK_MONOTONIC, &start);
+      lookahead_search(&lookahead, root, BENCH_LOOKAHEAD_ROLLOUTS, i);
+      clock_gettime(CLOCK_MONOTONIC, &end);
+      sample_ns[i] = (double)elapsed_ns(&start, &end);
+    }
+    lookahead_destroy(&lookahead);
+    
+    qsort(sample_ns, samples, sizeof(double), &compare_doubles);
+    double median = sample_ns[samples / 2];
+    double p99 = sample_ns[(samples * 99 + 99) / 100 - 1];
+    if (threads == 1) {
+      one_thread_ns = median;
+    }
+    dprintf(STDOUT, "lookahead_search,%u,%u,%u,%u,%u,%u,%.1f,%.1f,%.0f,%.2f\n", snake->width, snake->height, snake->length, threads, BENCH_LOOKAHEAD_ROLLOUTS, samples, median, p99, BENCH_LOOKAHEAD_ROLLOUTS / (median / 1e9), one_thread_ns / median);
+    
+    if (threads == max_threads) {
+      break;
+    }
+    threads = (threads * 2 < max_threads) ? threads * 2 : max_threads;
+  }
+  
+  free(sample_ns);
+  game_state_destroy(root);
+  return 0;
+}
+
+signed int bench_arena(unsigned int snake_count, unsigned int samples, unsigned int max_threads) {
+  // Time the ticks of an arena of [snake_count] snakes with 1 thread, then 
+  // twice as many each time up to [max_threads], and print a line of 
+  // results for each, as CSV on STDOUT
+  // The arena is as big as arena_default_side() makes it, and each sample 
+  // is one tick.  Returns -1 if the memory for it could not be allocated, 
+  // or the threads could not be started.
+  
+  unsigned int side = arena_default_side(snake_count);
+  double *sample_ns = malloc(samples * sizeof(double));
+  if (sample_ns == NULL) {
+    return -1;
+  }
+  
+  double one_thread_ns = 0;
+  unsigned int threads = 1;
+  while (1) {
+    struct Arena arena;
+    if (arena_init(&arena, side, side, snake_count, 1, threads) == -1) {
+      free(sample_ns);
+      return -1;
+    }
+    
+    for (unsigned int i = 0; i < BENCH_ARENA_WARMUP_TICKS; i++) {
+      if (arena_step(&arena) == -1) {
+        arena_destroy(&arena);
+        free(sample_ns);
+        return -1;
+      }
+    }
+    for (unsigned int i = 0; i < samples; i++) {
+      struct timespec start;
+      struct timespec end;
+      clock_gettime(CLOCK_MONOTONIC, &start);
+      signed int failed = arena_step(&arena);
+      clock_gettime(CLOCK_MONOTONIC, &end);
+      if (failed == -1) {
+        arena_destroy(&arena);
+        free(sample_ns);
+        return -1;
+      }
+      sample_ns[i] = (double)elapsed_ns(&start, &end);
+    }
+    arena_destroy(&arena);
+    
+    qsort(sample_ns, samples, sizeof(double), &compare_doubles);
+    double median = sample_ns[samples / 2];
+    double p99 = sample_ns[(samples * 99 + 99) / 100 - 1];
+    if (threads == 1) {
+      one_thread_ns = median;
+    }
+    dprintf(STDOUT, "arena_step,%u,%u,%u,%u,%u,%u,%.1f,%.1f,%.0f,%.2f\n", side, side, snake_count, snake_count * ARENA_FOOD_PER_SNAKE, threads, samples, median, p99, snake_count / (median / 1e9), one_thread_ns / median);
+    
+    if (threads == max_threads) {
+      break;
+    }
+    threads = (threads * 2 < max_threads) ? threads * 2 : max_threads;
+  }
+  
+  free(sample_ns);
+  return 0;
+}
+
+signed int bench_spectate(struct BenchBoard *board, unsigned int spectator_count, unsigned int slow_count, unsigned int samples) {
+  // Time streaming each tick of the game on [board] to [spectator_count] 
+  // spectators, [slow_count] of which never read anything, and print a 
+  // line of results, as CSV on STDOUT
+  // The spectators are on socket pairs in this process.  The sockets of 
+  // the slow ones are filled up first, as one that has stopped reading 
+  // would leave them.  The rest are read out after every tick, untimed.  
+  // The backlog limit is BENCH_SPECTATE_BACKLOG_LIMIT, and the ticks are 
+  // only timed once the slow spectators are having messages skipped.  
+  // They are then dropped while timing, if there are [samples] enough for 
+  // them to miss more than SPECTATE_MAX_MISSED_KEYFRAMES keyframes.  
+  // Messages skipped and spectators dropped are counted over the timed 
+  // ticks only.  Returns -1 if the memory or the sockets for it could not 
+  // be allocated.
+  
+  struct Snake *snake = &board->snake;
+  struct Spectate spectate;
+  signed int *readers = malloc(spectator_count * sizeof(signed int));
+  double *sample_ns = malloc(samples * sizeof(double));
+  unsigned char *buffer = malloc(65536);
+  if (readers == NULL || sample_ns == NULL || buffer == NULL || spectate_init(&spectate, NULL, snake->width, snake->height) == -1) {
+    free(readers);
+    free(sample_ns);
+    free(buffer);
+    return -1;
+  }
+  spectate.backlog_limit = BENCH_SPECTATE_BACKLOG_LIMIT;
+  
+  unsigned int reader_count = 0;
+  signed int failed = 0;
+  for (; reader_count < spectator_count && !failed; reader_count++) {
+    signed int fds[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0, fds) == -1) {
+      failed = 1;
+      break;
+    }
+    readers[reader_count] = fds[1];
+    if (spectate_add(&spectate, fds[0]) == -1) {
+      close(fds[0]);
+      failed = 1;
+    } else if (reader_count < slow_count) {
+      while (write(fds[0], buffer, 65536) > 0) {
+      }
+    }
+  }
+  
+  unsigned long long bytes_read = 0;
+  unsigned long ticks = 0;
+  unsigned long skipped = 0;
+  unsigned long dropped = 0;
+  unsigned int warmup_ticks = BENCH_WARMUP_SAMPLES;
+  for (unsigned int i = 0; i < warmup_ticks + samples && !failed; i++) {
+    // Every message is at least a byte, so a spectator that never reads 
+    // has messages skipped within the backlog limit in ticks
+    if (i == warmup_ticks && spectate.skipped < slow_count && warmup_ticks < BENCH_WARMUP_SAMPLES + BENCH_SPECTATE_BACKLOG_LIMIT) {
+      warmup_ticks++;
+    }
+    if (i == warmup_ticks) {
+      skipped = spectate.skipped;
+      dropped = spectate.dropped;
+    }
+    bench_snake_crawl(board, 1);
+    struct timespec start;
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    spectate_tick(&spectate, snake, &board->food);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    
+    for (unsigned int r = slow_count; r < reader_count; r++) {
+      ssize_t length;
+      while ((length = read(readers[r], buffer, 65536)) > 0) {
+        if (i >= warmup_ticks) {
+          bytes_read += length;
+        }
+      }
+    }
+    if (i >= warmup_ticks) {
+      sample_ns[ticks] = (double)elapsed_ns(&start, &end);
+      ticks++;
+    }
+  }
+  
+  if (!failed) {
+    double mean = 0;
+    for (unsigned int i = 0; i < samples; i++) {
+      mean += sample_ns[i] / samples;
+    }
+    qsort(sample_ns, samples, sizeof(double), &compare_doubles);
+    double median = sample_ns[samples / 2];
+    double p99 = sample_ns[(samples * 99 + 99) / 100 - 1];
+    unsigned int fast_count = spectator_count - slow_count;
+    dprintf(STDOUT, "spectate_tick,%u,%u,%u,%u,%u,%u,%.1f,%.1f,%.1f,%.2f,%lu,%lu\n", snake->width, snake->height, snake->length, spectator_count, slow_count, samples, median, p99, mean, fast_count ? (double)bytes_read / fast_count / samples : 0.0, spectate.skipped - skipped, spectate.dropped - dropped);
+  }
+  
+  for (unsigned int r = 0; r < reader_count; r++) {
+    close(readers[r]);
+  }
+  spectate_destroy(&spectate);
+  free(readers);
+  free(sample_ns);
+  free(buffer);
+  return failed ? -1 : 0;
+}
+
+signed int bench_multiplayer(unsigned int width, unsigned int height, unsigned int player_count, unsigned int samples) {
+  // Play [samples] lockstep ticks of a multiplayer game of [player_count] 
+  // players on a [width] by [height] board, each player a process of its 
+  // own, and print a line of results, as CSV on STDOUT
+  // Every player steers by autopilot and hands a turn over every tick, 
+  // then goes straight on to the tick barrier.  The ticks are played back 
+  // to back rather than DELAY_TIME_MS apart, so the time from a turn to 
+  // the tick taking it is all down to the lockstep.  The ticks are timed 
+  // by this process, player 0, once every player has joined, and the rest 
+  // stop when it leaves.  Returns -1 if the shared board or the memory 
+  // for it could not be set up, or the players could not be started or 
+  // did not all join within MULTIPLAYER_BARRIER_TIMEOUT_MS.
+  
+  char name[32];
+  snprintf(name, sizeof(name), "bench-%d-%u", (signed int)getpid(), player_count);
+  struct Multiplayer multiplayer;
+  struct Autopilot autopilot;
+  if (multiplayer_init(&multiplayer, name, width, height, 1) != 0) {
+    return -1;
+  }
+  if (autopilot_init(&autopilot) == -1) {
+    multiplayer_destroy(&multiplayer);
+    return -1;
+  }
+  
+  // Each of the other players joins on a mapping of its own.  It plays 
+  // until player 0 leaves, and says whether it got that far.
+  pid_t children[MULTIPLAYER_MAX_PLAYERS];
+  unsigned int child_count = 0;
+  for (; child_count + 1 < player_count; child_count++) {
+    children[child_count] = fork();
+    if (children[child_count] == -1) {
+      break;
+    }
+    if (children[child_count] == 0) {
+      multiplayer_unmap(&multiplayer);
+      struct Multiplayer player;
+      signed int status = 1;
+      if (multiplayer_init(&player, name, width, height, 1) == 0) {
+        status = 0;
+        while (__atomic_load_n(&player.board->barrier, __ATOMIC_ACQUIRE) & MULTIPLAYER_MEMBER(0)) {
+          autopilot_steer(&autopilot, &player.snake, &player.food);
+          multiplayer_push_turn(&player, player.snake.new_direction);
+          if (multiplayer_arrive(&player) != 0) {
+            status = 2;
+            break;
+          }
+        }
+        multiplayer_destroy(&player);
+      }
+      _exit(status);
+    }
+  }
+  
+  // Play along while the rest join, then warm up, then time the ticks
+  struct MultiplayerBoard *board = multiplayer.board;
+  struct Histogram barrier_ns;
+  memset(&barrier_ns, 0, sizeof(struct Histogram));
+  barrier_ns.min = ULLONG_MAX;
+  uint64_t join_deadline_ns = multiplayer_now_ns() + MULTIPLAYER_BARRIER_TIMEOUT_MS * 1000000ull;
+  unsigned long first_tick = 0;
+  struct timespec first;
+  struct timespec last;
+  unsigned int out = (child_count + 1 < player_count);
+  unsigned int joined = 0;
+  for (unsigned int i = 0; !out && i < BENCH_WARMUP_SAMPLES + samples; i += joined) {
+    if (!joined) {
+      joined = (__builtin_popcount(MULTIPLAYER_MEMBERS(__atomic_load_n(&board->barrier, __ATOMIC_ACQUIRE))) == player_count);
+      out = (!joined && multiplayer_now_ns() > join_deadline_ns);
+    }
+    if (i == BENCH_WARMUP_SAMPLES && barrier_ns.count == 0) {
+      first_tick = board->tick;
+      clock_gettime(CLOCK_MONOTONIC, &first);
+    }
+    autopilot_steer(&autopilot, &multiplayer.snake, &multiplayer.food);
+    multiplayer_push_turn(&multiplayer, multiplayer.snake.new_direction);
+    struct timespec start;
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    out |= multiplayer_arrive(&multiplayer);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    if (i >= BENCH_WARMUP_SAMPLES) {
+      histogram_record(&barrier_ns, elapsed_ns(&start, &end));
+    }
+  }
+  clock_gettime(CLOCK_MONOTONIC, &last);
+  unsigned long ticks = board->tick - first_tick;
+  // Stops the rest
+  multiplayer_leave(&multiplayer);
+  
+  unsigned int alive = !out;
+  signed int failed = (child_count + 1 < player_count || !joined);
+  for (unsigned int c = 0; c < child_count; c++) {
+    signed int status;
+    if (waitpid(children[c], &status, 0) == -1 || !WIFEXITED(status) || WEXITSTATUS(status) == 1) {
+      failed = 1;
+    } else if (WEXITSTATUS(status) == 0) {
+      alive++;
+    }
+  }
+  
+  // Every player's turns were timed by whichever player played the tick 
+  // that took them, in the slot of the player that made them
+  struct Histogram input_ns;
+  memset(&input_ns, 0, sizeof(struct Histogram));
+  input_ns.min = ULLONG_MAX;
+  for (unsigned int p = 0; p < MULTIPLAYER_MAX_PLAYERS; p++) {
+    struct Histogram *histogram = &board->players[p].input_latency;
+    if (histogram->count == 0) {
+      continue;
+    }
+    for (unsigned int bucket = 0; bucket < HISTOGRAM_BUCKETS; bucket++) {
+      input_ns.buckets[bucket] += histogram->buckets[bucket];
+    }
+    input_ns.count += histogram->count;
+    input_ns.total += histogram->total;
+    input_ns.min = (histogram->min < input_ns.min) ? histogram->min : input_ns.min;
+    input_ns.max = (histogram->max > input_ns.max) ? histogram->max : input_ns.max;
+  }
+  
+  if (!failed && barrier_ns.count != 0) {
+    double seconds = (double)elapsed_ns(&first, &last) / 1e9;
+    dprintf(STDOUT, "multiplayer_tick,%u,%u,%u,%lu,%.0f,%llu,%llu,%llu,%llu,%llu,%llu,%.5f,%u,%lu\n", width, height, player_count, ticks, ticks / seconds, histogram_percentile(&barrier_ns, 50), histogram_percentile(&barrier_ns, 99), input_ns.count, histogram_percentile(&input_ns, 50), histogram_percentile(&input_ns, 99), input_ns.max, (double)input_ns.max / (DELAY_TIME_MS * 1000000.0), alive, multiplayer.evictions);
+  }
+  
+  multiplayer_destroy(&multiplayer);
+  autopilot_destroy(&autopilot);
+  return failed ? -1 : 0;
+}
+
+signed int main(signed int argc, char *argv[]) {
+  
+  // Read the Command Line Options
+  unsigned int samples = BENCH_SAMPLES;
+  unsigned int only_width = 0;
+  unsigned int only_height = 0;
+  unsigned int max_threads = 0;
+  {
+    signed int option;
+    char *end;
+    while ((option = getopt(argc, argv, "n:g:t:")) != -1) {
+      if        (option == 'n') {
+        samples = strtoul(optarg, &end, 0);
+        if (*optarg == 0 || *end != 0 || samples == 0) {
+          option = '?';
+        }
+      } else if (option == 'g') {
+        if (sscanf(optarg, "%ux%u", &only_width, &only_height) != 2 ||
+            only_width < 2 || only_height < 2 || only_width > GRID_MAX_SIDE || only_height > GRID_MAX_SIDE || 
+            (only_width % 2 != 0 && only_height % 2 != 0)) {
+          option = '?';
+        }
+      } else if (option == 't') {
+        max_threads = strtoul(optarg, &end, 0);
+        if (*optarg == 0 || *end != 0 || max_threads == 0) {
+          option = '?';
+        }
+      }
+      if (option == '?') {
+        dprintf(STDERR, "Usage: %s [-n samples] [-g WIDTHxHEIGHT] [-t threads]\n", argv[0]);
+        dprintf(STDERR, "  -n samples  Timed samples per case (Default: %d)\n", BENCH_SAMPLES);
+        dprintf(STDERR, "  -g WxH      Only run on this Grid size.  W or H must be even.\n");
+        dprintf(STDERR, "  -t threads  Most threads to time lookahead searches and arenas with \n");
+        dprintf(STDERR, "              (Default: one for each processor)\n");
+        exit(3);
+      }
+    }
+  }
+  
+  // The Grids of an 80x24 and a 240x64 terminal, then two larger ones
+  unsigned int grid_sizes[][2] = {
+    {78, 21},
+    {238, 61},
+    {500, 200},
+    {1000, 1000},
+  };
+  unsigned int grid_size_count = sizeof(grid_sizes) / sizeof(grid_sizes[0]);
+  if (only_width != 0) {
+    grid_sizes[0][0] = only_width;
+    grid_sizes[0][1] = only_height;
+    grid_size_count = 1;
+  }
+  
+  dprintf(STDOUT, "function,width,height,length,batch,samples,median_ns,p99_ns\n");
+  for (unsigned int g = 0; g < grid_size_count; g++) {
+    unsigned int the_grid_space = grid_sizes[g][0] * grid_sizes[g][1];
+    // From a new snake to one that nearly fills the Grid
+    unsigned int lengths[] = {
+      STARTING_LENGTH,
+      the_grid_space / 10,
+      the_grid_space / 2,
+      the_grid_space - the_grid_space / 100,
+    };
+    for (unsigned int l = 0; l < sizeof(lengths) / sizeof(lengths[0]); l++) {
+      if (lengths[l] < STARTING_LENGTH || (l > 0 && lengths[l] <= lengths[l - 1])) {
+        continue;
+      }
+      
+      struct BenchBoard board;
+      if (bench_board_init(&board, grid_sizes[g][0], grid_sizes[g][1], lengths[l]) == -1) {
+        exit(11);
+      }
+      if (bench_run("snake_crawl", &bench_snake_crawl, &board, samples) == -1 ||
+          bench_run("rand_food_location", &bench_rand_food_location, &board, samples) == -1 ||
+          bench_run("regen_buffer", &bench_regen_buffer, &board, samples) == -1 ||
+          bench_run("regen_buffer_changes", &bench_regen_buffer_changes, &board, samples) == -1 ||
+          bench_run("reference_regen_buffer", &bench_reference_regen_buffer, &board, samples) == -1 ||
+          bench_run("reference_regen_buffer_changes", &bench_reference_regen_buffer_changes, &board, samples) == -1 ||
+          bench_run("snake_build_grid_state", &bench_snake_build_grid_state, &board, samples) == -1 ||
+          bench_run("autopilot_steer", &bench_autopilot_steer, &board, samples) == -1) {
+        exit(11);
+      }
+      bench_board_destroy(&board);
+    }
+  }
+  
+  // How the rollouts of a lookahead search scale with the threads playing 
+  // them, from a snake a tenth the size of the Grid
+  if (max_threads == 0) {
+    signed long processors = sysconf(_SC_NPROCESSORS_ONLN);
+    max_threads = (processors > 0) ? processors : 1;
+  }
+  dprintf(STDOUT, "\nfunction,width,height,length,threads,rollouts,samples,median_ns,p99_ns,rollouts_per_second,speedup\n");
+  for (unsigned int g = 0; g < grid_size_count; g++) {
+    unsigned int the_grid_space = grid_sizes[g][0] * grid_sizes[g][1];
+    if (the_grid_space > BENCH_LOOKAHEAD_MAX_GRID_SPACE) {
+      continue;
+    }
+    unsigned int length = (the_grid_space / 10 > STARTING_LENGTH) ? the_grid_space / 10 : STARTING_LENGTH;
+    struct BenchBoard board;
+    if (bench_board_init(&board, grid_sizes[g][0], grid_sizes[g][1], length) == -1) {
+      exit(11);
+    }
+    if (bench_lookahead(&board, samples, max_threads) == -1) {
+      exit(11);
+    }
+    bench_board_destroy(&board);
+  }
+  
+  // What streaming each tick to spectators costs the game, and takes from 
+  // each spectator, from a snake a tenth the size of the Grid.  Then again 
+  // with half of them too slow to keep up, being skipped and then dropped.
+  dprintf(STDOUT, "\nfunction,width,height,length,spectators,slow,samples,median_ns,p99_ns,mean_ns,bytes_per_spectator_per_tick,skipped,dropped\n");
+  for (unsigned int g = 0; g < grid_size_count; g++) {
+    unsigned int the_grid_space = grid_sizes[g][0] * grid_sizes[g][1];
+    unsigned int length = (the_grid_space / 10 > STARTING_LENGTH) ? the_grid_space / 10 : STARTING_LENGTH;
+    struct BenchBoard board;
+    if (bench_board_init(&board, grid_sizes[g][0], grid_sizes[g][1], length) == -1) {
+      exit(11);
+    }
+    if (bench_spectate(&board, BENCH_SPECTATORS, 0, samples) == -1 || 
+        bench_spectate(&board, BENCH_SPECTATORS, BENCH_SPECTATORS / 2, samples) == -1) {
+      exit(11);
+    }
+    bench_board_destroy(&board);
+  }
+  
+  // How the time of an arena tick grows with the snakes in it, and how it 
+  // scales with the threads playing it
+  dprintf(STDOUT, "\nfunction,width,height,snakes,food,threads,samples,median_ns,p99_ns,snake_ticks_per_second,speedup\n");
+  unsigned int snake_counts[] = {10, 100, 1000, 10000};
+  for (unsigned int c = 0; c < sizeof(snake_counts) / sizeof(snake_counts[0]); c++) {
+    if (bench_arena(snake_counts[c], samples, max_threads) == -1) {
+      exit(11);
+    }
+  }
+  
+  // How long the tick barrier of a multiplayer game holds a turn up, as 
+  // more and more players are kept in step
+  dprintf(STDOUT, "\nfunction,width,height,players,ticks,ticks_per_second,barrier_p50_ns,barrier_p99_ns,turns,input_to_tick_p50_ns,input_to_tick_p99_ns,input_to_tick_max_ns,input_to_tick_max_of_tick,alive,evictions\n");
+  for (unsigned int players = 2; players <= MULTIPLAYER_MAX_PLAYERS; players *= 2) {
+    if (bench_multiplayer(BENCH_MULTIPLAYER_WIDTH, BENCH_MULTIPLAYER_HEIGHT, players, samples) == -1) {
+      exit(11);
+    }
+  }
+  
+  return 0;
+}
@@ -0,0 +1,427 @@
+/*
+ * Name: Snake in C
+ * Author: Michael T. Kloos
+ *
+ * Copyright:
+ * (C) Copyright 2022 Michael T. Kloos (http://www.michaelkloos.com/).
+ * All Rights Reserved.
+ */
+
+#include <time.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <unistd.h>
+#include "snake.h"
+
+// START: Check Configuration Definitions
+
+// How many random ticks should be checked on each Grid by default?
+#define CHECK_CRAWL_TICKS 1000000
+// How many of the ticks out of 4 should the snake steer towards the 
+// food, out of the way of itself?  The rest of the time it steers at 
+// random, so it runs into itself often as well as growing long.
+#define CHECK_CRAWL_GREEDY 3
+
+// END: Check Configuration Definitions
+
+// The snake as the checker sees it, worked out the slow way: Every cell 
+// in a plain array from the head, moved along one by one each tick
+struct CrawlModel {
+  unsigned int width;
+  unsigned int height;
+  struct GridCell *cells;
+  unsigned int length;
+  unsigned int pending_growth;
+  unsigned int grow_by;
+  unsigned int score;
+  // The LINK_* sides each Grid space should have, and how many empty 
+  // spaces each row should have, as worked out from [cells]
+  // Indexed by: y * width + x
+  unsigned char *links;
+  unsigned int *row_free;
+};
+
+signed int crawl_model_init(struct CrawlModel *model, unsigned int width, unsigned int height);
+void crawl_model_destroy(struct CrawlModel *model);
+void crawl_model_load(struct CrawlModel *model, struct Snake *snake);
+void crawl_model_step(struct CrawlModel *model, struct GridCell *cell, unsigned int direction);
+unsigned int crawl_model_link(struct CrawlModel *model, struct GridCell *from, struct GridCell *to);
+unsigned int crawl_model_occupied(struct CrawlModel *model, struct GridCell *cell);
+void crawl_model_relink(struct CrawlModel *model, unsigned int new_direction);
+unsigned int crawl_model_crawl(struct CrawlModel *model, unsigned int direction, struct GridCell *food);
+unsigned int crawl_model_steer(struct CrawlModel *model, struct Snake *snake, struct GridCell *food, uint64_t *random_state);
+signed int crawl_compare(struct CrawlModel *model, struct Snake *snake, unsigned int head_direction, uint64_t *random_state);
+signed int check_crawl(unsigned int width, unsigned int height, unsigned long ticks, unsigned int seed);
+signed int main(signed int argc, char *argv[]);
+
+signed int crawl_model_init(struct CrawlModel *model, unsigned int width, unsigned int height) {
+  // Set up an empty model of a snake on a [width] by [height] Grid
+  // Returns -1 if the memory for it could not be allocated.
+  
+  model->width = width;
+  model->height = height;
+  model->cells = malloc(width * height * sizeof(struct GridCell));
+  model->links = malloc(width * height * sizeof(unsigned char));
+  model->row_free = malloc(height * sizeof(unsigned int));
+  if (model->cells == NULL || model->links == NULL || model->row_free == NULL) {
+    crawl_model_destroy(model);
+    return -1;
+  }
+  model->length = 0;
+  return 0;
+}
+
+void crawl_model_destroy(struct CrawlModel *model) {
+  // Free all of the memory owned by the model
+  
+  free(model->cells);
+  free(model->links);
+  free(model->row_free);
+  return;
+}
+
+void crawl_model_load(struct CrawlModel *model, struct Snake *snake) {
+  // Start the model off as a copy of [snake], as a new game leaves it
+  
+  model->length = snake->length;
+  struct SnakeWalk walk;
+  snake_walk_start(snake, &walk);
+  for (unsigned int i = 0; i < snake->length; i++) {
+    model->cells[i] = walk.cell;
+    if (i + 1 < snake->length) {
+      snake_walk_next(snake, &walk);
+    }
+  }
+  model->pending_growth = snake->pending_growth;
+  model->grow_by = snake->grow_by;
+  model->score = snake->score;
+  crawl_model_relink(model, snake->new_direction);
+  return;
+}
+
+void crawl_model_step(struct CrawlModel *model, struct GridCell *cell, unsigned int direction) {
+  // Move [cell] one Grid space towards [direction], wrapping around the edges
+  
+  signed int x = cell->x + ((direction == DIR_RIGHT) ? 1 : 0) - ((direction == DIR_LEFT) ? 1 : 0);
+  signed int y = cell->y + ((direction == DIR_DOWN) ? 1 : 0) - ((direction == DIR_UP) ? 1 : 0);
+  cell->x = (x + (signed int)model->width) % (signed int)model->width;
+  cell->y = (y + (signed int)model->height) % (signed int)model->height;
+  return;
+}
+
+unsigned int crawl_model_link(struct CrawlModel *model, struct GridCell *from, struct GridCell *to) {
+  // Find the LINK_* side of [from] that [to] is next to, by trying every direction
+  
+  for (unsigned int direction = 0; direction < 4; direction++) {
+    struct GridCell cell = *from;
+    crawl_model_step(model, &cell, direction);
+    if (cell.x == to->x && cell.y == to->y) {
+      return 1 << direction;
+    }
+  }
+  return 0;
+}
+
+unsigned int crawl_model_occupied(struct CrawlModel *model, struct GridCell *cell) {
+  // Find how far back from the head the snake cell on [cell] is, plus 1, 
+  // or 0 if the snake is not on it
+  
+  for (unsigned int i = 0; i < model->length; i++) {
+    if (model->cells[i].x == cell->x && model->cells[i].y == cell->y) {
+      return i + 1;
+    }
+  }
+  return 0;
+}
+
+void crawl_model_relink(struct CrawlModel *model, unsigned int new_direction) {
+  // Work out the links of every Grid space, and the empty spaces in each 
+  // row, from scratch, with the head pointing towards [new_direction]
+  
+  memset(model->links, 0, model->width * model->height);
+  for (unsigned int y = 0; y < model->height; y++) {
+    model->row_free[y] = model->width;
+  }
+  for (unsigned int i = 0; i < model->length; i++) {
+    struct GridCell *cell = &model->cells[i];
+    unsigned int links;
+    if        (i == 0) {
+      unsigned int back = crawl_model_link(model, cell, &model->cells[1]);
+      unsigned int forward = 1 << new_direction;
+      links = back | ((forward == back) ? LINK_OPPOSITE(back) : forward);
+    } else if (i == model->length - 1) {
+      unsigned int back = crawl_model_link(model, cell, &model->cells[i - 1]);
+      links = back | LINK_OPPOSITE(back);
+    } else {
+      links = crawl_model_link(model, cell, &model->cells[i - 1]) | crawl_model_link(model, cell, &model->cells[i + 1]);
+    }
+    model->links[cell->y * model->width + cell->x] = links;
+    model->row_free[cell->y]--;
+  }
+  return;
+}
+
+unsigned int crawl_model_crawl(struct CrawlModel *model, unsigned int direction, struct GridCell *food) {
+  // Crawl the model one tick towards [direction], with the food on [food]
+  // Returns 1 if it runs into itself, in which case nothing is moved, as 
+  // snake_crawl() does.  Otherwise returns 0.  Where the food goes next 
+  // is up to snake_crawl().
+  
+  struct GridCell head = model->cells[0];
+  crawl_model_step(model, &head, direction);
+  unsigned int on = crawl_model_occupied(model, &head);
+  if (on != 0 && (on != model->length || model->pending_growth != 0)) {
+    return 1;
+  }
+  
+  if (head.x == food->x && head.y == food->y) {
+    model->score++;
+    model->pending_growth += model->grow_by;
+    model->grow_by += GROW_BY_INCREMENT;
+  }
+  if (model->pending_growth > 0) {
+    model->pending_growth--;
+  } else {
+    model->length--;
+  }
+  memmove(&model->cells[1], &model->cells[0], model->length * sizeof(struct GridCell));
+  model->cells[0] = head;
+  model->length++;
+  
+  return 0;
+}
+
+unsigned int crawl_model_steer(struct CrawlModel *model, struct Snake *snake, struct GridCell *food, uint64_t *random_state) {
+  // Pick a DIR_* to steer [snake] towards
+  // Mostly the way that closes on the food soonest without running into 
+  // the snake, if there is one.  Otherwise at random.
+  
+  if (random_below(random_state, 4) >= CHECK_CRAWL_GREEDY || food->x < 0) {
+    return random_below(random_state, 4);
+  }
+  unsigned int best = random_below(random_state, 4);
+  unsigned int best_distance = UINT_MAX;
+  for (unsigned int direction = 0; direction < 4; direction++) {
+    struct GridCell cell = model->cells[0];
+    crawl_model_step(model, &cell, direction);
+    unsigned int on = crawl_model_occupied(model, &cell);
+    if (LINK_OPPOSITE(1 << direction) == (1u << snake->direction) || (on != 0 && on != model->length)) {
+      continue;
+    }
+    unsigned int dx = abs(cell.x - food->x);
+    unsigned int dy = abs(cell.y - food->y);
+    dx = (dx < model->width - dx) ? dx : model->width - dx;
+    dy = (dy < model->height - dy) ? dy : model->height - dy;
+    if (dx + dy < best_distance) {
+      best = direction;
+      best_distance = dx + dy;
+    }
+  }
+  return best;
+}
+
+signed int crawl_compare(struct CrawlModel *model, struct Snake *snake, unsigned int head_direction, uint64_t *random_state) {
+  // Check [snake] against the model, cell by cell and space by space, with the head pointing towards [head_direction]
+  // The free set is checked node by node of the Fenwick tree, and by 
+  // finding one empty space picked at random.  Returns -1, after saying 
+  // what is wrong on STDERR, if anything is off.
+  
+  unsigned int width = model->width;
+  unsigned int height = model->height;
+  if (snake->length != model->length || snake->pending_growth != model->pending_growth ||
+      snake->grow_by != model->grow_by || snake->score != model->score) {
+    dprintf(STDERR, "length %u/%u, pending_growth %u/%u, grow_by %u/%u, score %u/%u\n", snake->length, model->length, snake->pending_growth, model->pending_growth, snake->grow_by, model->grow_by, snake->score, model->score);
+    return -1;
+  }
+  struct SnakeWalk walk;
+  snake_walk_start(snake, &walk);
+  for (unsigned int i = 0; i < model->length; i++) {
+    if (walk.cell.x != model->cells[i].x || walk.cell.y != model->cells[i].y) {
+      dprintf(STDERR, "cell %u at %d,%d, should be at %d,%d\n", i, walk.cell.x, walk.cell.y, model->cells[i].x, model->cells[i].y);
+      return -1;
+    }
+    if (i + 1 < model->length) {
+      snake_walk_next(snake, &walk);
+    }
+  }
+  if (snake_head(snake)->x != model->cells[0].x || snake_head(snake)->y != model->cells[0].y ||
+      snake_tail(snake)->x != model->cells[model->length - 1].x || snake_tail(snake)->y != model->cells[model->length - 1].y) {
+    dprintf(STDERR, "head or tail out of step with the body\n");
+    return -1;
+  }
+  
+  // The links grid
+  crawl_model_relink(model, head_direction);
+  for (unsigned int y = 0; y < height; y++) {
+    for (unsigned int x = 0; x < width; x++) {
+      unsigned int links = *grid_space_links(snake, x, y);
+      if (links != model->links[y * width + x]) {
+        dprintf(STDERR, "links at %u,%u are 0x%X, should be 0x%X\n", x, y, links, model->links[y * width + x]);
+        return -1;
+      }
+    }
+  }
+  
+  // The free set: Its count, every node of the Fenwick tree, and one 
+  // empty space found by its place in Grid order
+  unsigned int free_cell_count = width * height - model->length;
+  if (snake->free_cell_count != free_cell_count) {
+    dprintf(STDERR, "free_cell_count %u, should be %u\n", snake->free_cell_count, free_cell_count);
+    return -1;
+  }
+  for (unsigned int n = 1; n <= height; n++) {
+    unsigned int count = 0;
+    for (unsigned int y = n - (n & -n); y < n; y++) {
+      count += model->row_free[y];
+    }
+    if (snake->free_counts[n] != count) {
+      dprintf(STDERR, "free_counts[%u] is %u, should be %u\n", n, snake->free_counts[n], count);
+      return -1;
+    }
+  }
+  if (free_cell_count != 0) {
+    unsigned int n = random_below(random_state, free_cell_count);
+    unsigned int index = 0;
+    for (unsigned int seen = 0; ; index++) {
+      if (model->links[index] == 0) {
+        if (seen == n) {
+          break;
+        }
+        seen++;
+      }
+    }
+    if (snake_free_cell(snake, n) != index) {
+      dprintf(STDERR, "empty space %u is at %u, should be at %u\n", n, snake_free_cell(snake, n), index);
+      return -1;
+    }
+  }
+  
+  return 0;
+}
+
+signed int check_crawl(unsigned int width, unsigned int height, unsigned long ticks, unsigned int seed) {
+  // Play [ticks] random ticks on a [width] by [height] Grid, checking every one against the model
+  // Every Game Over starts a new game.  Reports what was checked on
+  // STDOUT.  Returns -1 if the memory for it could not be allocated, or
+  // -2 if anything did not match.
+  
+  struct Snake snake;
+  struct GridCell food;
+  struct CrawlModel model;
+  if (crawl_model_init(&model, width, height) == -1) {
+    return -1;
+  }
+  if (game_init(&snake, &food, width, height, game_seed(seed, 0)) == -1) {
+    crawl_model_destroy(&model);
+    return -1;
+  }
+  crawl_model_load(&model, &snake);
+  uint64_t random_state = game_seed(seed, ULONG_MAX);
+  
+  unsigned long game = 0;
+  unsigned long collisions = 0;
+  unsigned long food_eaten = 0;
+  unsigned int longest = 0;
+  signed int retval = 0;
+  for (unsigned long tick = 0; tick < ticks; tick++) {
+    // A snake that runs into itself is not relinked, so its head still 
+    // points the way it went last
+    unsigned int head_direction = snake.direction;
+    snake_steer(&snake, crawl_model_steer(&model, &snake, &food, &random_state));
+    struct GridCell old_food = food;
+    unsigned int expected = crawl_model_crawl(&model, snake.new_direction, &food);
+    unsigned int collided = snake_crawl(&snake, &food);
+    if (collided != expected) {
+      dprintf(STDERR, "snake_crawl() returned %u, should have returned %u\n", collided, expected);
+      retval = -2;
+    } else if (crawl_compare(&model, &snake, collided ? head_direction : snake.new_direction, &random_state) == -1) {
+      retval = -2;
+    } else if (old_food.x != food.x || old_food.y != food.y) {
+      // Food is only moved by being eaten, and then only onto an empty space
+      food_eaten++;
+      if (old_food.x != model.cells[0].x || old_food.y != model.cells[0].y ||
+          (food.x < 0) != (model.length == width * height) ||
+          (food.x >= 0 && model.links[food.y * width + food.x] != 0)) {
+        dprintf(STDERR, "food moved from %d,%d to %d,%d\n", old_food.x, old_food.y, food.x, food.y);
+        retval = -2;
+      }
+    } else if (!collided && old_food.x == model.cells[0].x && old_food.y == model.cells[0].y) {
+      dprintf(STDERR, "food at %d,%d eaten, but not moved\n", food.x, food.y);
+      retval = -2;
+    }
+    if (retval != 0) {
+      dprintf(STDERR, "on %ux%u, seed %u, game %lu, tick %lu\n", width, height, seed, game, tick);
+      break;
+    }
+    
+    if (snake.length > longest) {
+      longest = snake.length;
+    }
+    if (collided) {
+      // Game Over: Start the next game
+      collisions++;
+      game++;
+      game_restart(&snake, &food, game_seed(seed, game));
+      crawl_model_load(&model, &snake);
+    }
+  }
+  
+  if (retval == 0) {
+    dprintf(STDOUT, "%ux%u: %lu ticks, %lu collisions, %lu food eaten, longest %u\n", width, height, ticks, collisions, food_eaten, longest);
+  }
+  snake_destroy(&snake);
+  crawl_model_destroy(&model);
+  return retval;
+}
+
+signed int main(signed int argc, char *argv[]) {
+  
+  // Read the Command Line Options
+  unsigned long ticks = CHECK_CRAWL_TICKS;
+  unsigned int seed = 1;
+  {
+    signed int option;
+    char *end;
+    while ((option = getopt(argc, argv, "n:S:")) != -1) {
+      if        (option == 'n') {
+        ticks = strtoul(optarg, &end, 0);
+        if (*optarg == 0 || *end != 0) {
+          option = '?';
+        }
+      } else if (option == 'S') {
+        seed = strtoul(optarg, &end, 0);
+        if (*optarg == 0 || *end != 0) {
+          option = '?';
+        }
+      }
+      if (option == '?') {
+        dprintf(STDERR, "Usage: %s [-n ticks] [-S seed]\n", argv[0]);
+        dprintf(STDERR, "  -n ticks  Random ticks to check on each Grid (Default: %d)\n", CHECK_CRAWL_TICKS);
+        dprintf(STDERR, "  -S seed   Seed the games and the steering\n");
+        exit(3);
+      }
+    }
+  }
+  
+  // Small Grids, which the snake fills up and runs into itself on often, 
+  // then one spread over several tiles
+  unsigned int grid_sizes[][2] = {
+    {10, 10},
+    {17, 11},
+    {70, 66},
+  };
+  for (unsigned int g = 0; g < sizeof(grid_sizes) / sizeof(grid_sizes[0]); g++) {
+    // The big Grid costs far more to check each tick
+    unsigned long grid_ticks = (g == 2) ? ticks / 20 : ticks;
+    signed int retval = check_crawl(grid_sizes[g][0], grid_sizes[g][1], grid_ticks, seed);
+    if (retval == -1) {
+      exit(11);
+    } else if (retval == -2) {
+      exit(1);
+    }
+  }
+  
+  return 0;
+}
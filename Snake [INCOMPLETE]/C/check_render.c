@@ -0,0 +1,391 @@
+/*
+ * Name: Snake in C
+ * Author: Michael T. Kloos
+ *
+ * Copyright:
+ * (C) Copyright 2022 Michael T. Kloos (http://www.michaelkloos.com/).
+ * All Rights Reserved.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "snake.h"
+
+// START: Check Configuration Definitions
+
+// Where the recorded boards and their reference frames are kept
+#define CHECK_RENDER_DIRECTORY "tests/frames/"
+
+// END: Check Configuration Definitions
+
+// A board to render: The game log it was recorded in, as NAME.log, and 
+// the tick of it to render
+// The reference frames are NAME.utf8 and NAME.ascii, rendered full 
+// frame by reference_regen_buffer() through a viewport of 
+// [viewport_width] by [viewport_height], which follows the head as it 
+// would on the terminal.
+struct RenderBoard {
+  const char *name;
+  unsigned long tick;
+  unsigned int viewport_width;
+  unsigned int viewport_height;
+};
+
+signed int read_reference(const char *path, char **content, unsigned long *length);
+signed int write_reference(const char *path, const char *content, unsigned long length);
+signed int check_frame(const char *path, const char *what, const char *frame, unsigned long length, const char *expected, unsigned long expected_length);
+signed int check_render(const struct RenderBoard *board, unsigned int update, unsigned int *glyphs_seen, unsigned int *links_seen);
+signed int check_render_changes(const struct RenderBoard *board);
+signed int main(signed int argc, char *argv[]);
+
+signed int read_reference(const char *path, char **content, unsigned long *length) {
+  // Read in the whole reference frame at [path]
+  // Returns -1 if it could not be read.
+  
+  FILE *file = fopen(path, "rb");
+  if (file == NULL) {
+    return -1;
+  }
+  
+  unsigned long capacity = 4096;
+  unsigned long used = 0;
+  char *data = malloc(capacity);
+  while (data != NULL) {
+    used += fread(data + used, 1, capacity - used, file);
+    if (used < capacity) {
+      break;
+    }
+    capacity *= 2;
+    char *grown = realloc(data, capacity);
+    if (grown == NULL) {
+      free(data);
+      data = NULL;
+      break;
+    }
+    data = grown;
+  }
+  
+  signed int failed = (data == NULL || ferror(file));
+  fclose(file);
+  if (failed) {
+    free(data);
+    return -1;
+  }
+  
+  *content = data;
+  *length = used;
+  return 0;
+}
+
+signed int write_reference(const char *path, const char *content, unsigned long length) {
+  // Replace the reference frame at [path] with the [length] bytes of [content]
+  // Returns -1 if it could not be written.
+  
+  FILE *file = fopen(path, "wb");
+  if (file == NULL) {
+    return -1;
+  }
+  signed int failed = (fwrite(content, 1, length, file) != length);
+  if (fclose(file) != 0) {
+    failed = 1;
+  }
+  return failed ? -1 : 0;
+}
+
+signed int check_frame(const char *path, const char *what, const char *frame, unsigned long length, const char *expected, unsigned long expected_length) {
+  // Compare the [length] bytes of [frame] against the [expected_length] 
+  // bytes of [expected], byte for byte
+  // Where they first differ is reported on STDERR, by its line and 
+  // column, as [path] differing from [what].  Returns -1 if they differ.
+  
+  unsigned long i = 0;
+  unsigned long line = 1;
+  unsigned long line_start = 0;
+  while (i < length && i < expected_length && frame[i] == expected[i]) {
+    if (frame[i] == '\n') {
+      line++;
+      line_start = i + 1;
+    }
+    i++;
+  }
+  if (i < length || i < expected_length) {
+    dprintf(STDERR, "%s: differs from %s at byte %lu (line %lu, byte %lu of it); rendered %lu bytes, expected %lu\n", path, what, i, line, i - line_start + 1, length, expected_length);
+    return -1;
+  }
+  return 0;
+}
+
+signed int check_render(const struct RenderBoard *board, unsigned int update, unsigned int *glyphs_seen, unsigned int *links_seen) {
+  // Render [board] in full, with and without UTF-8, and compare each frame 
+  // byte for byte against reference_regen_buffer() and the reference 
+  // frame, or replace the reference frames if [update] is set
+  // Every GLYPH_* drawn on the Grid is added to the bits of [glyphs_seen], 
+  // and the LINK_* sides of every space drawn to [links_seen].  
+  // Reports what went wrong on STDERR.  Returns -1 if the memory for it 
+  // could not be allocated, or -2 if the board could not be played back, 
+  // a reference frame could not be read or written, or a frame did not 
+  // match.
+  
+  char path[256];
+  struct GameLog log;
+  snprintf(path, sizeof(path), "%s%s.log", CHECK_RENDER_DIRECTORY, board->name);
+  if (log_load(&log, path) == -1) {
+    dprintf(STDERR, "%s: could not load the log\n", path);
+    return -2;
+  }
+  
+  struct Snake snake;
+  struct GridCell food;
+  unsigned long game;
+  if (log_seek(&log, board->tick, &snake, &food, &game) == -1) {
+    dprintf(STDERR, "%s: could not play through to tick %lu\n", path, board->tick);
+    log_destroy(&log);
+    return -2;
+  }
+  
+  // Big enough for the widest glyphs everywhere, as in the terminal game
+  unsigned long buffer_size = (board->viewport_width + 3) * (board->viewport_height + 3) * sizeof(char) * 4;
+  char *buffer = malloc(buffer_size);
+  char *reference_buffer = malloc(buffer_size);
+  if (buffer == NULL || reference_buffer == NULL) {
+    free(buffer);
+    free(reference_buffer);
+    snake_destroy(&snake);
+    log_destroy(&log);
+    return -1;
+  }
+  
+  signed int retval = 0;
+  for (unsigned int fallback = 0; fallback < 2 && retval == 0; fallback++) {
+    utf8_support = !fallback;
+    snprintf(path, sizeof(path), "%s%s.%s", CHECK_RENDER_DIRECTORY, board->name, fallback ? "ascii" : "utf8");
+    
+    struct Screen screen;
+    struct Screen reference_screen;
+    if (screen_init(&screen, board->viewport_width, board->viewport_height) == -1) {
+      retval = -1;
+      break;
+    }
+    if (screen_init(&reference_screen, board->viewport_width, board->viewport_height) == -1) {
+      screen_destroy(&screen);
+      retval = -1;
+      break;
+    }
+    screen_follow(&screen, &snake);
+    screen_follow(&reference_screen, &snake);
+    regen_buffer(buffer, &screen, &snake, &food);
+    reference_regen_buffer(reference_buffer, &reference_screen, &snake, &food);
+    unsigned long length = strlen(buffer);
+    unsigned long reference_length = strlen(reference_buffer);
+    for (unsigned int space = 0; space < board->viewport_width * board->viewport_height; space++) {
+      *glyphs_seen |= 1u << screen.glyphs[space];
+      unsigned int x = (screen.origin_x + space % board->viewport_width) % snake.width;
+      unsigned int y = (screen.origin_y + space / board->viewport_width) % snake.height;
+      *links_seen |= 1u << *grid_space_links(&snake, x, y);
+    }
+    screen_destroy(&screen);
+    screen_destroy(&reference_screen);
+    
+    // The reference frames only ever come from the renderer from before 
+    // the lookup tables, so that they show what it drew
+    if (update) {
+      if (write_reference(path, reference_buffer, reference_length) == -1) {
+        dprintf(STDERR, "%s: could not be written\n", path);
+        retval = -2;
+      }
+      continue;
+    }
+    
+    char *reference;
+    unsigned long stored_length;
+    if (read_reference(path, &reference, &stored_length) == -1) {
+      dprintf(STDERR, "%s: could not be read\n", path);
+      retval = -2;
+      break;
+    }
+    if (check_frame(path, "reference_regen_buffer()", buffer, length, reference_buffer, reference_length) == -1 || 
+        check_frame(path, "the reference frame", buffer, length, reference, stored_length) == -1) {
+      retval = -2;
+    }
+    free(reference);
+  }
+  utf8_support = 1;
+  
+  if (retval == 0) {
+    dprintf(STDOUT, "%s: tick %lu, %ux%u, %u long, %s\n", board->name, board->tick, board->viewport_width, board->viewport_height, snake.length, update ? "updated" : "matches");
+  }
+  free(buffer);
+  free(reference_buffer);
+  snake_destroy(&snake);
+  log_destroy(&log);
+  return retval;
+}
+
+signed int check_render_changes(const struct RenderBoard *board) {
+  // Play [board] from the start of its log up to its tick, with and 
+  // without UTF-8, rendering each tick with both regen_buffer_changes() 
+  // and reference_regen_buffer_changes(), and compare them byte for byte
+  // A full frame is rendered instead whenever render_frame() would, when 
+  // the viewport scrolls or the damage log overflows.  
+  // Reports what went wrong on STDERR.  Returns -1 if the memory for it 
+  // could not be allocated, or -2 if the board could not be played back 
+  // or the two renderers differ.
+  
+  char path[256];
+  struct GameLog log;
+  snprintf(path, sizeof(path), "%s%s.log", CHECK_RENDER_DIRECTORY, board->name);
+  if (log_load(&log, path) == -1) {
+    dprintf(STDERR, "%s: could not load the log\n", path);
+    return -2;
+  }
+  
+  unsigned long buffer_size = (board->viewport_width + 3) * (board->viewport_height + 3) * sizeof(char) * 4;
+  char *buffer = malloc(buffer_size);
+  char *reference_buffer = malloc(buffer_size);
+  if (buffer == NULL || reference_buffer == NULL) {
+    free(buffer);
+    free(reference_buffer);
+    log_destroy(&log);
+    return -1;
+  }
+  
+  signed int retval = 0;
+  unsigned long changes = 0;
+  for (unsigned int fallback = 0; fallback < 2 && retval == 0; fallback++) {
+    utf8_support = !fallback;
+    
+    struct Snake snake;
+    struct GridCell food;
+    unsigned long game;
+    if (log_seek(&log, 0, &snake, &food, &game) == -1) {
+      dprintf(STDERR, "%s: could not be played back\n", path);
+      retval = -2;
+      break;
+    }
+    struct Screen screen;
+    struct Screen reference_screen;
+    if (screen_init(&screen, board->viewport_width, board->viewport_height) == -1) {
+      snake_destroy(&snake);
+      retval = -1;
+      break;
+    }
+    if (screen_init(&reference_screen, board->viewport_width, board->viewport_height) == -1) {
+      screen_destroy(&screen);
+      snake_destroy(&snake);
+      retval = -1;
+      break;
+    }
+    
+    for (unsigned long tick = 0; retval == 0; tick++) {
+      // Both renderers empty the damage log, so each is given a copy
+      unsigned int damaged_cells[DAMAGE_LOG_SIZE];
+      unsigned int damage_count = snake.damage_count;
+      memcpy(damaged_cells, snake.damaged_cells, sizeof(damaged_cells));
+      screen_follow(&screen, &snake);
+      screen_follow(&reference_screen, &snake);
+      if (screen.stale || damage_count > DAMAGE_LOG_SIZE) {
+        regen_buffer(buffer, &screen, &snake, &food);
+        snake.damage_count = damage_count;
+        reference_regen_buffer(reference_buffer, &reference_screen, &snake, &food);
+      } else {
+        regen_buffer_changes(buffer, &screen, &snake, &food);
+        snake.damage_count = damage_count;
+        memcpy(snake.damaged_cells, damaged_cells, sizeof(damaged_cells));
+        reference_regen_buffer_changes(reference_buffer, &reference_screen, &snake, &food);
+        changes++;
+      }
+      if (check_frame(path, "reference_regen_buffer_changes()", buffer, strlen(buffer), reference_buffer, strlen(reference_buffer)) == -1) {
+        dprintf(STDERR, "%s: at tick %lu, %s\n", path, tick, fallback ? "without UTF-8" : "with UTF-8");
+        retval = -2;
+        break;
+      }
+      if (tick == board->tick) {
+        break;
+      }
+      
+      log_play_tick(&log, tick, &snake);
+      unsigned int collided = snake_crawl(&snake, &food);
+      if (collided == 2) {
+        retval = -1;
+      } else if (collided) {
+        // Game Over: Start the next game
+        game++;
+        game_restart(&snake, &food, game_seed(log.seed, game));
+      }
+    }
+    
+    screen_destroy(&screen);
+    screen_destroy(&reference_screen);
+    snake_destroy(&snake);
+  }
+  utf8_support = 1;
+  
+  if (retval == 0) {
+    dprintf(STDOUT, "%s: ticks 0 to %lu, %lu frames of changes with and without UTF-8, match reference_regen_buffer_changes()\n", board->name, board->tick, changes);
+  }
+  free(buffer);
+  free(reference_buffer);
+  log_destroy(&log);
+  return retval;
+}
+
+signed int main(signed int argc, char *argv[]) {
+  
+  // Read the Command Line Options
+  unsigned int update = 0;
+  {
+    signed int option;
+    while ((option = getopt(argc, argv, "u")) != -1) {
+      if        (option == 'u') {
+        update = 1;
+      } else {
+        dprintf(STDERR, "Usage: %s [-u]\n", argv[0]);
+        dprintf(STDERR, "  -u  Replace the reference frames with what reference_regen_buffer() renders now\n");
+        exit(3);
+      }
+    }
+  }
+  
+  // A long snake on a small Grid, wrapping around every edge, a short one 
+  // that has just turned after crossing the right edge, and a viewport 
+  // scrolled onto a bigger Grid.  
+  // The reference frames are rendered with explicit new lines.
+  const struct RenderBoard boards[] = {
+    {"autopilot_12x10", 300, 12, 10},
+    {"wrap_12x10", 9, 12, 10},
+    {"viewport_60x30", 1500, 24, 10},
+  };
+  unsigned int glyphs_seen = 0;
+  unsigned int links_seen = 0;
+  for (unsigned int b = 0; b < sizeof(boards) / sizeof(boards[0]); b++) {
+    signed int retval = check_render(&boards[b], update, &glyphs_seen, &links_seen);
+    if (retval == 0 && !update) {
+      retval = check_render_changes(&boards[b]);
+    }
+    if (retval == -1) {
+      exit(11);
+    } else if (retval == -2) {
+      exit(1);
+    }
+  }
+  
+  // Between them, the boards have to draw every glyph that can go on the 
+  // Grid, and a snake cell linked on every pair of sides, or some of the 
+  // glyph tables would go unchecked
+  for (unsigned int glyph = GLYPH_EMPTY; glyph <= GLYPH_FALLBACK_FOOD; glyph++) {
+    if (!(glyphs_seen & (1u << glyph))) {
+      dprintf(STDERR, "No board draws GLYPH %u\n", glyph);
+      exit(1);
+    }
+  }
+  for (unsigned int links = 1; links < 16; links++) {
+    if (__builtin_popcount(links) == 2 && !(links_seen & (1u << links))) {
+      dprintf(STDERR, "No board draws a snake cell with LINK_* sides %u\n", links);
+      exit(1);
+    }
+  }
+  
+  return 0;
+}
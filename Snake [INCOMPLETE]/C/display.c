@@ -0,0 +1,363 @@
+/*
+ * Name: Snake in C
+ * Author: Michael T. Kloos
+ *
+ * Copyright:
+ * (C) Copyright 2022 Michael T. Kloos (http://www.michaelkloos.com/).
+ * All Rights Reserved.
+ */
+
+#include <time.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/eventfd.h>
+#include "snake.h"
+
+signed int display_init(struct Display *display, unsigned int width, unsigned int height, signed int output_fd) {
+  // Set up a Display for a [width] by [height] Grid, to be drawn to [output_fd]
+  // [output_fd] must be non-blocking.  It is closed along with the Display.  
+  // The render thread is not started until display_start().  Returns -1 
+  // if the memory or the wake up eventfd could not be allocated.
+  
+  memset(display, 0, sizeof(struct Display));
+  display->output_fd = output_fd;
+  display->back = 0;
+  display->middle = 1;
+  display->front = 2;
+  
+  // Room for the Grid drawn in full, and then some for the Pause Menu on 
+  // a terminal too small to fit it otherwise
+  display->buffer_size = (width + 3) * (height + 3) * sizeof(char) * 4 + 1024;
+  display->buffer = malloc(display->buffer_size);
+  signed int failed = (display->buffer == NULL);
+  for (unsigned int i = 0; i < 3; i++) {
+    display->frames[i].glyphs = calloc(width * height, sizeof(unsigned char));
+    failed |= (display->frames[i].glyphs == NULL);
+  }
+  if (screen_init(&display->model, width, height) == -1) {
+    display->model.glyphs = NULL;
+    failed = 1;
+  }
+  if (screen_init(&display->terminal, width, height) == -1) {
+    display->terminal.glyphs = NULL;
+    failed = 1;
+  }
+  display->wake_fd = -1;
+  if (!failed) {
+    display->wake_fd = eventfd(0, EFD_CLOEXEC);
+    failed = (display->wake_fd == -1);
+  }
+  if (failed) {
+    display->output_fd = -1;
+    display_destroy(display);
+    return -1;
+  }
+  
+  return 0;
+}
+
+signed int display_start(struct Display *display) {
+  // Start the render thread
+  // Returns -1 if it could not be started.
+  
+  if (pthread_create(&display->thread, NULL, &display_thread, (void*)display) != 0) {
+    return -1;
+  }
+  return 0;
+}
+
+void display_publish(struct Display *display, unsigned int mode, struct Snake *snake, struct GridCell *food, unsigned int term_width, unsigned int term_height) {
+  // Hand the render thread a new Frame showing [mode] for the game as it is now
+  // Never waits on the render thread.  If it has not got to the last Frame 
+  // published yet, that one is replaced by this one.  [term_width] and 
+  // [term_height] are the size of the terminal now, for the Pause Menu.
+  
+  // Keep the model of the game up to date on every Frame, so that only 
+  // the spaces that changed have to be looked at.  The Grid only has to 
+  // be copied out for the Frames that show it.
+  uint64_t trace_start = (display->publish_trace != NULL) ? trace_now(display->publish_trace) : 0;
+  struct Frame *frame = &display->frames[display->back];
+  screen_update(&display->model, snake, food);
+  if (mode == FRAME_GAME) {
+    memcpy(frame->glyphs, display->model.glyphs, display->model.width * display->model.height);
+  }
+  frame->mode = mode;
+  frame->score = snake->score;
+  frame->term_width = term_width;
+  frame->term_height = term_height;
+  display->published++;
+  frame->sequence = display->published;
+  
+  // Swap it into the middle, and take whatever was there to fill in next time
+  unsigned int middle = __atomic_exchange_n(&display->middle, display->back | DISPLAY_FRAME_FRESH, __ATOMIC_ACQ_REL);
+  display->back = middle & ~DISPLAY_FRAME_FRESH;
+  display_wake(display);
+  
+  // The handover to the render thread starts with the span, so that the 
+  // trace viewer draws an arrow from it to the one that draws the Frame
+  if (display->publish_trace != NULL) {
+    trace_span(display->publish_trace, "publish", trace_start, display->published);
+    trace_event(display->publish_trace, 's', "frame", trace_start, 0, display->published);
+  }
+  
+  return;
+}
+
+void display_redraw(struct Display *display) {
+  // Have the render thread draw the Grid in full from the next Frame on, 
+  // such as after the terminal has been resized
+  
+  __atomic_store_n(&display->redraw, 1, __ATOMIC_RELEASE);
+  display_wake(display);
+  return;
+}
+
+void display_wake(struct Display *display) {
+  // Wake the render thread, if it is waiting
+  
+  uint64_t wake = 1;
+  if (write(display->wake_fd, &wake, sizeof(wake)) == -1) {
+    // Only fails if the count would overflow, in which case the render 
+    // thread has a wake up waiting already
+  }
+  return;
+}
+
+void display_stop(struct Display *display) {
+  // Stop the render thread, and wait for it to finish
+  // Anything it is still waiting to write is given up on.
+  
+  __atomic_store_n(&display->stop, 1, __ATOMIC_RELEASE);
+  display_wake(display);
+  pthread_join(display->thread, NULL);
+  return;
+}
+
+void display_destroy(struct Display *display) {
+  // Free all of the memory and the file descriptors owned by the Display
+  // The render thread must have been stopped.
+  
+  for (unsigned int i = 0; i < 3; i++) {
+    free(display->frames[i].glyphs);
+  }
+  if (display->model.glyphs != NULL) {
+    screen_destroy(&display->model);
+  }
+  if (display->terminal.glyphs != NULL) {
+    screen_destroy(&display->terminal);
+  }
+  free(display->buffer);
+  if (display->wake_fd != -1) {
+    close(display->wake_fd);
+  }
+  if (display->output_fd != -1) {
+    close(display->output_fd);
+  }
+  return;
+}
+
+signed int display_write(struct Display *display, const char *buffer, unsigned long length) {
+  // Write [length] bytes from [buffer] to the terminal
+  // While the terminal is not taking any more, wait for it to, or for the 
+  // render thread to be stopped.  A Frame partly written has to be 
+  // finished, or the terminal would be left in the middle of an escape 
+  // sequence.  Returns -1 if it could not be finished.
+  
+  unsigned int stalled = 0;
+  while (length > 0) {
+    ssize_t written = write(display->output_fd, buffer, length);
+    if (written > 0) {
+      buffer += written;
+      length -= written;
+      continue;
+    }
+    if (written == -1 && errno == EINTR) {
+      continue;
+    }
+    if (written == 0 || (errno != EAGAIN && errno != EWOULDBLOCK)) {
+      return -1;
+    }
+    
+    // The terminal is backed up.  Count it once for the Frame.
+    if (!stalled) {
+      display->output_stalls++;
+      stalled = 1;
+    }
+    struct pollfd fds[2];
+    fds[0].fd = display->output_fd;
+    fds[0].events = POLLOUT;
+    fds[1].fd = display->wake_fd;
+    fds[1].events = POLLIN;
+    struct timespec wait_start;
+    if (display->profile != NULL) {
+      clock_gettime(CLOCK_MONOTONIC, &wait_start);
+    }
+    uint64_t trace_start = (display->trace != NULL) ? trace_now(display->trace) : 0;
+    signed int retval = poll(fds, 2, -1);
+    if (display->profile != NULL) {
+      profile_record_since(display->profile, PROFILE_OUTPUT_WAIT, &wait_start);
+    }
+    if (display->trace != NULL) {
+      trace_span(display->trace, "output_wait", trace_start, length);
+    }
+    if (retval == -1 && errno != EINTR) {
+      return -1;
+    }
+    if (fds[1].revents & POLLIN) {
+      // Any Frame published meanwhile is still in the middle, and is 
+      // picked up once this one is done
+      uint64_t wakes;
+      if (read(display->wake_fd, &wakes, sizeof(wakes)) == -1) {
+        // It was readable, so this cannot fail
+      }
+    }
+    if (__atomic_load_n(&display->stop, __ATOMIC_ACQUIRE)) {
+      return -1;
+    }
+  }
+  
+  return 0;
+}
+
+void display_draw(struct Display *display, struct Frame *frame) {
+  // Render [frame] and write it to the terminal
+  // The Grid is only drawn where it differs from what the terminal shows, 
+  // however many Frames were dropped since.
+  
+  struct Profile *profile = display->profile;
+  struct TraceRing *trace = display->trace;
+  struct timespec phase_start;
+  if (profile != NULL) {
+    clock_gettime(CLOCK_MONOTONIC, &phase_start);
+  }
+  uint64_t trace_start = (trace != NULL) ? trace_now(trace) : 0;
+  
+  char *buffer = display->buffer;
+  if (frame->mode == FRAME_GAME) {
+    render_screen_changes(buffer, &display->terminal, frame->glyphs, frame->score);
+    if (profile != NULL) {
+      profile_record_since(profile, PROFILE_RENDER, &phase_start);
+    }
+    if (trace != NULL) {
+      trace_span(trace, "render", trace_start, frame->sequence);
+    }
+  } else {
+    // Clear the terminal
+    // Clear the scrollback buffer
+    // Reset the terminal cursor position to the top left
+    unsigned long size = display->buffer_size;
+    unsigned long length = snprintf(buffer, size, "\e[1;1H\e[0J\e[2J\e[3J\e[1;1H");
+    if (frame->mode == FRAME_GAME_OVER) {
+      length += snprintf(buffer + length, size - length, "Game Over\n\r");
+      length += snprintf(buffer + length, size - length, "Press Q to quit\n\r");
+      length += snprintf(buffer + length, size - length, "Press M to leave the current game and return to the menu (Not Implemented)\n\r");
+      length += snprintf(buffer + length, size - length, "Final Score: %d\r", frame->score);
+    } else {
+      length += snprintf(buffer + length, size - length, "Game Paused\n\r");
+      length += snprintf(buffer + length, size - length, "Press E to unpause\n\r");
+      length += snprintf(buffer + length, size - length, "Press Q to quit\n\r");
+      length += snprintf(buffer + length, size - length, "Press M to leave the current game and return to the menu (Not Implemented)\n\r");
+      length += snprintf(buffer + length, size - length, "Current Score: %d\n\r", frame->score);
+      length += snprintf(buffer + length, size - length, "Display output: %u bytes last frame, %llu bytes per frame on average\n\r", display->last_frame_bytes, display->drawn ? display->bytes / display->drawn : 0);
+      length += snprintf(buffer + length, size - length, "Frames dropped for a slow terminal: %lu\n\r", display->dropped);
+      length += snprintf(buffer + length, size - length, "Expected terminal size for current game: %ux%u\n\r", display->term_width, display->term_height);
+      length += snprintf(buffer + length, size - length, "Current terminal size: %dx%d\n\r", frame->term_width, frame->term_height);
+      snprintf(buffer + length, size - length, "The terminal size must match the expected size before unpause will be allowed.\r");
+    }
+    // The menu has been drawn over the Grid, so it has to be drawn back in full
+    display->terminal.stale = 1;
+  }
+  
+  unsigned long length = strlen(buffer);
+  if (profile != NULL) {
+    clock_gettime(CLOCK_MONOTONIC, &phase_start);
+  }
+  trace_start = (trace != NULL) ? trace_now(trace) : 0;
+  signed int failed = display_write(display, buffer, length);
+  if (profile != NULL) {
+    profile_record_since(profile, PROFILE_WRITE, &phase_start);
+  }
+  if (trace != NULL) {
+    trace_span(trace, "write", trace_start, length);
+  }
+  if (failed) {
+    // Who knows how much of it made it to the terminal
+    display->terminal.stale = 1;
+    return;
+  }
+  
+  // Keep count of the output, so that it can be shown on the Pause Menu
+  if (frame->mode == FRAME_GAME) {
+    display->last_frame_bytes = length;
+    display->bytes += length;
+    display->drawn++;
+    if (profile != NULL) {
+      histogram_record(&profile->histograms[PROFILE_FRAME_BYTES], length);
+    }
+  }
+  
+  return;
+}
+
+void* display_thread(void *display_arg) {
+  // The render thread: Draw the latest Frame whenever there is a new one
+  
+  struct Display *display = (struct Display*)display_arg;
+  struct TraceRing *trace = display->trace;
+  while (!__atomic_load_n(&display->stop, __ATOMIC_ACQUIRE)) {
+    unsigned int redraw = __atomic_exchange_n(&display->redraw, 0, __ATOMIC_ACQ_REL);
+    unsigned int taken = 0;
+    if (__atomic_load_n(&display->middle, __ATOMIC_ACQUIRE) & DISPLAY_FRAME_FRESH) {
+      // Take the new Frame.  Any published before it since the last one 
+      // taken will never be drawn.
+      unsigned int middle = __atomic_exchange_n(&display->middle, display->front, __ATOMIC_ACQ_REL);
+      display->front = middle & ~DISPLAY_FRAME_FRESH;
+      struct Frame *frame = &display->frames[display->front];
+      unsigned long dropped = frame->sequence - display->last_sequence - 1;
+      if (trace != NULL && dropped > 0) {
+        trace_event(trace, 'i', "dropped", trace_now(trace), 0, dropped);
+      }
+      display->dropped += dropped;
+      display->last_sequence = frame->sequence;
+      taken = 1;
+    } else if (!redraw) {
+      // Nothing to do until woken
+      uint64_t trace_start = (trace != NULL) ? trace_now(trace) : 0;
+      uint64_t wakes;
+      signed int failed = (read(display->wake_fd, &wakes, sizeof(wakes)) == -1 && errno != EINTR);
+      if (trace != NULL) {
+        trace_span(trace, "wait", trace_start, 0);
+      }
+      if (failed) {
+        break;
+      }
+      continue;
+    }
+    
+    if (redraw) {
+      display->terminal.stale = 1;
+      if (trace != NULL) {
+        trace_event(trace, 'i', "redraw", trace_now(trace), 0, display->last_sequence);
+      }
+    }
+    if (display->last_sequence != 0) {
+      // The Frame handed over by display_publish() ends up in this span
+      uint64_t trace_start = (trace != NULL) ? trace_now(trace) : 0;
+      display_draw(display, &display->frames[display->front]);
+      if (trace != NULL) {
+        trace_span(trace, "draw", trace_start, display->last_sequence);
+        if (taken) {
+          trace_event(trace, 'f', "frame", trace_start, 0, display->last_sequence);
+        }
+      }
+    }
+  }
+  
+  return NULL;
+}
@@ -0,0 +1,1559 @@
+/*
+ * Name: Snake in C
+ * Author: Michael T. Kloos
+ *
+ * Copyright:
+ * (C) Copyright 2022 Michael T. Kloos (http://www.michaelkloos.com/).
+ * All Rights Reserved.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <string.h>
+#include <limits.h>
+#include <stdint.h>
+#if defined(__BMI2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+#include "snake.h"
+
+unsigned int utf8_support = 1;
+
+#define GLYPH_BYTES(string) { string, sizeof(string) - 1 }
+
+// Indexed by GLYPH_*
+const struct GlyphBytes glyph_bytes[GLYPH_COUNT] = {
+  [GLYPH_EMPTY] = GLYPH_BYTES(" "),
+  [GLYPH_FOOD] = GLYPH_BYTES(FOOD_CELL),
+  [GLYPH_SNAKE_TB] = GLYPH_BYTES(SNAKE_CELL_TB),
+  [GLYPH_SNAKE_LR] = GLYPH_BYTES(SNAKE_CELL_LR),
+  [GLYPH_SNAKE_TL] = GLYPH_BYTES(SNAKE_CELL_TL),
+  [GLYPH_SNAKE_TR] = GLYPH_BYTES(SNAKE_CELL_TR),
+  [GLYPH_SNAKE_BL] = GLYPH_BYTES(SNAKE_CELL_BL),
+  [GLYPH_SNAKE_BR] = GLYPH_BYTES(SNAKE_CELL_BR),
+  [GLYPH_FALLBACK_SNAKE] = GLYPH_BYTES(FALLBACK_SNAKE),
+  [GLYPH_FALLBACK_FOOD] = GLYPH_BYTES(FALLBACK_FOOD_CELL),
+  [GLYPH_BORDER_VERTICAL] = GLYPH_BYTES(BORDER_VERTICAL),
+  [GLYPH_BORDER_HORIZONTAL] = GLYPH_BYTES(BORDER_HORIZONTAL),
+  [GLYPH_BORDER_CORNER_TOPLEFT] = GLYPH_BYTES(BORDER_CORNER_TOPLEFT),
+  [GLYPH_BORDER_CORNER_TOPRIGHT] = GLYPH_BYTES(BORDER_CORNER_TOPRIGHT),
+  [GLYPH_BORDER_CORNER_BOTTOMLEFT] = GLYPH_BYTES(BORDER_CORNER_BOTTOMLEFT),
+  [GLYPH_BORDER_CORNER_BOTTOMRIGHT] = GLYPH_BYTES(BORDER_CORNER_BOTTOMRIGHT),
+  [GLYPH_FALLBACK_BORDER] = GLYPH_BYTES(FALLBACK_BORDER),
+};
+
+// The GLYPH_* for a snake cell, indexed by the LINK_* sides it connects to
+// A Grid space with no links is empty.  A cell linked on just one side 
+// is drawn straight through, and so are the impossible 3 and 4 sides.
+const unsigned char link_glyphs[16] = {
+  [0] = GLYPH_EMPTY,
+  [LINK_UP] = GLYPH_SNAKE_TB,
+  [LINK_DOWN] = GLYPH_SNAKE_TB,
+  [LINK_UP | LINK_DOWN] = GLYPH_SNAKE_TB,
+  [LINK_LEFT] = GLYPH_SNAKE_LR,
+  [LINK_RIGHT] = GLYPH_SNAKE_LR,
+  [LINK_LEFT | LINK_RIGHT] = GLYPH_SNAKE_LR,
+  [LINK_UP | LINK_LEFT] = GLYPH_SNAKE_TL,
+  [LINK_UP | LINK_RIGHT] = GLYPH_SNAKE_TR,
+  [LINK_DOWN | LINK_LEFT] = GLYPH_SNAKE_BL,
+  [LINK_DOWN | LINK_RIGHT] = GLYPH_SNAKE_BR,
+  [LINK_UP | LINK_DOWN | LINK_LEFT] = GLYPH_SNAKE_TB,
+  [LINK_UP | LINK_DOWN | LINK_RIGHT] = GLYPH_SNAKE_TB,
+  [LINK_UP | LINK_LEFT | LINK_RIGHT] = GLYPH_SNAKE_TB,
+  [LINK_DOWN | LINK_LEFT | LINK_RIGHT] = GLYPH_SNAKE_TB,
+  [LINK_UP | LINK_DOWN | LINK_LEFT | LINK_RIGHT] = GLYPH_SNAKE_TB,
+};
+// The same without UTF-8, where every snake cell looks alike
+const unsigned char fallback_link_glyphs[16] = {
+  GLYPH_EMPTY,          GLYPH_FALLBACK_SNAKE, GLYPH_FALLBACK_SNAKE, GLYPH_FALLBACK_SNAKE, 
+  GLYPH_FALLBACK_SNAKE, GLYPH_FALLBACK_SNAKE, GLYPH_FALLBACK_SNAKE, GLYPH_FALLBACK_SNAKE, 
+  GLYPH_FALLBACK_SNAKE, GLYPH_FALLBACK_SNAKE, GLYPH_FALLBACK_SNAKE, GLYPH_FALLBACK_SNAKE, 
+  GLYPH_FALLBACK_SNAKE, GLYPH_FALLBACK_SNAKE, GLYPH_FALLBACK_SNAKE, GLYPH_FALLBACK_SNAKE, 
+};
+
+// Stands in for every tile of a Grid that has not been allocated, as 
+// none of its spaces have ever been linked to
+const unsigned char grid_empty_tile[GRID_TILE_SPACES];
+
+int sem_wai2(sem_t *sem) {
+  // Wrapper sem_wait() to force a retry in the event of failure code EINTR
+  
+  while (sem_wait(sem) == -1) {
+    if (errno != EINTR) {
+      return -1;
+    }
+  }
+  return 0;
+}
+
+uint64_t random_next(uint64_t *state) {
+  // Take the next 64 random bits from the generator [state] (SplitMix64)
+  // Any value at all is a good state to start from.
+  
+  *state += 0x9E3779B97F4A7C15ull;
+  uint64_t z = *state;
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+  return z ^ (z >> 31);
+}
+
+signed int gen_random_number(uint64_t *state, signed int min, signed int max) {
+  // Find a random integer somewhere from [min] through [max], using the generator [state]
+  
+  if (min > max) {
+    return 0;
+  }
+  // Scale the top 32 bits into range with a multiply rather than a divide
+  uint64_t length = (uint64_t)(max - min) + 1;
+  return min + (signed int)(((random_next(state) >> 32) * length) >> 32);
+}
+
+unsigned int random_below(uint64_t *state, unsigned int bound) {
+  // Find a random integer from 0 up to but not including [bound], using the generator [state]
+  // This is gen_random_number() from 0 through [bound] - 1, for bounds 
+  // too big for a signed int.  The two always agree.
+  
+  return (unsigned int)(((random_next(state) >> 32) * bound) >> 32);
+}
+
+uint64_t game_seed(unsigned int seed, unsigned long game) {
+  // Find the seed for game number [game] of a run started with [seed]
+  // Each game gets a generator of its own, so that any one of them can be 
+  // replayed without the ones before it.
+  
+  uint64_t state = seed + game * 0x9E3779B97F4A7C15ull;
+  return random_next(&state);
+}
+
+signed int game_init(struct Snake *snake, struct GridCell *food, unsigned int width, unsigned int height, uint64_t seed) {
+  // Set up the snake and food for a new game on a [width] by [height] Grid, 
+  // with the random number generator started from [seed]
+  // Returns -1 if the memory for it could not be allocated
+  
+  // The body starts out small, and grows with the snake
+  unsigned int the_grid_space = width * height;
+  if (snake_init_body(snake, (the_grid_space < SNAKE_BODY_INITIAL_CAPACITY) ? the_grid_space : SNAKE_BODY_INITIAL_CAPACITY) == -1) {
+    return -1;
+  }
+  if (snake_init_grid_state(snake, width, height) == -1) {
+    snake_destroy(snake);
+    return -1;
+  }
+  
+  if (game_restart(snake, food, seed) == -1) {
+    snake_destroy(snake);
+    return -1;
+  }
+  
+  return 0;
+}
+
+signed int game_restart(struct Snake *snake, struct GridCell *food, uint64_t seed) {
+  // Start a new game on the memory left by the last one, with the random 
+  // number generator started from [seed]
+  // Returns -1 if the memory for the tiles under the snake could not be 
+  // allocated.  That can only happen the first time, as the snake always 
+  // starts out on the same tiles, and they are kept from game to game.
+  
+  // Init the Snake
+  snake->random_state = seed;
+  snake->new_direction = STARTING_DIRECTION;
+  snake->direction = STARTING_DIRECTION;
+  snake->pending_growth = 0;
+  snake->grow_by = STARTING_GROW_BY;
+  snake->score = 0;
+  snake->length = 0;
+  snake->head = 0;
+  // Lay the snake out from the tail up to the head in the middle of the Grid
+  for (unsigned int i = STARTING_LENGTH; i > 0; i--) {
+    struct GridCell cell;
+    cell.x = snake->width / 2;
+    cell.y = snake->height / 2;
+    if (STARTING_DIRECTION == DIR_UP) {
+      cell.y += i - 1;
+    } else if (STARTING_DIRECTION == DIR_DOWN) {
+      cell.y -= i - 1;
+    } else if (STARTING_DIRECTION == DIR_LEFT) {
+      cell.x += i - 1;
+    } else {
+      cell.x -= i - 1;
+    }
+    snake_push_head(snake, &cell);
+  }
+  
+  // Init the set of empty Grid spaces used for food placement
+  if (snake_build_grid_state(snake) == -1) {
+    return -1;
+  }
+  
+  // Init the Food
+  rand_food_location(food, snake);
+  
+  return 0;
+}
+
+signed int snake_init_body(struct Snake *snake, unsigned int capacity) {
+  // Allocate an empty snake body with room for [capacity] cells
+  // It is grown with snake_grow_body() once the snake outgrows it.
+  
+  snake->profile = NULL;
+  snake->length = 0;
+  snake->capacity = capacity;
+  snake->head = 0;
+#ifdef PACKED_SNAKE_BODY
+  snake->body = calloc((capacity + 31) / 32, sizeof(uint64_t));
+  if (snake->body == NULL) {
+    return -1;
+  }
+#else
+  snake->cells_x = malloc(capacity * sizeof(uint16_t));
+  snake->cells_y = malloc(capacity * sizeof(uint16_t));
+  if (snake->cells_x == NULL || snake->cells_y == NULL) {
+    free(snake->cells_x);
+    free(snake->cells_y);
+    return -1;
+  }
+#endif
+  
+  return 0;
+}
+
+signed int snake_grow_body(struct Snake *snake) {
+  // Double the room in the snake body, up to as many cells as the Grid has spaces
+  // The cells are moved over so that the head is at the start of the 
+  // ring buffer.  Returns -1 if the memory for it could not be allocated, 
+  // in which case the body is left as it was.
+  
+  unsigned int the_grid_space = snake->width * snake->height;
+  unsigned int capacity = (snake->capacity < the_grid_space / 2) ? snake->capacity * 2 : the_grid_space;
+  if (capacity <= snake->capacity) {
+    // Already big enough to fill the Grid
+    return 0;
+  }
+  
+  struct Snake grown;
+#ifdef PACKED_SNAKE_BODY
+  grown.body = malloc((capacity + 31) / 32 * sizeof(uint64_t));
+  if (grown.body == NULL) {
+    return -1;
+  }
+  snake_copy_body(&grown, snake);
+  free(snake->body);
+  snake->body = grown.body;
+#else
+  grown.cells_x = malloc(capacity * sizeof(uint16_t));
+  grown.cells_y = malloc(capacity * sizeof(uint16_t));
+  if (grown.cells_x == NULL || grown.cells_y == NULL) {
+    free(grown.cells_x);
+    free(grown.cells_y);
+    return -1;
+  }
+  snake_copy_body(&grown, snake);
+  free(snake->cells_x);
+  free(snake->cells_y);
+  snake->cells_x = grown.cells_x;
+  snake->cells_y = grown.cells_y;
+#endif
+  snake->capacity = capacity;
+  snake->head = 0;
+  
+  return 0;
+}
+
+void snake_copy_body(struct Snake *to, struct Snake *from) {
+  // Copy the cells of the body of [from] into the body of [to], with the 
+  // head at the start of the ring buffer
+  // The body of [to] must have room for all of them.  Nothing else about 
+  // [to] is changed.
+  
+#ifdef PACKED_SNAKE_BODY
+  for (unsigned int i = 0; i + 1 < from->length; i++) {
+    unsigned int slot = from->head + i;
+    if (slot >= from->capacity) {
+      slot -= from->capacity;
+    }
+    uint64_t direction = (from->body[slot / 32] >> ((slot % 32) * 2)) & 0x3;
+    unsigned int shift = (i % 32) * 2;
+    uint64_t *word = &to->body[i / 32];
+    *word = (*word & ~((uint64_t)0x3 << shift)) | (direction << shift);
+  }
+#else
+  // The snake wraps around the end of the ring buffer at most once, so it 
+  // comes over in two pieces
+  unsigned int first = from->capacity - from->head;
+  if (first > from->length) {
+    first = from->length;
+  }
+  memcpy(to->cells_x, &from->cells_x[from->head], first * sizeof(uint16_t));
+  memcpy(to->cells_y, &from->cells_y[from->head], first * sizeof(uint16_t));
+  memcpy(&to->cells_x[first], from->cells_x, (from->length - first) * sizeof(uint16_t));
+  memcpy(&to->cells_y[first], from->cells_y, (from->length - first) * sizeof(uint16_t));
+#endif
+  
+  return;
+}
+
+signed int snake_init_grid_state(struct Snake *snake, unsigned int width, unsigned int height) {
+  // Allocate the per Grid space state for a [width] by [height] Grid
+  // Only the table of tiles is allocated here.  The tiles themselves are 
+  // allocated as the snake moves onto them.  Use snake_build_grid_state() 
+  // to fill it in.  Returns -1 if the memory for it could not be allocated.
+  
+  snake->width = width;
+  snake->height = height;
+  snake->tiles_across = (width + GRID_TILE_SIDE - 1) / GRID_TILE_SIDE;
+  unsigned int tile_count = snake->tiles_across * ((height + GRID_TILE_SIDE - 1) / GRID_TILE_SIDE);
+  snake->tiles = malloc(tile_count * sizeof(unsigned char*));
+  snake->used_tiles = malloc(tile_count * sizeof(unsigned int));
+  snake->used_tile_count = 0;
+  snake->free_counts = malloc((height + 1) * sizeof(unsigned int));
+  if (snake->tiles == NULL || snake->used_tiles == NULL || snake->free_counts == NULL) {
+    free(snake->tiles);
+    free(snake->used_tiles);
+    free(snake->free_counts);
+    snake->tiles = NULL;
+    snake->used_tiles = NULL;
+    snake->free_counts = NULL;
+    return -1;
+  }
+  for (unsigned int tile = 0; tile < tile_count; tile++) {
+    snake->tiles[tile] = (unsigned char*)grid_empty_tile;
+  }
+  
+  return 0;
+}
+
+signed int snake_build_grid_state(struct Snake *snake) {
+  // Build the per Grid space state from scratch for the current snake cells
+  // The tiles allocated for earlier snakes are kept, but cleared.  Returns 
+  // -1 if the memory for a tile under the snake could not be allocated.
+  
+  for (unsigned int i = 0; i < snake->used_tile_count; i++) {
+    memset(snake->tiles[snake->used_tiles[i]], 0, GRID_TILE_SPACES);
+  }
+  snake->damage_count = 0;
+  
+  // Every row starts out all empty, less the snake cells on it.  Counting 
+  // those up on the walk below is much quicker than taking them out of 
+  // the Fenwick tree one at a time, and never has to look at the Grid itself.
+  unsigned int height = snake->height;
+  snake->free_counts[0] = 0;
+  for (unsigned int n = 1; n <= height; n++) {
+    snake->free_counts[n] = snake->width;
+  }
+  snake->free_cell_count = snake->width * height - snake->length;
+  
+  // Walk the snake, recording how each of its cells connects to its neighbours
+  struct SnakeWalk walk;
+  snake_walk_start(snake, &walk);
+  while (1) {
+    if (grid_reserve_space(snake, walk.cell.x, walk.cell.y) == -1) {
+      return -1;
+    }
+    snake_relink_cell(snake, walk.i, &walk.cell);
+    snake->free_counts[walk.cell.y + 1]--;
+    if (walk.i + 1 == snake->length) {
+      break;
+    }
+    snake_walk_next(snake, &walk);
+  }
+  
+  // Build the Fenwick tree bottom up, with each node adding itself into 
+  // the next node that covers it
+  for (unsigned int n = 1; n <= height; n++) {
+    unsigned int parent = n + (n & -n);
+    if (parent <= height) {
+      snake->free_counts[parent] += snake->free_counts[n];
+    }
+  }
+  
+  return 0;
+}
+
+unsigned char* grid_space_links(struct Snake *snake, unsigned int x, unsigned int y) {
+  // Find where the LINK_* sides of the Grid space at [x], [y] are kept
+  // The rest of the spaces in its row of its tile follow on from it in 
+  // memory.  Only to be written to once grid_reserve_space() has been 
+  // called for it.
+  
+  unsigned char *tile = snake->tiles[(y / GRID_TILE_SIDE) * snake->tiles_across + x / GRID_TILE_SIDE];
+  return &tile[(y % GRID_TILE_SIDE) * GRID_TILE_SIDE + x % GRID_TILE_SIDE];
+}
+
+signed int grid_reserve_space(struct Snake *snake, unsigned int x, unsigned int y) {
+  // Allocate the tile holding the Grid space at [x], [y], unless it already is
+  // Returns -1 if the memory for it could not be allocated.
+  
+  unsigned int tile = (y / GRID_TILE_SIDE) * snake->tiles_across + x / GRID_TILE_SIDE;
+  if (snake->tiles[tile] != grid_empty_tile) {
+    return 0;
+  }
+  unsigned char *links = calloc(GRID_TILE_SPACES, sizeof(unsigned char));
+  if (links == NULL) {
+    return -1;
+  }
+  snake->tiles[tile] = links;
+  snake->used_tiles[snake->used_tile_count] = tile;
+  snake->used_tile_count++;
+  
+  return 0;
+}
+
+uint64_t grid_row_free_bits(const unsigned char *links) {
+  // Test the 64 Grid spaces of a row of a tile, with their links at 
+  // [links], for being empty
+  // Returns a bit for each, set if it is.
+  
+#if   defined(__AVX2__)
+  __m256i zero = _mm256_setzero_si256();
+  uint64_t low = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)&links[0]), zero));
+  uint64_t high = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)&links[32]), zero));
+  return low | (high << 32);
+#elif defined(__SSE2__)
+  __m128i zero = _mm_setzero_si128();
+  uint64_t bits = 0;
+  for (unsigned int i = 0; i < 4; i++) {
+    uint64_t quarter = (uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)&links[i * 16]), zero));
+    bits |= quarter << (i * 16);
+  }
+  return bits;
+#else
+  uint64_t bits = 0;
+  for (unsigned int i = 0; i < 64; i++) {
+    bits |= (uint64_t)(links[i] == 0) << i;
+  }
+  return bits;
+#endif
+}
+
+void snake_destroy(struct Snake *snake) {
+  // Free all of the memory owned by the snake
+  
+#ifdef PACKED_SNAKE_BODY
+  free(snake->body);
+#else
+  free(snake->cells_x);
+  free(snake->cells_y);
+#endif
+  for (unsigned int i = 0; i < snake->used_tile_count; i++) {
+    free(snake->tiles[snake->used_tiles[i]]);
+  }
+  free(snake->tiles);
+  free(snake->used_tiles);
+  free(snake->free_counts);
+  return;
+}
+
+#ifndef PACKED_SNAKE_BODY
+struct GridCell snake_cell(struct Snake *snake, unsigned int i) {
+  // Find the snake cell [i] cells back from the head in the ring buffer
+  // [i] must be less than snake->capacity
+  
+  unsigned int index = snake->head + i;
+  if (index >= snake->capacity) {
+    index -= snake->capacity;
+  }
+  struct GridCell cell = {snake->cells_x[index], snake->cells_y[index]};
+  return cell;
+}
+#endif
+
+struct GridCell* snake_head(struct Snake *snake) {
+  // Find the Grid space of the head of the snake
+  
+  return &snake->head_cell;
+}
+
+struct GridCell* snake_tail(struct Snake *snake) {
+  // Find the Grid space of the last cell of the snake
+  
+  return &snake->tail_cell;
+}
+
+unsigned int snake_body_link(struct Snake *snake, unsigned int i) {
+  // Find the LINK_* side of snake cell [i] that leads on to cell [i + 1]
+  // [i] must be less than snake->length - 1
+  
+#ifdef PACKED_SNAKE_BODY
+  unsigned int slot = snake->head + i;
+  if (slot >= snake->capacity) {
+    slot -= snake->capacity;
+  }
+  return 1 << ((snake->body[slot / 32] >> ((slot % 32) * 2)) & 0x3);
+#else
+  struct GridCell from = snake_cell(snake, i);
+  struct GridCell to = snake_cell(snake, i + 1);
+  return grid_cell_link(&from, &to);
+#endif
+}
+
+void snake_push_head(struct Snake *snake, struct GridCell *cell) {
+  // Add a new head to the front of the snake on the Grid space [cell]
+  // [cell] must be next to the current head, if there is one
+  
+  // Step the head back one slot in the ring buffer.  Every other cell 
+  // stays where it is in memory and so moves one index along from the 
+  // head.  If the ring buffer is full, this is the slot that the caller 
+  // has just dropped the last cell from.
+  if (snake->head == 0) {
+    snake->head = snake->capacity;
+  }
+  snake->head--;
+  
+#ifdef PACKED_SNAKE_BODY
+  if (snake->length != 0) {
+    // Record which way the old head lies from the new one
+    uint64_t direction = __builtin_ctz(grid_cell_link(cell, &snake->head_cell));
+    unsigned int shift = (snake->head % 32) * 2;
+    uint64_t *word = &snake->body[snake->head / 32];
+    *word = (*word & ~((uint64_t)0x3 << shift)) | (direction << shift);
+  }
+#else
+  snake->cells_x[snake->head] = cell->x;
+  snake->cells_y[snake->head] = cell->y;
+#endif
+  
+  if (snake->length == 0) {
+    snake->tail_cell = *cell;
+  }
+  snake->head_cell = *cell;
+  snake->length++;
+  return;
+}
+
+void snake_pop_tail(struct Snake *snake) {
+  // Drop the last cell off the end of the snake
+  
+  if (snake->length > 1) {
+#ifdef PACKED_SNAKE_BODY
+    // The new tail is the space that the old tail's link leads back to
+    grid_cell_step(snake, &snake->tail_cell, __builtin_ctz(LINK_OPPOSITE(snake_body_link(snake, snake->length - 2))));
+#else
+    snake->tail_cell = snake_cell(snake, snake->length - 2);
+#endif
+  }
+  
+  snake->length--;
+  return;
+}
+
+void snake_walk_start(struct Snake *snake, struct SnakeWalk *walk) {
+  // Begin a walk along the snake at its head
+  
+  walk->cell = *snake_head(snake);
+  walk->i = 0;
+#ifdef PACKED_SNAKE_BODY
+  walk->slot = snake->head;
+  walk->word = snake->body[walk->slot / 32] >> ((walk->slot % 32) * 2);
+#endif
+  return;
+}
+
+void snake_walk_next(struct Snake *snake, struct SnakeWalk *walk) {
+  // Step a walk along the snake on to the next cell towards the tail
+  // The walk must not already be at the tail.
+  
+#ifdef PACKED_SNAKE_BODY
+  // Use up the directions one word at a time instead of finding 
+  // each slot from scratch
+  unsigned int direction = walk->word & 0x3;
+  walk->word >>= 2;
+  walk->slot++;
+  if (walk->slot == snake->capacity) {
+    walk->slot = 0;
+    walk->word = snake->body[0];
+  } else if (walk->slot % 32 == 0) {
+    walk->word = snake->body[walk->slot / 32];
+  }
+  grid_cell_step(snake, &walk->cell, direction);
+#else
+  walk->cell = snake_cell(snake, walk->i + 1);
+#endif
+  walk->i++;
+  return;
+}
+
+void snake_occupy_cell(struct Snake *snake, signed int y) {
+  // Take an empty Grid space in row [y] out of the free set as a snake cell moves onto it
+  // Only the row matters to the free set.  The caller must relink the 
+  // cell afterwards to mark the space as occupied.
+  
+  for (unsigned int n = (unsigned int)y + 1; n <= snake->height; n += n & -n) {
+    snake->free_counts[n]--;
+  }
+  snake->free_cell_count--;
+  
+  return;
+}
+
+void snake_release_cell(struct Snake *snake, signed int x, signed int y) {
+  // Return a Grid space to the free set as the snake cell on it moves off
+  
+  *grid_space_links(snake, x, y) = 0;
+  snake_damage_cell(snake, (unsigned int)y * snake->width + (unsigned int)x);
+  
+  for (unsigned int n = (unsigned int)y + 1; n <= snake->height; n += n & -n) {
+    snake->free_counts[n]++;
+  }
+  snake->free_cell_count++;
+  
+  return;
+}
+
+void snake_damage_cell(struct Snake *snake, unsigned int index) {
+  // Note that what is drawn on the Grid space at [index] may have changed
+  
+  if (snake->damage_count < DAMAGE_LOG_SIZE) {
+    snake->damaged_cells[snake->damage_count] = index;
+  } else if (snake->damage_count > DAMAGE_LOG_SIZE) {
+    // Already overflowed, the whole Grid will be redrawn anyway
+    return;
+  }
+  snake->damage_count++;
+  
+  return;
+}
+
+unsigned int snake_free_cell(struct Snake *snake, unsigned int n) {
+  // Find the Grid index of the empty Grid space [n] spaces on from the 
+  // first, counting in Grid order from 0
+  // [n] must be less than snake->free_cell_count.  The answer depends only 
+  // on which spaces are empty, not on how they came to be empty.
+  
+  // Walk down the Fenwick tree to the row holding it, skipping over 
+  // every node that ends before it
+  unsigned int height = snake->height;
+  unsigned int y = 0;
+  for (unsigned int step = 1u << (31 - __builtin_clz(height)); step > 0; step >>= 1) {
+    if (y + step <= height && snake->free_counts[y + step] <= n) {
+      y += step;
+      n -= snake->free_counts[y];
+    }
+  }
+  
+  // Then along the row a tile at a time.  A tile that was never allocated 
+  // is empty all the way across.
+  unsigned int width = snake->width;
+  unsigned char **tiles = &snake->tiles[(y / GRID_TILE_SIDE) * snake->tiles_across];
+  for (unsigned int x = 0; ; x += GRID_TILE_SIDE) {
+    unsigned int run = (width - x < GRID_TILE_SIDE) ? width - x : GRID_TILE_SIDE;
+    const unsigned char *tile = tiles[x / GRID_TILE_SIDE];
+    if (tile == grid_empty_tile) {
+      if (n < run) {
+        return y * width + x + n;
+      }
+      n -= run;
+      continue;
+    }
+    
+    // The spaces past the end of the Grid are never linked to, so they 
+    // have to be left out
+    uint64_t bits = grid_row_free_bits(&tile[(y % GRID_TILE_SIDE) * GRID_TILE_SIDE]);
+    if (run < GRID_TILE_SIDE) {
+      bits &= ((uint64_t)1 << run) - 1;
+    }
+    unsigned int count = __builtin_popcountll(bits);
+    if (n >= count) {
+      n -= count;
+      continue;
+    }
+#ifdef __BMI2__
+    bits = _pdep_u64((uint64_t)1 << n, bits);
+#else
+    for (; n > 0; n--) {
+      bits &= bits - 1;
+    }
+#endif
+    return y * width + x + __builtin_ctzll(bits);
+  }
+}
+
+void grid_cell_step(struct Snake *snake, struct GridCell *cell, unsigned int direction) {
+  // Move [cell] one Grid space in the direction [direction] on the Grid of [snake]
+  
+  if        (direction == DIR_UP) {
+    cell->y -= 1;
+  } else if (direction == DIR_DOWN) {
+    cell->y += 1;
+  } else if (direction == DIR_LEFT) {
+    cell->x -= 1;
+  } else {                    // DIR_RIGHT
+    cell->x += 1;
+  }
+  
+  // Handle Wrapping
+  if        (cell->x < 0) {
+    cell->x += snake->width;
+  } else if (cell->x >= (signed int)snake->width) {
+    cell->x -= snake->width;
+  } else if (cell->y < 0) {
+    cell->y += snake->height;
+  } else if (cell->y >= (signed int)snake->height) {
+    cell->y -= snake->height;
+  }
+  
+  return;
+}
+
+unsigned int grid_cell_link(struct GridCell *from, struct GridCell *to) {
+  // Which side of the Grid space [from] does the neighbouring space [to] lie on?
+  // If the two are not next to each other, the snake has wrapped around 
+  // the edge of the Grid.  Treat that as the opposite direction.
+  
+  if (to->x == from->x) {
+    if (to->y > from->y) {
+      return (to->y - 1 == from->y) ? LINK_DOWN : LINK_UP;
+    }
+    return (to->y + 1 == from->y) ? LINK_UP : LINK_DOWN;
+  }
+  if (to->x > from->x) {
+    return (to->x - 1 == from->x) ? LINK_RIGHT : LINK_LEFT;
+  }
+  return (to->x + 1 == from->x) ? LINK_LEFT : LINK_RIGHT;
+}
+
+void snake_steer(struct Snake *snake, unsigned int direction) {
+  // Turn the snake towards [direction] on the next tick
+  // The snake cannot turn straight back on itself, so that is ignored.
+  
+  if (LINK_OPPOSITE(1 << direction) != (1u << snake->direction)) {
+    snake->new_direction = direction;
+  }
+  return;
+}
+
+signed int key_direction(signed int key) {
+  // Find the DIR_* that the key [key] from key_parse() steers in, or -1 
+  // if it does not steer
+  
+  if        (key == 'w' || key == 'W') {
+    return DIR_UP;
+  } else if (key == 's' || key == 'S') {
+    return DIR_DOWN;
+  } else if (key == 'a' || key == 'A') {
+    return DIR_LEFT;
+  } else if (key == 'd' || key == 'D') {
+    return DIR_RIGHT;
+  } else if (key >= KEY_ARROW && key <= KEY_ARROW + DIR_RIGHT) {
+    return key - KEY_ARROW;
+  }
+  return -1;
+}
+
+signed int key_parse(struct KeyParser *parser, unsigned char byte) {
+  // Feed the next [byte] read from the terminal to [parser]
+  // Returns the key pressed, if [byte] finishes one: Either the byte 
+  // itself, or KEY_ARROW + DIR_* for an arrow key.  Returns -1 while in 
+  // the middle of an escape sequence, and for any escape sequence that 
+  // is not an arrow key.
+  
+  if        (parser->state == 0) {
+    if (byte == '\e') {
+      parser->state = 1;
+      return -1;
+    }
+    return byte;
+  } else if (parser->state == 1) {
+    // Arrow keys are sent as ESC [ A in normal mode, and ESC O A in 
+    // application mode.  Anything else after ESC is taken as a key of its own.
+    if (byte == '[' || byte == 'O') {
+      parser->state = 2;
+      return -1;
+    }
+    parser->state = 0;
+    return key_parse(parser, byte);
+  }
+  
+  // Skip over the parameters, such as those sent with modifier keys 
+  // (ESC [ 1 ; 5 A), up to the final byte
+  if (byte >= 0x20 && byte < 0x40) {
+    return -1;
+  }
+  parser->state = 0;
+  if        (byte == 'A') {
+    return KEY_ARROW + DIR_UP;
+  } else if (byte == 'B') {
+    return KEY_ARROW + DIR_DOWN;
+  } else if (byte == 'C') {
+    return KEY_ARROW + DIR_RIGHT;
+  } else if (byte == 'D') {
+    return KEY_ARROW + DIR_LEFT;
+  }
+  return -1;
+}
+
+void turn_queue_init(struct TurnQueue *queue) {
+  // Empty out [queue]
+  
+  queue->head = 0;
+  queue->tail = 0;
+  return;
+}
+
+signed int turn_queue_push(struct TurnQueue *queue, unsigned int direction) {
+  // Queue up a turn towards [direction]
+  // Only to be called by the producer.  Returns -1 if the queue is full, 
+  // in which case the turn is dropped.
+  
+  unsigned int tail = queue->tail;
+  if (tail - __atomic_load_n(&queue->head, __ATOMIC_ACQUIRE) == TURN_QUEUE_SIZE) {
+    return -1;
+  }
+  queue->directions[tail % TURN_QUEUE_SIZE] = direction;
+  // Publish the turn only once it has been written
+  __atomic_store_n(&queue->tail, tail + 1, __ATOMIC_RELEASE);
+  
+  return 0;
+}
+
+signed int turn_queue_pop(struct TurnQueue *queue) {
+  // Take the oldest turn off [queue], or return -1 if it is empty
+  // Only to be called by the consumer.
+  
+  unsigned int head = queue->head;
+  if (head == __atomic_load_n(&queue->tail, __ATOMIC_ACQUIRE)) {
+    return -1;
+  }
+  signed int direction = queue->directions[head % TURN_QUEUE_SIZE];
+  // Hand the slot back only once it has been read
+  __atomic_store_n(&queue->head, head + 1, __ATOMIC_RELEASE);
+  
+  return direction;
+}
+
+void snake_take_turn(struct Snake *snake, struct TurnQueue *queue) {
+  // Turn the snake towards the next turn queued up in [queue], unless it 
+  // is already turning this tick
+  // Turns that would not change anything, straight on or straight back, 
+  // are dropped so that they do not hold up the ones behind them.
+  
+  while (snake->new_direction == snake->direction) {
+    signed int direction = turn_queue_pop(queue);
+    if (direction == -1) {
+      break;
+    }
+    snake_steer(snake, direction);
+  }
+  
+  return;
+}
+
+unsigned int snake_cell_links(struct Snake *snake, unsigned int i) {
+  // Find the LINK_* sides that the snake cell at index [i] connects to
+  
+  if (i == 0) {
+    // Head Of Snake
+    // Connects back to the body and forward in the direction it is about to move
+    unsigned int back = snake_body_link(snake, 0);
+    unsigned int forward = 1 << snake->new_direction;
+    if (forward == back) {
+      // Pointing back into the body: Draw the head straight
+      forward = LINK_OPPOSITE(back);
+    }
+    return back | forward;
+  }
+  
+  // The side facing the previous cell is the opposite of that cell's link onwards
+  unsigned int back = LINK_OPPOSITE(snake_body_link(snake, i - 1));
+  
+  if (i == snake->length - 1) {
+    // Tail of the Snake
+    // Drawn straight through, along whichever axis it joins the body on
+    return back | LINK_OPPOSITE(back);
+  }
+  
+  // Middle Cell of the Snake
+  return back | snake_body_link(snake, i);
+}
+
+void snake_relink_cell(struct Snake *snake, unsigned int i, struct GridCell *cell) {
+  // Refresh the LINK_* sides stored for the Grid space [cell] under snake cell [i]
+  
+  *grid_space_links(snake, cell->x, cell->y) = snake_cell_links(snake, i);
+  snake_damage_cell(snake, cell->y * snake->width + cell->x);
+  return;
+}
+
+void rand_food_location(struct GridCell *food, struct Snake *snake) {
+  // Generate a new random food location and assign it to the struct pointed at by [food]
+  
+  // Is there any empty Grid space left at all?
+  if (snake->free_cell_count == 0) {
+    // The snake fills the whole Grid.  There is nowhere for food to go.
+    food->x = -1;
+    food->y = -1;
+    return;
+  }
+  
+  // Pick one of the empty Grid spaces at random, by its place in Grid order
+  unsigned int the_grid_space = snake_free_cell(snake, random_below(&snake->random_state, snake->free_cell_count));
+  
+  // Derive the x and y coordinates of that space on the grid and 
+  // assign them to the food.
+  food->x = the_grid_space % snake->width;
+  food->y = the_grid_space / snake->width;
+  
+  return;
+}
+
+signed int screen_init(struct Screen *screen, unsigned int width, unsigned int height) {
+  // Set up an empty model of the terminal for a Grid of [width] by [height]
+  // Nothing is known to be on the terminal yet, so the first frame is drawn in full.
+  
+  screen->glyphs = calloc(width * height, sizeof(unsigned char));
+  if (screen->glyphs == NULL) {
+    return -1;
+  }
+  screen->width = width;
+  screen->height = height;
+  screen->origin_x = 0;
+  screen->origin_y = 0;
+  screen->score = 0;
+  screen->food.x = -1;
+  screen->food.y = -1;
+  screen->stale = 1;
+  
+  return 0;
+}
+
+void screen_destroy(struct Screen *screen) {
+  // Free all of the memory owned by the screen model
+  
+  free(screen->glyphs);
+  return;
+}
+
+unsigned int screen_follow_axis(unsigned int origin, unsigned int size, unsigned int grid_size, unsigned int head) {
+  // Find where a viewport [size] spaces across should start, on a Grid 
+  // [grid_size] spaces across, for the head at [head] to be well inside it
+  // It stays where it is at [origin] until the head comes within a 
+  // quarter of the way of either edge, then jumps to centre it.  Half a 
+  // viewport of crawling between jumps keeps the full redraws they cost 
+  // few and far between.
+  
+  if (size >= grid_size) {
+    return 0;
+  }
+  unsigned int offset = (head >= origin) ? head - origin : head + grid_size - origin;
+  if (offset >= size / 4 && offset < size - size / 4) {
+    return origin;
+  }
+  return (head >= size / 2) ? head - size / 2 : head + grid_size - size / 2;
+}
+
+void screen_follow(struct Screen *screen, struct Snake *snake) {
+  // Scroll the viewport of [screen] to follow the head of [snake]
+  // The whole viewport has to be redrawn if it moves, so it is marked stale.
+  
+  struct GridCell *head = snake_head(snake);
+  unsigned int origin_x = screen_follow_axis(screen->origin_x, screen->width, snake->width, head->x);
+  unsigned int origin_y = screen_follow_axis(screen->origin_y, screen->height, snake->height, head->y);
+  if (origin_x != screen->origin_x || origin_y != screen->origin_y) {
+    screen->origin_x = origin_x;
+    screen->origin_y = origin_y;
+    screen->stale = 1;
+  }
+  return;
+}
+
+unsigned int screen_space(struct Screen *screen, struct Snake *snake, unsigned int index) {
+  // Find where the Grid space at Grid index [index] is in the viewport of 
+  // [screen], or UINT_MAX if it is outside it
+  
+  // A Grid no bigger than the screen is shown whole, from the top left
+  if (screen->width == snake->width && screen->height == snake->height) {
+    return index;
+  }
+  unsigned int x = index % snake->width;
+  unsigned int y = index / snake->width;
+  x = (x >= screen->origin_x) ? x - screen->origin_x : x + snake->width - screen->origin_x;
+  y = (y >= screen->origin_y) ? y - screen->origin_y : y + snake->height - screen->origin_y;
+  if (x >= screen->width || y >= screen->height) {
+    return UINT_MAX;
+  }
+  return y * screen->width + x;
+}
+
+void screen_fill_row(struct Screen *screen, struct Snake *snake, unsigned int y, const unsigned char *glyph_from_links) {
+  // Work out the GLYPH_* of row [y] of the viewport of [screen] from the 
+  // links of the Grid spaces it shows, using [glyph_from_links]
+  // The head and the food are drawn as any other space would be, and 
+  // have to be put right afterwards.
+  
+  unsigned int grid_y = screen->origin_y + y;
+  if (grid_y >= snake->height) {
+    grid_y -= snake->height;
+  }
+  unsigned int grid_x = screen->origin_x;
+  unsigned char *glyphs = &screen->glyphs[y * screen->width];
+  unsigned int x = 0;
+  while (x < screen->width) {
+    // The links are side by side in memory up to the end of the tile, 
+    // or the end of the Grid, where the viewport wraps around
+    unsigned int run = GRID_TILE_SIDE - grid_x % GRID_TILE_SIDE;
+    if (run > snake->width - grid_x) {
+      run = snake->width - grid_x;
+    }
+    if (run > screen->width - x) {
+      run = screen->width - x;
+    }
+    const unsigned char *links = grid_space_links(snake, grid_x, grid_y);
+    for (unsigned int i = 0; i < run; i++) {
+      glyphs[x + i] = glyph_from_links[links[i]];
+    }
+    x += run;
+    grid_x += run;
+    if (grid_x == snake->width) {
+      grid_x = 0;
+    }
+  }
+  
+  return;
+}
+
+unsigned int grid_space_glyph(struct Snake *snake, struct GridCell *food, unsigned int index) {
+  // Find the GLYPH_* to draw on the Grid space at [index]
+  
+  // Is this a Snake Cell?
+  unsigned int links = *grid_space_links(snake, index % snake->width, index / snake->width);
+  if (links) {
+    if (!utf8_support) {
+      // UTF-8 not supported, fall back to ASCII for snake body
+      return GLYPH_FALLBACK_SNAKE;
+    }
+    
+    if (index == snake_head(snake)->y * snake->width + snake_head(snake)->x) {
+      // The head glyph follows new_direction, which can change between ticks
+      links = snake_cell_links(snake, 0);
+    }
+    return link_glyphs[links];
+  }
+  
+  // Is this a Food Cell?
+  if (food->x >= 0 && index == food->y * snake->width + food->x) {
+    if (!utf8_support) {
+      return GLYPH_FALLBACK_FOOD;
+    }
+    return GLYPH_FOOD;
+  }
+  
+  // If none of the above, it must be an Empty Cell
+  return GLYPH_EMPTY;
+}
+
+char* render_glyph(char *buffer, unsigned int glyph) {
+  // Render [glyph] into the Buffer
+  // Returns the position in the Buffer just after it.  A whole 4 bytes 
+  // are always copied, so the Buffer needs room to spare past the glyph.
+  
+  memcpy(buffer, glyph_bytes[glyph].bytes, 4);
+  return buffer + glyph_bytes[glyph].length;
+}
+
+void screen_fill_glyphs(struct Screen *screen, struct Snake *snake, struct GridCell *food) {
+  // Work out the GLYPH_* of every space in the viewport of [screen] from scratch
+  
+  // The only Grid spaces not drawn straight from their links are the 
+  // head, which follows new_direction, and the food
+  const unsigned char *glyph_from_links = utf8_support ? link_glyphs : fallback_link_glyphs;
+  for (unsigned int y = 0; y < screen->height; y++) {
+    screen_fill_row(screen, snake, y, glyph_from_links);
+  }
+  unsigned int head_index = snake_head(snake)->y * snake->width + snake_head(snake)->x;
+  unsigned int head_space = screen_space(screen, snake, head_index);
+  if (head_space != UINT_MAX) {
+    screen->glyphs[head_space] = grid_space_glyph(snake, food, head_index);
+  }
+  if (food->x >= 0) {
+    unsigned int food_index = food->y * snake->width + food->x;
+    unsigned int food_space = screen_space(screen, snake, food_index);
+    if (food_space != UINT_MAX) {
+      screen->glyphs[food_space] = grid_space_glyph(snake, food, food_index);
+    }
+  }
+  
+  screen->score = snake->score;
+  screen->food = *food;
+  screen->stale = 0;
+  snake->damage_count = 0;
+  
+  return;
+}
+
+unsigned int screen_changed_spaces(struct Screen *screen, struct Snake *snake, struct GridCell *food, unsigned int *spaces) {
+  // Gather the Grid index of every space that might look different now 
+  // from how [screen] has it into [spaces], and return how many there are
+  // That is those the snake has changed, the head since new_direction may 
+  // have changed, and wherever the food was and now is.  [spaces] must 
+  // have room for DAMAGE_LOG_SIZE + 3, and the damage log must not have 
+  // overflowed.
+  
+  unsigned int space_count = snake->damage_count;
+  memcpy(spaces, snake->damaged_cells, space_count * sizeof(unsigned int));
+  unsigned int width = snake->width;
+  spaces[space_count] = snake_head(snake)->y * width + snake_head(snake)->x;
+  space_count++;
+  if (screen->food.x >= 0) {
+    spaces[space_count] = screen->food.y * width + screen->food.x;
+    space_count++;
+  }
+  if (food->x >= 0) {
+    spaces[space_count] = food->y * width + food->x;
+    space_count++;
+  }
+  
+  return space_count;
+}
+
+void screen_update(struct Screen *screen, struct Snake *snake, struct GridCell *food) {
+  // Bring the GLYPH_* in [screen] up to date with the game, without 
+  // rendering anything
+  // Only the Grid spaces that may have changed are looked at, unless the 
+  // whole viewport has to be.
+  
+  screen_follow(screen, snake);
+  if (screen->stale || snake->damage_count > DAMAGE_LOG_SIZE) {
+    screen_fill_glyphs(screen, snake, food);
+    return;
+  }
+  
+  unsigned int spaces[DAMAGE_LOG_SIZE + 3];
+  unsigned int space_count = screen_changed_spaces(screen, snake, food, spaces);
+  for (unsigned int i = 0; i < space_count; i++) {
+    unsigned int space = screen_space(screen, snake, spaces[i]);
+    if (space != UINT_MAX) {
+      screen->glyphs[space] = grid_space_glyph(snake, food, spaces[i]);
+    }
+  }
+  
+  screen->score = snake->score;
+  screen->food = *food;
+  snake->damage_count = 0;
+  
+  return;
+}
+
+void render_screen(char *buffer, struct Screen *screen, struct Snake *snake, struct GridCell *food) {
+  // Render everything in [screen] into the Buffer: The Score, the Grid 
+  // Border, and the GLYPH_* of every space in the viewport
+  // If [snake] is not NULL, [screen] is first brought up to date with it 
+  // and [food] as a whole, a row at a time as it is rendered.
+  
+  unsigned int width = screen->width;
+  unsigned int height = screen->height;
+  if (snake != NULL) {
+    screen->score = snake->score;
+    screen->food = *food;
+    screen->stale = 0;
+    snake->damage_count = 0;
+  }
+  
+  // Render Line 1 with the Score Count, across the full width of the terminal
+  {
+    unsigned int term_width = width + 2;
+    char format_string[24];
+    snprintf(format_string, 24, "Score: %%-%dd", term_width - 7);
+    snprintf(buffer, term_width + 1, format_string, screen->score);
+    buffer += strlen(buffer);
+#ifndef NOEXPLICITNEWLINES
+    *buffer = '\n';
+    buffer++;
+    *buffer = '\r';
+    buffer++;
+#endif
+  }
+  
+  // Pick the glyphs for this frame up front, so that the loops below only 
+  // have to look them up
+  const unsigned char *glyph_from_links = link_glyphs;
+  unsigned int border_vertical = GLYPH_BORDER_VERTICAL;
+  unsigned int border_horizontal = GLYPH_BORDER_HORIZONTAL;
+  unsigned int border_topleft = GLYPH_BORDER_CORNER_TOPLEFT;
+  unsigned int border_topright = GLYPH_BORDER_CORNER_TOPRIGHT;
+  unsigned int border_bottomleft = GLYPH_BORDER_CORNER_BOTTOMLEFT;
+  unsigned int border_bottomright = GLYPH_BORDER_CORNER_BOTTOMRIGHT;
+  if (!utf8_support) {
+    // UTF-8 not supported, fall back to ASCII for everything
+    glyph_from_links = fallback_link_glyphs;
+    border_vertical = GLYPH_FALLBACK_BORDER;
+    border_horizontal = GLYPH_FALLBACK_BORDER;
+    border_topleft = GLYPH_FALLBACK_BORDER;
+    border_topright = GLYPH_FALLBACK_BORDER;
+    border_bottomleft = GLYPH_FALLBACK_BORDER;
+    border_bottomright = GLYPH_FALLBACK_BORDER;
+  }
+  
+  // Render Top Grid Border
+  buffer = render_glyph(buffer, border_topleft);
+  for (unsigned int x = 0; x < width; x++) {
+    buffer = render_glyph(buffer, border_horizontal);
+  }
+  buffer = render_glyph(buffer, border_topright);
+#ifndef NOEXPLICITNEWLINES
+  *buffer = '\n';
+  buffer++;
+  *buffer = '\r';
+  buffer++;
+#endif
+  
+  // The only Grid spaces not drawn straight from their links are the 
+  // head, which follows new_direction, and the food
+  unsigned int head_space = UINT_MAX;
+  unsigned int head_glyph = GLYPH_EMPTY;
+  unsigned int food_space = UINT_MAX;
+  unsigned int food_glyph = GLYPH_EMPTY;
+  if (snake != NULL) {
+    unsigned int head_index = snake_head(snake)->y * snake->width + snake_head(snake)->x;
+    head_space = screen_space(screen, snake, head_index);
+    head_glyph = grid_space_glyph(snake, food, head_index);
+    if (food->x >= 0) {
+      unsigned int food_index = food->y * snake->width + food->x;
+      food_space = screen_space(screen, snake, food_index);
+      food_glyph = grid_space_glyph(snake, food, food_index);
+    }
+  }
+  
+  // Writing to the Buffer could change anything as far as the compiler 
+  // knows, so keep local copies of the pointers used in the loop
+  unsigned char *glyphs = screen->glyphs;
+  unsigned int index = 0;
+  
+  for (unsigned int y = 0; y < height; y++) {
+    
+    // Render a Vertical Element of the Left Grid Border
+    buffer = render_glyph(buffer, border_vertical);
+    
+    if (snake != NULL) {
+      // The links are side by side in memory up to the end of the tile, 
+      // or the end of the Grid, where the viewport wraps around
+      unsigned int grid_y = screen->origin_y + y;
+      if (grid_y >= snake->height) {
+        grid_y -= snake->height;
+      }
+      unsigned int grid_x = screen->origin_x;
+      unsigned int x = 0;
+      while (x < width) {
+        unsigned int run = GRID_TILE_SIDE - grid_x % GRID_TILE_SIDE;
+        if (run > snake->width - grid_x) {
+          run = snake->width - grid_x;
+        }
+        if (run > width - x) {
+          run = width - x;
+        }
+        const unsigned char *links = grid_space_links(snake, grid_x, grid_y);
+        for (unsigned int i = 0; i < run; i++, index++) {
+          unsigned int glyph = glyph_from_links[links[i]];
+          if (index == head_space) {
+            glyph = head_glyph;
+          } else if (index == food_space) {
+            glyph = food_glyph;
+          }
+          buffer = render_glyph(buffer, glyph);
+          glyphs[index] = glyph;
+        }
+        x += run;
+        grid_x += run;
+        if (grid_x == snake->width) {
+          grid_x = 0;
+        }
+      }
+    } else {
+      for (unsigned int x = 0; x < width; x++, index++) {
+        buffer = render_glyph(buffer, glyphs[index]);
+      }
+    }
+    
+    // Render a Vertical Element of the Right Grid Border
+    buffer = render_glyph(buffer, border_vertical);
+    
+#ifndef NOEXPLICITNEWLINES
+    // In case we are running on a TTY that does not get up-to-date terminal size 
+    // information-such as over a COM port-explicitly output a New Line and Carriage Return.  
+    // This will keep the display sane in case the terminal is wider than the TTY believes.  
+    // It prevents reliance on wrapping for new lines.
+    // 
+    // This can be disabled by setting the above preprocessor definition, 'NOEXPLICITNEWLINES'
+    *buffer = '\n';
+    buffer++;
+    *buffer = '\r';
+    buffer++;
+#endif
+    
+  }
+  
+  // Render Bottom Grid Border
+  buffer = render_glyph(buffer, border_bottomleft);
+  for (unsigned int x = 0; x < width; x++) {
+    buffer = render_glyph(buffer, border_horizontal);
+  }
+  buffer = render_glyph(buffer, border_bottomright);
+  
+  // Make sure the string is NULL terminated
+  *buffer = 0;
+  
+  return;
+}
+
+char* render_space(char *buffer, struct Screen *screen, unsigned int index, unsigned int glyph, unsigned int *cursor) {
+  // Render the Grid space at [index] changing to [glyph] into the Buffer, 
+  // moving the terminal cursor to it first unless it is already there
+  // [cursor] is the Grid space the cursor will draw to next without 
+  // being moved, and is updated.  Returns the position in the Buffer 
+  // just after what was rendered.
+  
+  // Line 1 is the Score and Line 2 is the Top Grid Border.  Then each 
+  // line of the Grid starts with a Vertical Element of the Left Grid Border.
+  unsigned int width = screen->width;
+  unsigned int x = index % width;
+  if (index != *cursor) {
+    buffer += sprintf(buffer, "\e[%u;%uH", index / width + 3, x + 2);
+  }
+  buffer = render_glyph(buffer, glyph);
+  screen->glyphs[index] = glyph;
+  
+  // Drawing moves the cursor on to the right, but not past the Right Grid Border
+  *cursor = (x + 1 < width) ? index + 1 : UINT_MAX;
+  return buffer;
+}
+
+void regen_buffer(char *buffer, struct Screen *screen, struct Snake *snake, struct GridCell *food) {
+  // Render the whole Grid into the Buffer
+  // Everything rendered is recorded in [screen], as it will be on the terminal once drawn.
+  
+  render_screen(buffer, screen, snake, food);
+  
+  return;
+}
+
+void regen_buffer_changes(char *buffer, struct Screen *screen, struct Snake *snake, struct GridCell *food) {
+  // Render only what has changed since the last frame into the Buffer, as 
+  // a cursor move to each changed Grid space followed by its new glyph
+  // The snake's damage log must not have overflowed.
+  
+  // Only the score digits need redrawing.  The score never goes down, so 
+  // the new number always covers the old one.
+  if (snake->score != screen->score) {
+    buffer += sprintf(buffer, "\e[1;8H%u", snake->score);
+    screen->score = snake->score;
+  }
+  
+  unsigned int spaces[DAMAGE_LOG_SIZE + 3];
+  unsigned int space_count = screen_changed_spaces(screen, snake, food, spaces);
+  unsigned int cursor = UINT_MAX;
+  for (unsigned int i = 0; i < space_count; i++) {
+    unsigned int space = screen_space(screen, snake, spaces[i]);
+    if (space == UINT_MAX) {
+      continue;
+    }
+    unsigned int glyph = grid_space_glyph(snake, food, spaces[i]);
+    if (glyph != screen->glyphs[space]) {
+      buffer = render_space(buffer, screen, space, glyph, &cursor);
+    }
+  }
+  
+  // Make sure the string is NULL terminated
+  *buffer = 0;
+  
+  screen->food = *food;
+  snake->damage_count = 0;
+  
+  return;
+}
+
+void render_frame(char *buffer, struct Screen *screen, struct Snake *snake, struct GridCell *food) {
+  // Render what it takes to bring the terminal up to date with the game into the Buffer
+  // Only the changes since the last frame are rendered, unless the 
+  // terminal needs to be redrawn in full, such as when the viewport scrolls.
+  
+  screen_follow(screen, snake);
+  if (screen->stale || snake->damage_count > DAMAGE_LOG_SIZE) {
+    // Draw from the top left corner
+    memcpy(buffer, "\e[1;1H", 6);
+    regen_buffer(buffer + 6, screen, snake, food);
+  } else {
+    regen_buffer_changes(buffer, screen, snake, food);
+  }
+  
+  return;
+}
+
+void render_screen_changes(char *buffer, struct Screen *screen, const unsigned char *glyphs, unsigned int score) {
+  // Render what it takes to bring the terminal, as modelled by [screen], 
+  // up to [score] and the GLYPH_* in [glyphs] into the Buffer
+  // The Grid is compared space by space, so that any number of frames 
+  // can have been skipped since [screen] was last brought up to date.  
+  // If too much has changed, or the terminal needs to be redrawn in full 
+  // anyway, the whole Grid is rendered instead.  The Buffer must be big 
+  // enough for that.
+  
+  unsigned int the_grid_space = screen->width * screen->height;
+  
+  // Count the changes first, a word at a time through the runs that 
+  // have not changed.  Moving the cursor to a space costs several times 
+  // as much as drawing it, so past an eighth of the Grid it is about as 
+  // cheap to draw it all.  That also keeps the changes within the size 
+  // of a full frame.
+  unsigned int changes = 0;
+  if (!screen->stale) {
+    for (unsigned int index = 0; index < the_grid_space; index++) {
+      uint64_t old_word;
+      uint64_t new_word;
+      if (index + 8 <= the_grid_space) {
+        memcpy(&old_word, &screen->glyphs[index], 8);
+        memcpy(&new_word, &glyphs[index], 8);
+        if (old_word == new_word) {
+          index += 7;
+          continue;
+        }
+      }
+      changes += (screen->glyphs[index] != glyphs[index]);
+    }
+  }
+  
+  if (screen->stale || changes > the_grid_space / 8) {
+    memcpy(screen->glyphs, glyphs, the_grid_space);
+    screen->score = score;
+    screen->stale = 0;
+    // Draw from the top left corner
+    memcpy(buffer, "\e[1;1H", 6);
+    render_screen(buffer + 6, screen, NULL, NULL);
+    return;
+  }
+  
+  // Only the score digits need redrawing.  The score never goes down, so 
+  // the new number always covers the old one.
+  if (score != screen->score) {
+    buffer += sprintf(buffer, "\e[1;8H%u", score);
+    screen->score = score;
+  }
+  
+  unsigned int cursor = UINT_MAX;
+  for (unsigned int index = 0; index < the_grid_space && changes > 0; index++) {
+    if (glyphs[index] != screen->glyphs[index]) {
+      buffer = render_space(buffer, screen, index, glyphs[index], &cursor);
+      changes--;
+    }
+  }
+  
+  // Make sure the string is NULL terminated
+  *buffer = 0;
+  
+  return;
+}
+
+unsigned int snake_crawl(struct Snake *snake, struct GridCell *food) {
+  // Crawl Snake Forward
+  // Returns 1 if the snake ran into itself, in which case nothing is moved.  
+  // Returns 2 if the memory for it to move onto a new tile or outgrow its 
+  // body could not be allocated, in which case nothing is moved either.  
+  // Otherwise returns 0.
+  
+  struct GridCell old_head_cell = *snake_head(snake);
+  struct GridCell head_cell = old_head_cell;
+  
+  // Update the direction
+  snake->direction = snake->new_direction;
+  
+  // Move the head in the direction of the snake
+  grid_cell_step(snake, &head_cell, snake->direction);
+  
+  // Did we run into ourselves?
+  // Every occupied Grid space has links recorded on it, so this is a 
+  // single lookup.  The tail is about to leave its space, so moving 
+  // onto it is allowed.  That is, unless the snake is still growing, in 
+  // which case the tail stays put this tick.
+  if (*grid_space_links(snake, head_cell.x, head_cell.y) != 0) {
+    struct GridCell *last_cell = snake_tail(snake);
+    if (head_cell.x != last_cell->x || head_cell.y != last_cell->y || snake->pending_growth != 0) {
+      return 1;
+    }
+  }
+  
+  // Make room for the move before anything is changed, so that running 
+  // out of memory leaves the game as it was.  A full body only has to 
+  // grow if the tail stays put this tick, but it will have to sooner or later.
+  if ((snake->length == snake->capacity && snake_grow_body(snake) == -1) || 
+      grid_reserve_space(snake, head_cell.x, head_cell.y) == -1) {
+    return 2;
+  }
+  
+  // Did we consume food?
+  // The cells added are not laid out now.  They are fed out at the tail, 
+  // one per tick, starting with this one.
+  unsigned int food_consumed = 0;
+  if (head_cell.x == food->x && head_cell.y == food->y) {
+    // Handle food consume
+    snake->score += 1;
+    snake->pending_growth += snake->grow_by;
+    snake->grow_by += GROW_BY_INCREMENT;
+    food_consumed = 1;
+  }
+  
+  // Are we still expanding from food eaten?
+  if (snake->pending_growth > 0) {
+    // Grow by holding the tail in place for this tick.  This always fits 
+    // in the ring buffer, as room was made above.  Once the ring buffer is 
+    // as big as the Grid, a snake that fills it could only have moved onto 
+    // its own tail, which was ruled out above while growing.
+    snake->pending_growth--;
+  } else {
+    // The last cell falls off the end of the snake this tick
+    struct GridCell *last_cell = snake_tail(snake);
+    snake_release_cell(snake, last_cell->x, last_cell->y);
+    snake_pop_tail(snake);
+  }
+  
+  snake_push_head(snake, &head_cell);
+  snake_occupy_cell(snake, head_cell.y);
+  
+  // Only the ends of the snake change shape as it crawls.  Every other 
+  // cell keeps the same neighbours, it has just moved one index along.
+  snake_relink_cell(snake, snake->length - 1, snake_tail(snake));
+  snake_relink_cell(snake, 1, &old_head_cell);
+  snake_relink_cell(snake, 0, &head_cell);
+  
+  // Place the new food only after the snake has moved.  Doing it any 
+  // earlier could drop it under the new head or rule out the Grid space 
+  // that the tail has just left.
+  if (food_consumed) {
+    // Time it only if asked to.  Reading the clock can cost more than the 
+    // placement itself.
+    struct timespec food_start;
+    if (snake->profile != NULL) {
+      clock_gettime(CLOCK_MONOTONIC, &food_start);
+    }
+    rand_food_location(food, snake);
+    if (snake->profile != NULL) {
+      profile_record_since(snake->profile, PROFILE_FOOD, &food_start);
+    }
+  }
+  
+  return 0;
+}
+
+void game_observe(struct Snake *snake, struct GridCell *food, unsigned char *observation) {
+  // Write what is on each Grid space into [observation], one byte per 
+  // space in Grid order, as the LINK_* sides of any snake cell on it along 
+  // with OBSERVE_HEAD and OBSERVE_FOOD
+  
+  // The links are copied over a row of a tile at a time
+  unsigned int width = snake->width;
+  for (unsigned int y = 0; y < snake->height; y++) {
+    for (unsigned int x = 0; x < width; x += GRID_TILE_SIDE) {
+      memcpy(&observation[y * width + x], grid_space_links(snake, x, y), (width - x < GRID_TILE_SIDE) ? width - x : GRID_TILE_SIDE);
+    }
+  }
+  observation[snake_head(snake)->y * width + snake_head(snake)->x] |= OBSERVE_HEAD;
+  if (food->x >= 0) {
+    observation[food->y * width + food->x] |= OBSERVE_FOOD;
+  }
+  
+  return;
+}
+
+unsigned long long elapsed_ns(struct timespec *start, struct timespec *end) {
+  // How many nanoseconds passed from [start] to [end]
+  
+  return (unsigned long long)(end->tv_sec - start->tv_sec) * 1000000000ull + end->tv_nsec - start->tv_nsec;
+}
@@ -0,0 +1,349 @@
+/*
+ * Name: Snake in C
+ * Author: Michael T. Kloos
+ *
+ * Copyright:
+ * (C) Copyright 2022 Michael T. Kloos (http://www.michaelkloos.com/).
+ * All Rights Reserved.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "snake.h"
+
+struct GameState* game_state_new(unsigned int width, unsigned int height) {
+  // Allocate a GameState for a game on a [width] by [height] Grid
+  // Use game_state_load() to put a game in it.  Returns NULL if the 
+  // memory for it could not be allocated.
+  
+  // Lay out the block, with each part on a cache line of its own
+  unsigned long the_grid_space = (unsigned long)width * height;
+  unsigned int tiles_across = (width + GRID_TILE_SIDE - 1) / GRID_TILE_SIDE;
+  unsigned int tile_count = tiles_across * ((height + GRID_TILE_SIDE - 1) / GRID_TILE_SIDE);
+  unsigned long size = (sizeof(struct GameState) + 63) & ~63ul;
+  unsigned long body_offset = size;
+#ifdef PACKED_SNAKE_BODY
+  size += (the_grid_space + 31) / 32 * sizeof(uint64_t);
+#else
+  size += (the_grid_space * sizeof(uint16_t) + 63) & ~63ul;
+  unsigned long cells_y_offset = size;
+  size += the_grid_space * sizeof(uint16_t);
+#endif
+  size = (size + 63) & ~63ul;
+  unsigned long free_counts_offset = size;
+  size += ((height + 1) * sizeof(unsigned int) + 63) & ~63ul;
+  unsigned long tiles_offset = size;
+  size += (tile_count * sizeof(unsigned char*) + 63) & ~63ul;
+  unsigned long used_tiles_offset = size;
+  size += (tile_count * sizeof(unsigned int) + 63) & ~63ul;
+  unsigned long tile_data_offset = size;
+  size += (unsigned long)tile_count * GRID_TILE_SPACES;
+  
+  void *block = NULL;
+  if (posix_memalign(&block, 64, size) != 0) {
+    return NULL;
+  }
+  struct GameState *state = block;
+  state->size = size;
+  state->body_offset = body_offset;
+#ifndef PACKED_SNAKE_BODY
+  state->cells_y_offset = cells_y_offset;
+#endif
+  state->free_counts_offset = free_counts_offset;
+  state->tiles_offset = tiles_offset;
+  state->used_tiles_offset = used_tiles_offset;
+  state->tile_data_offset = tile_data_offset;
+  
+  // Every tile is there from the start, so every one of them is in use
+  struct Snake *snake = &state->snake;
+  snake->profile = NULL;
+  snake->width = width;
+  snake->height = height;
+  snake->capacity = the_grid_space;
+  snake->length = 0;
+  snake->head = 0;
+  snake->tiles_across = tiles_across;
+  snake->used_tile_count = tile_count;
+  game_state_rebase(state);
+  for (unsigned int tile = 0; tile < tile_count; tile++) {
+    snake->used_tiles[tile] = tile;
+  }
+  
+  return state;
+}
+
+void game_state_rebase(struct GameState *state) {
+  // Point the snake of [state] at the parts of its own block
+  // Call this on a copy of the block, which still points into the original.
+  
+  unsigned char *block = (unsigned char*)state;
+  struct Snake *snake = &state->snake;
+#ifdef PACKED_SNAKE_BODY
+  snake->body = (uint64_t*)&block[state->body_offset];
+#else
+  snake->cells_x = (uint16_t*)&block[state->body_offset];
+  snake->cells_y = (uint16_t*)&block[state->cells_y_offset];
+#endif
+  snake->free_counts = (unsigned int*)&block[state->free_counts_offset];
+  snake->tiles = (unsigned char**)&block[state->tiles_offset];
+  snake->used_tiles = (unsigned int*)&block[state->used_tiles_offset];
+  for (unsigned int tile = 0; tile < snake->used_tile_count; tile++) {
+    snake->tiles[tile] = &block[state->tile_data_offset + (unsigned long)tile * GRID_TILE_SPACES];
+  }
+  return;
+}
+
+void game_state_load(struct GameState *state, struct Snake *snake, struct GridCell *food) {
+  // Put the game of [snake] and [food] in [state]
+  // The game must be on a Grid the same size as that of [state].  Nothing 
+  // in [state] is left pointing at [snake].
+  
+  struct Snake *copy = &state->snake;
+  snake_copy_body(copy, snake);
+  copy->head = 0;
+  copy->length = snake->length;
+  copy->score = snake->score;
+  copy->new_direction = snake->new_direction;
+  copy->direction = snake->direction;
+  copy->pending_growth = snake->pending_growth;
+  copy->grow_by = snake->grow_by;
+  copy->head_cell = snake->head_cell;
+  copy->tail_cell = snake->tail_cell;
+  copy->random_state = snake->random_state;
+  state->food = *food;
+  
+  // Every tile is already allocated, so this cannot fail
+  snake_build_grid_state(copy);
+  return;
+}
+
+void game_state_copy(struct GameState *to, struct GameState *from) {
+  // Make [to] a copy of [from], which must be for a Grid the same size
+  
+  memcpy(to, from, from->size);
+  game_state_rebase(to);
+  return;
+}
+
+void game_state_destroy(struct GameState *state) {
+  // Free all of the memory owned by [state]
+  
+  free(state);
+  return;
+}
+
+signed int lookahead_init(struct Lookahead *lookahead, unsigned int width, unsigned int height, unsigned int worker_count) {
+  // Set up a lookahead for games on [width] by [height] Grids, with 
+  // [worker_count] threads to play the rollouts
+  // The calling thread is one of the workers.  Returns -1 if the memory 
+  // could not be allocated or the threads could not be started.
+  
+  lookahead->width = width;
+  lookahead->height = height;
+  if (worker_pool_init(&lookahead->pool, worker_count) == -1) {
+    return -1;
+  }
+  lookahead->workers = malloc(worker_count * sizeof(struct LookaheadWorker));
+  if (lookahead->workers == NULL) {
+    worker_pool_destroy(&lookahead->pool);
+    return -1;
+  }
+  signed int failed = 0;
+  for (unsigned int w = 0; w < worker_count; w++) {
+    lookahead->workers[w].state = game_state_new(width, height);
+    failed |= (lookahead->workers[w].state == NULL);
+  }
+  if (failed) {
+    lookahead_destroy(lookahead);
+    return -1;
+  }
+  
+  return 0;
+}
+
+unsigned int lookahead_search(struct Lookahead *lookahead, struct GameState *root, unsigned int rollouts, unsigned int seed) {
+  // Play [rollouts] rollouts on from [root], and find the way that did best
+  // Each rollout goes on for up to LOOKAHEAD_DEPTH ticks.  Rollout [n] is 
+  // played from game_seed(seed, n), and its food is put down from there 
+  // too, so that the rollouts do not know where the food will really go.  
+  // So the search comes out the same however many workers there are.  
+  // Returns the DIR_* to steer to.
+  
+  // The ways the snake can go, starting with the way it is already going, 
+  // so that it carries on that way unless another does better
+  lookahead->first_direction_count = 0;
+  lookahead->first_directions[lookahead->first_direction_count++] = root->snake.new_direction;
+  for (unsigned int direction = 0; direction < 4; direction++) {
+    if (direction != root->snake.new_direction && LINK_OPPOSITE(1 << direction) != (1u << root->snake.direction)) {
+      lookahead->first_directions[lookahead->first_direction_count++] = direction;
+    }
+  }
+  
+  lookahead->root = root;
+  lookahead->rollouts = rollouts;
+  lookahead->seed = seed;
+  lookahead->next_chunk = 0;
+  lookahead_run(lookahead, LOOKAHEAD_JOB_SEARCH);
+  
+  // Add up what every worker found, and go by the best average
+  memset(lookahead->values, 0, sizeof(lookahead->values));
+  memset(lookahead->counts, 0, sizeof(lookahead->counts));
+  for (unsigned int w = 0; w < lookahead->pool.worker_count; w++) {
+    for (unsigned int direction = 0; direction < 4; direction++) {
+      lookahead->values[direction] += lookahead->workers[w].values[direction];
+      lookahead->counts[direction] += lookahead->workers[w].counts[direction];
+    }
+  }
+  unsigned int best = lookahead->first_directions[0];
+  for (unsigned int i = 1; i < lookahead->first_direction_count; i++) {
+    unsigned int direction = lookahead->first_directions[i];
+    if (lookahead->counts[direction] == 0) {
+      continue;
+    }
+    if (lookahead->counts[best] == 0 ||
+        (double)lookahead->values[direction] / lookahead->counts[direction] > (double)lookahead->values[best] / lookahead->counts[best]) {
+      best = direction;
+    }
+  }
+  
+  return best;
+}
+
+void lookahead_destroy(struct Lookahead *lookahead) {
+  // Stop the worker threads, and free all of the memory owned by the lookahead
+  
+  worker_pool_destroy(&lookahead->pool);
+  for (unsigned int w = 0; w < lookahead->pool.worker_count; w++) {
+    game_state_destroy(lookahead->workers[w].state);
+  }
+  free(lookahead->workers);
+  return;
+}
+
+void lookahead_run(struct Lookahead *lookahead, unsigned int job) {
+  // Do [job] for the search set up in [lookahead] on the pool
+  
+  lookahead->job = job;
+  
+  worker_pool_run(&lookahead->pool, &lookahead_run_job, (void*)lookahead);
+  return;
+}
+
+void lookahead_run_job(void *lookahead_job, unsigned int worker) {
+  // Play chunks of the rollouts of the search by the lookahead at 
+  // [lookahead_job] as worker [worker] until there are none left
+  // The totals are kept on the stack until the end, so that the workers 
+  // do not keep writing to memory that is next to each other's.
+  
+  struct Lookahead *lookahead = (struct Lookahead*)lookahead_job;
+  struct LookaheadWorker *self = &lookahead->workers[worker];
+  unsigned long long values[4] = {0, 0, 0, 0};
+  unsigned long counts[4] = {0, 0, 0, 0};
+  unsigned int chunk_count = (lookahead->rollouts + LOOKAHEAD_CHUNK_SIZE - 1) / LOOKAHEAD_CHUNK_SIZE;
+  
+  while (1) {
+    unsigned int chunk = __atomic_fetch_add(&lookahead->next_chunk, 1, __ATOMIC_RELAXED);
+    if (chunk >= chunk_count) {
+      break;
+    }
+    unsigned int first = chunk * LOOKAHEAD_CHUNK_SIZE;
+    unsigned int last = first + LOOKAHEAD_CHUNK_SIZE;
+    if (last > lookahead->rollouts) {
+      last = lookahead->rollouts;
+    }
+    for (unsigned int n = first; n < last; n++) {
+      unsigned int direction = lookahead->first_directions[n % lookahead->first_direction_count];
+      game_state_copy(self->state, lookahead->root);
+      values[direction] += lookahead_rollout(self->state, direction, game_seed(lookahead->seed, n));
+      counts[direction]++;
+    }
+  }
+  
+  memcpy(self->values, values, sizeof(values));
+  memcpy(self->counts, counts, sizeof(counts));
+  return;
+}
+
+unsigned int lookahead_rollout(struct GameState *state, unsigned int first_direction, uint64_t seed) {
+  // Play the game in [state] on, going [first_direction] first, until
+  // Game Over or for LOOKAHEAD_DEPTH ticks
+  // The rest of the way is picked by lookahead_policy(), from [seed].  
+  // Returns how well that went: Each unit of food eaten is worth more than 
+  // staying alive for the whole rollout, so the food comes first, then 
+  // how many ticks the snake lasted.
+  
+  struct Snake *snake = &state->snake;
+  uint64_t random_state = seed;
+  snake->random_state = random_next(&random_state);
+  snake->new_direction = first_direction;
+  unsigned int start_score = snake->score;
+  
+  unsigned int tick;
+  for (tick = 0; tick < LOOKAHEAD_DEPTH; tick++) {
+    if (tick > 0) {
+      lookahead_policy(snake, &state->food, &random_state);
+    }
+    // It never runs out of memory, as it has all it could ever need
+    if (snake_crawl(snake, &state->food) != 0) {
+      break;
+    }
+  }
+  
+  return (snake->score - start_score) * (LOOKAHEAD_DEPTH + 1) + tick;
+}
+
+void lookahead_policy(struct Snake *snake, struct GridCell *food, uint64_t *random_state) {
+  // Pick the way for a rollout to go next, with the random number generator [random_state]
+  // Three times in four, it goes a way that is closer to the food, if 
+  // there is one that does not run straight into the snake.  Otherwise it 
+  // goes any way that does not, at random.  With nowhere safe to go, it 
+  // carries straight on.
+  
+  uint64_t random = random_next(random_state);
+  struct GridCell *head = snake_head(snake);
+  struct GridCell *tail = snake_tail(snake);
+  unsigned int distance = lookahead_food_distance(snake, head, food);
+  unsigned int safe[3];
+  unsigned int safe_count = 0;
+  unsigned int closer[3];
+  unsigned int closer_count = 0;
+  
+  for (unsigned int direction = 0; direction < 4; direction++) {
+    if (LINK_OPPOSITE(1 << direction) == (1u << snake->direction)) {
+      continue;
+    }
+    struct GridCell cell = *head;
+    grid_cell_step(snake, &cell, direction);
+    // The tail moves out of the way unless the snake is still growing
+    if (*grid_space_links(snake, cell.x, cell.y) != 0 &&
+        (cell.x != tail->x || cell.y != tail->y || snake->pending_growth != 0)) {
+      continue;
+    }
+    safe[safe_count++] = direction;
+    if (lookahead_food_distance(snake, &cell, food) < distance) {
+      closer[closer_count++] = direction;
+    }
+  }
+  
+  if        (closer_count != 0 && (random & 0x3) != 0) {
+    snake->new_direction = closer[(random >> 2) % closer_count];
+  } else if (safe_count != 0) {
+    snake->new_direction = safe[(random >> 2) % safe_count];
+  }
+  return;
+}
+
+unsigned int lookahead_food_distance(struct Snake *snake, struct GridCell *cell, struct GridCell *food) {
+  // How many steps [cell] is from the food, the shorter way around each axis of the Grid
+  // With no food on the Grid, every space is as far as can be.
+  
+  if (food->x < 0) {
+    return UINT32_MAX;
+  }
+  unsigned int dx = (cell->x > food->x) ? cell->x - food->x : food->x - cell->x;
+  unsigned int dy = (cell->y > food->y) ? cell->y - food->y : food->y - cell->y;
+  dx = (dx < snake->width - dx) ? dx : snake->width - dx;
+  dy = (dy < snake->height - dy) ? dy : snake->height - dy;
+  return dx + dy;
+}
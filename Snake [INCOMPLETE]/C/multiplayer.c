@@ -0,0 +1,720 @@
+/*
+ * Name: Snake in C
+ * Author: Michael T. Kloos
+ *
+ * Copyright:
+ * (C) Copyright 2022 Michael T. Kloos (http://www.michaelkloos.com/).
+ * All Rights Reserved.
+ */
+
+// For syscall(), which is the only way to a futex
+#define _DEFAULT_SOURCE
+
+#include <time.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <string.h>
+#include <limits.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include "snake.h"
+
+uint64_t multiplayer_now_ns(void) {
+  // Read CLOCK_MONOTONIC, in nanoseconds
+  // Every process reads the same clock, so a time taken by one player can 
+  // be compared with one taken by another.
+  
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000000000ull + now.tv_nsec;
+}
+
+signed int futex_wait_until(uint32_t *word, uint32_t value, uint64_t deadline_ns) {
+  // Sleep until woken by futex_wake_all() on [word], so long as [word] still holds [value]
+  // Gives up at [deadline_ns] on CLOCK_MONOTONIC, unless that is 0.  The 
+  // futex is not private, so it works between processes sharing the 
+  // memory [word] is in.  Returns -1 with errno set to EAGAIN if [word] 
+  // did not hold [value], to ETIMEDOUT once the deadline has passed, or 
+  // to EINTR.  Otherwise returns 0.
+  
+  struct timespec deadline;
+  deadline.tv_sec = deadline_ns / 1000000000ull;
+  deadline.tv_nsec = deadline_ns % 1000000000ull;
+  return syscall(SYS_futex, word, FUTEX_WAIT_BITSET, value, (deadline_ns != 0) ? &deadline : NULL, NULL, FUTEX_BITSET_MATCH_ANY);
+}
+
+void futex_wake_all(uint32_t *word) {
+  // Wake everything sleeping in futex_wait_until() on [word]
+  
+  syscall(SYS_futex, word, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+  return;
+}
+
+signed int multiplayer_init(struct Multiplayer *multiplayer, const char *name, unsigned int width, unsigned int height, unsigned int seed) {
+  // Join the game on the shared board called [name], first setting it up for a [width] by [height] Grid and [seed] if there is none yet
+  // A board left behind by a game that every player has left is set up 
+  // anew.  Waits for the tick that puts the snake down, which is at most 
+  // one tick away.  Returns -1 if the memory for it could not be 
+  // allocated, -2 if the shared memory could not be set up or opened, or
+  // -3 if there is no room on the board for another player.
+  
+  memset(multiplayer, 0, sizeof(struct Multiplayer));
+  if (strchr(name, '/') != NULL ||
+      snprintf(multiplayer->name, MULTIPLAYER_NAME_SIZE, "/snake-%s", name) >= MULTIPLAYER_NAME_SIZE) {
+    return -2;
+  }
+  
+  // Whoever makes the shared memory sets the board up.  Everyone else 
+  // waits for them to.
+  signed int retval;
+  unsigned int host;
+  while (1) {
+    signed int fd = shm_open(multiplayer->name, O_RDWR | O_CREAT | O_EXCL, 0600);
+    host = (fd != -1);
+    if (!host) {
+      if (errno != EEXIST) {
+        return -2;
+      }
+      fd = shm_open(multiplayer->name, O_RDWR, 0);
+      if (fd == -1) {
+        if (errno == ENOENT) {
+          // The last player of the old game has just removed it
+          continue;
+        }
+        return -2;
+      }
+    }
+    retval = host ? multiplayer_create(multiplayer, fd, width, height, seed) : multiplayer_attach(multiplayer, fd);
+    if (host || retval != 0 ||
+        MULTIPLAYER_MEMBERS(__atomic_load_n(&multiplayer->board->barrier, __ATOMIC_ACQUIRE)) != 0) {
+      close(fd);
+      break;
+    }
+    // Nobody is playing on it any more.  Another player may have found 
+    // that too, removed it, and set up a new board under the same name 
+    // since, so it is only removed if the name still opens the same 
+    // memory.  [fd] is held open until then, so the memory cannot be 
+    // freed and another take its inode.
+    multiplayer_unmap(multiplayer);
+    signed int current_fd = shm_open(multiplayer->name, O_RDONLY, 0);
+    struct stat stale;
+    struct stat current;
+    if (current_fd != -1 && fstat(fd, &stale) == 0 && fstat(current_fd, &current) == 0 &&
+        stale.st_dev == current.st_dev && stale.st_ino == current.st_ino) {
+      shm_unlink(multiplayer->name);
+    }
+    if (current_fd != -1) {
+      close(current_fd);
+    }
+    close(fd);
+  }
+  if (retval != 0) {
+    multiplayer_unmap(multiplayer);
+    if (host) {
+      shm_unlink(multiplayer->name);
+    }
+    return retval;
+  }
+  
+  // The first player is in the game before anyone else can join it
+  if (multiplayer_join(multiplayer) == -1) {
+    multiplayer_unmap(multiplayer);
+    return -3;
+  }
+  if (host) {
+    __atomic_store_n(&multiplayer->board->magic, MULTIPLAYER_MAGIC, __ATOMIC_RELEASE);
+  }
+  if (multiplayer_arrive(multiplayer) != 0) {
+    // There was nowhere to put the snake down
+    multiplayer_destroy(multiplayer);
+    return -3;
+  }
+  
+  return 0;
+}
+
+signed int multiplayer_create(struct Multiplayer *multiplayer, signed int fd, unsigned int width, unsigned int height, unsigned int seed) {
+  // Set up a new board in the shared memory [fd], for a [width] by [height] Grid, with the food placed from [seed]
+  // New shared memory is all zeroes, which is an empty Grid already.  
+  // Returns -1 or -2 as multiplayer_init() does.
+  
+  // Lay the block out, with each part on a cache line of its own
+  unsigned int capacity = width * height;
+  unsigned int tiles_across = (width + GRID_TILE_SIDE - 1) / GRID_TILE_SIDE;
+  unsigned int tile_count = tiles_across * ((height + GRID_TILE_SIDE - 1) / GRID_TILE_SIDE);
+  unsigned long size = (sizeof(struct MultiplayerBoard) + 63) & ~63ul;
+  unsigned long free_counts_offset = size;
+  size += ((height + 1) * sizeof(unsigned int) + 63) & ~63ul;
+  unsigned long tile_data_offset = size;
+  size += (unsigned long)tile_count * GRID_TILE_SPACES;
+#ifdef PACKED_SNAKE_BODY
+  unsigned long body_size = ((capacity + 31ul) / 32 * sizeof(uint64_t) + 63) & ~63ul;
+#else
+  unsigned long cells_y_offset = ((unsigned long)capacity * sizeof(uint16_t) + 63) & ~63ul;
+  unsigned long body_size = cells_y_offset * 2;
+#endif
+  unsigned long body_offset = size;
+  size += body_size * MULTIPLAYER_MAX_PLAYERS;
+  
+  if (ftruncate(fd, size) == -1) {
+    return -2;
+  }
+  void *block = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (block == MAP_FAILED) {
+    return -2;
+  }
+  struct MultiplayerBoard *board = block;
+  multiplayer->board = board;
+  multiplayer->size = size;
+  board->size = size;
+  board->free_counts_offset = free_counts_offset;
+  board->tile_data_offset = tile_data_offset;
+  board->body_offset = body_offset;
+  board->body_size = body_size;
+#ifndef PACKED_SNAKE_BODY
+  board->cells_y_offset = cells_y_offset;
+#endif
+  board->width = width;
+  board->height = height;
+  board->tiles_across = tiles_across;
+  board->tile_count = tile_count;
+  if (multiplayer_map_tiles(multiplayer) == -1) {
+    return -1;
+  }
+  
+  // Every row starts out empty, so each node of the Fenwick tree counts 
+  // all of the spaces in the rows it covers
+  unsigned int *free_counts = (unsigned int*)((unsigned char*)block + free_counts_offset);
+  for (unsigned int n = 1; n <= height; n++) {
+    free_counts[n] = width * (n & -n);
+  }
+  board->free_cell_count = capacity;
+  board->random_state = game_seed(seed, 0);
+  struct Snake snake;
+  multiplayer_load(multiplayer, 0, &snake);
+  rand_food_location(&board->food, &snake);
+  board->random_state = snake.random_state;
+  
+  board->start_ns = multiplayer_now_ns();
+  return 0;
+}
+
+signed int multiplayer_attach(struct Multiplayer *multiplayer, signed int fd) {
+  // Map the board in the shared memory [fd], as set up by another player
+  // That player may not be done setting it up, so this waits for them, 
+  // for up to MULTIPLAYER_BARRIER_TIMEOUT_MS.  Returns -1 or -2 as 
+  // multiplayer_init() does.
+  
+  struct timespec pause;
+  pause.tv_sec = 0;
+  pause.tv_nsec = 1000000;
+  unsigned int waited_ms = 0;
+  struct stat status;
+  while (1) {
+    if (fstat(fd, &status) == -1) {
+      return -2;
+    }
+    if ((unsigned long)status.st_size >= sizeof(struct MultiplayerBoard)) {
+      break;
+    }
+    if (waited_ms == MULTIPLAYER_BARRIER_TIMEOUT_MS) {
+      return -2;
+    }
+    nanosleep(&pause, NULL);
+    waited_ms++;
+  }
+  
+  // The whole block is there as soon as any of it is
+  void *block = mmap(NULL, status.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (block == MAP_FAILED) {
+    return -2;
+  }
+  multiplayer->board = block;
+  multiplayer->size = status.st_size;
+  while (__atomic_load_n(&multiplayer->board->magic, __ATOMIC_ACQUIRE) != MULTIPLAYER_MAGIC) {
+    if (waited_ms == MULTIPLAYER_BARRIER_TIMEOUT_MS) {
+      return -2;
+    }
+    nanosleep(&pause, NULL);
+    waited_ms++;
+  }
+  if (multiplayer->board->size != multiplayer->size) {
+    return -2;
+  }
+  
+  return multiplayer_map_tiles(multiplayer);
+}
+
+signed int multiplayer_map_tiles(struct Multiplayer *multiplayer) {
+  // Find every tile of the Grid in this process's mapping of the board
+  // Returns -1 if the memory for the table of them could not be allocated.
+  
+  struct MultiplayerBoard *board = multiplayer->board;
+  multiplayer->tiles = malloc(board->tile_count * sizeof(unsigned char*));
+  multiplayer->used_tiles = malloc(board->tile_count * sizeof(unsigned int));
+  if (multiplayer->tiles == NULL || multiplayer->used_tiles == NULL) {
+    return -1;
+  }
+  unsigned char *tile_data = (unsigned char*)board + board->tile_data_offset;
+  for (unsigned int tile = 0; tile < board->tile_count; tile++) {
+    multiplayer->tiles[tile] = &tile_data[(unsigned long)tile * GRID_TILE_SPACES];
+    multiplayer->used_tiles[tile] = tile;
+  }
+  
+  return 0;
+}
+
+void multiplayer_unmap(struct Multiplayer *multiplayer) {
+  // Let go of this process's mapping of the board, and the table of tiles in it
+  
+  if (multiplayer->board != NULL) {
+    munmap(multiplayer->board, multiplayer->size);
+    multiplayer->board = NULL;
+  }
+  free(multiplayer->tiles);
+  free(multiplayer->used_tiles);
+  multiplayer->tiles = NULL;
+  multiplayer->used_tiles = NULL;
+  return;
+}
+
+void multiplayer_destroy(struct Multiplayer *multiplayer) {
+  // Leave the game, give up the slot, and let go of the board
+  // The snake is taken off the Grid by the next tick.  The last player to 
+  // leave removes the shared memory, so the next game by that name is 
+  // set up afresh.
+  
+  multiplayer_leave(multiplayer);
+  
+  // The tick may be taking the snake off the Grid just now.  Whichever 
+  // of the two changes the slot first, the other goes along with.
+  struct MultiplayerBoard *board = multiplayer->board;
+  struct MultiplayerPlayer *slot = &board->players[multiplayer->player];
+  uint32_t state = __atomic_load_n(&slot->state, __ATOMIC_ACQUIRE);
+  while (1) {
+    uint32_t next = MULTIPLAYER_SLOT_FREE;
+    if (state == MULTIPLAYER_SLOT_PLAYING || state == MULTIPLAYER_SLOT_OUT) {
+      next = MULTIPLAYER_SLOT_LEAVING;
+    }
+    if (__atomic_compare_exchange_n(&slot->state, &state, next, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+      break;
+    }
+  }
+  
+  if (MULTIPLAYER_MEMBERS(__atomic_load_n(&board->barrier, __ATOMIC_ACQUIRE)) == 0) {
+    shm_unlink(multiplayer->name);
+  }
+  multiplayer_unmap(multiplayer);
+  return;
+}
+
+void multiplayer_load(struct Multiplayer *multiplayer, unsigned int player, struct Snake *snake) {
+  // Fill in [snake] with the snake of [player], on the Grid as it is on the board
+  // The pointers in [snake] are into this process's mapping of the board.
+  
+  struct MultiplayerBoard *board = multiplayer->board;
+  unsigned char *block = (unsigned char*)board;
+  *snake = board->players[player].snake;
+  snake->profile = multiplayer->profile;
+  snake->width = board->width;
+  snake->height = board->height;
+  snake->capacity = board->width * board->height;
+  snake->tiles_across = board->tiles_across;
+  snake->used_tile_count = board->tile_count;
+  snake->free_cell_count = board->free_cell_count;
+  snake->random_state = board->random_state;
+  snake->damage_count = board->damage_count;
+  memcpy(snake->damaged_cells, board->damaged_cells, sizeof(snake->damaged_cells));
+  
+  unsigned char *body = &block[board->body_offset + player * board->body_size];
+#ifdef PACKED_SNAKE_BODY
+  snake->body = (uint64_t*)body;
+#else
+  snake->cells_x = (uint16_t*)body;
+  snake->cells_y = (uint16_t*)&body[board->cells_y_offset];
+#endif
+  snake->free_counts = (unsigned int*)&block[board->free_counts_offset];
+  snake->tiles = multiplayer->tiles;
+  snake->used_tiles = multiplayer->used_tiles;
+  return;
+}
+
+void multiplayer_store(struct Multiplayer *multiplayer, unsigned int player, struct Snake *snake) {
+  // Put [snake], as loaded by multiplayer_load() and played on since, back on the board as the snake of [player]
+  
+  struct MultiplayerBoard *board = multiplayer->board;
+  board->players[player].snake = *snake;
+  board->free_cell_count = snake->free_cell_count;
+  board->random_state = snake->random_state;
+  board->damage_count = snake->damage_count;
+  memcpy(board->damaged_cells, snake->damaged_cells, sizeof(board->damaged_cells));
+  return;
+}
+
+signed int multiplayer_join(struct Multiplayer *multiplayer) {
+  // Take a free slot on the board, and have the tick barrier wait for this player from now on
+  // The snake is put down by the next tick.  Returns -1 if every slot is taken.
+  
+  struct MultiplayerBoard *board = multiplayer->board;
+  unsigned int player = 0;
+  while (1) {
+    if (player == MULTIPLAYER_MAX_PLAYERS) {
+      return -1;
+    }
+    uint32_t state = MULTIPLAYER_SLOT_FREE;
+    if (__atomic_compare_exchange_n(&board->players[player].state, &state, MULTIPLAYER_SLOT_JOINING, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+      break;
+    }
+    player++;
+  }
+  struct MultiplayerPlayer *slot = &board->players[player];
+  slot->pid = getpid();
+  turn_queue_init(&slot->turns);
+  memset(&slot->input_latency, 0, sizeof(struct Histogram));
+  slot->input_latency.min = ULLONG_MAX;
+  multiplayer->player = player;
+  
+  // A player cannot be counted in the middle of a tick being played
+  uint32_t barrier = __atomic_load_n(&board->barrier, __ATOMIC_ACQUIRE);
+  while (1) {
+    if (barrier & MULTIPLAYER_TICKING) {
+      futex_wait_until(&board->barrier, barrier, 0);
+      barrier = __atomic_load_n(&board->barrier, __ATOMIC_ACQUIRE);
+      continue;
+    }
+    if (__atomic_compare_exchange_n(&board->barrier, &barrier, barrier | MULTIPLAYER_MEMBER(player), 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+      break;
+    }
+  }
+  multiplayer->playing = 1;
+  
+  return 0;
+}
+
+signed int multiplayer_arrive(struct Multiplayer *multiplayer) {
+  // Wait at the tick barrier for every other player, then for the tick to be played
+  // The last player to get there plays the tick for all of them.  Any 
+  // player that has not got there within MULTIPLAYER_BARRIER_TIMEOUT_MS 
+  // is dropped from the game.  Then the view of the game is brought up 
+  // to date.  Returns 1 if the snake is out, or the player has been 
+  // dropped, as it plays no more.  Otherwise returns 0.
+  
+  struct MultiplayerBoard *board = multiplayer->board;
+  unsigned int player = multiplayer->player;
+  uint32_t barrier = __atomic_load_n(&board->barrier, __ATOMIC_ACQUIRE);
+  uint32_t next;
+  while (1) {
+    if (!(barrier & MULTIPLAYER_MEMBER(player))) {
+      // Dropped for holding up the rest
+      multiplayer->playing = 0;
+      return 1;
+    }
+    if (barrier & MULTIPLAYER_TICKING) {
+      futex_wait_until(&board->barrier, barrier, 0);
+      barrier = __atomic_load_n(&board->barrier, __ATOMIC_ACQUIRE);
+      continue;
+    }
+    next = barrier | (1u << player);
+    if (MULTIPLAYER_ARRIVED(next) == MULTIPLAYER_MEMBERS(next)) {
+      next |= MULTIPLAYER_TICKING;
+    }
+    if (__atomic_compare_exchange_n(&board->barrier, &barrier, next, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+      break;
+    }
+  }
+  
+  // Wait for the count of ticks played to move on, unless this player is 
+  // the last one here
+  uint32_t generation = next / MULTIPLAYER_GENERATION;
+  uint64_t deadline_ns = multiplayer_now_ns() + MULTIPLAYER_BARRIER_TIMEOUT_MS * 1000000ull;
+  barrier = next;
+  while (!(next & MULTIPLAYER_TICKING)) {
+    signed int retval = futex_wait_until(&board->barrier, barrier, (barrier & MULTIPLAYER_TICKING) ? 0 : deadline_ns);
+    signed int timed_out = (retval == -1 && errno == ETIMEDOUT);
+    barrier = __atomic_load_n(&board->barrier, __ATOMIC_ACQUIRE);
+    if (barrier / MULTIPLAYER_GENERATION != generation) {
+      break;
+    }
+    if (timed_out && !(barrier & MULTIPLAYER_TICKING)) {
+      // Drop everyone holding up the tick, then play it without them
+      uint32_t missing = MULTIPLAYER_MEMBERS(barrier) & ~MULTIPLAYER_ARRIVED(barrier);
+      next = (barrier & ~(missing << 8)) | MULTIPLAYER_TICKING;
+      if (__atomic_compare_exchange_n(&board->barrier, &barrier, next, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+        multiplayer->evictions += __builtin_popcount(missing);
+      } else {
+        next = barrier & ~MULTIPLAYER_TICKING;
+      }
+    }
+  }
+  if (next & MULTIPLAYER_TICKING) {
+    multiplayer_lead(multiplayer, next);
+  }
+  
+  // Nothing changes the board again until this player is back at the 
+  // barrier, so the view can be taken straight from it.  A snake taken 
+  // off the Grid already is left as it was last seen.
+  uint32_t state = __atomic_load_n(&board->players[player].state, __ATOMIC_ACQUIRE);
+  if (state == MULTIPLAYER_SLOT_PLAYING || state == MULTIPLAYER_SLOT_OUT) {
+    multiplayer_load(multiplayer, player, &multiplayer->snake);
+    multiplayer->food = board->food;
+  }
+  
+  return (state != MULTIPLAYER_SLOT_PLAYING);
+}
+
+void multiplayer_leave(struct Multiplayer *multiplayer) {
+  // Stop the tick barrier waiting for this player
+  // If this player was the only one the tick was waiting for, the tick is 
+  // played here on the way out.  Keeps the input latency of the player 
+  // for reporting, as nothing adds to it from now on.
+  
+  struct MultiplayerBoard *board = multiplayer->board;
+  if (!multiplayer->playing) {
+    // Left already, or dropped
+    multiplayer->input_latency = board->players[multiplayer->player].input_latency;
+    return;
+  }
+  multiplayer->playing = 0;
+  uint32_t self = MULTIPLAYER_MEMBER(multiplayer->player);
+  uint32_t barrier = __atomic_load_n(&board->barrier, __ATOMIC_ACQUIRE);
+  uint32_t next = 0;
+  while (barrier & self) {
+    if (barrier & MULTIPLAYER_TICKING) {
+      futex_wait_until(&board->barrier, barrier, 0);
+      barrier = __atomic_load_n(&board->barrier, __ATOMIC_ACQUIRE);
+      continue;
+    }
+    next = barrier & ~self;
+    if (MULTIPLAYER_MEMBERS(next) != 0 && MULTIPLAYER_ARRIVED(next) == MULTIPLAYER_MEMBERS(next)) {
+      next |= MULTIPLAYER_TICKING;
+    }
+    if (__atomic_compare_exchange_n(&board->barrier, &barrier, next, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+      break;
+    }
+  }
+  if (next & MULTIPLAYER_TICKING) {
+    multiplayer_lead(multiplayer, next);
+  }
+  
+  multiplayer->input_latency = board->players[multiplayer->player].input_latency;
+  return;
+}
+
+void multiplayer_lead(struct Multiplayer *multiplayer, uint32_t barrier) {
+  // Play the tick that the barrier, as [barrier] with MULTIPLAYER_TICKING set by this player, was waiting for
+  // Then start the barrier over for the next tick, and wake everyone 
+  // waiting on it.
+  
+  struct MultiplayerBoard *board = multiplayer->board;
+  multiplayer_play_tick(multiplayer, MULTIPLAYER_MEMBERS(barrier));
+  multiplayer->ticks_led++;
+  
+  // Nothing else changes the barrier while the tick is being played, but 
+  // it costs nothing to make sure
+  uint32_t next;
+  do {
+    next = (barrier & ~(0xFFu | MULTIPLAYER_TICKING)) + MULTIPLAYER_GENERATION;
+  } while (!__atomic_compare_exchange_n(&board->barrier, &barrier, next, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE));
+  futex_wake_all(&board->barrier);
+  
+  return;
+}
+
+void multiplayer_play_tick(struct Multiplayer *multiplayer, unsigned int members) {
+  // Play one tick of the game on the board for every player, [members] being those the barrier waited for
+  // The snakes crawl one at a time, in the order of their slots, so a 
+  // snake can run into one that has moved already this tick.  New players 
+  // are put down first, and the snakes of those that are out or have 
+  // left are taken off the Grid.  Only to be called by the player that 
+  // set MULTIPLAYER_TICKING, as nothing else looks at the board meanwhile.
+  
+  struct MultiplayerBoard *board = multiplayer->board;
+  struct Profile *profile = multiplayer->profile;
+  struct Snake snake;
+  uint64_t now_ns = multiplayer_now_ns();
+  board->damage_count = 0;
+  for (unsigned int player = 0; player < MULTIPLAYER_MAX_PLAYERS; player++) {
+    struct MultiplayerPlayer *slot = &board->players[player];
+    uint32_t state = __atomic_load_n(&slot->state, __ATOMIC_ACQUIRE);
+    unsigned int member = (members >> player) & 1;
+    if        (state == MULTIPLAYER_SLOT_JOINING && member) {
+      state = multiplayer_spawn(multiplayer, player) ? MULTIPLAYER_SLOT_PLAYING : MULTIPLAYER_SLOT_GONE;
+      __atomic_store_n(&slot->state, state, __ATOMIC_RELEASE);
+    } else if (state == MULTIPLAYER_SLOT_PLAYING && member) {
+      multiplayer_load(multiplayer, player, &snake);
+      multiplayer_take_turn(multiplayer, player, &snake, now_ns);
+      struct timespec phase_start;
+      if (profile != NULL) {
+        clock_gettime(CLOCK_MONOTONIC, &phase_start);
+      }
+      // Every tile and the whole body are there from the start, so this 
+      // can only fail by running into a snake
+      unsigned int collided = snake_crawl(&snake, &board->food);
+      if (profile != NULL) {
+        profile_record_since(profile, PROFILE_CRAWL, &phase_start);
+      }
+      multiplayer_store(multiplayer, player, &snake);
+      if (collided) {
+        // Left where it crashed for this tick, for everyone to see
+        __atomic_store_n(&slot->state, MULTIPLAYER_SLOT_OUT, __ATOMIC_RELEASE);
+      }
+    } else if (state == MULTIPLAYER_SLOT_LEAVING) {
+      multiplayer_clear(multiplayer, player);
+      __atomic_store_n(&slot->state, MULTIPLAYER_SLOT_FREE, __ATOMIC_RELEASE);
+    } else if ((state == MULTIPLAYER_SLOT_PLAYING && !member) || state == MULTIPLAYER_SLOT_OUT) {
+      // Unless the player leaves at the same time, in which case the 
+      // snake is taken off next tick instead
+      if (__atomic_compare_exchange_n(&slot->state, &state, MULTIPLAYER_SLOT_GONE, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+        multiplayer_clear(multiplayer, player);
+      }
+    }
+  }
+  board->tick++;
+  
+  return;
+}
+
+unsigned int multiplayer_spawn(struct Multiplayer *multiplayer, unsigned int player) {
+  // Put a new snake down for [player], laid out as a lone snake starts out
+  // Each slot has a column set aside for it, with the snake in the middle 
+  // of it.  If anything is in the way there, or just ahead, places are 
+  // tried at random instead.  Returns 0 if there was no room at any of 
+  // them, in which case the snake is left with no cells.
+  
+  struct MultiplayerBoard *board = multiplayer->board;
+  struct Snake snake;
+  multiplayer_load(multiplayer, player, &snake);
+  snake.new_direction = STARTING_DIRECTION;
+  snake.direction = STARTING_DIRECTION;
+  snake.pending_growth = 0;
+  snake.grow_by = STARTING_GROW_BY;
+  snake.score = 0;
+  snake.length = 0;
+  snake.head = 0;
+  
+  // Find the cells from the head back, and the space ahead of it
+  unsigned int backwards = __builtin_ctz(LINK_OPPOSITE(1 << STARTING_DIRECTION));
+  struct GridCell cells[STARTING_LENGTH + 1];
+  cells[0].x = (2 * player + 1) * board->width / (2 * MULTIPLAYER_MAX_PLAYERS);
+  cells[0].y = board->height / 2;
+  for (unsigned int try = 0; ; try++) {
+    struct GridCell ahead = cells[0];
+    grid_cell_step(&snake, &ahead, STARTING_DIRECTION);
+    cells[STARTING_LENGTH] = ahead;
+    for (unsigned int i = 1; i < STARTING_LENGTH; i++) {
+      cells[i] = cells[i - 1];
+      grid_cell_step(&snake, &cells[i], backwards);
+    }
+    unsigned int clear = 1;
+    for (unsigned int i = 0; i <= STARTING_LENGTH && clear; i++) {
+      clear = (*grid_space_links(&snake, cells[i].x, cells[i].y) == 0 &&
+               (cells[i].x != board->food.x || cells[i].y != board->food.y));
+    }
+    if (clear) {
+      break;
+    }
+    if (try == MULTIPLAYER_SPAWN_TRIES) {
+      multiplayer_store(multiplayer, player, &snake);
+      return 0;
+    }
+    cells[0].x = random_below(&snake.random_state, board->width);
+    cells[0].y = random_below(&snake.random_state, board->height);
+  }
+  
+  // Lay the snake out from the tail up to the head
+  for (unsigned int i = STARTING_LENGTH; i > 0; i--) {
+    snake_push_head(&snake, &cells[i - 1]);
+    snake_occupy_cell(&snake, cells[i - 1].y);
+  }
+  for (unsigned int i = 0; i < STARTING_LENGTH; i++) {
+    snake_relink_cell(&snake, i, &cells[i]);
+  }
+  multiplayer_store(multiplayer, player, &snake);
+  
+  return 1;
+}
+
+void multiplayer_clear(struct Multiplayer *multiplayer, unsigned int player) {
+  // Take the snake of [player] off the Grid
+  
+  struct MultiplayerBoard *board = multiplayer->board;
+  struct Snake snake;
+  multiplayer_load(multiplayer, player, &snake);
+  struct SnakeWalk walk;
+  snake_walk_start(&snake, &walk);
+  while (1) {
+    snake_release_cell(&snake, walk.cell.x, walk.cell.y);
+    if (walk.i + 1 == snake.length) {
+      break;
+    }
+    snake_walk_next(&snake, &walk);
+  }
+  snake.length = 0;
+  
+  // The snakes may have filled the Grid, leaving nowhere for the food
+  if (board->food.x < 0) {
+    rand_food_location(&board->food, &snake);
+  }
+  multiplayer_store(multiplayer, player, &snake);
+  
+  return;
+}
+
+void multiplayer_take_turn(struct Multiplayer *multiplayer, unsigned int player, struct Snake *snake, uint64_t now_ns) {
+  // Turn the snake of [player] towards the next turn it has queued up, as snake_take_turn() does
+  // How long each turn taken waited, up to [now_ns], is counted in the 
+  // input latency of the player.
+  
+  struct MultiplayerPlayer *slot = &multiplayer->board->players[player];
+  struct TurnQueue *turns = &slot->turns;
+  while (snake->new_direction == snake->direction) {
+    // The time is read before the turn, as taking the turn hands the 
+    // slot back to the player
+    unsigned int head = turns->head;
+    if (head == __atomic_load_n(&turns->tail, __ATOMIC_ACQUIRE)) {
+      break;
+    }
+    uint64_t made_ns = slot->turn_times[head % TURN_QUEUE_SIZE];
+    snake_steer(snake, turn_queue_pop(turns));
+    histogram_record(&slot->input_latency, (now_ns > made_ns) ? now_ns - made_ns : 0);
+  }
+  
+  return;
+}
+
+signed int multiplayer_push_turn(struct Multiplayer *multiplayer, unsigned int direction) {
+  // Hand a turn towards [direction] over to the next tick, noting when it was made
+  // Returns -1 if the queue of turns is full, in which case the turn is dropped.
+  
+  struct MultiplayerPlayer *slot = &multiplayer->board->players[multiplayer->player];
+  struct TurnQueue *turns = &slot->turns;
+  // The time goes in the slot the turn is about to, to be published along 
+  // with it.  A full queue still has its oldest turn in that slot.
+  unsigned int tail = turns->tail;
+  if (tail - __atomic_load_n(&turns->head, __ATOMIC_ACQUIRE) == TURN_QUEUE_SIZE) {
+    return -1;
+  }
+  slot->turn_times[tail % TURN_QUEUE_SIZE] = multiplayer_now_ns();
+  return turn_queue_push(turns, direction);
+}
+
+void multiplayer_next_deadline(struct Multiplayer *multiplayer, struct timespec *deadline) {
+  // Find when the next tick is due on the schedule every player keeps to, from now on
+  
+  uint64_t period_ns = DELAY_TIME_MS * 1000000ull;
+  uint64_t start_ns = multiplayer->board->start_ns;
+  uint64_t now_ns = multiplayer_now_ns();
+  uint64_t due_ns = start_ns;
+  if (now_ns > start_ns) {
+    due_ns += (now_ns - start_ns + period_ns - 1) / period_ns * period_ns;
+  }
+  deadline->tv_sec = due_ns / 1000000000ull;
+  deadline->tv_nsec = due_ns % 1000000000ull;
+  return;
+}
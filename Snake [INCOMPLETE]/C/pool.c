@@ -0,0 +1,98 @@
+/*
+ * Name: Snake in C
+ * Author: Michael T. Kloos
+ *
+ * Copyright:
+ * (C) Copyright 2022 Michael T. Kloos (http://www.michaelkloos.com/).
+ * All Rights Reserved.
+ */
+
+#include <stdlib.h>
+#include <semaphore.h>
+#include <pthread.h>
+#include "snake.h"
+
+signed int worker_pool_init(struct WorkerPool *pool, unsigned int worker_count) {
+  // Set up a pool of [worker_count] workers to run jobs on
+  // The calling thread is one of the workers, so [worker_count] - 1 
+  // threads are started.  Returns -1 if the memory could not be 
+  // allocated or the threads could not be started.
+  
+  pool->worker_count = worker_count;
+  pool->workers = malloc(worker_count * sizeof(struct PoolWorker));
+  if (pool->workers == NULL) {
+    return -1;
+  }
+  sem_init(&pool->done, 0, 0);
+  
+  // Start the worker threads, which wait to be given a job
+  for (unsigned int w = 1; w < worker_count; w++) {
+    struct PoolWorker *worker = &pool->workers[w];
+    worker->pool = pool;
+    worker->index = w;
+    sem_init(&worker->go, 0, 0);
+    if (pthread_create(&worker->thread, NULL, &worker_pool_thread, (void*)worker) != 0) {
+      // Stop the ones that did start
+      sem_destroy(&worker->go);
+      pool->worker_count = w;
+      worker_pool_destroy(pool);
+      return -1;
+    }
+  }
+  
+  return 0;
+}
+
+void worker_pool_run(struct WorkerPool *pool, void (*job)(void *context, unsigned int worker), void *context) {
+  // Have every worker call [job] on [context] with its index, the caller 
+  // included as worker 0, and wait for them all to finish
+  // A NULL [job] tells the worker threads to quit instead.
+  
+  pool->job = job;
+  pool->context = context;
+  
+  for (unsigned int w = 1; w < pool->worker_count; w++) {
+    sem_post(&pool->workers[w].go);
+  }
+  if (job != NULL) {
+    job(context, 0);
+  }
+  for (unsigned int w = 1; w < pool->worker_count; w++) {
+    sem_wai2(&pool->done);
+  }
+  
+  return;
+}
+
+void worker_pool_destroy(struct WorkerPool *pool) {
+  // Stop the worker threads, and free all of the memory owned by the pool
+  
+  worker_pool_run(pool, NULL, NULL);
+  for (unsigned int w = 1; w < pool->worker_count; w++) {
+    pthread_join(pool->workers[w].thread, NULL);
+    sem_destroy(&pool->workers[w].go);
+  }
+  sem_destroy(&pool->done);
+  
+  free(pool->workers);
+  return;
+}
+
+void* worker_pool_thread(void *pool_worker) {
+  // A worker thread of a pool, which does each job it is given until told to quit
+  
+  struct PoolWorker *worker = (struct PoolWorker*)pool_worker;
+  struct WorkerPool *pool = worker->pool;
+  
+  while (1) {
+    sem_wai2(&worker->go);
+    if (pool->job == NULL) {
+      break;
+    }
+    pool->job(pool->context, worker->index);
+    sem_post(&pool->done);
+  }
+  
+  sem_post(&pool->done);
+  return NULL;
+}
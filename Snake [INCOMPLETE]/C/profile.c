@@ -0,0 +1,177 @@
+/*
+ * Name: Snake in C
+ * Author: Michael T. Kloos
+ *
+ * Copyright:
+ * (C) Copyright 2022 Michael T. Kloos (http://www.michaelkloos.com/).
+ * All Rights Reserved.
+ */
+
+#include <time.h>
+#include <stdio.h>
+#include <string.h>
+#include <limits.h>
+#include "snake.h"
+
+// What each phase of a Profile is called in the reports, and what it is measured in
+const char *const profile_phase_names[PROFILE_COUNT] = {
+  "tick", "crawl", "food", "publish", "render", "write", "output_wait", "frame_bytes", "autopilot", "spectate", "barrier"
+};
+const char *const profile_phase_units[PROFILE_COUNT] = {
+  "ns", "ns", "ns", "ns", "ns", "ns", "ns", "bytes", "ns", "ns", "ns"
+};
+
+unsigned int histogram_bucket(unsigned long long value) {
+  // Find the bucket [value] is counted in
+  // Below HISTOGRAM_SUB_BUCKETS, each value has a bucket to itself.  From 
+  // there on, each power of 2 is split into HISTOGRAM_SUB_BUCKETS buckets 
+  // by the bits just under the top one.
+  
+  if (value < HISTOGRAM_SUB_BUCKETS) {
+    return value;
+  }
+  unsigned int top_bit = 63 - __builtin_clzll(value);
+  unsigned int shift = top_bit - HISTOGRAM_SUB_BUCKET_BITS;
+  unsigned int sub_bucket = (value >> shift) & (HISTOGRAM_SUB_BUCKETS - 1);
+  return (shift + 1) * HISTOGRAM_SUB_BUCKETS + sub_bucket;
+}
+
+unsigned long long histogram_bucket_low(unsigned int bucket) {
+  // The lowest value counted in [bucket]
+  
+  if (bucket < HISTOGRAM_SUB_BUCKETS) {
+    return bucket;
+  }
+  unsigned int shift = bucket / HISTOGRAM_SUB_BUCKETS - 1;
+  unsigned long long sub_bucket = bucket % HISTOGRAM_SUB_BUCKETS;
+  return (HISTOGRAM_SUB_BUCKETS + sub_bucket) << shift;
+}
+
+unsigned long long histogram_bucket_high(unsigned int bucket) {
+  // The highest value counted in [bucket]
+  
+  if (bucket + 1 == HISTOGRAM_BUCKETS) {
+    return ULLONG_MAX;
+  }
+  return histogram_bucket_low(bucket + 1) - 1;
+}
+
+void histogram_record(struct Histogram *histogram, unsigned long long value) {
+  // Count [value] in [histogram]
+  
+  histogram->buckets[histogram_bucket(value)]++;
+  histogram->count++;
+  histogram->total += value;
+  if (value < histogram->min) {
+    histogram->min = value;
+  }
+  if (value > histogram->max) {
+    histogram->max = value;
+  }
+  return;
+}
+
+unsigned long long histogram_percentile(struct Histogram *histogram, double percent) {
+  // Find the value that [percent]% of those counted in [histogram] are no more than
+  // This is the top of the bucket it was counted in, so it is never 
+  // under the true value.  Returns 0 if nothing has been counted.
+  
+  if (histogram->count == 0) {
+    return 0;
+  }
+  unsigned long long rank = (unsigned long long)(percent / 100 * histogram->count + 0.5);
+  if (rank < 1) {
+    rank = 1;
+  }
+  unsigned long long seen = 0;
+  for (unsigned int bucket = 0; bucket < HISTOGRAM_BUCKETS; bucket++) {
+    seen += histogram->buckets[bucket];
+    if (seen >= rank) {
+      unsigned long long high = histogram_bucket_high(bucket);
+      return (high < histogram->max) ? high : histogram->max;
+    }
+  }
+  
+  return histogram->max;
+}
+
+void profile_init(struct Profile *profile) {
+  // Start [profile] off with nothing counted
+  
+  memset(profile, 0, sizeof(struct Profile));
+  for (unsigned int phase = 0; phase < PROFILE_COUNT; phase++) {
+    profile->histograms[phase].min = ULLONG_MAX;
+  }
+  return;
+}
+
+void profile_record_since(struct Profile *profile, unsigned int phase, struct timespec *start) {
+  // Count the time from [start] until now as one run of [phase]
+  
+  struct timespec end;
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  histogram_record(&profile->histograms[phase], elapsed_ns(start, &end));
+  return;
+}
+
+void histogram_print(struct Histogram *histogram, const char *name, const char *unit) {
+  // Report a summary of [histogram] on STDOUT, as [name] measured in [unit]
+  // Only the count is reported if nothing has been counted.
+  
+  dprintf(STDOUT, "%s_count: %llu\n", name, histogram->count);
+  if (histogram->count == 0) {
+    return;
+  }
+  dprintf(STDOUT, "%s_mean_%s: %.1f\n", name, unit, (double)histogram->total / histogram->count);
+  dprintf(STDOUT, "%s_min_%s: %llu\n", name, unit, histogram->min);
+  dprintf(STDOUT, "%s_p50_%s: %llu\n", name, unit, histogram_percentile(histogram, 50));
+  dprintf(STDOUT, "%s_p90_%s: %llu\n", name, unit, histogram_percentile(histogram, 90));
+  dprintf(STDOUT, "%s_p99_%s: %llu\n", name, unit, histogram_percentile(histogram, 99));
+  dprintf(STDOUT, "%s_p999_%s: %llu\n", name, unit, histogram_percentile(histogram, 99.9));
+  dprintf(STDOUT, "%s_max_%s: %llu\n", name, unit, histogram->max);
+  return;
+}
+
+void profile_print(struct Profile *profile) {
+  // Report a summary of every phase counted in [profile] on STDOUT
+  // The phases that never ran are left out.
+  
+  for (unsigned int phase = 0; phase < PROFILE_COUNT; phase++) {
+    struct Histogram *histogram = &profile->histograms[phase];
+    if (histogram->count == 0) {
+      continue;
+    }
+    histogram_print(histogram, profile_phase_names[phase], profile_phase_units[phase]);
+  }
+  
+  return;
+}
+
+signed int profile_write_csv(struct Profile *profile, const char *path) {
+  // Write every bucket with anything in it from [profile] to a CSV file at [path]
+  // One row per bucket: The phase, its unit, the lowest and highest 
+  // value the bucket takes, and how many were counted in it.  Returns -1 
+  // if the file could not be written.
+  
+  FILE *file = fopen(path, "w");
+  if (file == NULL) {
+    return -1;
+  }
+  
+  fprintf(file, "phase,unit,low,high,count\n");
+  for (unsigned int phase = 0; phase < PROFILE_COUNT; phase++) {
+    struct Histogram *histogram = &profile->histograms[phase];
+    for (unsigned int bucket = 0; bucket < HISTOGRAM_BUCKETS; bucket++) {
+      if (histogram->buckets[bucket] == 0) {
+        continue;
+      }
+      fprintf(file, "%s,%s,%llu,%llu,%llu\n", profile_phase_names[phase], profile_phase_units[phase], histogram_bucket_low(bucket), histogram_bucket_high(bucket), histogram->buckets[bucket]);
+    }
+  }
+  
+  signed int failed = ferror(file);
+  if (fclose(file) != 0 || failed) {
+    return -1;
+  }
+  return 0;
+}
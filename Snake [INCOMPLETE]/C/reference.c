@@ -0,0 +1,269 @@
+/*
+ * Name: Snake in C
+ * Author: Michael T. Kloos
+ *
+ * Copyright:
+ * (C) Copyright 2022 Michael T. Kloos (http://www.michaelkloos.com/).
+ * All Rights Reserved.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <limits.h>
+#include "snake.h"
+
+// The renderer as it was before glyphs were picked and emitted through 
+// lookup tables: A switch on the links of each space, and the glyph bytes 
+// stored one at a time behind a branch on utf8_support.  Only what has 
+// been added since, the tiles and the viewport, is found the current way.  
+// It is not used to play, only to check and time regen_buffer() and 
+// regen_buffer_changes() against.
+
+char* reference_put_bytes(char *buffer, const char *bytes) {
+  // Store the bytes of a glyph into the Buffer one at a time, as the 
+  // glyph macros used to
+  // Returns the position in the Buffer just after them.
+  
+  while (*bytes != 0) {
+    *buffer = *bytes;
+    buffer++;
+    bytes++;
+  }
+  return buffer;
+}
+
+unsigned int reference_space_glyph(struct Snake *snake, struct GridCell *food, unsigned int index) {
+  // Find the GLYPH_* to draw on the Grid space at [index]
+  
+  // Is this a Snake Cell?
+  unsigned int links = *grid_space_links(snake, index % snake->width, index / snake->width);
+  if (links) {
+    if (!utf8_support) {
+      // UTF-8 not supported, fall back to ASCII for snake body
+      return GLYPH_FALLBACK_SNAKE;
+    }
+    
+    if (index == snake_head(snake)->y * snake->width + snake_head(snake)->x) {
+      // The head glyph follows new_direction, which can change between ticks
+      links = snake_cell_links(snake, 0);
+    }
+    
+    switch (links) {
+      case LINK_UP | LINK_LEFT:
+        return GLYPH_SNAKE_TL;
+      case LINK_UP | LINK_RIGHT:
+        return GLYPH_SNAKE_TR;
+      case LINK_DOWN | LINK_LEFT:
+        return GLYPH_SNAKE_BL;
+      case LINK_DOWN | LINK_RIGHT:
+        return GLYPH_SNAKE_BR;
+      case LINK_LEFT | LINK_RIGHT:
+      case LINK_LEFT:
+      case LINK_RIGHT:
+        return GLYPH_SNAKE_LR;
+      default:
+        return GLYPH_SNAKE_TB;
+    }
+  }
+  
+  // Is this a Food Cell?
+  if (food->x >= 0 && index == food->y * snake->width + food->x) {
+    if (!utf8_support) {
+      return GLYPH_FALLBACK_FOOD;
+    }
+    return GLYPH_FOOD;
+  }
+  
+  // If none of the above, it must be an Empty Cell
+  return GLYPH_EMPTY;
+}
+
+char* reference_render_glyph(char *buffer, unsigned int glyph) {
+  // Render [glyph] into the Buffer
+  // Returns the position in the Buffer just after it
+  
+  switch (glyph) {
+    case GLYPH_FOOD:
+      buffer = reference_put_bytes(buffer, FOOD_CELL);
+      break;
+    case GLYPH_SNAKE_TB:
+      buffer = reference_put_bytes(buffer, SNAKE_CELL_TB);
+      break;
+    case GLYPH_SNAKE_LR:
+      buffer = reference_put_bytes(buffer, SNAKE_CELL_LR);
+      break;
+    case GLYPH_SNAKE_TL:
+      buffer = reference_put_bytes(buffer, SNAKE_CELL_TL);
+      break;
+    case GLYPH_SNAKE_TR:
+      buffer = reference_put_bytes(buffer, SNAKE_CELL_TR);
+      break;
+    case GLYPH_SNAKE_BL:
+      buffer = reference_put_bytes(buffer, SNAKE_CELL_BL);
+      break;
+    case GLYPH_SNAKE_BR:
+      buffer = reference_put_bytes(buffer, SNAKE_CELL_BR);
+      break;
+    case GLYPH_FALLBACK_SNAKE:
+      buffer = reference_put_bytes(buffer, FALLBACK_SNAKE);
+      break;
+    case GLYPH_FALLBACK_FOOD:
+      buffer = reference_put_bytes(buffer, FALLBACK_FOOD_CELL);
+      break;
+    default:
+      *buffer = ' ';
+      buffer++;
+      break;
+  }
+  
+  return buffer;
+}
+
+void reference_regen_buffer(char *buffer, struct Screen *screen, struct Snake *snake, struct GridCell *food) {
+  // Render the whole Grid into the Buffer, as regen_buffer() does
+  // Everything rendered is recorded in [screen], as it will be on the terminal once drawn.
+  
+  unsigned int term_width = screen->width + 2;
+  
+  // Render Line 1 with the Score Count
+  {
+    char format_string[24];
+    snprintf(format_string, 24, "Score: %%-%dd", term_width - 7);
+    snprintf(buffer, term_width + 1, format_string, snake->score);
+    buffer += strlen(buffer);
+#ifndef NOEXPLICITNEWLINES
+    *buffer = '\n';
+    buffer++;
+    *buffer = '\r';
+    buffer++;
+#endif
+  }
+  
+  // Render Top Grid Border
+  if (utf8_support) {
+    buffer = reference_put_bytes(buffer, BORDER_CORNER_TOPLEFT);
+    for (unsigned int x = 0; x < screen->width; x++) {
+      buffer = reference_put_bytes(buffer, BORDER_HORIZONTAL);
+    }
+    buffer = reference_put_bytes(buffer, BORDER_CORNER_TOPRIGHT);
+  } else {
+    for (unsigned int x = 0; x < term_width; x++) {
+      buffer = reference_put_bytes(buffer, FALLBACK_BORDER);
+    }
+  }
+#ifndef NOEXPLICITNEWLINES
+  *buffer = '\n';
+  buffer++;
+  *buffer = '\r';
+  buffer++;
+#endif
+  
+  unsigned int space = 0;
+  
+  for (unsigned int y = 0; y < screen->height; y++) {
+    
+    // Render a Vertical Element of the Left Grid Border
+    if (utf8_support) {
+      buffer = reference_put_bytes(buffer, BORDER_VERTICAL);
+    } else {
+      buffer = reference_put_bytes(buffer, FALLBACK_BORDER);
+    }
+    
+    unsigned int grid_y = (screen->origin_y + y) % snake->height;
+    for (unsigned int x = 0; x < screen->width; x++, space++) {
+      unsigned int grid_x = (screen->origin_x + x) % snake->width;
+      unsigned int glyph = reference_space_glyph(snake, food, grid_y * snake->width + grid_x);
+      buffer = reference_render_glyph(buffer, glyph);
+      screen->glyphs[space] = glyph;
+    }
+    
+    // Render a Vertical Element of the Right Grid Border
+    if (utf8_support) {
+      buffer = reference_put_bytes(buffer, BORDER_VERTICAL);
+    } else {
+      buffer = reference_put_bytes(buffer, FALLBACK_BORDER);
+    }
+    
+#ifndef NOEXPLICITNEWLINES
+    *buffer = '\n';
+    buffer++;
+    *buffer = '\r';
+    buffer++;
+#endif
+    
+  }
+  
+  // Render Bottom Grid Border
+  if (utf8_support) {
+    buffer = reference_put_bytes(buffer, BORDER_CORNER_BOTTOMLEFT);
+    for (unsigned int x = 0; x < screen->width; x++) {
+      buffer = reference_put_bytes(buffer, BORDER_HORIZONTAL);
+    }
+    buffer = reference_put_bytes(buffer, BORDER_CORNER_BOTTOMRIGHT);
+  } else {
+    for (unsigned int x = 0; x < term_width; x++) {
+      buffer = reference_put_bytes(buffer, FALLBACK_BORDER);
+    }
+  }
+  
+  // Make sure the string is NULL terminated
+  *buffer = 0;
+  
+  // The terminal will now match the game exactly
+  screen->score = snake->score;
+  screen->food = *food;
+  screen->stale = 0;
+  snake->damage_count = 0;
+  
+  return;
+}
+
+void reference_regen_buffer_changes(char *buffer, struct Screen *screen, struct Snake *snake, struct GridCell *food) {
+  // Render only what has changed since the last frame into the Buffer, 
+  // as regen_buffer_changes() does
+  // The snake's damage log must not have overflowed.
+  
+  // Only the score digits need redrawing.  The score never goes down, so 
+  // the new number always covers the old one.
+  if (snake->score != screen->score) {
+    buffer += sprintf(buffer, "\e[1;8H%u", snake->score);
+    screen->score = snake->score;
+  }
+  
+  unsigned int spaces[DAMAGE_LOG_SIZE + 3];
+  unsigned int space_count = screen_changed_spaces(screen, snake, food, spaces);
+  
+  // The space of the viewport the cursor will draw to next without being moved
+  unsigned int cursor = UINT_MAX;
+  
+  for (unsigned int i = 0; i < space_count; i++) {
+    unsigned int space = screen_space(screen, snake, spaces[i]);
+    if (space == UINT_MAX) {
+      continue;
+    }
+    unsigned int glyph = reference_space_glyph(snake, food, spaces[i]);
+    if (glyph == screen->glyphs[space]) {
+      continue;
+    }
+    
+    // Line 1 is the Score and Line 2 is the Top Grid Border.  Then each 
+    // line of the Grid starts with a Vertical Element of the Left Grid Border.
+    unsigned int x = space % screen->width;
+    if (space != cursor) {
+      buffer += sprintf(buffer, "\e[%u;%uH", space / screen->width + 3, x + 2);
+    }
+    buffer = reference_render_glyph(buffer, glyph);
+    screen->glyphs[space] = glyph;
+    
+    // Drawing moves the cursor on to the right, but not past the Right Grid Border
+    cursor = (x + 1 < screen->width) ? space + 1 : UINT_MAX;
+  }
+  
+  // Make sure the string is NULL terminated
+  *buffer = 0;
+  
+  screen->food = *food;
+  snake->damage_count = 0;
+  
+  return;
+}
@@ -0,0 +1,442 @@
+/*
+ * Name: Snake in C
+ * Author: Michael T. Kloos
+ *
+ * Copyright:
+ * (C) Copyright 2022 Michael T. Kloos (http://www.michaelkloos.com/).
+ * All Rights Reserved.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "snake.h"
+
+unsigned int varint_encode(unsigned char *buffer, uint64_t value) {
+  // Encode [value] as a varint into the Buffer
+  // Returns how many bytes it took, which is at most 10.
+  
+  unsigned int length = 0;
+  while (value >= 0x80) {
+    buffer[length] = (value & 0x7F) | 0x80;
+    value >>= 7;
+    length++;
+  }
+  buffer[length] = value;
+  return length + 1;
+}
+
+void log_put_varint(struct GameLog *log, uint64_t value) {
+  // Write [value] to the log being recorded as a varint
+  
+  unsigned char buffer[10];
+  fwrite(buffer, 1, varint_encode(buffer, value), log->file);
+  return;
+}
+
+signed int log_get_varint(struct GameLog *log, uint64_t *value) {
+  // Read a varint from the log being played back into [value]
+  // Returns -1 if the log ends part way through it, or if it is too big.
+  
+  *value = 0;
+  for (unsigned int shift = 0; shift < 64; shift += 7) {
+    if (log->position >= log->length) {
+      return -1;
+    }
+    unsigned char byte = log->data[log->position];
+    log->position++;
+    *value |= (uint64_t)(byte & 0x7F) << shift;
+    if (!(byte & 0x80)) {
+      return 0;
+    }
+  }
+  return -1;
+}
+
+signed int log_create(struct GameLog *log, const char *path, unsigned int width, unsigned int height, unsigned int seed) {
+  // Start recording a run on a [width] by [height] Grid, started with [seed], to a new log at [path]
+  // Returns -1 if the file could not be created.
+  
+  log->file = fopen(path, "wb");
+  if (log->file == NULL) {
+    return -1;
+  }
+  log->data = NULL;
+  log->tick = 0;
+  log->width = width;
+  log->height = height;
+  log->seed = seed;
+  
+  fwrite(LOG_MAGIC, 1, 4, log->file);
+  log_put_varint(log, width);
+  log_put_varint(log, height);
+  log_put_varint(log, seed);
+  
+  return 0;
+}
+
+void log_write_tick(struct GameLog *log, unsigned long tick, unsigned long game, struct Snake *snake, struct GridCell *food) {
+  // Record whatever tick [tick] of game number [game] needs, just before the snake crawls
+  // That is a keyframe every LOG_KEYFRAME_INTERVAL ticks, and the turn 
+  // the snake is about to make, if any.  Everything else follows from the seed.
+  
+  if (tick % LOG_KEYFRAME_INTERVAL == 0) {
+    // The fixed size part goes through a buffer first, to find how long it is
+    unsigned char header[11 * 10];
+    unsigned int header_length = log_keyframe_header(header, game, snake, food);
+    unsigned int link_count = snake->length - 1;
+    
+    log_put_varint(log, ((uint64_t)(tick - log->tick) << 3) | LOG_RECORD_KEYFRAME);
+    log_put_varint(log, header_length + (link_count + 3) / 4);
+    fwrite(header, 1, header_length, log->file);
+    unsigned int byte = 0;
+    for (unsigned int i = 0; i < link_count; i++) {
+      byte |= __builtin_ctz(snake_body_link(snake, i)) << ((i % 4) * 2);
+      if (i % 4 == 3 || i + 1 == link_count) {
+        fputc(byte, log->file);
+        byte = 0;
+      }
+    }
+    log->tick = tick;
+  }
+  
+  if (snake->new_direction != snake->direction) {
+    log_put_varint(log, ((uint64_t)(tick - log->tick) << 3) | (LOG_RECORD_INPUT + snake->new_direction));
+    log->tick = tick;
+  }
+  
+  return;
+}
+
+unsigned int log_keyframe_header(unsigned char *buffer, unsigned long game, struct Snake *snake, struct GridCell *food) {
+  // Encode the fixed size part of a keyframe of game number [game] into the Buffer
+  // That is everything up to the links of the snake.  Returns how many 
+  // bytes it took, which is at most 11 * 10.
+  
+  uint64_t values[11] = {
+    game, 
+    snake->score, 
+    snake->direction, 
+    snake->pending_growth, 
+    snake->grow_by, 
+    food->x + 1, 
+    food->y + 1, 
+    snake->random_state, 
+    snake->length, 
+    snake_head(snake)->x, 
+    snake_head(snake)->y, 
+  };
+  unsigned int length = 0;
+  for (unsigned int i = 0; i < 11; i++) {
+    length += varint_encode(&buffer[length], values[i]);
+  }
+  return length;
+}
+
+signed int log_finish(struct GameLog *log, unsigned long tick) {
+  // Stop recording, with the run having stopped before tick [tick]
+  // Returns -1 if any of the log could not be written.
+  
+  log_put_varint(log, ((uint64_t)(tick - log->tick) << 3) | LOG_RECORD_END);
+  log->tick = tick;
+  
+  signed int failed = ferror(log->file);
+  if (fclose(log->file) != 0) {
+    failed = 1;
+  }
+  log->file = NULL;
+  if (failed) {
+    return -1;
+  }
+  return 0;
+}
+
+signed int log_load(struct GameLog *log, const char *path) {
+  // Read in the whole log at [path] for playback, and check it over
+  // Returns -1 if it could not be read, or is not a whole game log.
+  
+  FILE *file = fopen(path, "rb");
+  if (file == NULL) {
+    return -1;
+  }
+  
+  unsigned long capacity = 4096;
+  unsigned long length = 0;
+  unsigned char *data = malloc(capacity);
+  while (data != NULL) {
+    length += fread(data + length, 1, capacity - length, file);
+    if (length < capacity) {
+      break;
+    }
+    capacity *= 2;
+    unsigned char *grown = realloc(data, capacity);
+    if (grown == NULL) {
+      free(data);
+      data = NULL;
+      break;
+    }
+    data = grown;
+  }
+  
+  signed int failed = (data == NULL || ferror(file));
+  fclose(file);
+  if (failed) {
+    free(data);
+    return -1;
+  }
+  
+  log->file = NULL;
+  log->data = data;
+  log->length = length;
+  log->position = 4;
+  log->tick = 0;
+  
+  // Read the header
+  uint64_t width;
+  uint64_t height;
+  uint64_t seed;
+  if (length < 4 || memcmp(data, LOG_MAGIC, 4) != 0 || 
+      log_get_varint(log, &width) == -1 || log_get_varint(log, &height) == -1 || log_get_varint(log, &seed) == -1 || 
+      width < STARTING_LENGTH * 2 || height < STARTING_LENGTH * 2 || width > GRID_MAX_SIDE || height > GRID_MAX_SIDE || seed > UINT32_MAX) {
+    log_destroy(log);
+    return -1;
+  }
+  log->width = width;
+  log->height = height;
+  log->seed = seed;
+  log->records = log->position;
+  
+  // Run through every record once, so that playback can trust the log 
+  // from here on.  It must start with a keyframe on tick 0, so that there 
+  // is always one to seek back to, and finish with the end.
+  struct LogRecord record;
+  record.kind = LOG_RECORD_INPUT;
+  unsigned int first = 1;
+  while (record.kind != LOG_RECORD_END) {
+    if (log_read_record(log, &record) == -1 || (first && (record.kind != LOG_RECORD_KEYFRAME || record.tick != 0))) {
+      log_destroy(log);
+      return -1;
+    }
+    first = 0;
+  }
+  if (log->position != log->length) {
+    log_destroy(log);
+    return -1;
+  }
+  log->end_tick = record.tick;
+  
+  // Ready the first record for playback
+  log->position = log->records;
+  log->tick = 0;
+  log_read_record(log, &log->next);
+  
+  return 0;
+}
+
+signed int log_read_record(struct GameLog *log, struct LogRecord *record) {
+  // Read the next record of the log being played back into [record]
+  // A keyframe is skipped over, with only where to find it kept in [record].  
+  // Returns -1 if the record is not whole or not understood.
+  
+  uint64_t value;
+  if (log_get_varint(log, &value) == -1) {
+    return -1;
+  }
+  record->tick = log->tick + (value >> 3);
+  record->kind = value & 0x7;
+  
+  if (record->kind < LOG_RECORD_KEYFRAME) {
+    record->direction = record->kind;
+    record->kind = LOG_RECORD_INPUT;
+  } else if (record->kind == LOG_RECORD_KEYFRAME) {
+    if (log_get_varint(log, &value) == -1 || value > log->length - log->position) {
+      return -1;
+    }
+    record->position = log->position;
+    record->length = value;
+    log->position += value;
+  } else if (record->kind != LOG_RECORD_END) {
+    return -1;
+  }
+  
+  log->tick = record->tick;
+  return 0;
+}
+
+unsigned int log_play_tick(struct GameLog *log, unsigned long tick, struct Snake *snake) {
+  // Play back every record for tick [tick] onto [snake], just before it crawls
+  // Returns 1 if the log ends here, and the tick is not to be played.  
+  // Otherwise returns 0.
+  
+  while (log->next.tick == tick) {
+    if (log->next.kind == LOG_RECORD_END) {
+      return 1;
+    }
+    if (log->next.kind == LOG_RECORD_INPUT) {
+      // Set outright rather than steered.  It was only recorded if the 
+      // turn was allowed.
+      snake->new_direction = log->next.direction;
+    }
+    // The log was checked over when it was loaded, so this cannot fail
+    log_read_record(log, &log->next);
+  }
+  return 0;
+}
+
+signed int log_restore(struct GameLog *log, struct LogRecord *keyframe, struct Snake *snake, struct GridCell *food, unsigned long *game) {
+  // Set up the snake and food of a game from [keyframe], and find which game number it is
+  // Returns -1 if the keyframe does not make sense, such as a body that 
+  // leaves the Grid, breaks apart or crosses itself, or food under the 
+  // snake, or if the memory could not be allocated.
+  
+  unsigned long position = log->position;
+  unsigned long length = log->length;
+  log->position = keyframe->position;
+  log->length = keyframe->position + keyframe->length;
+  
+  // game, score, direction, pending growth, grow-by, food x + 1, food y + 1, 
+  // random state, length, head x, head y
+  uint64_t values[11];
+  signed int failed = 0;
+  for (unsigned int i = 0; i < 11 && !failed; i++) {
+    failed = (log_get_varint(log, &values[i]) == -1);
+  }
+  unsigned long links_position = log->position;
+  unsigned long links_length = log->length - log->position;
+  log->position = position;
+  log->length = length;
+  
+  unsigned int width = log->width;
+  unsigned int height = log->height;
+  if (failed || values[1] > UINT32_MAX || values[2] > DIR_RIGHT || values[3] > UINT32_MAX || values[4] > UINT32_MAX || 
+      values[5] > width || values[6] > height || (values[5] == 0) != (values[6] == 0) || 
+      values[8] < 2 || values[8] > width * height || (values[8] - 1 + 3) / 4 > links_length || 
+      values[9] >= width || values[10] >= height) {
+    return -1;
+  }
+  
+  snake->direction = values[2];
+  snake->new_direction = values[2];
+  snake->pending_growth = values[3];
+  snake->grow_by = values[4];
+  snake->random_state = values[7];
+  snake->score = values[1];
+  // Room for the snake as it is, or as much as a new game starts with
+  unsigned int capacity = (width * height < SNAKE_BODY_INITIAL_CAPACITY) ? width * height : SNAKE_BODY_INITIAL_CAPACITY;
+  if (capacity < values[8]) {
+    capacity = values[8];
+  }
+  if (snake_init_body(snake, capacity) == -1) {
+    return -1;
+  }
+  if (snake_init_grid_state(snake, width, height) == -1) {
+    snake_destroy(snake);
+    return -1;
+  }
+  
+  // Find the tail by following the links back from the head, then lay 
+  // the snake out from the tail up to the head
+  unsigned char *links = &log->data[links_position];
+  unsigned int link_count = values[8] - 1;
+  struct GridCell cell;
+  cell.x = values[9];
+  cell.y = values[10];
+  for (unsigned int i = 0; i < link_count; i++) {
+    grid_cell_step(snake, &cell, (links[i / 4] >> ((i % 4) * 2)) & 0x3);
+  }
+  // Every cell has to be on the Grid, next to the one laid out before it, 
+  // and on a space of its own, or the free set and the links would not 
+  // add up.  Each space is marked as it is taken, to catch the body 
+  // crossing itself.  snake_build_grid_state() clears the marks.
+  for (unsigned int i = link_count + 1; i > 0; i--) {
+    struct GridCell next = cell;
+    if (i <= link_count) {
+      unsigned int link = 1 << ((links[(i - 1) / 4] >> (((i - 1) % 4) * 2)) & 0x3);
+      grid_cell_step(snake, &next, __builtin_ctz(LINK_OPPOSITE(link)));
+      failed = (grid_cell_link(&cell, &next) != LINK_OPPOSITE(link));
+    }
+    if (failed || next.x < 0 || next.x >= (signed int)width || next.y < 0 || next.y >= (signed int)height || 
+        grid_reserve_space(snake, next.x, next.y) == -1 || *grid_space_links(snake, next.x, next.y) != 0) {
+      failed = 1;
+      break;
+    }
+    *grid_space_links(snake, next.x, next.y) = LINK_UP;
+    cell = next;
+    snake_push_head(snake, &cell);
+  }
+  if (failed || snake_build_grid_state(snake) == -1) {
+    snake_destroy(snake);
+    return -1;
+  }
+  
+  // The food cannot be under the snake either
+  struct GridCell food_cell;
+  food_cell.x = (signed int)values[5] - 1;
+  food_cell.y = (signed int)values[6] - 1;
+  if (food_cell.x >= 0 && *grid_space_links(snake, food_cell.x, food_cell.y) != 0) {
+    snake_destroy(snake);
+    return -1;
+  }
+  
+  *game = values[0];
+  *food = food_cell;
+  
+  return 0;
+}
+
+signed int log_seek(struct GameLog *log, unsigned long tick, struct Snake *snake, struct GridCell *food, unsigned long *game) {
+  // Set up the game as it was at the start of tick [tick], ready to play 
+  // back on from there
+  // This starts from the last keyframe at or before [tick], then plays 
+  // through to it as fast as possible.  [tick] must not be past the end 
+  // of the log.  Returns -1 if a keyframe does not make sense or the 
+  // memory could not be allocated.
+  
+  // Find the keyframe
+  struct LogRecord record;
+  struct LogRecord keyframe;
+  unsigned long after_keyframe = log->records;
+  log->position = log->records;
+  log->tick = 0;
+  while (1) {
+    log_read_record(log, &record);
+    if (record.tick > tick || record.kind == LOG_RECORD_END) {
+      break;
+    }
+    if (record.kind == LOG_RECORD_KEYFRAME) {
+      keyframe = record;
+      after_keyframe = log->position;
+    }
+  }
+  
+  // Play on from just after it
+  log->position = after_keyframe;
+  log->tick = keyframe.tick;
+  log_read_record(log, &log->next);
+  if (log_restore(log, &keyframe, snake, food, game) == -1) {
+    return -1;
+  }
+  
+  for (unsigned long t = keyframe.tick; t < tick; t++) {
+    log_play_tick(log, t, snake);
+    unsigned int collided = snake_crawl(snake, food);
+    if (collided == 2) {
+      return -1;
+    }
+    if (collided) {
+      // Game Over: Start the next game
+      (*game)++;
+      game_restart(snake, food, game_seed(log->seed, *game));
+    }
+  }
+  
+  return 0;
+}
+
+void log_destroy(struct GameLog *log) {
+  // Free all of the memory owned by a log that was played back
+  
+  free(log->data);
+  return;
+}
@@ -12,1024 +12,1586 @@
 #include <stdlib.h>
 #include <errno.h>
 #include <string.h>
-#include <poll.h>
 #include <termios.h>
 #include <signal.h>
-#include <semaphore.h>
 #include <unistd.h>
 #include <limits.h>
-#include <pthread.h>
-#include <sys/time.h>
+#include <stdint.h>
+#include <fcntl.h>
 #include <sys/ioctl.h>
+#include <sys/resource.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <sys/signalfd.h>
+#include "snake.h"
 
-#define STDIN 0
-#define STDOUT 1
-#define STDERR 2
+// What a headless run renders each tick
+#define HEADLESS_RENDER_NONE 0
+// Render the changes, just as the game would draw them
+#define HEADLESS_RENDER_CHANGES 1
+// Render the whole viewport every tick
+#define HEADLESS_RENDER_FULL 2
 
-#define DIR_UP 0
-#define DIR_DOWN 1
-#define DIR_LEFT 2
-#define DIR_RIGHT 3
+// How many buckets the tick lateness histogram has.  Bucket 0 counts ticks 
+// under 1us late, and bucket [b] those from 2^(b - 1)us up to 2^b us late.  
+// The last bucket also takes everything later than that.
+#define TICK_LATENESS_BUCKETS 24
 
-#define USIG_PAUSE (SIGRTMIN + 0)
-#define USIG_P_ACK (SIGRTMIN + 1)
+// How many bytes are read from the terminal at a time.  Everything typed 
+// since the last read is taken in one go, up to this much.
+#define INPUT_BURST_SIZE 64
 
-// START: Build-Time Configuration Definitions
-
-// What direction should the snake be pointing at start?
-#define STARTING_DIRECTION DIR_UP
-// How long should the snake be at the start?  This must be at least 2.
-#define STARTING_LENGTH 5
-// How many cells should be added to the snake when food is consumed?
-// If GROW_BY_INCREMENT is not 0, this will change after the first unit 
-// of food is consumed.
-#define STARTING_GROW_BY 2
-// What should be added to the "Grow By" rate after food is consumed?
-#define GROW_BY_INCREMENT 2
-// How long should the delay between ticks be in milliseconds?
-#define DELAY_TIME_MS 150
-
-// Border Cell: Vertical U+2503: ┃
-#define BORDER_VERTICAL(buffer_return, buffer_input) \
-  { \
-    buffer_return = buffer_input; \
-    *buffer_return = 0xE2; \
-    buffer_return++; \
-    *buffer_return = 0x94; \
-    buffer_return++; \
-    *buffer_return = 0x83; \
-    buffer_return++; \
-  }
-// Border Cell: Horizontal U+2501: ━
-#define BORDER_HORIZONTAL(buffer_return, buffer_input) \
-  { \
-    buffer_return = buffer_input; \
-    *buffer_return = 0xE2; \
-    buffer_return++; \
-    *buffer_return = 0x94; \
-    buffer_return++; \
-    *buffer_return = 0x81; \
-    buffer_return++; \
-  }
-// Border Cell: Top-Left Corner U+250F: ┏
-#define BORDER_CORNER_TOPLEFT(buffer_return, buffer_input) \
-  { \
-    buffer_return = buffer_input; \
-    *buffer_return = 0xE2; \
-    buffer_return++; \
-    *buffer_return = 0x94; \
-    buffer_return++; \
-    *buffer_return = 0x8F; \
-    buffer_return++; \
-  }
-// Border Cell: Top-Right Corner U+2513: ┓
-#define BORDER_CORNER_TOPRIGHT(buffer_return, buffer_input) \
-  { \
-    buffer_return = buffer_input; \
-    *buffer_return = 0xE2; \
-    buffer_return++; \
-    *buffer_return = 0x94; \
-    buffer_return++; \
-    *buffer_return = 0x93; \
-    buffer_return++; \
-  }
-// Border Cell: Bottom-Left Corner U+2517: ┗
-#define BORDER_CORNER_BOTTOMLEFT(buffer_return, buffer_input) \
-  { \
-    buffer_return = buffer_input; \
-    *buffer_return = 0xE2; \
-    buffer_return++; \
-    *buffer_return = 0x94; \
-    buffer_return++; \
-    *buffer_return = 0x97; \
-    buffer_return++; \
-  }
-// Border Cell: Bottom-Right Corner U+251B: ┛
-#define BORDER_CORNER_BOTTOMRIGHT(buffer_return, buffer_input) \
-  { \
-    buffer_return = buffer_input; \
-    *buffer_return = 0xE2; \
-    buffer_return++; \
-    *buffer_return = 0x94; \
-    buffer_return++; \
-    *buffer_return = 0x9B; \
-    buffer_return++; \
-  }
-
-// Snake Cell: Vertical U+2502: │
-#define SNAKE_CELL_TB(buffer_return, buffer_input) \
-  { \
-    buffer_return = buffer_input; \
-    *buffer_return = 0xE2; \
-    buffer_return++; \
-    *buffer_return = 0x94; \
-    buffer_return++; \
-    *buffer_return = 0x82; \
-    buffer_return++; \
-  }
-// Snake Cell: Horizontal U+2500: ─
-#define SNAKE_CELL_LR(buffer_return, buffer_input) \
-  { \
-    buffer_return = buffer_input; \
-    *buffer_return = 0xE2; \
-    buffer_return++; \
-    *buffer_return = 0x94; \
-    buffer_return++; \
-    *buffer_return = 0x80; \
-    buffer_return++; \
-  }
-// Snake Cell: Top-Left U+256F: ╯
-#define SNAKE_CELL_TL(buffer_return, buffer_input) \
-  { \
-    buffer_return = buffer_input; \
-    *buffer_return = 0xE2; \
-    buffer_return++; \
-    *buffer_return = 0x95; \
-    buffer_return++; \
-    *buffer_return = 0xAF; \
-    buffer_return++; \
-  }
-// Snake Cell: Top-Right U+2570: ╰
-#define SNAKE_CELL_TR(buffer_return, buffer_input) \
-  { \
-    buffer_return = buffer_input; \
-    *buffer_return = 0xE2; \
-    buffer_return++; \
-    *buffer_return = 0x95; \
-    buffer_return++; \
-    *buffer_return = 0xB0; \
-    buffer_return++; \
-  }
-// Snake Cell: Bottom-Left U+256E: ╮
-#define SNAKE_CELL_BL(buffer_return, buffer_input) \
-  { \
-    buffer_return = buffer_input; \
-    *buffer_return = 0xE2; \
-    buffer_return++; \
-    *buffer_return = 0x95; \
-    buffer_return++; \
-    *buffer_return = 0xAE; \
-    buffer_return++; \
-  }
-// Snake Cell: Bottom-Right U+256D: ╭
-#define SNAKE_CELL_BR(buffer_return, buffer_input) \
-  { \
-    buffer_return = buffer_input; \
-    *buffer_return = 0xE2; \
-    buffer_return++; \
-    *buffer_return = 0x95; \
-    buffer_return++; \
-    *buffer_return = 0xAD; \
-    buffer_return++; \
-  }
-
-#define FOOD_CELL(buffer_return, buffer_input) \
-  { \
-    buffer_return = buffer_input; \
-    *buffer_return = 0xE2; \
-    buffer_return++; \
-    *buffer_return = 0xAC; \
-    buffer_return++; \
-    *buffer_return = 0xA5; \
-    buffer_return++; \
-  }
-
-// Fallback Border: X
-#define FALLBACK_BORDER(buffer_return, buffer_input) \
-  { \
-    buffer_return = buffer_input; \
-    *buffer_return = 'X'; \
-    buffer_return++; \
-  }
-// Fallback Snake: +
-#define FALLBACK_SNAKE(buffer_return, buffer_input) \
-  { \
-    buffer_return = buffer_input; \
-    *buffer_return = '+'; \
-    buffer_return++; \
-  }
-// Fallback Food: F
-#define FALLBACK_FOOD_CELL(buffer_return, buffer_input) \
-  { \
-    buffer_return = buffer_input; \
-    *buffer_return = 'F'; \
-    buffer_return++; \
-  }
-
-// END: Build-Time Configuration Definitions
-
-unsigned int utf8_support = 1;
-unsigned int score;
 unsigned int not_paused;
-unsigned int curr_term_width;
-unsigned int curr_term_height;
+unsigned int game_over;
 unsigned int term_width;
 unsigned int term_height;
-unsigned int grid_width;
-unsigned int grid_height;
-sem_t sem0;
-sem_t sem1;
+unsigned int curr_term_width;
+unsigned int curr_term_height;
 
-struct Snake {
-  unsigned int new_direction;
-  unsigned int direction;
-  unsigned int length;
-  unsigned int grid_used_length;
-  unsigned int grow_by;
-  struct GridCell *cells;
+// Settings for a headless run, taken from the command line
+struct HeadlessOptions {
+  // The size of the Grid, and of the viewport onto it that is rendered
+  unsigned int width;
+  unsigned int height;
+  unsigned int viewport_width;
+  unsigned int viewport_height;
+  unsigned long ticks;
+  // Keys to press, one per tick, or NULL to press them at random
+  char *script;
+  unsigned long script_length;
+  // Set if [script] is instead a line of keys per tick, all pressed at 
+  // once, as read from the terminal in one go
+  unsigned int bursts;
+  // Set to have the autopilot steer instead of pressing any keys
+  unsigned int autopilot;
+  // HEADLESS_RENDER_*
+  unsigned int render;
+  // The log to play back from tick [seek] on instead of pressing keys, or NULL
+  struct GameLog *replay;
+  unsigned long seek;
+  // The log to record the run to, or NULL
+  struct GameLog *record;
+  // How many games to play at once as a batch (0 for just the one), or 
+  // how many snakes to play in an arena (0 for none), and how many 
+  // threads to play them with
+  unsigned int batch;
+  unsigned int arena;
+  unsigned int threads;
+  // Where to time the phases of every tick, or NULL not to
+  struct Profile *profile;
 };
 
-struct GridCell {
-  signed int x;
-  signed int y;
+// How far behind schedule the ticks of the game on the terminal started
+struct TickStats {
+  unsigned long ticks;
+  // Ticks that started after the next tick was already due, so were 
+  // run back to back with it to catch up
+  unsigned long late_ticks;
+  // Ticks never run, as the game fell more than TICK_CATCH_UP_LIMIT 
+  // ticks behind
+  unsigned long skipped_ticks;
+  unsigned long long lateness_total_ns;
+  unsigned long long lateness_max_ns;
+  unsigned long lateness_buckets[TICK_LATENESS_BUCKETS];
 };
 
-struct ThreadInfo {
+// The game being played on the terminal
+struct TerminalGame {
   struct Snake *snake;
   struct GridCell *food;
-  char *display_content;
+  // Drawn to by the render thread
+  struct Display *display;
+  // The logs being played back from and recorded to, or NULL
+  struct GameLog *replay;
+  struct GameLog *record;
+  // How many ticks have been played, and which game this is, for the logs
+  unsigned long tick;
+  unsigned long game;
+  struct TickStats tick_stats;
+  // A timerfd that is readable whenever ticks have come due, and the 
+  // deadline of the next tick to be played.  The timer is stopped while 
+  // the game is paused or over, so nothing wakes the event loop then.
+  signed int tick_fd;
+  struct timespec deadline;
+  // Keys read from the terminal, and the turns made with them that the 
+  // snake has not taken yet
+  struct KeyParser keys;
+  struct TurnQueue turns;
+  // Steers the snake in place of the keys, or NULL to leave it to them
+  struct Autopilot *autopilot;
+  // Where to time the phases of every tick, or NULL not to
+  struct Profile *profile;
+  // Where to trace what the event loop does, or NULL not to
+  struct TraceRing *trace;
+  // Streams every tick to spectators, or NULL not to
+  struct Spectate *spectate;
+  // The shared board the game is played on in step with other players, 
+  // or NULL to play alone.  The snake and food are its view of the board.
+  struct Multiplayer *multiplayer;
 };
 
-int sem_wai2(sem_t *sem);
-void signal_handle(signed int sig_number);
-signed int gen_random_number(signed int min, signed int max);
-void rand_food_location(struct GridCell *food, struct Snake *snake, unsigned int width, unsigned int height);
-void regen_buffer(char *buffer, struct Snake *snake, struct GridCell *food);
-void snake_append_cells(struct Snake *snake, unsigned int num_to_add);
-void snake_crawl(struct Snake *snake, struct GridCell *food);
-void* game_loop(void *thread_info);
-void* signal_receiver_thread(void *arg);
+void publish_frame(struct TerminalGame *game);
+void timespec_add_ns(struct timespec *time, unsigned long long ns);
+void tick_stats_record(struct TickStats *stats, unsigned long long lateness_ns);
+void print_tick_stats(struct TickStats *stats);
+void schedule_ticks(struct TerminalGame *game, unsigned int run);
+unsigned int play_tick(struct TerminalGame *game);
+unsigned int play_multiplayer_tick(struct TerminalGame *game);
+void play_due_ticks(struct TerminalGame *game);
+void end_game(struct TerminalGame *game);
+void toggle_pause(struct TerminalGame *game);
+void handle_resize(struct TerminalGame *game, signed int signal_fd);
+void read_keys(struct TerminalGame *game, unsigned int *quit);
+signed int terminal_display_init(struct Display *display, unsigned int view_width, unsigned int view_height);
+signed int terminal_setup(struct termios *old_tty_settings);
+void terminal_restore(struct termios *old_tty_settings);
+signed int read_script(const char *path, struct HeadlessOptions *options, unsigned int bursts);
+signed int run_headless(struct HeadlessOptions *options, unsigned int seed);
+signed int run_batch(struct HeadlessOptions *options, unsigned int seed);
+signed int run_arena(struct HeadlessOptions *options, unsigned int seed);
+signed int run_viewer(const char *path);
+void print_usage(const char *name);
 signed int main(signed int argc, char *argv[], char *envp[]);
 
-int sem_wai2(sem_t *sem) {
-  // Wrapper sem_wait() to force a retry in the event of failure code EINTR
+void publish_frame(struct TerminalGame *game) {
+  // Have the render thread draw the game as it is now: The Grid, or the 
+  // Pause Menu, or the Game Over screen once the game has ended
   
-  while (sem_wait(sem) == -1) {
-    if (errno != EINTR) {
-      return -1;
+  unsigned int mode = FRAME_PAUSED;
+  if        (game_over) {
+    mode = FRAME_GAME_OVER;
+  } else if (not_paused) {
+    mode = FRAME_GAME;
+  }
+  display_publish(game->display, mode, game->snake, game->food, curr_term_width, curr_term_height);
+  return;
+}
+
+void timespec_add_ns(struct timespec *time, unsigned long long ns) {
+  // Move [time] on by [ns] nanoseconds
+  
+  ns += time->tv_nsec;
+  time->tv_sec += ns / 1000000000ull;
+  time->tv_nsec = ns % 1000000000ull;
+  return;
+}
+
+void tick_stats_record(struct TickStats *stats, unsigned long long lateness_ns) {
+  // Count a tick that started [lateness_ns] nanoseconds after it was due
+  
+  unsigned long long lateness_us = lateness_ns / 1000;
+  unsigned int bucket = 0;
+  if (lateness_us > 0) {
+    bucket = 64 - __builtin_clzll(lateness_us);
+    if (bucket >= TICK_LATENESS_BUCKETS) {
+      bucket = TICK_LATENESS_BUCKETS - 1;
     }
   }
+  stats->lateness_buckets[bucket]++;
+  
+  stats->ticks++;
+  stats->lateness_total_ns += lateness_ns;
+  if (lateness_ns > stats->lateness_max_ns) {
+    stats->lateness_max_ns = lateness_ns;
+  }
+  if (lateness_ns >= DELAY_TIME_MS * 1000000ull) {
+    stats->late_ticks++;
+  }
+  
+  return;
+}
+
+void print_tick_stats(struct TickStats *stats) {
+  // Report how far behind schedule the ticks started on STDOUT
+  // Only the buckets of the histogram with ticks in are listed.
+  
+  dprintf(STDOUT, "ticks: %lu\n", stats->ticks);
+  dprintf(STDOUT, "late_ticks: %lu\n", stats->late_ticks);
+  dprintf(STDOUT, "skipped_ticks: %lu\n", stats->skipped_ticks);
+  dprintf(STDOUT, "lateness_mean_us: %.1f\n", stats->ticks ? (double)stats->lateness_total_ns / stats->ticks / 1000 : 0.0);
+  dprintf(STDOUT, "lateness_max_us: %.1f\n", (double)stats->lateness_max_ns / 1000);
+  for (unsigned int bucket = 0; bucket < TICK_LATENESS_BUCKETS; bucket++) {
+    if (stats->lateness_buckets[bucket] == 0) {
+      continue;
+    }
+    if (bucket == TICK_LATENESS_BUCKETS - 1) {
+      dprintf(STDOUT, "lateness_over_%luus: %lu\n", 1ul << (bucket - 1), stats->lateness_buckets[bucket]);
+    } else {
+      dprintf(STDOUT, "lateness_under_%luus: %lu\n", 1ul << bucket, stats->lateness_buckets[bucket]);
+    }
+  }
+  
+  return;
+}
+
+void schedule_ticks(struct TerminalGame *game, unsigned int run) {
+  // Start the ticks going, with the first one due straight away, or stop them
+  // Each tick is due a whole number of periods after the first, measured 
+  // on a clock that is never stepped.  The timer keeps to those deadlines 
+  // itself, so the time spent on each tick does not add up over the game.  
+  // In a multiplayer game, the first is instead due when the next tick of 
+  // the board is, so that every player keeps to the same schedule and no 
+  // one is kept waiting at the tick barrier for long.
+  
+  struct itimerspec timer;
+  memset(&timer, 0, sizeof(timer));
+  if (run) {
+    if (game->multiplayer != NULL) {
+      multiplayer_next_deadline(game->multiplayer, &game->deadline);
+    } else {
+      clock_gettime(CLOCK_MONOTONIC, &game->deadline);
+    }
+    timer.it_value = game->deadline;
+    timer.it_interval.tv_sec = DELAY_TIME_MS / 1000;
+    timer.it_interval.tv_nsec = (DELAY_TIME_MS % 1000) * 1000000;
+  }
+  timerfd_settime(game->tick_fd, TFD_TIMER_ABSTIME, &timer, NULL);
+  
+  return;
+}
+
+unsigned int play_tick(struct TerminalGame *game) {
+  // Play one tick of the game and draw it
+  // Returns 1 if the game has ended, either by the snake running into 
+  // itself (or out of memory to crawl on with) or by the recording running 
+  // out.  Otherwise returns 0.
+  
+  if (game->multiplayer != NULL) {
+    return play_multiplayer_tick(game);
+  }
+  
+  // Take the next turn queued up, or the autopilot's, then play back or 
+  // record the turn made this tick
+  if        (game->autopilot != NULL) {
+    autopilot_steer(game->autopilot, game->snake, game->food);
+  } else if (game->replay == NULL) {
+    snake_take_turn(game->snake, &game->turns);
+  }
+  if (game->replay != NULL && log_play_tick(game->replay, game->tick, game->snake)) {
+    // The recording has run out.  End the game here.
+    return 1;
+  }
+  if (game->record != NULL) {
+    log_write_tick(game->record, game->tick, game->game, game->snake, game->food);
+  }
+  // Count the tick even if the snake runs into itself, so that a 
+  // recording plays back up to and including that
+  game->tick++;
+  struct Profile *profile = game->profile;
+  struct timespec phase_start;
+  if (profile != NULL) {
+    clock_gettime(CLOCK_MONOTONIC, &phase_start);
+  }
+  unsigned int collided = snake_crawl(game->snake, game->food);
+  if (profile != NULL) {
+    profile_record_since(profile, PROFILE_CRAWL, &phase_start);
+  }
+  if (collided) {
+    // The snake ran into itself
+    return 1;
+  }
+  
+  if (game->spectate != NULL) {
+    if (profile != NULL) {
+      clock_gettime(CLOCK_MONOTONIC, &phase_start);
+    }
+    spectate_tick(game->spectate, game->snake, game->food);
+    if (profile != NULL) {
+      profile_record_since(profile, PROFILE_SPECTATE, &phase_start);
+    }
+  }
+  
+  if (profile != NULL) {
+    clock_gettime(CLOCK_MONOTONIC, &phase_start);
+  }
+  publish_frame(game);
+  if (profile != NULL) {
+    profile_record_since(profile, PROFILE_PUBLISH, &phase_start);
+  }
+  
   return 0;
 }
 
-void signal_handle(signed int sig_number) {
-  // Signal Handler
-  int errno_backup = errno; // Save errno from interrupted thread context.
+unsigned int play_multiplayer_tick(struct TerminalGame *game) {
+  // Play one tick of a multiplayer game, in step with the other players, and draw it
+  // The tick is played on the board by whichever player reaches the tick 
+  // barrier last, with the turns every player has handed over by then.  
+  // Returns 1 if the snake is out, or this player has been dropped for 
+  // holding up the rest.  Otherwise returns 0.
   
-  if        (sig_number == SIGWINCH) {
-    // Running in execution context of child thread: Signal Listener
-    // Terminal Resize Event
-    
-    pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
-    sem_wai2(&sem1);
-    
-    // Get the terminal size
-    struct winsize term_size;
-    ioctl(STDOUT, TIOCGWINSZ, &term_size);
-    // TODO: Consider checking ioctl return value
-    curr_term_width = term_size.ws_col;
-    curr_term_height = term_size.ws_row;
-    
-    if (term_width != curr_term_width || term_height != curr_term_height) {
-      // Pause the game
-      
-      // Nothing to pause if already paused
-      if (not_paused) {
-        kill(0, USIG_PAUSE); // Dispatch Pause signal to Game Loop thread
-        
-        sigset_t wait_signal;
-        sigemptyset(&wait_signal);
-        sigaddset(&wait_signal, USIG_P_ACK);
-        sigwaitinfo(&wait_signal, NULL);
-        
-        not_paused = 0;
-      }
+  struct Multiplayer *multiplayer = game->multiplayer;
+  struct Profile *profile = game->profile;
+  struct timespec phase_start;
+  
+  // The autopilot steers the view, and hands over whatever turn that makes
+  if (game->autopilot != NULL) {
+    autopilot_steer(game->autopilot, game->snake, game->food);
+    if (game->snake->new_direction != game->snake->direction) {
+      multiplayer_push_turn(multiplayer, game->snake->new_direction);
     }
+  }
+  
+  if (profile != NULL) {
+    clock_gettime(CLOCK_MONOTONIC, &phase_start);
+  }
+  unsigned int out = multiplayer_arrive(multiplayer);
+  if (profile != NULL) {
+    profile_record_since(profile, PROFILE_BARRIER, &phase_start);
+  }
+  game->tick = multiplayer->board->tick;
+  if (out) {
+    return 1;
+  }
+  
+  if (profile != NULL) {
+    clock_gettime(CLOCK_MONOTONIC, &phase_start);
+  }
+  publish_frame(game);
+  if (profile != NULL) {
+    profile_record_since(profile, PROFILE_PUBLISH, &phase_start);
+  }
+  
+  return 0;
+}
+
+void play_due_ticks(struct TerminalGame *game) {
+  // Play the ticks that have come due since the tick timer last fired
+  // Up to TICK_CATCH_UP_LIMIT late ticks are played back to back to get 
+  // back on schedule.  Past that, all but the latest are skipped.
+  
+  unsigned long long tick_period_ns = DELAY_TIME_MS * 1000000ull;
+  struct TickStats *stats = &game->tick_stats;
+  
+  uint64_t due;
+  if (read(game->tick_fd, &due, sizeof(due)) != sizeof(due)) {
+    // Nothing is due after all.  The timer was stopped or restarted 
+    // since it was found to be readable.
+    return;
+  }
+  if (due > TICK_CATCH_UP_LIMIT) {
+    if (game->trace != NULL) {
+      trace_event(game->trace, 'i', "skip", trace_now(game->trace), 0, due - 1);
+    }
+    stats->skipped_ticks += due - 1;
+    timespec_add_ns(&game->deadline, (due - 1) * tick_period_ns);
+    due = 1;
+  }
+  
+  for (; due > 0; due--) {
+    // How late is this tick?
+    // Wrapping arithmetic: This is negative if the tick is early, which 
+    // it cannot be once the timer has fired.  Count it as on time.
+    struct timespec tick_start;
+    clock_gettime(CLOCK_MONOTONIC, &tick_start);
+    uint64_t trace_start = (game->trace != NULL) ? elapsed_ns(game->trace->start, &tick_start) : 0;
+    signed long long lateness_ns = (signed long long)elapsed_ns(&game->deadline, &tick_start);
+    tick_stats_record(stats, (lateness_ns > 0) ? lateness_ns : 0);
+    timespec_add_ns(&game->deadline, tick_period_ns);
     
-    // Clear the terminal
-    // Clear the scrollback buffer
-    // Reset the terminal cursor position to the top left
-    dprintf(STDOUT, "\e[1;1H\e[0J\e[2J\e[3J\e[1;1H");
-    
-    dprintf(STDOUT, "Game Paused\n\r");
-    dprintf(STDOUT, "Press E to unpause\n\r");
-    dprintf(STDOUT, "Press Q to quit\n\r");
-    dprintf(STDOUT, "Press M to leave the current game and return to the menu (Not Implemented)\n\r");
-    dprintf(STDOUT, "Current Score: %d\n\r", score);
-    dprintf(STDOUT, "Expected terminal size for current game: %dx%d\n\r", term_width, term_height);
-    dprintf(STDOUT, "Current terminal size: %dx%d\n\r", curr_term_width, curr_term_height);
-    dprintf(STDOUT, "The terminal size must match the expected size before unpause will be allowed.\r");
-    
-    sem_post(&sem1);
-    pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, NULL);
-  } else if (sig_number == USIG_PAUSE) {
-    // Running in execution context of child thread: Game Loop
-    // Pause Event
-    // The entirety of this execution pathway from function call to return 
-    //   occurs in a state of enabled pthread thread cancellability.
-    
-    // Inform the other thread that pause has been received 
-    // and is now being handled.  The other thread can now 
-    // take over display drawing until unpaused.
-    kill(0, USIG_P_ACK);
-    
-    // Wait for unpause (Another USIG_PAUSE signal)
-    sigset_t wait_signal;
-    sigemptyset(&wait_signal);
-    sigaddset(&wait_signal, USIG_PAUSE);
-    sigwaitinfo(&wait_signal, NULL);
+    unsigned int ended = play_tick(game);
+    if (game->profile != NULL) {
+      profile_record_since(game->profile, PROFILE_TICK, &tick_start);
+    }
+    if (game->trace != NULL) {
+      trace_span(game->trace, "tick", trace_start, game->tick);
+    }
+    if (ended) {
+      end_game(game);
+      return;
+    }
   }
   
-  errno = errno_backup; // Restore errno from interrupted thread context.
   return;
 }
 
-signed int gen_random_number(signed int min, signed int max) {
-  // Find a random integer somewhere from [min] through [max]
+void end_game(struct TerminalGame *game) {
+  // Stop the game for good and show the Game Over screen from now on
   
-  if (min > max) {
-    return 0;
+  if (game->trace != NULL) {
+    trace_event(game->trace, 'i', "game_over", trace_now(game->trace), 0, game->tick);
+  }
+  game_over = 1;
+  not_paused = 0;
+  schedule_ticks(game, 0);
+  if (game->multiplayer != NULL) {
+    // The rest play on without this player
+    multiplayer_leave(game->multiplayer);
+  }
+  publish_frame(game);
+  if (game->spectate != NULL) {
+    spectate_end(game->spectate);
+  }
+  return;
+}
+
+void toggle_pause(struct TerminalGame *game) {
+  // Pause the game, or unpause it if it is paused
+  // A multiplayer game plays on for everyone else, so it is only paused 
+  // to show the Pause Menu while the Grid does not fit the terminal.
+  
+  // A finished game cannot be unpaused, and neither can one that no 
+  // longer fits the terminal
+  if (game_over || term_width != curr_term_width || term_height != curr_term_height || 
+      (game->multiplayer != NULL && not_paused)) {
+    return;
   }
-  unsigned int length = (max - min) + 1;
-  return min + (rand() % length);
+  
+  if (game->trace != NULL) {
+    trace_event(game->trace, 'i', not_paused ? "pause" : "unpause", trace_now(game->trace), 0, game->tick);
+  }
+  if (not_paused) {
+    not_paused = 0;
+    schedule_ticks(game, 0);
+    publish_frame(game);
+  } else {
+    // The render thread draws the Grid back in full over the Pause Menu.  
+    // The schedule starts over, as the ticks missed while paused were never due.
+    not_paused = 1;
+    publish_frame(game);
+    if (game->multiplayer == NULL) {
+      schedule_ticks(game, 1);
+    }
+  }
+  
+  return;
 }
 
-void rand_food_location(struct GridCell *food, struct Snake *snake, unsigned int width, unsigned int height) {
-  // Generate a new random food location and assign it to the struct pointed at by [food]
-  
-  // How many Grid spaces are there?
-  unsigned int the_grid_space = (width * height);
-  // Subtract the Grid spaces used by the used snake length to get a count of spaces empty
-  the_grid_space -= snake->grid_used_length;
-  // Find a random Grid index within those spaces that are empty
-  the_grid_space = gen_random_number(0, the_grid_space - 1);
-  
-  // Walk through all Grid spaces from index 0 to the space chosen at random.
-  // For each space that is occupied by a snake cell, increment the index of 
-  // the chosen space. This has the effect of translating the index of an empty 
-  // Grid space of the empty Grid spaces, to an index of an empty Grid 
-  // space within the entirety of all of the Grid spaces.
-  // 
-  // Example: 
-  // Suppose that we chose index: 1 (The 2nd empty Grid space).
-  // This is the status of the beginning of the first line of the 
-  // grid ('+' is a snake cell and '_' is an empty space): "_+_" .
-  //                                              Indexes:  012
-  // 
-  // In this case, this procedure should convert the index: 1 to the 
-  // index: 2 (The index on the Grid of the 2nd empty Grid space).
-  unsigned int i = 0;
-  for (unsigned int y = 0; y < height; y++) {
-    for (unsigned int x = 0; x < width; x++) {
-      // Iterate through the snake to check if any cells occupy the space
-      for (unsigned int j = 0; j < snake->length; j++) {
-        if (snake->cells[j].x == (signed int)x && snake->cells[j].y == (signed int)y) {
-          the_grid_space++;
-          // Break the loop because it is possible for a snake to have 
-          // several cells on the same x, y coordinate.  However, we only 
-          // want to count one overlap per x, y location.
-          // 
-          // Since we have incremented the chosen index, it is not possible for us 
-          // to have reached the chosen index yet. Therefore, we can skip that check 
-          // on this pass.
-          goto continue_grid_loop;
-        }
-      }
-      
-      // Have we reached the randomly chosen empty grid space?
-      if (i == the_grid_space) {
-        // Derive the x and y coordinates of that space on the grid and 
-        // assign them to the food.  
-        food->x = the_grid_space % width;
-        food->y = the_grid_space / width;
-        // We have finished generating a new food location.
-        return;
+void handle_resize(struct TerminalGame *game, signed int signal_fd) {
+  // Respond to the terminal being resized (SIGWINCH, read from [signal_fd])
+  // The game is paused if the Grid no longer fits the terminal.
+  
+  // Several resizes may have been merged into one.  Only the latest size matters.
+  struct signalfd_siginfo info;
+  while (read(signal_fd, &info, sizeof(info)) == sizeof(info)) {
+  }
+  
+  // Get the terminal size
+  struct winsize term_size;
+  ioctl(STDOUT, TIOCGWINSZ, &term_size);
+  // TODO: Consider checking ioctl return value
+  curr_term_width = term_size.ws_col;
+  curr_term_height = term_size.ws_row;
+  if (game->trace != NULL) {
+    trace_event(game->trace, 'i', "resize", trace_now(game->trace), 0, curr_term_width * 1000ul + curr_term_height);
+  }
+  
+  // The ticks of a multiplayer game go on regardless, or the other 
+  // players would drop this one
+  if (not_paused && (term_width != curr_term_width || term_height != curr_term_height)) {
+    not_paused = 0;
+    if (game->multiplayer == NULL) {
+      schedule_ticks(game, 0);
+    }
+  }
+  
+  if (not_paused) {
+    // Still playing, but the terminal may have redrawn itself differently
+    display_redraw(game->display);
+  } else {
+    publish_frame(game);
+  }
+  
+  return;
+}
+
+void read_keys(struct TerminalGame *game, unsigned int *quit) {
+  // Take in everything typed on the terminal since the last read
+  // Turns are queued up for the ticks to take, rather than made straight 
+  // away, so that none are lost when several come within one tick.  
+  // Sets [quit] if Q was pressed.
+  
+  unsigned char bytes[INPUT_BURST_SIZE];
+  ssize_t length = read(STDIN, bytes, sizeof(bytes));
+  for (ssize_t i = 0; i < length && !*quit; i++) {
+    signed int key = key_parse(&game->keys, bytes[i]);
+    signed int direction = key_direction(key);
+    if        (key == 'q' || key == 'Q') {
+      *quit = 1;
+    } else if (key == 'e' || key == 'E') {
+      toggle_pause(game);
+    } else if (direction != -1 && not_paused && game->replay == NULL && game->autopilot == NULL) {
+      // Game input should not be accepted if the game is paused, or 
+      // if the moves are coming from a recording or the autopilot.  In a 
+      // multiplayer game, the turns are handed straight over to the tick.
+      if (game->multiplayer != NULL) {
+        multiplayer_push_turn(game->multiplayer, direction);
+      } else {
+        turn_queue_push(&game->turns, direction);
       }
-      
-      continue_grid_loop:
-      i++;
     }
   }
   
-  // Should be unreachable
-  food->x = -1;
-  food->y = -1;
+  // Turn the head now if the snake is not already turning this tick.  
+  // Regenerating and Redrawing the display is not necessary if UTF-8 is off because 
+  // the snake doesn't change with basic ASCII encoding in the event of altered 
+  // new_direction settings.  This will help with display performance if running 
+  // through an actual COM port, such as an RS232 or UART, with UTF-8 off.  
+  // Only the tick can turn the snake of a multiplayer game.
+  if (not_paused && game->replay == NULL && game->autopilot == NULL && game->multiplayer == NULL) {
+    unsigned int new_direction = game->snake->new_direction;
+    snake_take_turn(game->snake, &game->turns);
+    if (utf8_support && game->snake->new_direction != new_direction) {
+      publish_frame(game);
+    }
+  }
+  
   return;
 }
 
-void regen_buffer(char *buffer, struct Snake *snake, struct GridCell *food) {
-  // Render the Grid into the Buffer
+signed int terminal_display_init(struct Display *display, unsigned int view_width, unsigned int view_height) {
+  // Set up a Display of a [view_width] by [view_height] viewport, to be 
+  // drawn on the terminal
+  // The render thread writes to the terminal through a file description 
+  // of its own, so that it alone is non-blocking.  STDIN and STDOUT share 
+  // theirs with the shell.  Returns -1 if the terminal could not be 
+  // opened, or -2 if the memory for it could not be allocated.
+  
+  const char *tty_path = ttyname(STDOUT);
+  signed int output_fd = -1;
+  if (tty_path != NULL) {
+    output_fd = open(tty_path, O_WRONLY | O_NONBLOCK | O_NOCTTY | O_CLOEXEC);
+  }
+  if (output_fd == -1) {
+    return -1;
+  }
+  if (display_init(display, view_width, view_height, output_fd) == -1) {
+    return -2;
+  }
+  display->term_width = term_width;
+  display->term_height = term_height;
   
-  // Render Line 1 with the Score Count
+  return 0;
+}
+
+signed int terminal_setup(struct termios *old_tty_settings) {
+  // Put the terminal in raw mode, keeping the settings it had in 
+  // [old_tty_settings], then hide the cursor and clear it
+  // Returns -1 if the settings could not be read, or -2 if they could 
+  // not be changed.
+  
+  // Set TTY to Raw mode
   {
-    char format_string[24];
-    snprintf(format_string, 24, "Score: %%-%dd", term_width - 7);
-    snprintf(buffer, term_width + 1, format_string, score);
-    buffer += strlen(buffer);
-#ifndef NOEXPLICITNEWLINES
-    *buffer = '\n';
-    buffer++;
-    *buffer = '\r';
-    buffer++;
-#endif
-  }
-  
-  // Render Top Grid Border
-  if (utf8_support) {
-    BORDER_CORNER_TOPLEFT(buffer, buffer);
-    for (unsigned int x = 0; x < grid_width; x++) {
-      BORDER_HORIZONTAL(buffer, buffer);
-    }
-    BORDER_CORNER_TOPRIGHT(buffer, buffer);
+    struct termios raw_tty_settings;
+    signed int retval;
+    retval = ioctl(STDOUT, TCGETS, old_tty_settings);
+    if (retval == -1) {
+      return -1;
+    }
+    memcpy(&raw_tty_settings, old_tty_settings, sizeof(struct termios));
+    raw_tty_settings.c_iflag &= ~(IGNBRK | BRKINT | PARMRK | ISTRIP | INLCR | IGNCR | ICRNL | IXON);
+    raw_tty_settings.c_oflag &= ~OPOST;
+    raw_tty_settings.c_lflag &= ~(ECHO | ECHONL | ICANON | ISIG | IEXTEN);
+    raw_tty_settings.c_cflag &= ~(CSIZE | PARENB);
+    raw_tty_settings.c_cflag |= CS8;
+    retval = ioctl(STDOUT, TCSETS, &raw_tty_settings);
+    if (retval == -1) {
+      return -2;
+    }
+  }
+  
+  // Disable the cursor
+  dprintf(STDOUT, "\e[?25l");
+  
+  // Clear the terminal
+  // Clear the scrollback buffer
+  // Reset the terminal cursor position to the top left
+  dprintf(STDOUT, "\e[1;1H\e[0J\e[2J\e[3J\e[1;1H");
+  
+  return 0;
+}
+
+void terminal_restore(struct termios *old_tty_settings) {
+  // Put the terminal back as terminal_setup() found it
+  
+  // Enable the cursor
+  dprintf(STDOUT, "\e[?25h");
+  
+  // Restore the TTY to the original mode
+  ioctl(STDOUT, TCSETS, old_tty_settings);
+  return;
+}
+
+signed int read_script(const char *path, struct HeadlessOptions *options, unsigned int bursts) {
+  // Load the keys for a headless run from the file at [path]
+  // Line breaks are dropped, so that a script can be split over many lines, 
+  // unless [bursts] is set.  Then they end the keys of each tick.  
+  // Returns -1 if the file could not be read.
+  
+  FILE *file = fopen(path, "rb");
+  if (file == NULL) {
+    return -1;
+  }
+  
+  unsigned long capacity = 4096;
+  unsigned long length = 0;
+  char *script = malloc(capacity);
+  signed int c;
+  while (script != NULL && (c = fgetc(file)) != EOF) {
+    if ((c == '\n' || c == '\r') && !bursts) {
+      continue;
+    }
+    if (length == capacity) {
+      capacity *= 2;
+      char *grown = realloc(script, capacity);
+      if (grown == NULL) {
+        free(script);
+        script = NULL;
+        break;
+      }
+      script = grown;
+    }
+    script[length] = c;
+    length++;
+  }
+  
+  signed int failed = (script == NULL || ferror(file));
+  fclose(file);
+  if (failed) {
+    free(script);
+    return -1;
+  }
+  
+  options->script = script;
+  options->script_length = length;
+  options->bursts = bursts;
+  return 0;
+}
+
+signed int run_headless(struct HeadlessOptions *options, unsigned int seed) {
+  // Play the game with no terminal for [options->ticks] ticks, as fast as 
+  // it will go, then report how fast that was on STDOUT
+  // Every Game Over starts a new game straight away.  When playing back a 
+  // log, [seed] must be the one it was recorded with.  Returns -1 if the 
+  // memory for it could not be allocated, or -2 if the log cannot be played back.  
+  // Only a viewport onto the Grid is rendered, so a huge Grid renders no 
+  // slower than a small one.
+  
+  struct Snake snake;
+  struct GridCell food;
+  unsigned long game = 0;
+  unsigned long first_tick = 0;
+  if (options->replay != NULL) {
+    first_tick = options->seek;
+    if (log_seek(options->replay, first_tick, &snake, &food, &game) == -1) {
+      return -2;
+    }
   } else {
-    for (unsigned int x = 0; x < term_width; x++) {
-      FALLBACK_BORDER(buffer, buffer);
+    if (game_init(&snake, &food, options->width, options->height, game_seed(seed, game)) == -1) {
+      return -1;
     }
   }
-#ifndef NOEXPLICITNEWLINES
-  *buffer = '\n';
-  buffer++;
-  *buffer = '\r';
-  buffer++;
-#endif
+  struct Profile *profile = options->profile;
+  snake.profile = profile;
   
-  unsigned int snake_length = snake->length;
+  // Rendering goes into a buffer that is never sent anywhere
+  struct Screen screen;
+  char *display_content = NULL;
+  if (options->render != HEADLESS_RENDER_NONE) {
+    display_content = malloc((options->viewport_width + 3) * (options->viewport_height + 3) * sizeof(char) * 4);
+    if (display_content == NULL || screen_init(&screen, options->viewport_width, options->viewport_height) == -1) {
+      free(display_content);
+      snake_destroy(&snake);
+      return -1;
+    }
+  }
   
-  for (unsigned int y = 0; y < grid_height; y++) {
-    
-    // Render a Vertical Element of the Left Grid Border
-    if (utf8_support) {
-      BORDER_VERTICAL(buffer, buffer);
-    } else {
-      FALLBACK_BORDER(buffer, buffer);
+  // The autopilot keeps its scratch space from one decision to the next
+  struct Autopilot autopilot;
+  if (options->autopilot) {
+    if (autopilot_init(&autopilot) == -1) {
+      if (options->render != HEADLESS_RENDER_NONE) {
+        screen_destroy(&screen);
+      }
+      free(display_content);
+      snake_destroy(&snake);
+      return -1;
+    }
+    autopilot.profile = profile;
+  }
+  
+  // Random key presses come from their own generator (xorshift32), so the 
+  // food lands in the same places for a given seed whichever keys are used
+  uint32_t key_state = (seed * 2654435761u) | 1;
+  // Scripted bursts of keys go through the same parsing and queueing as 
+  // keys read from the terminal
+  struct KeyParser keys;
+  struct TurnQueue turns;
+  unsigned long burst_position = 0;
+  keys.state = 0;
+  turn_queue_init(&turns);
+  
+  unsigned long games = 1;
+  unsigned int best_score = 0;
+  unsigned long long render_bytes = 0;
+  // Time spent in each phase of the sampled ticks: Input, Crawl, New Game, 
+  // and Render
+  unsigned long samples = 0;
+  unsigned long long phase_ns[4] = {0, 0, 0, 0};
+  
+  // Every phase timed also includes the time to read the clock once.  
+  // Find out how long that takes, so that it can be taken back out.
+  unsigned long long clock_ns = ULLONG_MAX;
+  for (unsigned int i = 0; i < 1000; i++) {
+    struct timespec clock_start;
+    struct timespec clock_end;
+    clock_gettime(CLOCK_MONOTONIC, &clock_start);
+    clock_gettime(CLOCK_MONOTONIC, &clock_end);
+    if (elapsed_ns(&clock_start, &clock_end) < clock_ns) {
+      clock_ns = elapsed_ns(&clock_start, &clock_end);
+    }
+  }
+  
+  struct timespec run_start;
+  clock_gettime(CLOCK_MONOTONIC, &run_start);
+  
+  for (unsigned long tick = first_tick; tick < first_tick + options->ticks; tick++) {
+    // Every tick is timed if there is a Profile to time them into
+    unsigned int sampled = (tick % HEADLESS_SAMPLE_INTERVAL == 0 || profile != NULL);
+    struct timespec phase_start[5];
+    if (sampled) {
+      clock_gettime(CLOCK_MONOTONIC, &phase_start[0]);
     }
     
-    for (unsigned int x = 0; x < grid_width; x++) {
-      // Is this a Snake Cell?
-      for (unsigned int i = 0; i < snake_length; i++) {
-        if (snake->cells[i].x == (signed int)x && snake->cells[i].y == (signed int)y) {
-          // Regen Snake Cell
-          if (utf8_support) {
-            // TODO: Clean this up.  This solution is nasty.
-            
-            if (i == 0) { // Collapse this decision tree for easier readability in your editor
-              // Head Of Snake
-              
-              // Select the correct arrow
-              if (snake->cells[1].x == (signed int)x) {
-                if (snake->cells[1].y > (signed int)y) {
-                  if (snake->cells[1].y - 1 != (signed int)y) {
-                    // Wrapping has occurred.  Treat as opposite direction.
-                    goto render_head_from_top;
-                  }
-                  // From Bottom
-                  render_head_from_bottom:
-                  
-                  if        (snake->new_direction == DIR_LEFT) {
-                    // Arrow Bottom to Left
-                    SNAKE_CELL_BL(buffer, buffer);
-                  } else if (snake->new_direction == DIR_RIGHT) {
-                    // Arrow Bottom to Right
-                    SNAKE_CELL_BR(buffer, buffer);
-                  } else {
-                    // Arrow Bottom to Top
-                    SNAKE_CELL_TB(buffer, buffer);
-                  }
-                } else {
-                  if (snake->cells[1].y + 1 != (signed int)y) {
-                    // Wrapping has occurred.  Treat as opposite direction.
-                    goto render_head_from_bottom;
-                  }
-                  // From Top
-                  render_head_from_top:
-                  
-                  if        (snake->new_direction == DIR_LEFT) {
-                    // Arrow Top to Left
-                    SNAKE_CELL_TL(buffer, buffer);
-                  } else if (snake->new_direction == DIR_RIGHT) {
-                    // Arrow Top to Right
-                    SNAKE_CELL_TR(buffer, buffer);
-                  } else {
-                    // Arrow Top to Bottom
-                    SNAKE_CELL_TB(buffer, buffer);
-                  }
-                }
-              } else {
-                if (snake->cells[1].x > (signed int)x) {
-                  if (snake->cells[1].x - 1 != (signed int)x) {
-                    // Wrapping has occurred.  Treat as opposite direction.
-                    goto render_head_from_left;
-                  }
-                  // From Right
-                  render_head_from_right:
-                  
-                  if        (snake->new_direction == DIR_UP) {
-                    // Arrow Right to Top
-                    SNAKE_CELL_TR(buffer, buffer);
-                  } else if (snake->new_direction == DIR_DOWN) {
-                    // Arrow Right to Down
-                    SNAKE_CELL_BR(buffer, buffer);
-                  } else {
-                    // Arrow Right to Left
-                    SNAKE_CELL_LR(buffer, buffer);
-                  }
-                } else {
-                  if (snake->cells[1].x + 1 != (signed int)x) {
-                    // Wrapping has occurred.  Treat as opposite direction.
-                    goto render_head_from_right;
-                  }
-                  // From Left
-                  render_head_from_left:
-                  
-                  if        (snake->new_direction == DIR_UP) {
-                    // Arrow Left to Top
-                    SNAKE_CELL_TL(buffer, buffer);
-                  } else if (snake->new_direction == DIR_DOWN) {
-                    // Arrow Left to Down
-                    SNAKE_CELL_BL(buffer, buffer);
-                  } else {
-                    // Arrow Left to Right
-                    SNAKE_CELL_LR(buffer, buffer);
-                  }
-                }
-              }
-            } else if (i == snake->length - 1) {
-              // Tail of the Snake
-              render_snake_tail:
-              
-              // Which direction is the previous cell?
-              if (snake->cells[i].x != snake->cells[i - 1].x) {
-                // Tail is Horizontal
-                SNAKE_CELL_LR(buffer, buffer);
-              } else {
-                // Tail is Vertical
-                SNAKE_CELL_TB(buffer, buffer);
-              }
-            } else {
-              if (snake->cells[i].x == snake->cells[i + 1].x && snake->cells[i].y == snake->cells[i + 1].y) {
-                // Snake is not yet fully extended from an earlier growth, but 
-                // this is the last effective cell.  Treat it as the last cell 
-                // by jumping into the code to handle that case.
-                goto render_snake_tail;
-              }
-              // Middle Cell of the Snake
-              
-              // Which direction is the Previous Cell?
-              if (snake->cells[i].x > snake->cells[i - 1].x) {
-                if (snake->cells[i].x - 1 != snake->cells[i - 1].x) {
-                  // Wrapping has occurred.  Treat as opposite direction.
-                  goto render_middle_from_right;
-                }
-                // Previous Cell is to the Left
-                render_middle_from_left:
-                
-                // Which direction is the Next Cell?
-                // Use Not Equals to ensure that this still runs even if the snake is wrapping
-                if (snake->cells[i].x != snake->cells[i + 1].x) {
-                  // Next Cell is to the Right
-                  SNAKE_CELL_LR(buffer, buffer);
-                } else {
-                  // Next Cell is on the vertical axis
-                  
-                  // Is the Next Cell Up or Down?
-                  if (snake->cells[i].y > snake->cells[i + 1].y) {
-                    if (snake->cells[i].y - 1 != snake->cells[i + 1].y) {
-                      // Wrapping has occurred.  Treat as opposite direction.
-                      goto render_middle_from_left_to_bottom;
-                    }
-                    // Next Cell is to the Top
-                    render_middle_from_left_to_top:
-                    SNAKE_CELL_TL(buffer, buffer);
-                  } else {
-                    if (snake->cells[i].y + 1 != snake->cells[i + 1].y) {
-                      // Wrapping has occurred.  Treat as opposite direction.
-                      goto render_middle_from_left_to_top;
-                    }
-                    // Next Cell is to the Bottom
-                    render_middle_from_left_to_bottom:
-                    SNAKE_CELL_BL(buffer, buffer);
-                  }
-                }
-              } else if (snake->cells[i].x < snake->cells[i - 1].x) {
-                if (snake->cells[i].x + 1 != snake->cells[i - 1].x) {
-                  // Wrapping has occurred.  Treat as opposite direction.
-                  goto render_middle_from_left;
-                }
-                // Previous Cell is to the Right
-                render_middle_from_right:
-                
-                // Which direction is the Next Cell?
-                // Use Not Equals to ensure that this still runs even if the snake is wrapping
-                if (snake->cells[i].x != snake->cells[i + 1].x) {
-                  // Next Cell is to the Left
-                  SNAKE_CELL_LR(buffer, buffer);
-                } else {
-                  // Next Cell is on the vertical axis
-                  
-                  // Is the Next Cell Up or Down?
-                  if (snake->cells[i].y > snake->cells[i + 1].y) {
-                    if (snake->cells[i].y - 1 != snake->cells[i + 1].y) {
-                      // Wrapping has occurred.  Treat as opposite direction.
-                      goto render_middle_from_right_to_bottom;
-                    }
-                    // Next Cell is to the Top
-                    render_middle_from_right_to_top:
-                    SNAKE_CELL_TR(buffer, buffer);
-                  } else {
-                    if (snake->cells[i].y + 1 != snake->cells[i + 1].y) {
-                      // Wrapping has occurred.  Treat as opposite direction.
-                      goto render_middle_from_right_to_top;
-                    }
-                    // Next Cell is to the Bottom
-                    render_middle_from_right_to_bottom:
-                    SNAKE_CELL_BR(buffer, buffer);
-                  }
-                }
-              } else {
-                // Previous Cell is on the vertical axis
-                
-                // Is the Previous Cell Up or Down?
-                if (snake->cells[i].y > snake->cells[i - 1].y) {
-                  if (snake->cells[i].y - 1 != snake->cells[i - 1].y) {
-                    // Wrapping has occurred.  Treat as opposite direction.
-                    goto render_middle_from_bottom;
-                  }
-                  // Previous Cell is to the Top
-                  render_middle_from_top:
-                  
-                  // Which direction is the Next Cell?
-                  if (snake->cells[i].x > snake->cells[i + 1].x) {
-                    if (snake->cells[i].x - 1 != snake->cells[i + 1].x) {
-                      // Wrapping has occurred.  Treat as opposite direction.
-                      goto render_middle_from_top_to_right;
-                    }
-                    // Next Cell is to the Left
-                    render_middle_from_top_to_left:
-                    SNAKE_CELL_TL(buffer, buffer);
-                  } else if (snake->cells[i].x < snake->cells[i + 1].x) {
-                    if (snake->cells[i].x + 1 != snake->cells[i + 1].x) {
-                      // Wrapping has occurred.  Treat as opposite direction.
-                      goto render_middle_from_top_to_left;
-                    }
-                    // Next Cell is to the Right
-                    render_middle_from_top_to_right:
-                    SNAKE_CELL_TR(buffer, buffer);
-                  } else {
-                    // Next Cell is to the Bottom
-                    SNAKE_CELL_TB(buffer, buffer);
-                  }
-                } else {
-                  if (snake->cells[i].y + 1 != snake->cells[i - 1].y) {
-                    // Wrapping has occurred.  Treat as opposite direction.
-                    goto render_middle_from_top;
-                  }
-                  // Previous Cell is to the Bottom
-                  render_middle_from_bottom:
-                  
-                  // Which direction is the Next Cell?
-                  if (snake->cells[i].x > snake->cells[i + 1].x) {
-                    if (snake->cells[i].x - 1 != snake->cells[i + 1].x) {
-                      // Wrapping has occurred.  Treat as opposite direction.
-                      goto render_middle_from_bottom_to_right;
-                    }
-                    // Next Cell is to the Left
-                    render_middle_from_bottom_to_left:
-                    SNAKE_CELL_BL(buffer, buffer);
-                  } else if (snake->cells[i].x < snake->cells[i + 1].x) {
-                    if (snake->cells[i].x + 1 != snake->cells[i + 1].x) {
-                      // Wrapping has occurred.  Treat as opposite direction.
-                      goto render_middle_from_bottom_to_left;
-                    }
-                    // Next Cell is to the Right
-                    render_middle_from_bottom_to_right:
-                    SNAKE_CELL_BR(buffer, buffer);
-                  } else {
-                    // Next Cell is to the Top
-                    SNAKE_CELL_TB(buffer, buffer);
-                  }
-                }
-              }
-            }
-          } else {
-            // UTF-8 not supported, fall back to ASCII for snake body
-            FALLBACK_SNAKE(buffer, buffer);
+    // Press a key, or not
+    if (options->replay != NULL) {
+      log_play_tick(options->replay, tick, &snake);
+    } else {
+      signed int direction = -1;
+      if        (options->autopilot) {
+        autopilot_steer(&autopilot, &snake, &food);
+      } else if (options->bursts) {
+        // Press every key on the next line at once
+        while (burst_position < options->script_length) {
+          char byte = options->script[burst_position];
+          burst_position++;
+          if (byte == '\n') {
+            break;
+          }
+          signed int turn = key_direction(key_parse(&keys, byte));
+          if (turn != -1) {
+            turn_queue_push(&turns, turn);
           }
-          
-          goto next_grid_cell;
         }
-      }
-      
-      // Is this a Food Cell?
-      if (food->x == (signed int)x && food->y == (signed int)y) {
-        // Regen Food Cell
-        if (utf8_support) {
-          FOOD_CELL(buffer, buffer);
-        } else {
-          FALLBACK_FOOD_CELL(buffer, buffer);
+        snake_take_turn(&snake, &turns);
+      } else if (options->script != NULL) {
+        if (tick < options->script_length) {
+          direction = key_direction(options->script[tick]);
         }
-        goto next_grid_cell;
+      } else {
+        key_state ^= key_state << 13;
+        key_state ^= key_state >> 17;
+        key_state ^= key_state << 5;
+        // About one tick in four
+        if ((key_state & 0x3) == 0) {
+          direction = (key_state >> 2) & 0x3;
+        }
+      }
+      if (direction != -1) {
+        snake_steer(&snake, direction);
       }
-      
-      // If none of the above, it must be an Empty Cell
-      // Regen Empty Cell
-      *buffer = ' ';
-      buffer++;
-      
-      next_grid_cell:;
+    }
+    if (options->record != NULL) {
+      log_write_tick(options->record, tick, game, &snake, &food);
     }
     
-    // Render a Vertical Element of the Right Grid Border
-    if (utf8_support) {
-      BORDER_VERTICAL(buffer, buffer);
-    } else {
-      FALLBACK_BORDER(buffer, buffer);
+    if (sampled) {
+      clock_gettime(CLOCK_MONOTONIC, &phase_start[1]);
+    }
+    
+    unsigned int collided = snake_crawl(&snake, &food);
+    if (collided == 2) {
+      snake_destroy(&snake);
+      if (options->render != HEADLESS_RENDER_NONE) {
+        screen_destroy(&screen);
+      }
+      if (options->autopilot) {
+        autopilot_destroy(&autopilot);
+      }
+      free(display_content);
+      return -1;
+    }
+    
+    if (sampled) {
+      clock_gettime(CLOCK_MONOTONIC, &phase_start[2]);
     }
     
-#ifndef NOEXPLICITNEWLINES
-    // In case we are running on a TTY that does not get up-to-date terminal size 
-    // information-such as over a COM port-explicitly output a New Line and Carriage Return.  
-    // This will keep the display sane in case the terminal is wider than the TTY believes.  
-    // It prevents reliance on wrapping for new lines.
-    // 
-    // This can be disabled by setting the above preprocessor definition, 'NOEXPLICITNEWLINES'
-    *buffer = '\n';
-    buffer++;
-    *buffer = '\r';
-    buffer++;
-#endif
+    if (collided) {
+      // Game Over: Start the next game
+      if (snake.score > best_score) {
+        best_score = snake.score;
+      }
+      game++;
+      game_restart(&snake, &food, game_seed(seed, game));
+      games++;
+      if (options->render != HEADLESS_RENDER_NONE) {
+        screen.stale = 1;
+      }
+    }
     
+    if (sampled) {
+      clock_gettime(CLOCK_MONOTONIC, &phase_start[3]);
+    }
+    
+    if (!collided && options->render != HEADLESS_RENDER_NONE) {
+      if (options->render == HEADLESS_RENDER_FULL) {
+        screen.stale = 1;
+      }
+      render_frame(display_content, &screen, &snake, &food);
+      unsigned long bytes = strlen(display_content);
+      render_bytes += bytes;
+      if (profile != NULL) {
+        histogram_record(&profile->histograms[PROFILE_FRAME_BYTES], bytes);
+      }
+    }
+    
+    if (sampled) {
+      clock_gettime(CLOCK_MONOTONIC, &phase_start[4]);
+      for (unsigned int phase = 0; phase < 4; phase++) {
+        phase_ns[phase] += elapsed_ns(&phase_start[phase], &phase_start[phase + 1]);
+      }
+      samples++;
+      if (profile != NULL) {
+        histogram_record(&profile->histograms[PROFILE_TICK], elapsed_ns(&phase_start[0], &phase_start[4]));
+        histogram_record(&profile->histograms[PROFILE_CRAWL], elapsed_ns(&phase_start[1], &phase_start[2]));
+        if (!collided && options->render != HEADLESS_RENDER_NONE) {
+          histogram_record(&profile->histograms[PROFILE_RENDER], elapsed_ns(&phase_start[3], &phase_start[4]));
+        }
+      }
+    }
+  }
+  
+  struct timespec run_end;
+  clock_gettime(CLOCK_MONOTONIC, &run_end);
+  
+  if (snake.score > best_score) {
+    best_score = snake.score;
   }
   
-  // Render Bottom Grid Border
-  if (utf8_support) {
-    BORDER_CORNER_BOTTOMLEFT(buffer, buffer);
-    for (unsigned int x = 0; x < grid_width; x++) {
-      BORDER_HORIZONTAL(buffer, buffer);
+  // Report in "name: value" lines, so that the output is easy to parse
+  double seconds = elapsed_ns(&run_start, &run_end) / 1e9;
+  double phase_avg_ns[4];
+  for (unsigned int phase = 0; phase < 4; phase++) {
+    phase_avg_ns[phase] = 0;
+    if (samples > 0) {
+      phase_avg_ns[phase] = (double)phase_ns[phase] / samples - clock_ns;
     }
-    BORDER_CORNER_BOTTOMRIGHT(buffer, buffer);
-  } else {
-    for (unsigned int x = 0; x < term_width; x++) {
-      FALLBACK_BORDER(buffer, buffer);
+    if (phase_avg_ns[phase] < 0) {
+      phase_avg_ns[phase] = 0;
     }
   }
+  dprintf(STDOUT, "grid: %ux%u\n", options->width, options->height);
+  if (options->render != HEADLESS_RENDER_NONE) {
+    dprintf(STDOUT, "viewport: %ux%u\n", options->viewport_width, options->viewport_height);
+  }
+  dprintf(STDOUT, "seed: %u\n", seed);
+  dprintf(STDOUT, "ticks: %lu\n", options->ticks);
+  dprintf(STDOUT, "games: %lu\n", games);
+  dprintf(STDOUT, "best_score: %u\n", best_score);
+  dprintf(STDOUT, "seconds: %.6f\n", seconds);
+  dprintf(STDOUT, "ticks_per_second: %.0f\n", options->ticks / seconds);
+  dprintf(STDOUT, "clock_ns: %llu\n", clock_ns);
+  dprintf(STDOUT, "input_ns_per_tick: %.1f\n", phase_avg_ns[0]);
+  dprintf(STDOUT, "crawl_ns_per_tick: %.1f\n", phase_avg_ns[1]);
+  dprintf(STDOUT, "new_game_ns_per_tick: %.1f\n", phase_avg_ns[2]);
+  dprintf(STDOUT, "render_ns_per_tick: %.1f\n", phase_avg_ns[3]);
+  if (options->render != HEADLESS_RENDER_NONE) {
+    dprintf(STDOUT, "render_bytes_per_tick: %.1f\n", options->ticks ? (double)render_bytes / options->ticks : 0.0);
+  }
+  // Only the tiles of the Grid the snakes have been on take any memory
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  dprintf(STDOUT, "grid_tiles: %u\n", snake.tiles_across * ((options->height + GRID_TILE_SIDE - 1) / GRID_TILE_SIDE));
+  dprintf(STDOUT, "grid_tiles_used: %u\n", snake.used_tile_count);
+  dprintf(STDOUT, "max_rss_kb: %ld\n", usage.ru_maxrss);
+  if (options->autopilot) {
+    dprintf(STDOUT, "autopilot_decisions: %lu\n", autopilot.decisions);
+    dprintf(STDOUT, "autopilot_fallbacks: %lu\n", autopilot.fallbacks);
+  }
+  if (profile != NULL) {
+    profile_print(profile);
+  }
   
-  // Make sure the string is NULL terminated
-  *buffer = 0;
+  snake_destroy(&snake);
+  if (options->render != HEADLESS_RENDER_NONE) {
+    screen_destroy(&screen);
+  }
+  if (options->autopilot) {
+    autopilot_destroy(&autopilot);
+  }
+  free(display_content);
   
-  return;
+  return 0;
 }
 
-void snake_append_cells(struct Snake *snake, unsigned int num_to_add) {
-  unsigned int i = snake->length;
-  unsigned int last_cell_index = i - 1;
-  snake->length += num_to_add;
-  snake->cells = realloc(snake->cells, snake->length * sizeof(struct GridCell));
-  // TODO: Handle realloc failure
-  // TODO: Consider changing to reallocarray() to easily safely handle multiplication overflow
-  while (i < snake->length) {
-    snake->cells[i] = snake->cells[last_cell_index];
-    i++;
+signed int run_batch(struct HeadlessOptions *options, unsigned int seed) {
+  // Play [options->batch] games at once with no terminal for 
+  // [options->ticks] ticks each, as fast as they will go, then report how 
+  // fast that was on STDOUT
+  // Returns -1 if the memory for them could not be allocated, or the 
+  // threads could not be started.
+  
+  unsigned int count = options->batch;
+  unsigned int the_grid_space = options->width * options->height;
+  
+  struct timespec setup_start;
+  clock_gettime(CLOCK_MONOTONIC, &setup_start);
+  
+  struct GameBatch batch;
+  if (batch_init(&batch, count, options->width, options->height, seed, options->threads) == -1) {
+    return -1;
   }
-  return;
-}
-
-void snake_crawl(struct Snake *snake, struct GridCell *food) {
-  // Crawl Snake Forward
-  
-  unsigned int width = grid_width;
-  unsigned int height = grid_height;
-  
-  signed int prev_cell_x = snake->cells[0].x;
-  signed int prev_cell_y = snake->cells[0].y;
-  signed int head_cell_x = prev_cell_x;
-  signed int head_cell_y = prev_cell_y;
-  
-  // Update the direction
-  snake->direction = snake->new_direction;
-  
-  // Move the head in the direction of the snake
-  if        (snake->direction == DIR_UP) {
-    head_cell_y -= 1;
-  } else if (snake->direction == DIR_DOWN) {
-    head_cell_y += 1;
-  } else if (snake->direction == DIR_LEFT) {
-    head_cell_x -= 1;
-  } else {                    // DIR_RIGHT
-    head_cell_x += 1;
-  }
-  
-  // Handle Wrapping
-  if        (head_cell_x < 0) {
-    head_cell_x += width;
-  } else if (head_cell_x >= (signed int)width) {
-    head_cell_x -= width;
-  } else if (head_cell_y < 0) {
-    head_cell_y += height;
-  } else if (head_cell_y >= (signed int)height) {
-    head_cell_y -= height;
-  }
-  
-  // Are we still expanding from cells added to the snake?
-  // This should be handled before checking for food consumption 
-  // because snake->length might be increased there.  This crawl
-  // tick does not apply to cells added during it.  Cells added 
-  // during this tick will be expanded in subsequent ticks.
-  if (snake->grid_used_length < snake->length) {
-    snake->grid_used_length++;
-  }
-  
-  // Did we consume food?
-  if (head_cell_x == food->x && head_cell_y == food->y) {
-    // Handle food consume
-    score += 1;
-    snake_append_cells(snake, snake->grow_by);
-    snake->grow_by += GROW_BY_INCREMENT;
-    rand_food_location(food, snake, width, height);
-  }
-  
-  snake->cells[0].x = head_cell_x;
-  snake->cells[0].y = head_cell_y;
-  
-  signed int old_cell_x;
-  signed int old_cell_y;
-  
-  old_cell_x = snake->cells[1].x;
-  old_cell_y = snake->cells[1].y;
-  snake->cells[1].x = prev_cell_x;
-  snake->cells[1].y = prev_cell_y;
-  prev_cell_x = old_cell_x;
-  prev_cell_y = old_cell_y;
-  
-  // Move along the rest of the snake body
-  for (unsigned int i = 2; i < snake->length; i++) {
-    if (head_cell_x == prev_cell_x && head_cell_y == prev_cell_y) {
-      // TODO: Handle body collision
+  
+  // Random key presses, the same way as for a single game.  One set of 
+  // them is made up front and used over and over, so that making them up 
+  // is not part of what is timed.
+  unsigned char *turns = malloc((unsigned long)HEADLESS_BATCH_TICKS * count);
+  unsigned char *observations = malloc((unsigned long)the_grid_space * count);
+  if (turns == NULL || observations == NULL) {
+    free(turns);
+    free(observations);
+    batch_destroy(&batch);
+    return -1;
+  }
+  uint32_t key_state = (seed * 2654435761u) | 1;
+  for (unsigned long i = 0; i < (unsigned long)HEADLESS_BATCH_TICKS * count; i++) {
+    key_state ^= key_state << 13;
+    key_state ^= key_state >> 17;
+    key_state ^= key_state << 5;
+    turns[i] = BATCH_NO_TURN;
+    // About one tick in four
+    if ((key_state & 0x3) == 0) {
+      turns[i] = (key_state >> 2) & 0x3;
     }
-    
-    old_cell_x = snake->cells[i].x;
-    old_cell_y = snake->cells[i].y;
-    snake->cells[i].x = prev_cell_x;
-    snake->cells[i].y = prev_cell_y;
-    prev_cell_x = old_cell_x;
-    prev_cell_y = old_cell_y;
   }
   
-  return;
+  struct timespec run_start;
+  clock_gettime(CLOCK_MONOTONIC, &run_start);
+  
+  for (unsigned long tick = 0; tick < options->ticks; tick += HEADLESS_BATCH_TICKS) {
+    unsigned int ticks = HEADLESS_BATCH_TICKS;
+    if (options->ticks - tick < ticks) {
+      ticks = options->ticks - tick;
+    }
+    if (batch_step(&batch, turns, ticks, observations) == -1) {
+      free(turns);
+      free(observations);
+      batch_destroy(&batch);
+      return -1;
+    }
+  }
+  
+  struct timespec run_end;
+  clock_gettime(CLOCK_MONOTONIC, &run_end);
+  
+  unsigned long games = 0;
+  unsigned int best_score = 0;
+  for (unsigned int n = 0; n < count; n++) {
+    games += batch.games[n].games;
+    if (batch.games[n].best_score > best_score) {
+      best_score = batch.games[n].best_score;
+    }
+    if (batch.games[n].snake.score > best_score) {
+      best_score = batch.games[n].snake.score;
+    }
+  }
+  
+  // Report in "name: value" lines, so that the output is easy to parse
+  double seconds = elapsed_ns(&run_start, &run_end) / 1e9;
+  double total_ticks = (double)options->ticks * count;
+  dprintf(STDOUT, "grid: %ux%u\n", options->width, options->height);
+  dprintf(STDOUT, "seed: %u\n", seed);
+  dprintf(STDOUT, "batch: %u\n", count);
+  dprintf(STDOUT, "threads: %u\n", options->threads);
+  dprintf(STDOUT, "ticks: %lu\n", options->ticks);
+  dprintf(STDOUT, "games: %lu\n", games);
+  dprintf(STDOUT, "best_score: %u\n", best_score);
+  dprintf(STDOUT, "setup_seconds: %.6f\n", elapsed_ns(&setup_start, &run_start) / 1e9);
+  dprintf(STDOUT, "seconds: %.6f\n", seconds);
+  dprintf(STDOUT, "ticks_per_second: %.0f\n", total_ticks / seconds);
+  
+  free(turns);
+  free(observations);
+  batch_destroy(&batch);
+  
+  return 0;
 }
 
-void* game_loop(void *thread_info) {
-  pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
-  
-  struct timespec target_sleep_time;
-  target_sleep_time.tv_sec = DELAY_TIME_MS / 1000;
-  target_sleep_time.tv_nsec = (DELAY_TIME_MS % 1000) * 1000000;
-  
-  struct ThreadInfo *th_info = (struct ThreadInfo*)thread_info;
-  struct Snake *snake = th_info->snake;
-  struct GridCell *food = th_info->food;
-  char *display_content = th_info->display_content;
-  
-  sigset_t pause_signal;
-  sigemptyset(&pause_signal);
-  sigaddset(&pause_signal, USIG_PAUSE);
-  
-  // Game Loop
-  while (1) {
-    // Get processing start time
-    struct timeval loop_start_time;
-    gettimeofday(&loop_start_time, NULL);
-    
-    // The meat of the game loop:
-    // --Get a lock on the thread synchronization tool (Mutex or Binary Semaphore)
-    // --Crawl the snake forward
-    // --Use the newly generated data to renderer the display buffer
-    // --Print/Draw the display buffer
-    // --Release the lock
-    sem_wai2(&sem0);
-    snake_crawl(snake, food);
-    regen_buffer(display_content, snake, food);
-    dprintf(STDOUT, "\e[1;1H%s", display_content);
-    sem_post(&sem0);
-    
-    // The rest of the loop below calculates sleep time and sleeps while 
-    // thread cancellation is enabled, providing a clean exit point.
-    
-    // Get processing end time
-    struct timeval loop_end_time;
-    gettimeofday(&loop_end_time, NULL);
-    
-    // Thread sleep calculations, nanosleep(), interruptibility, and cancellability
-    {
-      pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, NULL);
-      // Allow thread interruptions for Game Pausing
-      // This thread must only be interruptible while cancellation is 
-      //   enabled to prevent it from hanging on sigwaitinfo() during a 
-      //   pause-quit event outside of nanosleep().q
-      pthread_sigmask(SIG_UNBLOCK, &pause_signal, NULL);
-      
-      // How much time elapsed while processing?
-      if (loop_end_time.tv_usec < loop_start_time.tv_usec) {
-        loop_end_time.tv_sec--;
-        loop_end_time.tv_usec += (1000000 - loop_start_time.tv_usec);
-      } else {
-        loop_end_time.tv_usec -= loop_start_time.tv_usec;
-      }
-      loop_end_time.tv_sec -= loop_start_time.tv_sec;
-      
-      // Init nanosleep struct with time 0 in case processing took too long.
-      // nanosleep() much still be called to give the thread an opportunity to be cancelled.
-      struct timespec actual_sleep_time;
-      actual_sleep_time.tv_sec = 0;
-      actual_sleep_time.tv_nsec = 0;
-      
-      // Is the elapsed processing time less than the target sleep time?
-      if (((loop_end_time.tv_sec == target_sleep_time.tv_sec) && (((long)loop_end_time.tv_usec * 1000) < target_sleep_time.tv_nsec)) || \
-           (loop_end_time.tv_sec <  target_sleep_time.tv_sec)) {
-        
-        // Set the nanosleep time to the target time remaining
-        actual_sleep_time.tv_sec = target_sleep_time.tv_sec - loop_end_time.tv_sec;
-        if ((long)loop_end_time.tv_usec * 1000 > target_sleep_time.tv_nsec) {
-          actual_sleep_time.tv_sec--;
-          actual_sleep_time.tv_nsec = (1000000l - loop_end_time.tv_usec) * 1000 + target_sleep_time.tv_nsec;
-        } else {
-          actual_sleep_time.tv_nsec = target_sleep_time.tv_nsec - ((long)loop_end_time.tv_usec * 1000);
-        }
-        actual_sleep_time.tv_nsec = target_sleep_time.tv_nsec - (loop_end_time.tv_usec * 1000);
-        
+signed int run_arena(struct HeadlessOptions *options, unsigned int seed) {
+  // Play [options->arena] snakes in one arena with no terminal for 
+  // [options->ticks] ticks, as fast as they will go, then report how fast 
+  // that was on STDOUT
+  // Every tick is timed.  Returns -1 if the memory for it could not be 
+  // allocated, or the threads could not be started.
+  
+  struct timespec setup_start;
+  clock_gettime(CLOCK_MONOTONIC, &setup_start);
+  
+  struct Arena arena;
+  if (arena_init(&arena, options->width, options->height, options->arena, seed, options->threads) == -1) {
+    return -1;
+  }
+  struct Profile profile;
+  profile_init(&profile);
+  
+  struct timespec run_start;
+  clock_gettime(CLOCK_MONOTONIC, &run_start);
+  
+  for (unsigned long tick = 0; tick < options->ticks; tick++) {
+    struct timespec tick_start;
+    clock_gettime(CLOCK_MONOTONIC, &tick_start);
+    if (arena_step(&arena) == -1) {
+      arena_destroy(&arena);
+      return -1;
+    }
+    profile_record_since(&profile, PROFILE_TICK, &tick_start);
+  }
+  
+  struct timespec run_end;
+  clock_gettime(CLOCK_MONOTONIC, &run_end);
+  
+  unsigned long deaths = 0;
+  unsigned int best_score = 0;
+  unsigned int alive = 0;
+  unsigned int longest = 0;
+  for (unsigned int n = 0; n < arena.snake_count; n++) {
+    struct ArenaSnake *arena_snake = &arena.snakes[n];
+    deaths += arena_snake->deaths;
+    if (arena_snake->best_score > best_score) {
+      best_score = arena_snake->best_score;
+    }
+    if (arena_snake->alive) {
+      alive++;
+      if (arena_snake->snake.score > best_score) {
+        best_score = arena_snake->snake.score;
       }
-      
-      struct timespec rem_sleep_time;
-      while (nanosleep(&actual_sleep_time, &rem_sleep_time) == -1) {
-        if (errno != EINTR) {
-          break;
-        }
-        actual_sleep_time = rem_sleep_time;
+      if (arena_snake->snake.length > longest) {
+        longest = arena_snake->snake.length;
       }
-      
-      // Block thread interruptions for Game Pausing
-      pthread_sigmask(SIG_BLOCK, &pause_signal, NULL);
-      pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
     }
   }
-  return NULL;
+  
+  // Report in "name: value" lines, so that the output is easy to parse
+  double seconds = elapsed_ns(&run_start, &run_end) / 1e9;
+  dprintf(STDOUT, "grid: %ux%u\n", options->width, options->height);
+  dprintf(STDOUT, "seed: %u\n", seed);
+  dprintf(STDOUT, "snakes: %u\n", arena.snake_count);
+  dprintf(STDOUT, "food: %u\n", arena.food_count);
+  dprintf(STDOUT, "threads: %u\n", options->threads);
+  dprintf(STDOUT, "ticks: %lu\n", options->ticks);
+  dprintf(STDOUT, "deaths: %lu\n", deaths);
+  dprintf(STDOUT, "best_score: %u\n", best_score);
+  dprintf(STDOUT, "alive: %u\n", alive);
+  dprintf(STDOUT, "longest: %u\n", longest);
+  dprintf(STDOUT, "setup_seconds: %.6f\n", elapsed_ns(&setup_start, &run_start) / 1e9);
+  dprintf(STDOUT, "seconds: %.6f\n", seconds);
+  dprintf(STDOUT, "ticks_per_second: %.0f\n", options->ticks / seconds);
+  dprintf(STDOUT, "snake_ticks_per_second: %.0f\n", (double)options->ticks * arena.snake_count / seconds);
+  profile_print(&profile);
+  
+  arena_destroy(&arena);
+  
+  return 0;
 }
 
-void* signal_receiver_thread(void *arg) {
-  struct timespec sleep_time;
-  sleep_time.tv_sec = 10;
-  sleep_time.tv_nsec = 0;
+signed int run_viewer(const char *path) {
+  // Watch the game streamed to spectators on the Unix domain socket at 
+  // [path], drawn on the terminal as it is played
+  // Nothing is drawn until the first keyframe.  Once the game is over, 
+  // the Game Over screen stays up until Q is pressed, as it does for the 
+  // player.  Returns the code to exit with.
+  
+  struct SpectateView view;
+  {
+    signed int retval = spectate_view_connect(&view, path);
+    if (retval == -1) {
+      return 11;
+    } else if (retval == -2) {
+      return 6;
+    }
+  }
+  
+  // Show as much of the Grid as fits the terminal
+  {
+    struct winsize term_size;
+    ioctl(STDOUT, TIOCGWINSZ, &term_size);
+    curr_term_width = term_size.ws_col;
+    curr_term_height = term_size.ws_row;
+    term_width = curr_term_width;
+    term_height = curr_term_height;
+  }
+  unsigned int view_width = (term_width - 2 < view.stream.width) ? term_width - 2 : view.stream.width;
+  unsigned int view_height = (term_height - 3 < view.stream.height) ? term_height - 3 : view.stream.height;
   
+  // Wait on key presses from STDIN, and on the stream
+  signed int epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+  if (epoll_fd == -1) {
+    spectate_view_destroy(&view);
+    return 12;
+  }
+  signed int fds[] = {STDIN, view.fd};
+  for (unsigned int i = 0; i < sizeof(fds) / sizeof(fds[0]); i++) {
+    struct epoll_event event;
+    event.events = EPOLLIN;
+    event.data.fd = fds[i];
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fds[i], &event) == -1) {
+      close(epoll_fd);
+      spectate_view_destroy(&view);
+      return 12;
+    }
+  }
+  
+  struct Display display;
+  struct termios old_tty_settings;
   {
-    sigset_t del_signal_mask;
-    sigemptyset(&del_signal_mask);
-    sigaddset(&del_signal_mask, SIGWINCH);
-    pthread_sigmask(SIG_UNBLOCK, &del_signal_mask, NULL);
+    signed int retval = terminal_display_init(&display, view_width, view_height);
+    if (retval != 0) {
+      close(epoll_fd);
+      spectate_view_destroy(&view);
+      return (retval == -1) ? 25 : 11;
+    }
+    retval = terminal_setup(&old_tty_settings);
+    if (retval != 0) {
+      display_destroy(&display);
+      close(epoll_fd);
+      spectate_view_destroy(&view);
+      return (retval == -1) ? 25 : 26;
+    }
+  }
+  if (display_start(&display) == -1) {
+    terminal_restore(&old_tty_settings);
+    display_destroy(&display);
+    close(epoll_fd);
+    spectate_view_destroy(&view);
+    return 10;
   }
   
-  while (1) {
-    nanosleep(&sleep_time, NULL);
+  signed int exit_code = 0;
+  unsigned int quit = 0;
+  while (!quit) {
+    struct epoll_event events[2];
+    signed int count = epoll_wait(epoll_fd, events, sizeof(events) / sizeof(events[0]), -1);
+    if (count < 0) {
+      if (errno != EINTR) {
+        exit_code = 2;
+        break;
+      }
+      continue;
+    }
+    
+    for (signed int i = 0; i < count && !quit; i++) {
+      if        (events[i].data.fd == view.fd) {
+        // Draw the game as it is after everything received.  A keyframe 
+        // may have moved the snake anywhere, so the Grid is drawn in full.
+        unsigned long keyframes = view.keyframes;
+        unsigned long ticks = view.ticks;
+        if (spectate_view_read(&view) == -1) {
+          exit_code = 9;
+          view.ended = 1;
+        }
+        if (view.keyframes != keyframes) {
+          display.model.stale = 1;
+        }
+        if (view.synced && (view.keyframes != keyframes || view.ticks != ticks || view.ended)) {
+          display_publish(&display, view.ended ? FRAME_GAME_OVER : FRAME_GAME, &view.snake, &view.food, curr_term_width, curr_term_height);
+        }
+        if (view.ended) {
+          // Nothing more is coming
+          epoll_ctl(epoll_fd, EPOLL_CTL_DEL, view.fd, NULL);
+        }
+      } else if (events[i].events & (EPOLLERR | EPOLLHUP)) {
+        // Unhanded or Fault condition on STDIN
+        exit_code = 51;
+        quit = 1;
+      } else {
+        // Data received on STDIN.  Only Q does anything.
+        unsigned char bytes[INPUT_BURST_SIZE];
+        ssize_t length = read(STDIN, bytes, sizeof(bytes));
+        for (ssize_t b = 0; b < length; b++) {
+          if (bytes[b] == 'q' || bytes[b] == 'Q') {
+            quit = 1;
+          }
+        }
+      }
+    }
   }
   
-  return NULL;
+  display_stop(&display);
+  terminal_restore(&old_tty_settings);
+  display_destroy(&display);
+  close(epoll_fd);
+  spectate_view_destroy(&view);
+  dprintf(STDOUT, "\n");
+  
+  return exit_code;
+}
+
+void print_usage(const char *name) {
+  // Describe the command line options on STDERR
+  
+  dprintf(STDERR, "Usage: %s [-S seed] [-g WIDTHxHEIGHT] [-o log | -p log [-j tick]] [-P csv] [-T json] [-s socket | -m name] [-A] [-l | -H [-n ticks] [-i script | -I bursts] [-r | -R [-v WIDTHxHEIGHT]] [-b games | -M snakes] [-t threads]]\n", name);
+  dprintf(STDERR, "  -S seed    Seed the food placement, so that a game can be repeated\n");
+  dprintf(STDERR, "  -g WxH     Grid size, up to %ux%u (Default: as big as fits the terminal, \n", GRID_MAX_SIDE, GRID_MAX_SIDE);
+  dprintf(STDERR, "             or 78x21 with -H).  A Grid bigger than the terminal is shown \n");
+  dprintf(STDERR, "             through a viewport that follows the head.\n");
+  dprintf(STDERR, "  -o log     Record the game to the file [log], to be played back with -p\n");
+  dprintf(STDERR, "  -p log     Play back the game recorded in [log], in time on the terminal, or \n");
+  dprintf(STDERR, "             as fast as possible with -H.  The seed and Grid size are those \n");
+  dprintf(STDERR, "             of the recording, and it plays on until the recording ends.\n");
+  dprintf(STDERR, "  -j tick    Jump to tick [tick] of the recording before playing it back\n");
+  dprintf(STDERR, "  -P csv     Time every phase of every tick.  On exit, report a summary of \n");
+  dprintf(STDERR, "             each phase, and write its full histogram to the file [csv].  \n");
+  dprintf(STDERR, "             Setting SNAKE_PROFILE=csv in the environment does the same.  \n");
+  dprintf(STDERR, "             Not for batches or arenas.\n");
+  dprintf(STDERR, "  -T json    Trace what the event loop and the render thread do, and write \n");
+  dprintf(STDERR, "             it on exit to the file [json], to be opened in a trace viewer \n");
+  dprintf(STDERR, "             such as Perfetto.  Setting SNAKE_TRACE=json in the environment \n");
+  dprintf(STDERR, "             does the same.  Not for headless runs.\n");
+  dprintf(STDERR, "  -s socket  Stream every tick to spectators on a Unix domain socket made at \n");
+  dprintf(STDERR, "             [socket], for them to watch with -w.  Spectators too slow to keep \n");
+  dprintf(STDERR, "             up miss ticks, and are dropped if they fall too far behind.  Not \n");
+  dprintf(STDERR, "             for headless runs.\n");
+  dprintf(STDERR, "  -m name    Play on the shared board called [name], along with every other \n");
+  dprintf(STDERR, "             player on this machine that gives the same name, up to %u.  \n", MULTIPLAYER_MAX_PLAYERS);
+  dprintf(STDERR, "             The first player sets the board up, with their seed and Grid \n");
+  dprintf(STDERR, "             size.  The game cannot be paused, and a player that falls %ums \n", MULTIPLAYER_BARRIER_TIMEOUT_MS);
+  dprintf(STDERR, "             behind is dropped.  Not for headless runs, recordings, or -s.\n");
+  dprintf(STDERR, "  -A         Autopilot: Steer towards the food by itself, in place of the \n");
+  dprintf(STDERR, "             keys.  Each decision is timed as the autopilot phase by -P.\n");
+  dprintf(STDERR, "  -l         On exit, report how late the ticks started, as a histogram, \n");
+  dprintf(STDERR, "             how many frames the terminal was too slow to be shown, and how \n");
+  dprintf(STDERR, "             the spectators of -s kept up, and the players of -m\n");
+  dprintf(STDERR, "  -H         Headless: Play with no terminal as fast as possible, then \n");
+  dprintf(STDERR, "             report how fast that was.  The options below only apply to this.\n");
+  dprintf(STDERR, "  -n ticks   How many ticks to run for (Default: 1000000)\n");
+  dprintf(STDERR, "  -i script  Press the keys in the file [script], one per tick.  W, A, S, and D \n");
+  dprintf(STDERR, "             steer, anything else is a tick without a key.  Line breaks are \n");
+  dprintf(STDERR, "             skipped.  Without this, keys are pressed at random.\n");
+  dprintf(STDERR, "  -I bursts  Press the keys on each line of the file [bursts] all at once in \n");
+  dprintf(STDERR, "             one tick, as if typed faster than the ticks.  Turns are queued \n");
+  dprintf(STDERR, "             up for the ticks after, and arrow keys steer too.\n");
+  dprintf(STDERR, "  -r         Also render each tick, the way the game would draw it\n");
+  dprintf(STDERR, "  -R         Also render the whole viewport every tick\n");
+  dprintf(STDERR, "  -v WxH     Size of the viewport rendered by -r and -R (Default: as much \n");
+  dprintf(STDERR, "             of the Grid as fits 78x21)\n");
+  dprintf(STDERR, "  -b games   Play this many games at once, each for the number of ticks \n");
+  dprintf(STDERR, "             given by -n, with random keys.  -o, -p, -i, -I, -A, -r, -R, -v, and \n");
+  dprintf(STDERR, "             -P do not apply.\n");
+  dprintf(STDERR, "  -M snakes  Play this many snakes at once in one arena, each steering \n");
+  dprintf(STDERR, "             itself, for the number of ticks given by -n.  The Grid is %u \n", ARENA_SPACES_PER_SNAKE);
+  dprintf(STDERR, "             spaces for each snake unless -g is given, and has %u unit of \n", ARENA_FOOD_PER_SNAKE);
+  dprintf(STDERR, "             food for each.  Up to %u snakes.  Every tick is timed.  The \n", ARENA_MAX_SNAKES);
+  dprintf(STDERR, "             same options as for -b do not apply.\n");
+  dprintf(STDERR, "  -t threads How many threads to play the games of -b or the arena of -M \n");
+  dprintf(STDERR, "             with (Default: one for each processor)\n");
+  dprintf(STDERR, "Or: %s -w socket\n", name);
+  dprintf(STDERR, "  -w socket  Watch the game streamed by -s on [socket], in place of playing \n");
+  dprintf(STDERR, "             one.  Q stops watching.\n");
+  return;
 }
 
 signed int main(signed int argc, char *argv[], char *envp[]) {
   
-  // Seed the PRNG
+  // Read the Command Line Options
+  unsigned int headless = 0;
+  unsigned int seed_given = 0;
+  unsigned int seed = 0;
+  struct HeadlessOptions headless_options;
+  headless_options.ticks = 1000000;
+  headless_options.script = NULL;
+  headless_options.script_length = 0;
+  headless_options.autopilot = 0;
+  headless_options.bursts = 0;
+  headless_options.render = HEADLESS_RENDER_NONE;
+  headless_options.replay = NULL;
+  headless_options.seek = 0;
+  headless_options.record = NULL;
+  headless_options.batch = 0;
+  headless_options.arena = 0;
+  headless_options.threads = 0;
+  headless_options.profile = NULL;
+  const char *record_path = NULL;
+  const char *profile_path = NULL;
+  const char *trace_path = NULL;
+  const char *replay_path = NULL;
+  const char *spectate_path = NULL;
+  const char *watch_path = NULL;
+  const char *multiplayer_name = NULL;
+  unsigned int seek_given = 0;
+  unsigned int print_lateness = 0;
+  // The Grid of an 80x24 terminal, shown whole
+  unsigned int grid_given = 0;
+  unsigned int viewport_given = 0;
+  headless_options.width = 78;
+  headless_options.height = 21;
+  headless_options.viewport_width = 78;
+  headless_options.viewport_height = 21;
   {
+    signed int option;
+    char *end;
+    while ((option = getopt(argc, argv, "S:o:p:j:P:T:s:w:m:AlHg:n:i:I:rRv:b:M:t:")) != -1) {
+      if        (option == 'S') {
+        seed = strtoul(optarg, &end, 0);
+        if (*optarg == 0 || *end != 0) {
+          print_usage(argv[0]);
+          exit(3);
+        }
+        seed_given = 1;
+      } else if (option == 'o') {
+        record_path = optarg;
+      } else if (option == 'p') {
+        replay_path = optarg;
+      } else if (option == 'j') {
+        headless_options.seek = strtoul(optarg, &end, 0);
+        if (*optarg == 0 || *end != 0) {
+          print_usage(argv[0]);
+          exit(3);
+        }
+        seek_given = 1;
+      } else if (option == 'P') {
+        profile_path = optarg;
+      } else if (option == 'T') {
+        trace_path = optarg;
+      } else if (option == 's') {
+        spectate_path = optarg;
+      } else if (option == 'w') {
+        watch_path = optarg;
+      } else if (option == 'm') {
+        // The name goes into that of the shared memory
+        if (*optarg == 0 || strchr(optarg, '/') != NULL || strlen(optarg) + 8 > MULTIPLAYER_NAME_SIZE) {
+          print_usage(argv[0]);
+          exit(3);
+        }
+        multiplayer_name = optarg;
+      } else if (option == 'A') {
+        headless_options.autopilot = 1;
+      } else if (option == 'l') {
+        print_lateness = 1;
+      } else if (option == 'H') {
+        headless = 1;
+      } else if (option == 'g') {
+        // The snake starts out laid straight across the middle of the Grid
+        if (sscanf(optarg, "%ux%u", &headless_options.width, &headless_options.height) != 2 || 
+            headless_options.width < STARTING_LENGTH * 2 || headless_options.height < STARTING_LENGTH * 2 || 
+            headless_options.width > GRID_MAX_SIDE || headless_options.height > GRID_MAX_SIDE) {
+          print_usage(argv[0]);
+          exit(3);
+        }
+        grid_given = 1;
+      } else if (option == 'n') {
+        headless_options.ticks = strtoul(optarg, &end, 0);
+        if (*optarg == 0 || *end != 0) {
+          print_usage(argv[0]);
+          exit(3);
+        }
+      } else if (option == 'i' || option == 'I') {
+        free(headless_options.script);
+        if (read_script(optarg, &headless_options, option == 'I') == -1) {
+          exit(4);
+        }
+      } else if (option == 'r') {
+        headless_options.render = HEADLESS_RENDER_CHANGES;
+      } else if (option == 'R') {
+        headless_options.render = HEADLESS_RENDER_FULL;
+      } else if (option == 'v') {
+        if (sscanf(optarg, "%ux%u", &headless_options.viewport_width, &headless_options.viewport_height) != 2 || 
+            headless_options.viewport_width == 0 || headless_options.viewport_height == 0 || 
+            headless_options.viewport_width > GRID_MAX_SIDE || headless_options.viewport_height > GRID_MAX_SIDE) {
+          print_usage(argv[0]);
+          exit(3);
+        }
+        viewport_given = 1;
+      } else if (option == 'b') {
+        headless_options.batch = strtoul(optarg, &end, 0);
+        if (*optarg == 0 || *end != 0 || headless_options.batch == 0) {
+          print_usage(argv[0]);
+          exit(3);
+        }
+      } else if (option == 'M') {
+        headless_options.arena = strtoul(optarg, &end, 0);
+        if (*optarg == 0 || *end != 0 || headless_options.arena == 0 || headless_options.arena > ARENA_MAX_SNAKES) {
+          print_usage(argv[0]);
+          exit(3);
+        }
+      } else if (option == 't') {
+        headless_options.threads = strtoul(optarg, &end, 0);
+        if (*optarg == 0 || *end != 0 || headless_options.threads == 0) {
+          print_usage(argv[0]);
+          exit(3);
+        }
+      } else {
+        print_usage(argv[0]);
+        exit(3);
+      }
+    }
+    // A recording can only be made from the start of a run, so it cannot 
+    // be made while jumping into the middle of another
+    // A batch or an arena has no single game to record, play back, 
+    // script, render, or time, and cannot be both
+    // Headless runs are not kept to a schedule, so cannot be late, and 
+    // have no threads to trace or ticks to stream to spectators
+    // A spectator only watches, so plays no game of its own
+    // A multiplayer game is played on the terminal, in time, and has no 
+    // one game of its own to record, play back, or stream
+    // Only a headless run can be told how big a viewport to render
+    // The autopilot steers in place of a script or a recording
+    if (optind < argc || (seek_given && replay_path == NULL) || (record_path != NULL && replay_path != NULL) || 
+        ((print_lateness || trace_path != NULL || spectate_path != NULL) && headless) || 
+        (watch_path != NULL && (headless || seed_given || grid_given || record_path != NULL || replay_path != NULL || 
+                                profile_path != NULL || trace_path != NULL || spectate_path != NULL || print_lateness || 
+                                headless_options.autopilot || multiplayer_name != NULL)) || 
+        (multiplayer_name != NULL && (headless || record_path != NULL || replay_path != NULL || spectate_path != NULL)) || 
+        (viewport_given && (!headless || headless_options.render == HEADLESS_RENDER_NONE)) || 
+        (headless_options.autopilot && (replay_path != NULL || headless_options.script != NULL || 
+                                        headless_options.batch != 0 || headless_options.arena != 0)) || 
+        ((headless_options.batch != 0 || headless_options.arena != 0) && 
+         (!headless || record_path != NULL || replay_path != NULL || headless_options.script != NULL || 
+          headless_options.render != HEADLESS_RENDER_NONE || profile_path != NULL || 
+          (headless_options.batch != 0 && headless_options.arena != 0))) || 
+        (headless_options.threads != 0 && headless_options.batch == 0 && headless_options.arena == 0)) {
+      print_usage(argv[0]);
+      exit(3);
+    }
+  }
+  
+  // Spectator Mode: Only the terminal is needed, to draw the game on
+  if (watch_path != NULL) {
+    exit(run_viewer(watch_path));
+  }
+  
+  // Time the phases of the ticks if asked to, by -P or by the environment.  
+  // When not, nothing is timed but the 1 tick in HEADLESS_SAMPLE_INTERVAL 
+  // that a headless run always times.
+  struct Profile profile;
+  if (profile_path == NULL && headless_options.batch == 0 && headless_options.arena == 0) {
+    for (unsigned int i = 0; envp[i] != NULL; i++) {
+      if (strncmp(envp[i], "SNAKE_PROFILE=", 14) == 0 && envp[i][14] != 0) {
+        profile_path = &envp[i][14];
+      }
+    }
+  }
+  if (profile_path != NULL) {
+    profile_init(&profile);
+    headless_options.profile = &profile;
+  }
+  
+  // Trace the threads of the game if asked to, by -T or by the environment
+  struct Trace trace;
+  if (trace_path == NULL && !headless) {
+    for (unsigned int i = 0; envp[i] != NULL; i++) {
+      if (strncmp(envp[i], "SNAKE_TRACE=", 12) == 0 && envp[i][12] != 0) {
+        trace_path = &envp[i][12];
+      }
+    }
+  }
+  if (trace_path != NULL && trace_init(&trace) == -1) {
+    exit(11);
+  }
+  
+  // Load the game log to play back
+  struct GameLog replay_log;
+  if (replay_path != NULL) {
+    if (log_load(&replay_log, replay_path) == -1) {
+      exit(4);
+    }
+    headless_options.replay = &replay_log;
+    if (headless_options.seek > replay_log.end_tick) {
+      headless_options.seek = replay_log.end_tick;
+    }
+    headless_options.ticks = replay_log.end_tick - headless_options.seek;
+    headless_options.width = replay_log.width;
+    headless_options.height = replay_log.height;
+    seed = replay_log.seed;
+    seed_given = 1;
+  }
+  
+  // Pick the seed for the games
+  if (!seed_given) {
     time_t s = time(NULL);
     if (s == (time_t)-1) {
       exit(2);
     }
-    srand((unsigned int)(s % INT_MAX));
-  }
-  
-  // Mask Signals: SIGWINCH, USIG_PAUSE, USIG_P_ACK
-  sigset_t add_signal_mask;
-  {
-    sigemptyset(&add_signal_mask);
-    sigaddset(&add_signal_mask, SIGWINCH);
-    sigaddset(&add_signal_mask, USIG_PAUSE);
-    sigaddset(&add_signal_mask, USIG_P_ACK);
-    sigprocmask(SIG_BLOCK, &add_signal_mask, NULL);
+    seed = (unsigned int)(s % INT_MAX);
   }
   
-  // Setup the Signal Handler for Terminal Resize Events (SIGWINCH)
-  {
-    struct sigaction sig_action;
-    sig_action.sa_handler = &signal_handle;
-    sigemptyset(&(sig_action.sa_mask));
-    sig_action.sa_flags = 0;
-    sigaction(SIGWINCH, &sig_action, NULL);
+  // Headless Mode: No terminal, threads, or signals are needed at all
+  struct GameLog record_log;
+  if (headless) {
+    // An arena grows with the snakes in it, unless told how big to be
+    if (headless_options.arena != 0 && !grid_given) {
+      headless_options.width = arena_default_side(headless_options.arena);
+      headless_options.height = headless_options.width;
+    }
+    // The viewport never shows more than the whole Grid
+    if (headless_options.viewport_width > headless_options.width) {
+      headless_options.viewport_width = headless_options.width;
+    }
+    if (headless_options.viewport_height > headless_options.height) {
+      headless_options.viewport_height = headless_options.height;
+    }
+    if (record_path != NULL) {
+      if (log_create(&record_log, record_path, headless_options.width, headless_options.height, seed) == -1) {
+        exit(5);
+      }
+      headless_options.record = &record_log;
+    }
+    if (headless_options.threads == 0) {
+      signed long processors = sysconf(_SC_NPROCESSORS_ONLN);
+      headless_options.threads = (processors > 0) ? processors : 1;
+    }
+    signed int retval;
+    if        (headless_options.batch != 0) {
+      retval = run_batch(&headless_options, seed);
+    } else if (headless_options.arena != 0) {
+      retval = run_arena(&headless_options, seed);
+    } else {
+      retval = run_headless(&headless_options, seed);
+    }
+    free(headless_options.script);
+    if (replay_path != NULL) {
+      log_destroy(&replay_log);
+    }
+    if (retval == -1) {
+      exit(11);
+    } else if (retval == -2) {
+      exit(4);
+    }
+    if (record_path != NULL && log_finish(&record_log, headless_options.ticks) == -1) {
+      exit(5);
+    }
+    if (profile_path != NULL && profile_write_csv(&profile, profile_path) == -1) {
+      exit(7);
+    }
+    return 0;
   }
+  free(headless_options.script);
   
-  // Setup the Signal Handler for Pause Notifications (USIG_PAUSE)
+  // Set up the event loop.  It waits on key presses from STDIN, on ticks 
+  // coming due from a timerfd, and on terminal resizes from a signalfd.  
+  // SIGWINCH is blocked so that it is only ever seen through the signalfd.
+  struct TerminalGame terminal_game;
+  signed int signal_fd;
+  signed int epoll_fd;
   {
-    struct sigaction sig_action;
-    sig_action.sa_handler = &signal_handle;
-    sigemptyset(&(sig_action.sa_mask));
-    sig_action.sa_flags = 0;
-    sigaction(USIG_PAUSE, &sig_action, NULL);
+    sigset_t resize_signal;
+    sigemptyset(&resize_signal);
+    sigaddset(&resize_signal, SIGWINCH);
+    sigprocmask(SIG_BLOCK, &resize_signal, NULL);
+    
+    signal_fd = signalfd(-1, &resize_signal, SFD_NONBLOCK | SFD_CLOEXEC);
+    terminal_game.tick_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (signal_fd == -1 || terminal_game.tick_fd == -1 || epoll_fd == -1) {
+      exit(12);
+    }
+    signed int fds[] = {STDIN, terminal_game.tick_fd, signal_fd};
+    for (unsigned int i = 0; i < sizeof(fds) / sizeof(fds[0]); i++) {
+      struct epoll_event event;
+      event.events = EPOLLIN;
+      event.data.fd = fds[i];
+      if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fds[i], &event) == -1) {
+        exit(12);
+      }
+    }
   }
   
   // Determine the terminal size
@@ -1042,257 +1604,265 @@ signed int main(signed int argc, char *argv[], char *envp[]) {
     curr_term_height = term_size.ws_row;
     term_width = curr_term_width;
     term_height = curr_term_height;
-    grid_width = term_width - 2;
-    grid_height = term_height - 3;
   }
   
-  // Allocated the memory for the Display Buffer
-  char* display_content = 0;
-  {
-    unsigned int buffer_size = (term_width + 1) * term_height * sizeof(char) * 4;
-    display_content = malloc(buffer_size);
-    // TODO: Handle malloc failure
+  // The Grid fills the terminal, unless given a size by -g, by the 
+  // recording, or by the shared board.  Then the terminal shows as much of 
+  // it as fits, through a viewport that follows the head.
+  unsigned int grid_width = term_width - 2;
+  unsigned int grid_height = term_height - 3;
+  if (grid_given || replay_path != NULL) {
+    grid_width = headless_options.width;
+    grid_height = headless_options.height;
   }
   
-  // Init the Snake
+  // Init the Snake and the Food, either for a new game, where the 
+  // recording is being played back from, or on the shared board
   struct Snake snake;
-  {
-    snake.new_direction = STARTING_DIRECTION;
-    snake.direction = STARTING_DIRECTION;
-    snake.length = STARTING_LENGTH;
-    snake.grid_used_length = STARTING_LENGTH;
-    snake.grow_by = STARTING_GROW_BY;
-    snake.cells = malloc(sizeof(struct GridCell) * STARTING_LENGTH);
-    // TODO: Handle malloc failure
-    snake.cells[0].x = grid_width / 2;
-    snake.cells[0].y = grid_height / 2;
-    for (unsigned int i = 1; i < STARTING_LENGTH; i++) {
-      if (STARTING_DIRECTION == DIR_UP) {
-        snake.cells[i].x = snake.cells[0].x;
-        snake.cells[i].y = snake.cells[0].y + i;
-      } else if (STARTING_DIRECTION == DIR_DOWN) {
-        snake.cells[i].x = snake.cells[0].x;
-        snake.cells[i].y = snake.cells[0].y - i;
-      } else if (STARTING_DIRECTION == DIR_LEFT) {
-        snake.cells[i].x = snake.cells[0].x + i;
-        snake.cells[i].y = snake.cells[0].y;
-      } else {
-        snake.cells[i].x = snake.cells[0].x - i;
-        snake.cells[i].y = snake.cells[0].y;
-      }
+  struct GridCell food;
+  unsigned long game = 0;
+  struct Multiplayer multiplayer;
+  if (multiplayer_name != NULL) {
+    signed int retval = multiplayer_init(&multiplayer, multiplayer_name, grid_width, grid_height, seed);
+    if        (retval == -1) {
+      exit(11);
+    } else if (retval == -2) {
+      exit(13);
+    } else if (retval == -3) {
+      exit(14);
+    }
+    grid_width = multiplayer.board->width;
+    grid_height = multiplayer.board->height;
+  } else if (replay_path != NULL) {
+    if (log_seek(&replay_log, headless_options.seek, &snake, &food, &game) == -1) {
+      exit(4);
+    }
+  } else {
+    if (game_init(&snake, &food, grid_width, grid_height, game_seed(seed, game)) == -1) {
+      exit(11);
     }
   }
+  unsigned int view_width = (term_width - 2 < grid_width) ? term_width - 2 : grid_width;
+  unsigned int view_height = (term_height - 3 < grid_height) ? term_height - 3 : grid_height;
   
-  // Init the Food
-  struct GridCell food;
-  rand_food_location(&food, &snake, grid_width, grid_height);
+  // Start recording
+  if (record_path != NULL) {
+    if (log_create(&record_log, record_path, grid_width, grid_height, seed) == -1) {
+      exit(5);
+    }
+  }
   
-  // START: Setup the Terminal
-  // Set TTY to Raw mode
-  struct termios old_tty_settings;
+  // Start listening for spectators.  They are taken on by the event loop.
+  struct Spectate spectate;
+  if (spectate_path != NULL) {
+    signed int retval = spectate_init(&spectate, spectate_path, grid_width, grid_height);
+    if (retval == -1) {
+      exit(11);
+    } else if (retval == -2) {
+      exit(6);
+    }
+    struct epoll_event event;
+    event.events = EPOLLIN;
+    event.data.fd = spectate.listen_fd;
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, spectate.listen_fd, &event) == -1) {
+      exit(12);
+    }
+  }
+  
+  // Init the Autopilot
+  struct Autopilot autopilot;
+  if (headless_options.autopilot && autopilot_init(&autopilot) == -1) {
+    exit(11);
+  }
+  
+  // Init the Display
+  struct Display display;
   {
-    struct termios raw_tty_settings;
-    signed int retval;
-    retval = ioctl(STDOUT, TCGETS, &old_tty_settings);
+    signed int retval = terminal_display_init(&display, view_width, view_height);
     if (retval == -1) {
       exit(25);
+    } else if (retval == -2) {
+      exit(11);
     }
-    memcpy(&raw_tty_settings, &old_tty_settings, sizeof(struct termios));
-    raw_tty_settings.c_iflag &= ~(IGNBRK | BRKINT | PARMRK | ISTRIP | INLCR | IGNCR | ICRNL | IXON);
-    raw_tty_settings.c_oflag &= ~OPOST;
-    raw_tty_settings.c_lflag &= ~(ECHO | ECHONL | ICANON | ISIG | IEXTEN);
-    raw_tty_settings.c_cflag &= ~(CSIZE | PARENB);
-    raw_tty_settings.c_cflag |= CS8;
-    retval = ioctl(STDOUT, TCSETS, &raw_tty_settings);
+  }
+  
+  // Setup the Terminal
+  struct termios old_tty_settings;
+  {
+    signed int retval = terminal_setup(&old_tty_settings);
     if (retval == -1) {
+      exit(25);
+    } else if (retval == -2) {
       exit(26);
     }
   }
   
-  // Disable the cursor
-  dprintf(STDOUT, "\e[?25l");
-  
-  // Clear the terminal
-  // Clear the scrollback buffer
-  // Reset the terminal cursor position to the top left
-  dprintf(STDOUT, "\e[1;1H\e[0J\e[2J\e[3J\e[1;1H");
-  // END: Setup the Terminal
-  
-  // Init polling struct
-  struct pollfd pfd;
-  pfd.fd = STDIN;
-  pfd.events = POLLIN;
+  // Start the render thread.  From here on, only it writes to the terminal.
+  if (display_start(&display) == -1) {
+    ioctl(STDOUT, TCSETS, &old_tty_settings);
+    exit(10);
+  }
   
   not_paused = 1;
-  score = 0;
+  game_over = 0;
   
-  // Create a New Thread for the Game Loop
-  pthread_t pthread_id_gameloop;
-  pthread_t pthread_id_signals;
-  struct ThreadInfo th_info;
-  {
-    th_info.snake = &snake;
-    th_info.food = &food;
-    th_info.display_content = display_content;
-    sem_init(&sem0, 0, 1);
-    sem_init(&sem1, 0, 1);
-    if (pthread_create(&pthread_id_gameloop, NULL, &game_loop, (void*)&th_info) != 0) {
-      exit(10);
-    }
-    if (pthread_create(&pthread_id_signals, NULL, &signal_receiver_thread, NULL) != 0) {
-      exit(10);
-    }
+  terminal_game.snake = &snake;
+  terminal_game.food = &food;
+  terminal_game.multiplayer = NULL;
+  if (multiplayer_name != NULL) {
+    terminal_game.snake = &multiplayer.snake;
+    terminal_game.food = &multiplayer.food;
+    terminal_game.multiplayer = &multiplayer;
+    multiplayer.profile = headless_options.profile;
+  }
+  terminal_game.display = &display;
+  terminal_game.replay = headless_options.replay;
+  terminal_game.record = NULL;
+  if (record_path != NULL) {
+    terminal_game.record = &record_log;
+  }
+  terminal_game.tick = headless_options.seek;
+  terminal_game.game = game;
+  memset(&terminal_game.tick_stats, 0, sizeof(terminal_game.tick_stats));
+  terminal_game.profile = headless_options.profile;
+  snake.profile = headless_options.profile;
+  display.profile = headless_options.profile;
+  terminal_game.trace = NULL;
+  if (trace_path != NULL) {
+    terminal_game.trace = &trace.rings[TRACE_THREAD_MAIN];
+    display.publish_trace = &trace.rings[TRACE_THREAD_MAIN];
+    display.trace = &trace.rings[TRACE_THREAD_RENDER];
   }
+  terminal_game.keys.state = 0;
+  turn_queue_init(&terminal_game.turns);
+  terminal_game.spectate = NULL;
+  if (spectate_path != NULL) {
+    terminal_game.spectate = &spectate;
+  }
+  terminal_game.autopilot = NULL;
+  if (headless_options.autopilot) {
+    terminal_game.autopilot = &autopilot;
+    autopilot.profile = headless_options.profile;
+  }
+  schedule_ticks(&terminal_game, 1);
   
   unsigned int exit_code = 0;
+  unsigned int quit = 0;
   // Main Event Loop
-  while (1) {
-    // Listen for key-presses (Data) on STDIN
-    signed int retval = poll(&pfd, 1, 3000);
-    if (retval > 0) {
-      if (pfd.revents & (POLLERR | POLLHUP | POLLNVAL)) {
-        // Unhanded or Fault condition
-        exit_code = 1;
-        break;
-      } else {
-        // POLLIN: Data received on STDIN
-        char data = 0;
-        read(STDIN, &data, 1);
-        if        (data == 'q' || data == 'Q') {
-          break;
-        } else if (data == 'e' || data == 'E') {
-          sem_wai2(&sem1);
-          if (term_width == curr_term_width && term_height == curr_term_height) {
-            if (not_paused) {
-              kill(0, USIG_PAUSE); // Dispatch Pause signal to Game Loop thread (Pause)
-              sigset_t wait_signal;
-              sigemptyset(&wait_signal);
-              sigaddset(&wait_signal, USIG_P_ACK);
-              sigwaitinfo(&wait_signal, NULL);
-              
-              not_paused = 0;
-              
-              // Clear the terminal
-              // Clear the scrollback buffer
-              // Reset the terminal cursor position to the top left
-              dprintf(STDOUT, "\e[1;1H\e[0J\e[2J\e[3J\e[1;1H");
-              
-              dprintf(STDOUT, "Game Paused\n\r");
-              dprintf(STDOUT, "Press E to unpause\n\r");
-              dprintf(STDOUT, "Press Q to quit\n\r");
-              dprintf(STDOUT, "Press M to leave the current game and return to the menu (Not Implemented)\n\r");
-              dprintf(STDOUT, "Current Score: %d\n\r", score);
-              dprintf(STDOUT, "Expected terminal size for current game: %dx%d\n\r", term_width, term_height);
-              dprintf(STDOUT, "Current terminal size: %dx%d\n\r", curr_term_width, curr_term_height);
-              dprintf(STDOUT, "The terminal size must match the expected size before unpause will be allowed.\r");
-            } else {
-              dprintf(STDOUT, "\e[1;1H%s", display_content);
-              kill(0, USIG_PAUSE); // Dispatch Pause signal to Game Loop thread (Resume)
-              not_paused = 1;
-            }
-          }
-          sem_post(&sem1);
-        } else {
-          // Game input should not be accepted if the game is paused
-          if (not_paused) {
-            if (data == 'w' || data == 'W') {
-              sem_wai2(&sem0);
-              if (snake.direction == DIR_UP || snake.direction == DIR_LEFT || snake.direction == DIR_RIGHT) {
-                snake.new_direction = DIR_UP;
-              }
-              // Regenerating and Redrawing the display is not necessary if UTF-8 is off because 
-              // the snake doesn't change with basic ASCII encoding in the event of altered 
-              // new_direction settings.  This will help with display performance if running 
-              // through an actual COM port, such as an RS232 or UART, with UTF-8 off.
-              if (utf8_support) {
-                regen_buffer(display_content, &snake, &food);
-                dprintf(STDOUT, "\e[1;1H%s", display_content);
-              }
-              sem_post(&sem0);
-            } else if (data == 's' || data == 'S') {
-              sem_wai2(&sem0);
-              if (snake.direction == DIR_DOWN || snake.direction == DIR_LEFT || snake.direction == DIR_RIGHT) {
-                snake.new_direction = DIR_DOWN;
-              }
-              // Regenerating and Redrawing the display is not necessary if UTF-8 is off because 
-              // the snake doesn't change with basic ASCII encoding in the event of altered 
-              // new_direction settings.  This will help with display performance if running 
-              // through an actual COM port, such as an RS232 or UART, with UTF-8 off.
-              if (utf8_support) {
-                regen_buffer(display_content, &snake, &food);
-                dprintf(STDOUT, "\e[1;1H%s", display_content);
-              }
-              sem_post(&sem0);
-            } else if (data == 'a' || data == 'A') {
-              sem_wai2(&sem0);
-              if (snake.direction == DIR_UP || snake.direction == DIR_LEFT || snake.direction == DIR_DOWN) {
-                snake.new_direction = DIR_LEFT;
-              }
-              // Regenerating and Redrawing the display is not necessary if UTF-8 is off because 
-              // the snake doesn't change with basic ASCII encoding in the event of altered 
-              // new_direction settings.  This will help with display performance if running 
-              // through an actual COM port, such as an RS232 or UART, with UTF-8 off.
-              if (utf8_support) {
-                regen_buffer(display_content, &snake, &food);
-                dprintf(STDOUT, "\e[1;1H%s", display_content);
-              }
-              sem_post(&sem0);
-            } else if (data == 'd' || data == 'D') {
-              sem_wai2(&sem0);
-              if (snake.direction == DIR_UP || snake.direction == DIR_RIGHT || snake.direction == DIR_DOWN) {
-                snake.new_direction = DIR_RIGHT;
-              }
-              // Regenerating and Redrawing the display is not necessary if UTF-8 is off because 
-              // the snake doesn't change with basic ASCII encoding in the event of altered 
-              // new_direction settings.  This will help with display performance if running 
-              // through an actual COM port, such as an RS232 or UART, with UTF-8 off.
-              if (utf8_support) {
-                regen_buffer(display_content, &snake, &food);
-                dprintf(STDOUT, "\e[1;1H%s", display_content);
-              }
-              sem_post(&sem0);
-            }
-          }
-        }
-      }
-    } else if (retval < 0) {
-      // Poll syscall error
+  while (!quit) {
+    struct epoll_event events[4];
+    uint64_t trace_start = (terminal_game.trace != NULL) ? trace_now(terminal_game.trace) : 0;
+    signed int count = epoll_wait(epoll_fd, events, sizeof(events) / sizeof(events[0]), -1);
+    if (terminal_game.trace != NULL) {
+      trace_span(terminal_game.trace, "epoll_wait", trace_start, (count > 0) ? count : 0);
+    }
+    if (count < 0) {
+      // epoll_wait syscall error
       // All errors treated as fatal except for 
-      // EINTR (Signal received while polling) 
-      // In this case, simply restart polling.
+      // EINTR (Signal received while waiting) 
+      // In this case, simply restart waiting.
       if (errno != EINTR) {
         exit_code = 2;
         break;
       }
+      continue;
+    }
+    
+    for (signed int i = 0; i < count && !quit; i++) {
+      if        (events[i].data.fd == terminal_game.tick_fd) {
+        play_due_ticks(&terminal_game);
+      } else if (events[i].data.fd == signal_fd) {
+        handle_resize(&terminal_game, signal_fd);
+      } else if (spectate_path != NULL && events[i].data.fd == spectate.listen_fd) {
+        spectate_accept(&spectate);
+      } else if (events[i].events & (EPOLLERR | EPOLLHUP)) {
+        // Unhanded or Fault condition on STDIN
+        exit_code = 1;
+        quit = 1;
+      } else {
+        // Data received on STDIN
+        trace_start = (terminal_game.trace != NULL) ? trace_now(terminal_game.trace) : 0;
+        read_keys(&terminal_game, &quit);
+        if (terminal_game.trace != NULL) {
+          trace_span(terminal_game.trace, "keys", trace_start, terminal_game.turns.tail - terminal_game.turns.head);
+        }
+      }
     }
   }
   
   // Clean up and exit:
+  display_stop(&display);
+  close(epoll_fd);
+  close(terminal_game.tick_fd);
+  close(signal_fd);
   
-  // Join the threads here
-  pthread_cancel(pthread_id_gameloop);
-  pthread_cancel(pthread_id_signals);
-  pthread_join(pthread_id_gameloop, NULL);
-  pthread_join(pthread_id_signals, NULL);
-  sem_destroy(&sem0);
-  sem_destroy(&sem1);
-  
-  // START: Restore the Terminal
-  // Enable the cursor
-  dprintf(STDOUT, "\e[?25h");
+  // Restore the Terminal
+  terminal_restore(&old_tty_settings);
   
-  // Restore the TTY to the original mode
-  ioctl(STDOUT, TCSETS, &old_tty_settings);
-  // END: Restore the Terminal
+  // Finish off the game logs
+  signed int log_failed = 0;
+  if (record_path != NULL) {
+    log_failed = (log_finish(&record_log, terminal_game.tick) == -1);
+  }
+  if (replay_path != NULL) {
+    log_destroy(&replay_log);
+  }
   
-  // Free the memory
-  free(snake.cells);
-  free(display_content);
+  // Free the memory, and give up the place on the shared board
+  if (multiplayer_name != NULL) {
+    multiplayer_destroy(&multiplayer);
+  } else {
+    snake_destroy(&snake);
+  }
+  display_destroy(&display);
+  if (spectate_path != NULL) {
+    spectate_destroy(&spectate);
+  }
+  if (headless_options.autopilot) {
+    autopilot_destroy(&autopilot);
+  }
   
   dprintf(STDOUT, "\n");
   
+  if (print_lateness) {
+    print_tick_stats(&terminal_game.tick_stats);
+    dprintf(STDOUT, "frames_published: %lu\n", display.published);
+    dprintf(STDOUT, "frames_drawn: %lu\n", display.drawn);
+    dprintf(STDOUT, "frames_dropped: %lu\n", display.dropped);
+    dprintf(STDOUT, "output_stalls: %lu\n", display.output_stalls);
+    if (spectate_path != NULL) {
+      dprintf(STDOUT, "spectators_joined: %lu\n", spectate.joined);
+      dprintf(STDOUT, "spectators_dropped: %lu\n", spectate.dropped);
+      dprintf(STDOUT, "spectator_messages_sent: %lu\n", spectate.sent);
+      dprintf(STDOUT, "spectator_messages_skipped: %lu\n", spectate.skipped);
+      dprintf(STDOUT, "spectator_bytes: %llu\n", spectate.bytes);
+    }
+    if (multiplayer_name != NULL) {
+      dprintf(STDOUT, "multiplayer_ticks_led: %lu\n", multiplayer.ticks_led);
+      dprintf(STDOUT, "multiplayer_evictions: %lu\n", multiplayer.evictions);
+      histogram_print(&multiplayer.input_latency, "input_to_tick", "ns");
+    }
+  }
+  signed int profile_failed = 0;
+  if (profile_path != NULL) {
+    profile_print(&profile);
+    profile_failed = (profile_write_csv(&profile, profile_path) == -1);
+  }
+  // Both threads are done with the Trace by now
+  signed int trace_failed = 0;
+  if (trace_path != NULL) {
+    trace_failed = (trace_write_json(&trace, trace_path) == -1);
+    trace_destroy(&trace);
+  }
+  
   if (exit_code > 0) {
     exit_code += 50;
+  } else if (log_failed) {
+    exit_code = 5;
+  } else if (profile_failed) {
+    exit_code = 7;
+  } else if (trace_failed) {
+    exit_code = 8;
   }
   
   return exit_code;
@@ -0,0 +1,1243 @@
+/*
+ * Name: Snake in C
+ * Author: Michael T. Kloos
+ *
+ * Copyright:
+ * (C) Copyright 2022 Michael T. Kloos (http://www.michaelkloos.com/).
+ * All Rights Reserved.
+ */
+
+#ifndef SNAKE_H
+#define SNAKE_H
+
+#include <time.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <semaphore.h>
+
+#define STDIN 0
+#define STDOUT 1
+#define STDERR 2
+
+#define DIR_UP 0
+#define DIR_DOWN 1
+#define DIR_LEFT 2
+#define DIR_RIGHT 3
+
+// Which sides of its Grid space a snake cell connects to
+// Bit positions line up with the DIR_* values: (1 << DIR_*)
+#define LINK_UP (1 << DIR_UP)
+#define LINK_DOWN (1 << DIR_DOWN)
+#define LINK_LEFT (1 << DIR_LEFT)
+#define LINK_RIGHT (1 << DIR_RIGHT)
+// The LINK_* sides facing the other way
+#define LINK_OPPOSITE(links) ((((links) & (LINK_UP | LINK_LEFT)) << 1) | (((links) & (LINK_DOWN | LINK_RIGHT)) >> 1))
+
+// Keys found by key_parse() that are not a single byte: The arrow keys, 
+// each given as KEY_ARROW + DIR_*
+#define KEY_ARROW 0x100
+
+// What is drawn on a Grid space
+#define GLYPH_EMPTY 0
+#define GLYPH_FOOD 1
+#define GLYPH_SNAKE_TB 2
+#define GLYPH_SNAKE_LR 3
+#define GLYPH_SNAKE_TL 4
+#define GLYPH_SNAKE_TR 5
+#define GLYPH_SNAKE_BL 6
+#define GLYPH_SNAKE_BR 7
+#define GLYPH_FALLBACK_SNAKE 8
+#define GLYPH_FALLBACK_FOOD 9
+#define GLYPH_BORDER_VERTICAL 10
+#define GLYPH_BORDER_HORIZONTAL 11
+#define GLYPH_BORDER_CORNER_TOPLEFT 12
+#define GLYPH_BORDER_CORNER_TOPRIGHT 13
+#define GLYPH_BORDER_CORNER_BOTTOMLEFT 14
+#define GLYPH_BORDER_CORNER_BOTTOMRIGHT 15
+#define GLYPH_FALLBACK_BORDER 16
+#define GLYPH_COUNT 17
+
+// How many changed Grid spaces the snake keeps track of for the display.  
+// If more than this change before the display catches up, it is redrawn in full.
+#define DAMAGE_LOG_SIZE 32
+
+// What each Grid space holds in an observation of a game, one byte per space
+// The low 4 bits are the LINK_* sides of the snake cell on it, if any.
+#define OBSERVE_HEAD 0x10
+#define OBSERVE_FOOD 0x20
+
+// A game in a batch that is not to turn this tick
+#define BATCH_NO_TURN 0xFF
+
+// What the workers of a batch are to do
+#define BATCH_JOB_INIT 0
+#define BATCH_JOB_STEP 1
+
+// What the workers of a lookahead are to do
+#define LOOKAHEAD_JOB_SEARCH 0
+
+// What the workers of an arena are to do: Each phase of a tick, in the 
+// order they are done in
+#define ARENA_JOB_STEER 0
+#define ARENA_JOB_JUDGE 1
+#define ARENA_JOB_VACATE 2
+#define ARENA_JOB_ADVANCE 3
+
+// Game Log File Format
+// A header of LOG_MAGIC, then varints for the Grid width, Grid height, 
+// and seed of the run.  Then one record after another, each starting 
+// with a varint of (ticks since the last record << 3) | LOG_RECORD_*.  
+// Varints are unsigned LEB128: 7 bits per byte, low bits first, with 
+// the top bit set on every byte but the last.
+#define LOG_MAGIC "SNK1"
+// Records 0 through 3: The snake turns to that DIR_* at the start of the tick
+#define LOG_RECORD_INPUT 0
+// The state of the game at the start of the tick: A varint of how many 
+// bytes long the rest of it is, then varints for the game number, score, 
+// direction, pending growth, grow-by, food x + 1, food y + 1, random 
+// state, length, head x, and head y.  Then the DIR_* from each cell on 
+// to the next, from the head back, 4 to a byte starting from the low bits.
+#define LOG_RECORD_KEYFRAME 4
+// The run stopped before this tick.  Always the last record.
+#define LOG_RECORD_END 5
+
+// Spectator Stream Format
+// A header of SPECTATE_MAGIC, then varints for the Grid width and Grid 
+// height.  Then one message after another, each starting with a byte of 
+// SPECTATE_MESSAGE_* or'd with the flags that go with it.  Varints are 
+// as in a game log.
+#define SPECTATE_MAGIC "SNKS"
+#define SPECTATE_MESSAGE_MASK 0xE0
+// One tick played: The low 2 bits are the DIR_* the head moved.  Or'd 
+// with SPECTATE_TAIL_FREED if the tail moved up behind it, with 
+// SPECTATE_FOOD_MOVED if varints for food x + 1 and food y + 1 follow, 
+// and with SPECTATE_SCORE if a varint of the new score follows.
+#define SPECTATE_MESSAGE_TICK 0x00
+#define SPECTATE_TAIL_FREED 0x04
+#define SPECTATE_FOOD_MOVED 0x08
+#define SPECTATE_SCORE 0x10
+// The whole game after the tick just played, in place of the change: A 
+// varint of how many bytes long the rest of it is, then the same as the 
+// rest of a LOG_RECORD_KEYFRAME
+#define SPECTATE_MESSAGE_KEYFRAME 0x20
+// The game is over.  Always the last message.
+#define SPECTATE_MESSAGE_END 0x40
+
+// START: Build-Time Configuration Definitions
+
+// What direction should the snake be pointing at start?
+#define STARTING_DIRECTION DIR_UP
+// How long should the snake be at the start?  This must be at least 2.
+#define STARTING_LENGTH 5
+// How many cells should be added to the snake when food is consumed?
+// If GROW_BY_INCREMENT is not 0, this will change after the first unit 
+// of food is consumed.
+#define STARTING_GROW_BY 2
+// What should be added to the "Grow By" rate after food is consumed?
+#define GROW_BY_INCREMENT 2
+// How long should the delay between ticks be in milliseconds?
+#define DELAY_TIME_MS 150
+// How many ticks behind schedule can the game fall before it gives up on 
+// catching up?  Until then, late ticks are run back to back to get back 
+// on schedule.  Past this, the ticks missed are skipped instead, and the 
+// schedule carries on from where it is now.
+#define TICK_CATCH_UP_LIMIT 3
+// How many ticks apart should the keyframes in a game log be?  Playback 
+// can only jump straight to a keyframe.  Anything after one is reached by 
+// playing on from it.
+#define LOG_KEYFRAME_INTERVAL 4096
+// How many games of a batch should a worker take at a time?  Workers 
+// that run out steal from the others this many games at a time.
+#define BATCH_CHUNK_SIZE 16
+// In headless batch mode, how many ticks should each call to batch_step() play?
+#define HEADLESS_BATCH_TICKS 64
+// In headless mode, how often should a tick be timed phase by phase?  
+// Reading the clock costs about as much as a whole tick, so only 1 tick 
+// in this many is timed that closely.
+#define HEADLESS_SAMPLE_INTERVAL 64
+// How many turns can be queued up ahead of the snake?  The snake takes 
+// one per tick, so that two turns made within one tick both happen.  
+// Must be a power of 2.
+#define TURN_QUEUE_SIZE 8
+// How finely should the histograms of a Profile split each power of 2, 
+// as a power of 2 itself?  Every value is counted to within 1 part in 
+// 2^this of what it really was.
+#define HISTOGRAM_SUB_BUCKET_BITS 4
+// How many cells should a snake body have room for to begin with?  It 
+// doubles whenever the snake outgrows it, up to the size of the Grid, so 
+// that a snake on a huge Grid only takes memory for as long as it is.
+#define SNAKE_BODY_INITIAL_CAPACITY 4096
+// How far around the head should the autopilot look for a way to the 
+// food?  It searches a square of this many Grid spaces a side, centred on 
+// the head, which bounds how long a decision takes on any size of Grid.  
+// Must be odd.
+#define AUTOPILOT_WINDOW_SIDE 65
+// How many spaces of the window can the autopilot search from for a way 
+// to the food, before it settles for the best way found so far?
+#define AUTOPILOT_SEARCH_LIMIT 1024
+// How many ticks should a lookahead rollout play on for, at most?
+#define LOOKAHEAD_DEPTH 64
+// How many rollouts of a lookahead should a worker take at a time?
+#define LOOKAHEAD_CHUNK_SIZE 4
+// How many Grid spaces should an arena have for each snake on it, when 
+// the size of its Grid is not given?
+#define ARENA_SPACES_PER_SNAKE 400
+// How many units of food should an arena have on it for each snake?
+#define ARENA_FOOD_PER_SNAKE 1
+// How many cells should the body of an arena snake have room for to 
+// begin with?  It doubles whenever the snake outgrows it.
+#define ARENA_BODY_INITIAL_CAPACITY 64
+// How many steps away can an arena snake see food?  It heads for the 
+// closest unit of food in sight, and wanders while there is none.
+#define ARENA_SIGHT 64
+// How many Grid spaces a side are the blocks an arena counts the food 
+// in?  Snakes look for food a block at a time, skipping empty blocks.
+#define ARENA_BLOCK_SIDE 8
+// How many snakes of an arena should a worker take at a time?
+#define ARENA_CHUNK_SIZE 16
+// How many Grid spaces should be tried at random for a new snake or unit 
+// of food, before giving up on it until the next tick?
+#define ARENA_PLACE_TRIES 64
+// How many ticks apart should the keyframes sent to spectators be?  A 
+// spectator that joins, or falls behind, waits for the next one.
+#define SPECTATE_KEYFRAME_INTERVAL 32
+// How many spectators can watch a game at once?
+#define SPECTATE_MAX_SPECTATORS 256
+// How many bytes can be left waiting for a spectator that is not reading 
+// fast enough?  Past this, the messages to it are skipped until a 
+// keyframe fits again.  Each Spectate can be given a limit of its own.
+#define SPECTATE_BACKLOG_LIMIT 65536
+// How many keyframes in a row can a spectator miss before it is dropped?
+#define SPECTATE_MAX_MISSED_KEYFRAMES 4
+// How many players can share a multiplayer board?  No more than 8, as 
+// the tick barrier keeps a bit for each of them in a byte.
+#define MULTIPLAYER_MAX_PLAYERS 8
+// How long should the players waiting at the tick barrier wait for one 
+// that has not got there, before dropping it from the game?  This keeps 
+// a player that has died or been stopped from holding up the rest for good.
+#define MULTIPLAYER_BARRIER_TIMEOUT_MS 1000
+// How many places should be tried at random for the snake of a new 
+// player, when the one set aside for it is taken, before turning the 
+// player away?
+#define MULTIPLAYER_SPAWN_TRIES 64
+// How many events should each thread keep for a trace?  Once a thread 
+// has this many, each new one replaces its oldest.  Must be a power of 2.
+#define TRACE_RING_SIZE 65536
+// Store the snake body as a stream of 2-bit directions, packed into 
+// 64-bit words, instead of as the coordinates of every cell?  The body 
+// then takes 1/16th of the memory, which matters on very large Grids.
+// #define PACKED_SNAKE_BODY
+
+// Each glyph is the string of bytes sent to the terminal to draw it, 
+// which must be no more than 3 bytes long.
+
+// Border Cell: Vertical U+2503: ┃
+#define BORDER_VERTICAL "\xE2\x94\x83"
+// Border Cell: Horizontal U+2501: ━
+#define BORDER_HORIZONTAL "\xE2\x94\x81"
+// Border Cell: Top-Left Corner U+250F: ┏
+#define BORDER_CORNER_TOPLEFT "\xE2\x94\x8F"
+// Border Cell: Top-Right Corner U+2513: ┓
+#define BORDER_CORNER_TOPRIGHT "\xE2\x94\x93"
+// Border Cell: Bottom-Left Corner U+2517: ┗
+#define BORDER_CORNER_BOTTOMLEFT "\xE2\x94\x97"
+// Border Cell: Bottom-Right Corner U+251B: ┛
+#define BORDER_CORNER_BOTTOMRIGHT "\xE2\x94\x9B"
+
+// Snake Cell: Vertical U+2502: │
+#define SNAKE_CELL_TB "\xE2\x94\x82"
+// Snake Cell: Horizontal U+2500: ─
+#define SNAKE_CELL_LR "\xE2\x94\x80"
+// Snake Cell: Top-Left U+256F: ╯
+#define SNAKE_CELL_TL "\xE2\x95\xAF"
+// Snake Cell: Top-Right U+2570: ╰
+#define SNAKE_CELL_TR "\xE2\x95\xB0"
+// Snake Cell: Bottom-Left U+256E: ╮
+#define SNAKE_CELL_BL "\xE2\x95\xAE"
+// Snake Cell: Bottom-Right U+256D: ╭
+#define SNAKE_CELL_BR "\xE2\x95\xAD"
+
+// Food Cell: U+2B25: ⬥
+#define FOOD_CELL "\xE2\xAC\xA5"
+
+// Fallback Border: X
+#define FALLBACK_BORDER "X"
+// Fallback Snake: +
+#define FALLBACK_SNAKE "+"
+// Fallback Food: F
+#define FALLBACK_FOOD_CELL "F"
+
+// END: Build-Time Configuration Definitions
+
+extern unsigned int utf8_support;
+
+struct GridCell {
+  signed int x;
+  signed int y;
+};
+
+// The phases of the game timed by a Profile
+// A whole tick on the game thread
+#define PROFILE_TICK 0
+// snake_crawl(), food placement included
+#define PROFILE_CRAWL 1
+// rand_food_location(), when food was eaten
+#define PROFILE_FOOD 2
+// Handing a Frame over to the render thread
+#define PROFILE_PUBLISH 3
+// Rendering a Frame into the Buffer
+#define PROFILE_RENDER 4
+// Writing a Frame to the terminal, waits included
+#define PROFILE_WRITE 5
+// Waiting on a terminal that is not taking any more output
+#define PROFILE_OUTPUT_WAIT 6
+// The bytes written for a Frame.  Not a time.
+#define PROFILE_FRAME_BYTES 7
+// autopilot_steer() deciding which way to go
+#define PROFILE_AUTOPILOT 8
+// spectate_tick() sending the tick to every spectator
+#define PROFILE_SPECTATE 9
+// Waiting at the tick barrier of a multiplayer game for the other 
+// players, and playing the tick for all of them if last to get there
+#define PROFILE_BARRIER 10
+#define PROFILE_COUNT 11
+
+// The threads a Trace keeps events for
+// The event loop of the game on the terminal
+#define TRACE_THREAD_MAIN 0
+// The render thread of the Display
+#define TRACE_THREAD_RENDER 1
+#define TRACE_THREAD_COUNT 2
+
+// Values under 2^HISTOGRAM_SUB_BUCKET_BITS get a bucket each.  Every 
+// power of 2 above that is split into that many buckets.
+#define HISTOGRAM_SUB_BUCKETS (1u << HISTOGRAM_SUB_BUCKET_BITS)
+#define HISTOGRAM_BUCKETS ((64 - HISTOGRAM_SUB_BUCKET_BITS + 1) * HISTOGRAM_SUB_BUCKETS)
+
+// What a Frame shows: The Grid, the Pause Menu, or the Game Over screen
+#define FRAME_GAME 0
+#define FRAME_PAUSED 1
+#define FRAME_GAME_OVER 2
+
+// Set in Display::middle while the Frame there has not been taken by the 
+// render thread yet
+#define DISPLAY_FRAME_FRESH 0x4
+
+// Set in Autopilot::first_step once the search has searched on from a space
+#define AUTOPILOT_SEARCHED 0x80
+
+// Set in Arena::owners on a Grid space with food on it.  The rest of the 
+// bits say which unit of food it is.
+#define ARENA_FOOD 0x8000
+// Arena::owners takes the number of a snake, plus 1, and that of a unit 
+// of food, below ARENA_FOOD
+#define ARENA_MAX_SNAKES ((ARENA_FOOD - 2) / ARENA_FOOD_PER_SNAKE)
+
+// Set in MultiplayerBoard::magic once the board has been set up
+#define MULTIPLAYER_MAGIC 0x4D4B4E53
+// How long the name of the shared memory behind a multiplayer board can 
+// be, "/snake-" included
+#define MULTIPLAYER_NAME_SIZE 64
+
+// What a slot of a multiplayer board holds
+// Nobody
+#define MULTIPLAYER_SLOT_FREE 0
+// A new player, whose snake the next tick puts down
+#define MULTIPLAYER_SLOT_JOINING 1
+#define MULTIPLAYER_SLOT_PLAYING 2
+// A snake that has run into something.  It stays where it is for a tick, 
+// and the next tick takes it off the Grid.
+#define MULTIPLAYER_SLOT_OUT 3
+// A player whose snake is off the Grid, or never got on it
+#define MULTIPLAYER_SLOT_GONE 4
+// A player that has left.  The next tick takes its snake off the Grid 
+// and frees the slot.
+#define MULTIPLAYER_SLOT_LEAVING 5
+
+// MultiplayerBoard::barrier, all in the one futex word: A bit for each 
+// player that has got to the barrier for this tick, a bit for each 
+// player the barrier waits for, set while the tick is being played, and 
+// a count of the ticks played, from MULTIPLAYER_GENERATION up
+#define MULTIPLAYER_ARRIVED(barrier) ((barrier) & 0xFF)
+#define MULTIPLAYER_MEMBERS(barrier) (((barrier) >> 8) & 0xFF)
+#define MULTIPLAYER_MEMBER(player) (0x100u << (player))
+#define MULTIPLAYER_TICKING 0x10000u
+#define MULTIPLAYER_GENERATION 0x20000u
+
+// The snake body stores its coordinates in 16 bits each, which limits 
+// how wide and how tall a Grid can be
+#define GRID_MAX_SIDE 0xFFFF
+
+// The Grid is stored in square tiles of this many spaces a side, each 
+// allocated only once the snake first moves onto it.  A row of a tile is 
+// 64 bytes, so that the empty spaces in it fit in one 64-bit word.
+#define GRID_TILE_SIDE 64
+#define GRID_TILE_SPACES (GRID_TILE_SIDE * GRID_TILE_SIDE)
+
+// The bytes sent to the terminal to draw a glyph
+struct GlyphBytes {
+  // Padded out so that it can always be copied whole.  Only the first 
+  // [length] bytes are part of the glyph.
+  char bytes[4];
+  unsigned int length;
+};
+
+// Where key_parse() is in an escape sequence sent by a key
+struct KeyParser {
+  // 0: Not in one, 1: After ESC, 2: After ESC [ or ESC O
+  unsigned int state;
+};
+
+// Turns queued up by the player, for the snake to take one per tick
+// Single producer, single consumer: One thread may push while another 
+// pops, without a lock.  [head] is only written by the consumer and 
+// [tail] only by the producer.  Both count up forever and wrap.
+struct TurnQueue {
+  unsigned int head;
+  unsigned int tail;
+  unsigned char directions[TURN_QUEUE_SIZE];
+};
+
+// One game: The snake, the Grid it is on, and everything else about it 
+// but the food.  Nothing is shared between snakes, so separate games can 
+// be played on separate threads.
+struct Snake {
+  // Where to time the phases of a tick, or NULL not to
+  struct Profile *profile;
+  // The size of the Grid
+  unsigned int width;
+  unsigned int height;
+  unsigned int score;
+  unsigned int new_direction;
+  unsigned int direction;
+  unsigned int length;
+  // Cells still to be added to the snake from food already eaten.  
+  // The tail stays put for one tick per cell until this runs out.
+  unsigned int pending_growth;
+  unsigned int grow_by;
+  // The two ends of the snake, kept apart from the body so that a crawl 
+  // does not have to go looking for them
+  struct GridCell head_cell;
+  struct GridCell tail_cell;
+#ifdef PACKED_SNAKE_BODY
+  // Ring buffer of [capacity] 2-bit slots, 32 to each word.  Slot [head] 
+  // holds the DIR_* from the head to the next cell, and so on down the 
+  // body, wrapping around at the end.  Everything between the two ends 
+  // is found by walking the directions.
+  uint64_t *body;
+#else
+  // Ring buffer of [capacity] snake cells, split into an array of x 
+  // coordinates and one of y coordinates.  The head is at index [head] 
+  // and the body follows on from it, wrapping around at the end.  
+  // Use snake_cell() to find the nth cell from the head.
+  uint16_t *cells_x;
+  uint16_t *cells_y;
+#endif
+  unsigned int capacity;
+  unsigned int head;
+  // Fenwick tree of how many empty Grid spaces there are in each row, for 
+  // finding the nth empty space in Grid order.  Node [n], counting from 1, 
+  // covers the (n & -n) rows up to and including row n - 1.
+  unsigned int *free_counts;
+  unsigned int free_cell_count;
+  // The snake's own random number generator (SplitMix64), which decides 
+  // where the food goes.  The same seed always gives the same game.
+  uint64_t random_state;
+  // The LINK_* sides each occupied Grid space connects to (0 if empty)
+  // Split into tiles of GRID_TILE_SIDE by GRID_TILE_SIDE spaces, indexed 
+  // by: (y / GRID_TILE_SIDE) * tiles_across + x / GRID_TILE_SIDE.  A tile 
+  // the snake has never been on points at grid_empty_tile, and is only 
+  // allocated when it first moves onto it.  Use grid_space_links().  
+  // This doubles as the occupancy map, as every snake cell links somewhere.  
+  // The head is recomputed when rendering since it follows new_direction.
+  unsigned char **tiles;
+  unsigned int tiles_across;
+  // Which tiles have been allocated, in the order they were, so that they 
+  // can be cleared without looking through the rest
+  unsigned int *used_tiles;
+  unsigned int used_tile_count;
+  // Grid spaces whose links have changed since the display last caught up.  
+  // [damage_count] runs past DAMAGE_LOG_SIZE once there are too many to list.
+  unsigned int damaged_cells[DAMAGE_LOG_SIZE];
+  unsigned int damage_count;
+};
+
+// What the terminal is currently showing of the game
+// A Grid bigger than the terminal is shown through a [width] by [height] 
+// viewport onto it, which scrolls to follow the head.
+struct Screen {
+  // The GLYPH_* drawn on each space of the viewport
+  // Indexed by: y * width + x
+  unsigned char *glyphs;
+  unsigned int width;
+  unsigned int height;
+  // The Grid space shown in the top left corner.  The viewport wraps 
+  // around the edges of the Grid, as the snake does.
+  unsigned int origin_x;
+  unsigned int origin_y;
+  unsigned int score;
+  struct GridCell food;
+  // Set when the terminal is not showing the Grid at all, such as before 
+  // the first frame or after the Pause Menu.  The next frame is drawn in full.
+  unsigned int stale;
+};
+
+// A count of values in buckets that grow with the value, so that any 
+// value from 1 up to 2^64 is kept to the same relative precision in 
+// fixed memory, as in an HDR histogram
+struct Histogram {
+  unsigned long long count;
+  unsigned long long total;
+  unsigned long long min;
+  unsigned long long max;
+  unsigned long long buckets[HISTOGRAM_BUCKETS];
+};
+
+// Where the time goes in the phases of the game, one histogram each
+// Each histogram is only ever recorded to by one thread.
+struct Profile {
+  struct Histogram histograms[PROFILE_COUNT];
+};
+
+// Something that happened on a thread, for a Trace
+struct TraceEvent {
+  // When it happened, and for how long, in nanoseconds since the Trace started
+  uint64_t start_ns;
+  uint64_t duration_ns;
+  // What it was, and a number that goes with it
+  const char *name;
+  uint64_t value;
+  // As in the Chrome trace event format: 'X' for something that took 
+  // time, 'i' for something that did not, and 's' and 'f' for the start 
+  // and finish of a hand over from one thread to another, with [value] 
+  // matching the two up
+  char phase;
+};
+
+// The events of one thread, in a ring buffer of TRACE_RING_SIZE
+// Only the thread itself ever records to it, so it needs no lock.
+struct TraceRing {
+  const char *thread_name;
+  // How many events have been recorded in all.  Event [n] is kept in 
+  // slot (n % TRACE_RING_SIZE) until it is replaced.
+  unsigned long long count;
+  struct TraceEvent *events;
+  struct timespec *start;
+};
+
+// Events from every thread, on one timeline, to be viewed in a trace viewer
+struct Trace {
+  struct timespec start;
+  struct TraceRing rings[TRACE_THREAD_COUNT];
+};
+
+// A snapshot of the game, as published for the render thread to draw
+// Nothing in it changes from when it is published until the game takes 
+// it back to fill in again.
+struct Frame {
+  // FRAME_*
+  unsigned int mode;
+  unsigned int score;
+  // The GLYPH_* of each Grid space, as for Screen::glyphs
+  unsigned char *glyphs;
+  // The size the terminal is now, for the Pause Menu
+  unsigned int term_width;
+  unsigned int term_height;
+  // Counts up by 1 with every Frame published
+  unsigned long sequence;
+};
+
+// The terminal, drawn by a thread of its own so that a terminal that is 
+// slow to take output never holds up the game
+// The game and the render thread pass Frames through a triple buffer.  
+// The game fills in [back] and swaps it with [middle].  The render thread 
+// swaps [front] with [middle] whenever there is a newer Frame there, so 
+// it always draws the latest one.  Any it never got to are dropped.
+struct Display {
+  struct Frame frames[3];
+  // Game: The Frame being filled in, and the game as last published
+  unsigned int back;
+  struct Screen model;
+  unsigned long published;
+  // Shared: The index of the spare Frame, or'd with DISPLAY_FRAME_FRESH 
+  // if it has not been drawn
+  unsigned int middle;
+  // Render thread: The Frame being drawn, and what the terminal shows
+  unsigned int front;
+  struct Screen terminal;
+  char *buffer;
+  unsigned long buffer_size;
+  // Render thread: Written to without blocking.  Output the terminal is 
+  // not ready for waits until it is, while newer Frames replace the one 
+  // waiting to be drawn.
+  signed int output_fd;
+  // Written to wake the render thread: When a Frame is published, or when 
+  // [redraw] or [stop] is set
+  signed int wake_fd;
+  // Set to have the render thread draw the Grid in full next time, or to stop
+  unsigned int redraw;
+  unsigned int stop;
+  pthread_t thread;
+  // Render thread: What has been drawn, how many Frames were dropped 
+  // unseen, and how many times output had to wait for the terminal
+  unsigned long drawn;
+  unsigned long dropped;
+  unsigned long output_stalls;
+  unsigned long last_sequence;
+  unsigned int last_frame_bytes;
+  unsigned long long bytes;
+  // The size of terminal the game was started on, that it must be to 
+  // unpause.  The Grid may be smaller or bigger than it shows.
+  unsigned int term_width;
+  unsigned int term_height;
+  // Render thread: Where to time drawing the Frames, or NULL not to
+  struct Profile *profile;
+  // Render thread: Where to trace what it does, or NULL not to
+  struct TraceRing *trace;
+  // Game: Where to trace Frames being published, or NULL not to
+  struct TraceRing *publish_trace;
+};
+
+// Steers a snake towards the food by itself
+// Each decision searches a window of the Grid around the head, by A*, 
+// for the shortest way to the food.  If there is none, or taking it 
+// would leave the snake too little room, it follows a Hamiltonian cycle 
+// of the Grid instead, or failing that makes for the most room.  The 
+// scratch space is allocated once up front, for the biggest window.
+struct Autopilot {
+  // Where to time each decision, or NULL not to
+  struct Profile *profile;
+  // The window being searched: The Grid space in its top left corner, and 
+  // its size.  Across an axis it spans the whole of, the window wraps 
+  // around as the Grid does.  Otherwise its edges lead off to spaces it 
+  // does not look at.
+  unsigned int origin_x;
+  unsigned int origin_y;
+  unsigned int width;
+  unsigned int height;
+  unsigned int wraps_x;
+  unsigned int wraps_y;
+  // The window space the head is on, as x | (y << 16)
+  uint32_t head;
+  // Indexed by window space, y * width + x: The LINK_* of the snake cell 
+  // still on it next tick (0 if none), the DIR_* from the head that the 
+  // search reached it by (or'd with AUTOPILOT_SEARCHED once it has been 
+  // searched from), how many steps that took, and the number of the last 
+  // search that reached it.  Anything but [links] only holds for a space 
+  // the current search has reached.
+  unsigned char *links;
+  unsigned char *first_step;
+  uint16_t *steps;
+  unsigned int *seen;
+  unsigned int search;
+  // Window spaces still to be searched from, as x | (y << 16).  Room for 
+  // two stacks of 4 per window space, as the search needs.
+  uint32_t *queue;
+  // How many decisions were made, and how many of those fell back to the 
+  // cycle or to the most room
+  unsigned long decisions;
+  unsigned long fallbacks;
+};
+
+// A whole game in one block of memory, header and all, so that it can be 
+// copied with one memcpy() by game_state_copy()
+// Everything the snake points to follows the header in the same block: 
+// Its body, with room to fill the Grid so that it never has to grow, the 
+// Fenwick tree, the table and list of tiles, and every tile of the Grid, 
+// all allocated up front.  So playing on from it never allocates.  The 
+// pointers in the copy are then moved over to the copy's own block.
+struct GameState {
+  // How big the whole block is, in bytes
+  unsigned long size;
+  // Where each part the snake points to starts, in bytes from the start of the block
+  unsigned long body_offset;
+#ifndef PACKED_SNAKE_BODY
+  unsigned long cells_y_offset;
+#endif
+  unsigned long free_counts_offset;
+  unsigned long tiles_offset;
+  unsigned long used_tiles_offset;
+  unsigned long tile_data_offset;
+  struct Snake snake;
+  struct GridCell food;
+};
+
+// A worker thread of a pool
+struct PoolWorker {
+  struct WorkerPool *pool;
+  unsigned int index;
+  pthread_t thread;
+  // Posted to hand the worker the next job
+  sem_t go;
+};
+
+// A pool of worker threads, that each job is run on all at once
+// Worker 0 is the thread calling worker_pool_run().  It has no thread of its own.
+struct WorkerPool {
+  unsigned int worker_count;
+  struct PoolWorker *workers;
+  // Posted by each worker thread as it finishes a job
+  sem_t done;
+  // The job for the workers, and what to run it on.  NULL tells the 
+  // worker threads to quit.
+  void (*job)(void *context, unsigned int worker);
+  void *context;
+};
+
+// What each worker of a lookahead keeps for itself
+struct LookaheadWorker {
+  // Where the worker plays out each rollout, on a fresh copy of the root
+  struct GameState *state;
+  // The total value of the rollouts it played in the last search, and how 
+  // many there were, by the DIR_* they started with
+  unsigned long long values[4];
+  unsigned long counts[4];
+};
+
+// Picks which way to go by Monte Carlo rollouts: Playing the game on from 
+// a position many times over, starting each way the snake can go, then 
+// going wherever did best on average.  The rollouts are shared out 
+// between a pool of worker threads.
+struct Lookahead {
+  unsigned int width;
+  unsigned int height;
+  // Worker 0 is the thread calling lookahead_search()
+  struct WorkerPool pool;
+  // Indexed by worker
+  struct LookaheadWorker *workers;
+  // The job for the workers: LOOKAHEAD_JOB_*, and what goes with it
+  unsigned int job;
+  struct GameState *root;
+  unsigned int rollouts;
+  unsigned int seed;
+  // The ways the snake can go from the root.  Rollout [n] starts with 
+  // first_directions[n % first_direction_count].
+  unsigned int first_directions[3];
+  unsigned int first_direction_count;
+  // The next chunk of LOOKAHEAD_CHUNK_SIZE rollouts to be taken
+  unsigned int next_chunk;
+  // The totals of every worker from the last search, by the DIR_* the rollouts started with
+  unsigned long long values[4];
+  unsigned long counts[4];
+};
+
+// One of the snakes of an arena
+// Only the body of [snake] is used.  What is on each Grid space is kept 
+// by the arena instead, for all of the snakes at once.
+struct ArenaSnake {
+  struct Snake snake;
+  // Set while it is on the Grid.  A snake that dies is taken off it, and 
+  // comes back as a new snake once there is room for one.
+  unsigned int alive;
+  // Where the head is going this tick, whether that kills the snake, and 
+  // which unit of food it eats there (-1 if none)
+  struct GridCell next_cell;
+  unsigned int dies;
+  signed int eats;
+  // The unit of food it is heading for, and where that was when it was 
+  // picked.  Once the food is not there any more, it picks another.
+  unsigned int target;
+  struct GridCell target_cell;
+  unsigned long deaths;
+  unsigned int best_score;
+};
+
+// Many snakes steering themselves around one Grid, with food on it for 
+// all of them
+// A snake dies running into any snake, or head on into another head.  
+// Every snake moves at once, so each tick is done in phases, and the 
+// workers share out the snakes for each phase.  Only the one thread 
+// ever puts new snakes and food down, in order, so a run comes out the 
+// same however many workers there are.
+struct Arena {
+  unsigned int width;
+  unsigned int height;
+  unsigned int snake_count;
+  struct ArenaSnake *snakes;
+  // Where each unit of food is, or -1, -1 if it could not be put down yet
+  unsigned int food_count;
+  struct GridCell *foods;
+  // What is on each Grid space: 0 if nothing, n + 1 for a cell of snake 
+  // [n], or ARENA_FOOD | n for unit of food [n].  This is how any snake 
+  // finds out what it is about to run into, with a single lookup.  
+  // Indexed by: y * width + x
+  uint16_t *owners;
+  // How many heads are moving onto each Grid space this tick.  Only 
+  // non-zero between the steer and vacate phases.
+  unsigned char *claims;
+  // How many units of food are in each block of ARENA_BLOCK_SIDE by 
+  // ARENA_BLOCK_SIDE Grid spaces, so that a snake can find the closest 
+  // without looking at every space around it
+  // Indexed by: (y / ARENA_BLOCK_SIDE) * blocks_across + x / ARENA_BLOCK_SIDE
+  unsigned int *block_food;
+  unsigned int blocks_across;
+  unsigned int blocks_down;
+  // Picks where new snakes and food are put down
+  uint64_t random_state;
+  unsigned long long ticks;
+  // Worker 0 is the thread calling arena_step()
+  struct WorkerPool pool;
+  // The job for the workers: ARENA_JOB_*, and the next chunk of 
+  // ARENA_CHUNK_SIZE snakes to be taken for it
+  unsigned int job;
+  unsigned int next_chunk;
+  // Set if a snake body could not be grown
+  unsigned int failed;
+};
+
+// Position in a walk along the snake from head to tail
+struct SnakeWalk {
+  // The snake cell reached so far, and how many cells back from the head it is
+  struct GridCell cell;
+  unsigned int i;
+#ifdef PACKED_SNAKE_BODY
+  // The directions not yet used from the current word of the body
+  uint64_t word;
+  unsigned int slot;
+#endif
+};
+
+// One record read back from a game log
+struct LogRecord {
+  // LOG_RECORD_INPUT, LOG_RECORD_KEYFRAME, or LOG_RECORD_END
+  unsigned int kind;
+  unsigned long tick;
+  // LOG_RECORD_INPUT: The DIR_* turned to
+  unsigned int direction;
+  // LOG_RECORD_KEYFRAME: Where the rest of it starts in the log, and how long it is
+  unsigned long position;
+  unsigned long length;
+};
+
+// A game log, as it is being recorded or played back
+struct GameLog {
+  // Recording: The file being written to (NULL when playing back)
+  FILE *file;
+  // Playback: The whole log, read in up front, and how far playback has got
+  unsigned char *data;
+  unsigned long length;
+  unsigned long position;
+  // Playback: Where the first record starts, just after the header
+  unsigned long records;
+  // Playback: The next record to be played, and the tick the log ends on
+  struct LogRecord next;
+  unsigned long end_tick;
+  // The tick of the last record recorded or read
+  unsigned long tick;
+  // From the header
+  unsigned int width;
+  unsigned int height;
+  unsigned int seed;
+};
+
+// One spectator of a Spectate, on a connection of its own
+struct Spectator {
+  signed int fd;
+  // What is left of the messages its socket would not take yet, to be 
+  // sent before anything else.  Only whole messages are ever skipped, so 
+  // what it is sent always parses.
+  unsigned char *backlog;
+  unsigned long backlog_length;
+  unsigned long backlog_capacity;
+  // Set while it waits for a keyframe, from when it joined or had a 
+  // message skipped, and how many keyframes it has missed in a row
+  unsigned int syncing;
+  unsigned int missed_keyframes;
+};
+
+// Streams a game to spectators on a Unix domain socket, one message per tick
+// Each tick is sent as what changed since the last: Which way the head 
+// moved, whether the tail moved up, and where the food is and what the 
+// score is if they changed.  Every SPECTATE_KEYFRAME_INTERVAL ticks, the 
+// whole game is sent instead, for spectators to catch up from.  Nothing 
+// ever waits on a spectator.  One that is slow to read has messages 
+// skipped, and is dropped if it falls too far behind.
+struct Spectate {
+  // The socket listened on (-1 for none), and where it is
+  signed int listen_fd;
+  const char *path;
+  // An fd held open (-1 for none) to be let go of when no more can be 
+  // opened, so a spectator waiting to connect can still be turned away
+  signed int spare_fd;
+  unsigned int width;
+  unsigned int height;
+  // Room for SPECTATE_MAX_SPECTATORS.  The first [spectator_count] are watching.
+  struct Spectator *spectators;
+  unsigned int spectator_count;
+  // The game as it was last sent, to find what has changed since
+  unsigned int length;
+  unsigned int score;
+  struct GridCell food;
+  // How many ticks are left until the next keyframe
+  unsigned int keyframe_countdown;
+  // How many bytes can be left waiting for each spectator: 
+  // SPECTATE_BACKLOG_LIMIT, unless changed after spectate_init()
+  unsigned long backlog_limit;
+  // The message being sent, built once for every spectator
+  unsigned char *message;
+  unsigned long message_capacity;
+  // How many spectators have joined and been dropped, how many messages 
+  // were sent whole and skipped, and how many bytes were sent in all
+  unsigned long joined;
+  unsigned long dropped;
+  unsigned long sent;
+  unsigned long skipped;
+  unsigned long long bytes;
+};
+
+// The game streamed from a Spectate, played along on the spectator's side
+struct SpectateView {
+  signed int fd;
+  // What has been received and not played yet, read as a game log is 
+  // when played back.  [stream.data] has room for [capacity] bytes, 
+  // which grows to fit a whole keyframe.
+  struct GameLog stream;
+  unsigned long capacity;
+  // The game, once a keyframe has been received
+  struct Snake snake;
+  struct GridCell food;
+  unsigned int synced;
+  // Counts up with every keyframe played, and every tick
+  unsigned long keyframes;
+  unsigned long ticks;
+  // Set once the game is over, or the stream has ended
+  unsigned int ended;
+};
+
+// One player's slot on a multiplayer board
+struct MultiplayerPlayer {
+  // MULTIPLAYER_SLOT_*, and the process playing in it
+  uint32_t state;
+  signed int pid;
+  // The turns made by the player that no tick has taken yet, and when 
+  // each was made, in nanoseconds on CLOCK_MONOTONIC.  The player's 
+  // process is the producer, and whichever process plays the tick is the 
+  // consumer.
+  struct TurnQueue turns;
+  uint64_t turn_times[TURN_QUEUE_SIZE];
+  // The player's snake.  Only what is about its body is kept here.  What 
+  // it shares with the other snakes is kept by the board, and the 
+  // pointers only hold in the process that last played a tick.
+  struct Snake snake;
+  // How long each turn taken waited, from being made to the tick that took it
+  struct Histogram input_latency;
+};
+
+// A game played by many processes at once on one Grid, each with a snake 
+// of its own, in shared memory
+// Everything is laid out in the one block, as in a GameState: The header, 
+// the Fenwick tree, every tile of the Grid, and a body for each slot with 
+// room to fill the Grid, so playing on it never allocates.  The parts 
+// are found by their offsets, as each process maps the block somewhere 
+// else.  The players are kept in lockstep by the tick barrier.  Each tick 
+// is played for all of them by the last to get there, while the rest 
+// wait, so only ever one process at a time changes the board.
+struct MultiplayerBoard {
+  // MULTIPLAYER_MAGIC, written last, so that nobody joins a board that 
+  // is not set up yet
+  uint32_t magic;
+  // MULTIPLAYER_ARRIVED() and the rest
+  uint32_t barrier;
+  // How big the whole block is, in bytes, and where each part starts
+  unsigned long size;
+  unsigned long free_counts_offset;
+  unsigned long tile_data_offset;
+  unsigned long body_offset;
+  unsigned long body_size;
+#ifndef PACKED_SNAKE_BODY
+  unsigned long cells_y_offset;
+#endif
+  unsigned int width;
+  unsigned int height;
+  unsigned int tiles_across;
+  unsigned int tile_count;
+  // When tick 0 was due, in nanoseconds on CLOCK_MONOTONIC, which every 
+  // process shares.  Every player keeps to the same schedule from it.
+  uint64_t start_ns;
+  unsigned long tick;
+  // What every snake on the Grid shares, as kept in a struct Snake
+  unsigned int free_cell_count;
+  uint64_t random_state;
+  unsigned int damaged_cells[DAMAGE_LOG_SIZE];
+  unsigned int damage_count;
+  struct GridCell food;
+  struct MultiplayerPlayer players[MULTIPLAYER_MAX_PLAYERS];
+};
+
+// A process's side of a multiplayer game
+struct Multiplayer {
+  // The shared memory the board is in, and this process's mapping of it
+  char name[MULTIPLAYER_NAME_SIZE];
+  struct MultiplayerBoard *board;
+  unsigned long size;
+  // This process's slot, and whether the tick barrier still waits for it
+  unsigned int player;
+  unsigned int playing;
+  // Every tile of the Grid where this process has it mapped, and the 
+  // list of them, for the snakes to point at
+  unsigned char **tiles;
+  unsigned int *used_tiles;
+  // The game as of the last tick: This player's snake, on the Grid it 
+  // shares with the rest.  For the display and the autopilot only.
+  struct Snake snake;
+  struct GridCell food;
+  // Where to time the snakes crawling in the ticks played here, or NULL not to
+  struct Profile *profile;
+  // How many ticks were played here, how many players were dropped from 
+  // the game here for holding it up, and this player's input latency as 
+  // of when it left the game
+  unsigned long ticks_led;
+  unsigned long evictions;
+  struct Histogram input_latency;
+};
+
+// One game of a batch
+struct BatchGame {
+  struct Snake snake;
+  struct GridCell food;
+  // How many games have been started in this slot of the batch, and the 
+  // best score out of those that have ended
+  unsigned long games;
+  unsigned int best_score;
+};
+
+// The chunks of a batch that one worker starts out with
+// Any worker takes the next chunk by counting [next] up, so other 
+// workers can steal from it the same way as the owner.
+struct BatchQueue {
+  unsigned int next;
+  unsigned int end;
+  // Keep each queue on a cache line of its own
+  char padding[56];
+};
+
+// A batch of separate games on Grids of the same size, played in step 
+// by a pool of worker threads
+struct GameBatch {
+  unsigned int count;
+  unsigned int width;
+  unsigned int height;
+  unsigned int seed;
+  struct BatchGame *games;
+  // Worker 0 is the thread calling batch_step()
+  struct WorkerPool pool;
+  // Indexed by worker
+  struct BatchQueue *queues;
+  // The job for the workers: BATCH_JOB_*, and what goes with it
+  unsigned int job;
+  const unsigned char *turns;
+  unsigned int ticks;
+  unsigned char *observations;
+  // Set if any game could not be set up, or played on
+  unsigned int failed;
+};
+
+// Indexed by GLYPH_*
+extern const struct GlyphBytes glyph_bytes[GLYPH_COUNT];
+// The GLYPH_* for a snake cell, indexed by the LINK_* sides it connects to
+extern const unsigned char link_glyphs[16];
+// The same without UTF-8
+extern const unsigned char fallback_link_glyphs[16];
+// What each PROFILE_* phase is called in the reports, and what it is measured in
+extern const char *const profile_phase_names[PROFILE_COUNT];
+extern const char *const profile_phase_units[PROFILE_COUNT];
+// What each TRACE_THREAD_* is called in the trace viewer
+extern const char *const trace_thread_names[TRACE_THREAD_COUNT];
+// Stands in for every tile of a Grid that has not been allocated
+extern const unsigned char grid_empty_tile[GRID_TILE_SPACES];
+
+int sem_wai2(sem_t *sem);
+signed int worker_pool_init(struct WorkerPool *pool, unsigned int worker_count);
+void worker_pool_run(struct WorkerPool *pool, void (*job)(void *context, unsigned int worker), void *context);
+void worker_pool_destroy(struct WorkerPool *pool);
+void* worker_pool_thread(void *pool_worker);
+uint64_t random_next(uint64_t *state);
+signed int gen_random_number(uint64_t *state, signed int min, signed int max);
+unsigned int random_below(uint64_t *state, unsigned int bound);
+uint64_t game_seed(unsigned int seed, unsigned long game);
+signed int game_init(struct Snake *snake, struct GridCell *food, unsigned int width, unsigned int height, uint64_t seed);
+signed int game_restart(struct Snake *snake, struct GridCell *food, uint64_t seed);
+signed int snake_init_body(struct Snake *snake, unsigned int capacity);
+signed int snake_grow_body(struct Snake *snake);
+void snake_copy_body(struct Snake *to, struct Snake *from);
+signed int snake_init_grid_state(struct Snake *snake, unsigned int width, unsigned int height);
+signed int snake_build_grid_state(struct Snake *snake);
+void snake_destroy(struct Snake *snake);
+unsigned char* grid_space_links(struct Snake *snake, unsigned int x, unsigned int y);
+signed int grid_reserve_space(struct Snake *snake, unsigned int x, unsigned int y);
+uint64_t grid_row_free_bits(const unsigned char *links);
+#ifndef PACKED_SNAKE_BODY
+struct GridCell snake_cell(struct Snake *snake, unsigned int i);
+#endif
+struct GridCell* snake_head(struct Snake *snake);
+struct GridCell* snake_tail(struct Snake *snake);
+unsigned int snake_body_link(struct Snake *snake, unsigned int i);
+void snake_push_head(struct Snake *snake, struct GridCell *cell);
+void snake_pop_tail(struct Snake *snake);
+void snake_walk_start(struct Snake *snake, struct SnakeWalk *walk);
+void snake_walk_next(struct Snake *snake, struct SnakeWalk *walk);
+void snake_occupy_cell(struct Snake *snake, signed int y);
+void snake_release_cell(struct Snake *snake, signed int x, signed int y);
+void snake_damage_cell(struct Snake *snake, unsigned int index);
+unsigned int snake_free_cell(struct Snake *snake, unsigned int n);
+void grid_cell_step(struct Snake *snake, struct GridCell *cell, unsigned int direction);
+unsigned int grid_cell_link(struct GridCell *from, struct GridCell *to);
+void snake_steer(struct Snake *snake, unsigned int direction);
+signed int key_direction(signed int key);
+signed int key_parse(struct KeyParser *parser, unsigned char byte);
+void turn_queue_init(struct TurnQueue *queue);
+signed int turn_queue_push(struct TurnQueue *queue, unsigned int direction);
+signed int turn_queue_pop(struct TurnQueue *queue);
+void snake_take_turn(struct Snake *snake, struct TurnQueue *queue);
+unsigned int snake_cell_links(struct Snake *snake, unsigned int i);
+void snake_relink_cell(struct Snake *snake, unsigned int i, struct GridCell *cell);
+void rand_food_location(struct GridCell *food, struct Snake *snake);
+signed int screen_init(struct Screen *screen, unsigned int width, unsigned int height);
+void screen_destroy(struct Screen *screen);
+unsigned int screen_follow_axis(unsigned int origin, unsigned int size, unsigned int grid_size, unsigned int head);
+void screen_follow(struct Screen *screen, struct Snake *snake);
+unsigned int screen_space(struct Screen *screen, struct Snake *snake, unsigned int index);
+void screen_fill_row(struct Screen *screen, struct Snake *snake, unsigned int y, const unsigned char *glyph_from_links);
+unsigned int grid_space_glyph(struct Snake *snake, struct GridCell *food, unsigned int index);
+char* render_glyph(char *buffer, unsigned int glyph);
+void screen_fill_glyphs(struct Screen *screen, struct Snake *snake, struct GridCell *food);
+unsigned int screen_changed_spaces(struct Screen *screen, struct Snake *snake, struct GridCell *food, unsigned int *spaces);
+void screen_update(struct Screen *screen, struct Snake *snake, struct GridCell *food);
+void render_screen(char *buffer, struct Screen *screen, struct Snake *snake, struct GridCell *food);
+char* render_space(char *buffer, struct Screen *screen, unsigned int index, unsigned int glyph, unsigned int *cursor);
+void regen_buffer(char *buffer, struct Screen *screen, struct Snake *snake, struct GridCell *food);
+void regen_buffer_changes(char *buffer, struct Screen *screen, struct Snake *snake, struct GridCell *food);
+void render_frame(char *buffer, struct Screen *screen, struct Snake *snake, struct GridCell *food);
+void render_screen_changes(char *buffer, struct Screen *screen, const unsigned char *glyphs, unsigned int score);
+unsigned int snake_crawl(struct Snake *snake, struct GridCell *food);
+void game_observe(struct Snake *snake, struct GridCell *food, unsigned char *observation);
+unsigned long long elapsed_ns(struct timespec *start, struct timespec *end);
+signed int autopilot_init(struct Autopilot *autopilot);
+void autopilot_destroy(struct Autopilot *autopilot);
+unsigned int grid_cycle_direction(unsigned int width, unsigned int height, unsigned int x, unsigned int y);
+void autopilot_load_window(struct Autopilot *autopilot, struct Snake *snake);
+uint32_t autopilot_step(struct Autopilot *autopilot, uint32_t space, unsigned int direction);
+void autopilot_new_search(struct Autopilot *autopilot);
+unsigned int autopilot_food_distance(struct Autopilot *autopilot, struct Snake *snake, struct GridCell *food, uint32_t space);
+unsigned int autopilot_axis_gap(unsigned int origin, unsigned int size, unsigned int wraps, unsigned int grid_size, unsigned int target);
+unsigned int autopilot_room(struct Autopilot *autopilot, uint32_t start, unsigned int region, unsigned int enough, const unsigned int *rooms);
+signed int autopilot_search(struct Autopilot *autopilot, struct Snake *snake, struct GridCell *food);
+void autopilot_steer(struct Autopilot *autopilot, struct Snake *snake, struct GridCell *food);
+unsigned int varint_encode(unsigned char *buffer, uint64_t value);
+void log_put_varint(struct GameLog *log, uint64_t value);
+signed int log_get_varint(struct GameLog *log, uint64_t *value);
+signed int log_create(struct GameLog *log, const char *path, unsigned int width, unsigned int height, unsigned int seed);
+void log_write_tick(struct GameLog *log, unsigned long tick, unsigned long game, struct Snake *snake, struct GridCell *food);
+unsigned int log_keyframe_header(unsigned char *buffer, unsigned long game, struct Snake *snake, struct GridCell *food);
+signed int log_finish(struct GameLog *log, unsigned long tick);
+signed int log_load(struct GameLog *log, const char *path);
+signed int log_read_record(struct GameLog *log, struct LogRecord *record);
+unsigned int log_play_tick(struct GameLog *log, unsigned long tick, struct Snake *snake);
+signed int log_restore(struct GameLog *log, struct LogRecord *keyframe, struct Snake *snake, struct GridCell *food, unsigned long *game);
+signed int log_seek(struct GameLog *log, unsigned long tick, struct Snake *snake, struct GridCell *food, unsigned long *game);
+void log_destroy(struct GameLog *log);
+signed int spectate_init(struct Spectate *spectate, const char *path, unsigned int width, unsigned int height);
+void spectate_destroy(struct Spectate *spectate);
+void spectate_accept(struct Spectate *spectate);
+signed int spectate_add(struct Spectate *spectate, signed int fd);
+void spectate_drop(struct Spectate *spectate, unsigned int i);
+signed int spectate_send(struct Spectate *spectate, unsigned int i, const unsigned char *message, unsigned long length);
+signed int spectate_flush(struct Spectator *spectator);
+unsigned char* spectate_reserve(struct Spectate *spectate, unsigned long length);
+void spectate_broadcast(struct Spectate *spectate, unsigned long length, unsigned int keyframe);
+void spectate_tick(struct Spectate *spectate, struct Snake *snake, struct GridCell *food);
+void spectate_end(struct Spectate *spectate);
+signed int spectate_view_connect(struct SpectateView *view, const char *path);
+void spectate_view_destroy(struct SpectateView *view);
+signed int spectate_view_read(struct SpectateView *view);
+signed int spectate_view_play(struct SpectateView *view);
+signed int spectate_view_move(struct SpectateView *view, unsigned int direction, unsigned int tail_freed);
+uint64_t multiplayer_now_ns(void);
+signed int futex_wait_until(uint32_t *word, uint32_t value, uint64_t deadline_ns);
+void futex_wake_all(uint32_t *word);
+signed int multiplayer_init(struct Multiplayer *multiplayer, const char *name, unsigned int width, unsigned int height, unsigned int seed);
+signed int multiplayer_create(struct Multiplayer *multiplayer, signed int fd, unsigned int width, unsigned int height, unsigned int seed);
+signed int multiplayer_attach(struct Multiplayer *multiplayer, signed int fd);
+signed int multiplayer_map_tiles(struct Multiplayer *multiplayer);
+void multiplayer_unmap(struct Multiplayer *multiplayer);
+void multiplayer_destroy(struct Multiplayer *multiplayer);
+void multiplayer_load(struct Multiplayer *multiplayer, unsigned int player, struct Snake *snake);
+void multiplayer_store(struct Multiplayer *multiplayer, unsigned int player, struct Snake *snake);
+signed int multiplayer_join(struct Multiplayer *multiplayer);
+signed int multiplayer_arrive(struct Multiplayer *multiplayer);
+void multiplayer_leave(struct Multiplayer *multiplayer);
+void multiplayer_lead(struct Multiplayer *multiplayer, uint32_t barrier);
+void multiplayer_play_tick(struct Multiplayer *multiplayer, unsigned int members);
+unsigned int multiplayer_spawn(struct Multiplayer *multiplayer, unsigned int player);
+void multiplayer_clear(struct Multiplayer *multiplayer, unsigned int player);
+void multiplayer_take_turn(struct Multiplayer *multiplayer, unsigned int player, struct Snake *snake, uint64_t now_ns);
+signed int multiplayer_push_turn(struct Multiplayer *multiplayer, unsigned int direction);
+void multiplayer_next_deadline(struct Multiplayer *multiplayer, struct timespec *deadline);
+signed int batch_init(struct GameBatch *batch, unsigned int count, unsigned int width, unsigned int height, unsigned int seed, unsigned int worker_count);
+signed int batch_step(struct GameBatch *batch, const unsigned char *turns, unsigned int ticks, unsigned char *observations);
+void batch_destroy(struct GameBatch *batch);
+void batch_run(struct GameBatch *batch, unsigned int job);
+void batch_run_job(void *batch_job, unsigned int worker);
+void batch_play_chunk(struct GameBatch *batch, unsigned int chunk);
+struct GameState* game_state_new(unsigned int width, unsigned int height);
+void game_state_rebase(struct GameState *state);
+void game_state_load(struct GameState *state, struct Snake *snake, struct GridCell *food);
+void game_state_copy(struct GameState *to, struct GameState *from);
+void game_state_destroy(struct GameState *state);
+signed int lookahead_init(struct Lookahead *lookahead, unsigned int width, unsigned int height, unsigned int worker_count);
+unsigned int lookahead_search(struct Lookahead *lookahead, struct GameState *root, unsigned int rollouts, unsigned int seed);
+void lookahead_destroy(struct Lookahead *lookahead);
+void lookahead_run(struct Lookahead *lookahead, unsigned int job);
+void lookahead_run_job(void *lookahead_job, unsigned int worker);
+unsigned int lookahead_rollout(struct GameState *state, unsigned int first_direction, uint64_t seed);
+void lookahead_policy(struct Snake *snake, struct GridCell *food, uint64_t *random_state);
+unsigned int lookahead_food_distance(struct Snake *snake, struct GridCell *cell, struct GridCell *food);
+unsigned int arena_default_side(unsigned int snake_count);
+signed int arena_init(struct Arena *arena, unsigned int width, unsigned int height, unsigned int snake_count, unsigned int seed, unsigned int worker_count);
+signed int arena_step(struct Arena *arena);
+void arena_destroy(struct Arena *arena);
+void arena_run(struct Arena *arena, unsigned int job);
+void arena_run_job(void *arena_job, unsigned int worker);
+unsigned int arena_distance(struct Arena *arena, struct GridCell *from, struct GridCell *to);
+unsigned int arena_space_open(struct Arena *arena, struct GridCell *cell);
+void arena_pick_target(struct Arena *arena, struct ArenaSnake *arena_snake);
+void arena_steer(struct Arena *arena, unsigned int n);
+void arena_judge(struct Arena *arena, unsigned int n);
+void arena_vacate(struct Arena *arena, unsigned int n);
+void arena_advance(struct Arena *arena, unsigned int n);
+unsigned int arena_spawn(struct Arena *arena, unsigned int n);
+unsigned int arena_place_food(struct Arena *arena, unsigned int food);
+unsigned int histogram_bucket(unsigned long long value);
+unsigned long long histogram_bucket_low(unsigned int bucket);
+unsigned long long histogram_bucket_high(unsigned int bucket);
+void histogram_record(struct Histogram *histogram, unsigned long long value);
+unsigned long long histogram_percentile(struct Histogram *histogram, double percent);
+void profile_init(struct Profile *profile);
+void profile_record_since(struct Profile *profile, unsigned int phase, struct timespec *start);
+void histogram_print(struct Histogram *histogram, const char *name, const char *unit);
+void profile_print(struct Profile *profile);
+signed int profile_write_csv(struct Profile *profile, const char *path);
+signed int trace_init(struct Trace *trace);
+void trace_destroy(struct Trace *trace);
+uint64_t trace_now(struct TraceRing *ring);
+void trace_event(struct TraceRing *ring, char phase, const char *name, uint64_t start_ns, uint64_t duration_ns, uint64_t value);
+void trace_span(struct TraceRing *ring, const char *name, uint64_t start_ns, uint64_t value);
+signed int trace_write_json(struct Trace *trace, const char *path);
+signed int display_init(struct Display *display, unsigned int width, unsigned int height, signed int output_fd);
+signed int display_start(struct Display *display);
+void display_publish(struct Display *display, unsigned int mode, struct Snake *snake, struct GridCell *food, unsigned int term_width, unsigned int term_height);
+void display_redraw(struct Display *display);
+void display_wake(struct Display *display);
+void display_stop(struct Display *display);
+void display_destroy(struct Display *display);
+signed int display_write(struct Display *display, const char *buffer, unsigned long length);
+void display_draw(struct Display *display, struct Frame *frame);
+void* display_thread(void *display_arg);
+char* reference_put_bytes(char *buffer, const char *bytes);
+unsigned int reference_space_glyph(struct Snake *snake, struct GridCell *food, unsigned int index);
+char* reference_render_glyph(char *buffer, unsigned int glyph);
+void reference_regen_buffer(char *buffer, struct Screen *screen, struct Snake *snake, struct GridCell *food);
+void reference_regen_buffer_changes(char *buffer, struct Screen *screen, struct Snake *snake, struct GridCell *food);
+
+#endif
@@ -0,0 +1,623 @@
+/*
+ * Name: Snake in C
+ * Author: Michael T. Kloos
+ *
+ * Copyright:
+ * (C) Copyright 2022 Michael T. Kloos (http://www.michaelkloos.com/).
+ * All Rights Reserved.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "snake.h"
+
+signed int spectate_init(struct Spectate *spectate, const char *path, unsigned int width, unsigned int height) {
+  // Set up a Spectate for a game on a [width] by [height] Grid, listening for spectators on a Unix domain socket at [path]
+  // If [path] is NULL, nothing is listened on, and spectators are only 
+  // added by spectate_add().  A socket left at [path] by an earlier run 
+  // is replaced, but nothing else is.  Returns -1 if the memory for it 
+  // could not be allocated, or -2 if the socket could not be listened on.
+  
+  memset(spectate, 0, sizeof(struct Spectate));
+  spectate->listen_fd = -1;
+  spectate->spare_fd = -1;
+  spectate->width = width;
+  spectate->height = height;
+  spectate->backlog_limit = SPECTATE_BACKLOG_LIMIT;
+  spectate->spectators = malloc(SPECTATE_MAX_SPECTATORS * sizeof(struct Spectator));
+  // Room for a whole tick message, or a keyframe of a new game
+  spectate->message_capacity = 4096;
+  spectate->message = malloc(spectate->message_capacity);
+  if (spectate->spectators == NULL || spectate->message == NULL) {
+    spectate_destroy(spectate);
+    return -1;
+  }
+  
+  if (path == NULL) {
+    return 0;
+  }
+  struct sockaddr_un address;
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  if (strlen(path) >= sizeof(address.sun_path)) {
+    spectate_destroy(spectate);
+    return -2;
+  }
+  strcpy(address.sun_path, path);
+  struct stat status;
+  if (lstat(path, &status) == 0 && S_ISSOCK(status.st_mode)) {
+    unlink(path);
+  }
+  spectate->listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (spectate->listen_fd == -1 ||
+      bind(spectate->listen_fd, (struct sockaddr*)&address, sizeof(address)) == -1) {
+    spectate_destroy(spectate);
+    return -2;
+  }
+  spectate->path = path;
+  spectate->spare_fd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+  if (spectate->spare_fd == -1 || listen(spectate->listen_fd, SOMAXCONN) == -1) {
+    spectate_destroy(spectate);
+    return -2;
+  }
+  
+  return 0;
+}
+
+void spectate_destroy(struct Spectate *spectate) {
+  // Disconnect every spectator, stop listening, and free all of the memory owned by [spectate]
+  
+  for (unsigned int i = 0; i < spectate->spectator_count; i++) {
+    close(spectate->spectators[i].fd);
+    free(spectate->spectators[i].backlog);
+  }
+  if (spectate->listen_fd != -1) {
+    close(spectate->listen_fd);
+  }
+  if (spectate->spare_fd != -1) {
+    close(spectate->spare_fd);
+  }
+  if (spectate->path != NULL) {
+    unlink(spectate->path);
+  }
+  free(spectate->spectators);
+  free(spectate->message);
+  return;
+}
+
+void spectate_accept(struct Spectate *spectate) {
+  // Take on every spectator waiting to connect to the socket
+  // Any past SPECTATE_MAX_SPECTATORS are turned away, and so are any 
+  // that come while no more fds can be opened.
+  
+  while (1) {
+    signed int fd = accept(spectate->listen_fd, NULL, NULL);
+    if (fd == -1) {
+      // EAGAIN once there are no more, or an error with one that gave up 
+      // waiting, which is no reason to stop listening
+      if (errno == EINTR || errno == ECONNABORTED) {
+        continue;
+      }
+      // Out of fds.  The spectator would be left waiting, and the socket 
+      // would wake the game over and over to take it on, so let go of 
+      // the spare to make room to take it on and hang up on it.
+      if ((errno == EMFILE || errno == ENFILE) && spectate->spare_fd != -1) {
+        close(spectate->spare_fd);
+        fd = accept(spectate->listen_fd, NULL, NULL);
+        if (fd != -1) {
+          close(fd);
+        }
+        spectate->spare_fd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+        if (fd != -1) {
+          continue;
+        }
+      }
+      return;
+    }
+    if (fcntl(fd, F_SETFD, FD_CLOEXEC) == -1 || fcntl(fd, F_SETFL, O_NONBLOCK) == -1 || 
+        spectate_add(spectate, fd) == -1) {
+      close(fd);
+    }
+  }
+}
+
+signed int spectate_add(struct Spectate *spectate, signed int fd) {
+  // Start streaming the game to a new spectator on the connection [fd]
+  // [fd] must be non-blocking.  It is sent the header straight away, and 
+  // the game from the next keyframe on.  It is closed when the spectator 
+  // is dropped.  Returns -1 if there is no room for another spectator or 
+  // the header could not be sent, in which case [fd] is left open.
+  
+  if (spectate->spectator_count == SPECTATE_MAX_SPECTATORS) {
+    return -1;
+  }
+  
+  struct Spectator *spectator = &spectate->spectators[spectate->spectator_count];
+  spectator->fd = fd;
+  spectator->backlog = NULL;
+  spectator->backlog_length = 0;
+  spectator->backlog_capacity = 0;
+  spectator->syncing = 1;
+  spectator->missed_keyframes = 0;
+  
+  // The socket is new, so the header always fits
+  unsigned char header[4 + 2 * 10];
+  memcpy(header, SPECTATE_MAGIC, 4);
+  unsigned int length = 4;
+  length += varint_encode(&header[length], spectate->width);
+  length += varint_encode(&header[length], spectate->height);
+  if (send(fd, header, length, MSG_NOSIGNAL | MSG_DONTWAIT) != (ssize_t)length) {
+    return -1;
+  }
+  spectate->bytes += length;
+  
+  spectate->spectator_count++;
+  spectate->joined++;
+  return 0;
+}
+
+void spectate_drop(struct Spectate *spectate, unsigned int i) {
+  // Disconnect spectator [i]
+  // The last spectator is moved into its place.
+  
+  struct Spectator *spectator = &spectate->spectators[i];
+  close(spectator->fd);
+  free(spectator->backlog);
+  spectate->spectator_count--;
+  *spectator = spectate->spectators[spectate->spectator_count];
+  spectate->dropped++;
+  return;
+}
+
+signed int spectate_flush(struct Spectator *spectator) {
+  // Send as much of the backlog of [spectator] as its socket will take
+  // Returns -1 if the connection has failed, for it to be dropped.
+  
+  unsigned long sent = 0;
+  while (sent < spectator->backlog_length) {
+    ssize_t length = send(spectator->fd, spectator->backlog + sent, spectator->backlog_length - sent, MSG_NOSIGNAL | MSG_DONTWAIT);
+    if (length == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+      if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        break;
+      }
+      return -1;
+    }
+    sent += length;
+  }
+  memmove(spectator->backlog, spectator->backlog + sent, spectator->backlog_length - sent);
+  spectator->backlog_length -= sent;
+  return 0;
+}
+
+signed int spectate_send(struct Spectate *spectate, unsigned int i, const unsigned char *message, unsigned long length) {
+  // Send a whole [message] of [length] bytes to spectator [i], or skip it
+  // The message is only started if what might be left waiting of it 
+  // fits in the backlog, or if the backlog is empty.  Whatever of it the 
+  // socket does not take now joins the backlog.  Returns 1 if it was 
+  // skipped, -1 if the spectator is to be dropped, or 0 otherwise.
+  
+  struct Spectator *spectator = &spectate->spectators[i];
+  if (spectator->backlog_length > 0 && spectate_flush(spectator) == -1) {
+    return -1;
+  }
+  
+  unsigned long sent = 0;
+  if (spectator->backlog_length == 0) {
+    while (sent < length) {
+      ssize_t part = send(spectator->fd, message + sent, length - sent, MSG_NOSIGNAL | MSG_DONTWAIT);
+      if (part == -1) {
+        if (errno == EINTR) {
+          continue;
+        }
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+          break;
+        }
+        return -1;
+      }
+      sent += part;
+    }
+  } else if (spectator->backlog_length + length > spectate->backlog_limit) {
+    return 1;
+  }
+  spectate->bytes += sent;
+  if (sent == length) {
+    return 0;
+  }
+  
+  // Keep the rest for when the socket has room
+  unsigned long needed = spectator->backlog_length + length - sent;
+  if (needed > spectator->backlog_capacity) {
+    unsigned long capacity = (spectator->backlog_capacity > 0) ? spectator->backlog_capacity : 4096;
+    while (capacity < needed) {
+      capacity *= 2;
+    }
+    unsigned char *backlog = realloc(spectator->backlog, capacity);
+    if (backlog == NULL) {
+      return -1;
+    }
+    spectator->backlog = backlog;
+    spectator->backlog_capacity = capacity;
+  }
+  memcpy(spectator->backlog + spectator->backlog_length, message + sent, length - sent);
+  spectator->backlog_length = needed;
+  spectate->bytes += length - sent;
+  return 0;
+}
+
+unsigned char* spectate_reserve(struct Spectate *spectate, unsigned long length) {
+  // Make sure the message being built has room for [length] bytes, and find where it starts
+  // Returns NULL if the memory for it could not be allocated.
+  
+  if (length > spectate->message_capacity) {
+    unsigned long capacity = spectate->message_capacity;
+    while (capacity < length) {
+      capacity *= 2;
+    }
+    unsigned char *message = realloc(spectate->message, capacity);
+    if (message == NULL) {
+      return NULL;
+    }
+    spectate->message = message;
+    spectate->message_capacity = capacity;
+  }
+  return spectate->message;
+}
+
+void spectate_broadcast(struct Spectate *spectate, unsigned long length, unsigned int keyframe) {
+  // Send the message that has been built, [length] bytes long, to every spectator that can take it
+  // If [keyframe] is set, spectators waiting on one are sent it too.  
+  // Otherwise they are skipped.  Spectators whose connections have 
+  // failed, or who have missed too many keyframes, are dropped.
+  
+  unsigned int i = 0;
+  while (i < spectate->spectator_count) {
+    struct Spectator *spectator = &spectate->spectators[i];
+    signed int result;
+    if (spectator->syncing && !keyframe) {
+      // Nothing can be sent until a keyframe, but the backlog can still drain
+      result = (spectator->backlog_length > 0 && spectate_flush(spectator) == -1) ? -1 : 1;
+    } else {
+      result = spectate_send(spectate, i, spectate->message, length);
+    }
+    
+    if        (result == 0) {
+      spectator->syncing = 0;
+      spectator->missed_keyframes = 0;
+      spectate->sent++;
+    } else if (result == 1) {
+      spectator->syncing = 1;
+      if (keyframe) {
+        spectator->missed_keyframes++;
+      }
+      spectate->skipped++;
+    }
+    if (result == -1 || spectator->missed_keyframes > SPECTATE_MAX_MISSED_KEYFRAMES) {
+      // The last spectator takes its place, so look at this one again
+      spectate_drop(spectate, i);
+      continue;
+    }
+    i++;
+  }
+  
+  return;
+}
+
+void spectate_tick(struct Spectate *spectate, struct Snake *snake, struct GridCell *food) {
+  // Send the tick just played to every spectator
+  // That is the change since the last tick, or a keyframe of the whole 
+  // game every SPECTATE_KEYFRAME_INTERVAL ticks.  The first tick sent is 
+  // always a keyframe.  If the memory for a keyframe could not be 
+  // allocated, it is left until the next tick.
+  
+  if (spectate->spectator_count == 0) {
+    // Nobody to send it to.  Whoever joins next waits for a keyframe anyway.
+    spectate->keyframe_countdown = 0;
+    return;
+  }
+  
+  unsigned char *message;
+  unsigned long length;
+  unsigned int keyframe = (spectate->keyframe_countdown == 0);
+  if (keyframe) {
+    // A keyframe of game number 0, as the spectators have no use for the number
+    unsigned int link_count = snake->length - 1;
+    message = spectate_reserve(spectate, 1 + 10 + 11 * 10 + (link_count + 3) / 4);
+    if (message == NULL) {
+      return;
+    }
+    unsigned char header[11 * 10];
+    unsigned int header_length = log_keyframe_header(header, 0, snake, food);
+    message[0] = SPECTATE_MESSAGE_KEYFRAME;
+    length = 1;
+    length += varint_encode(&message[length], header_length + (link_count + 3) / 4);
+    memcpy(&message[length], header, header_length);
+    length += header_length;
+    // The DIR_* from each cell on to the next, from the head back, 4 to a byte
+    unsigned int byte = 0;
+    for (unsigned int i = 0; i < link_count; i++) {
+      byte |= __builtin_ctz(snake_body_link(snake, i)) << ((i % 4) * 2);
+      if (i % 4 == 3 || i + 1 == link_count) {
+        message[length] = byte;
+        length++;
+        byte = 0;
+      }
+    }
+    spectate->keyframe_countdown = SPECTATE_KEYFRAME_INTERVAL;
+  } else {
+    // The head always moves.  The tail moved up unless the snake grew.
+    message = spectate->message;
+    message[0] = SPECTATE_MESSAGE_TICK | snake->direction;
+    length = 1;
+    if (snake->length == spectate->length) {
+      message[0] |= SPECTATE_TAIL_FREED;
+    }
+    if (food->x != spectate->food.x || food->y != spectate->food.y) {
+      message[0] |= SPECTATE_FOOD_MOVED;
+      length += varint_encode(&message[length], food->x + 1);
+      length += varint_encode(&message[length], food->y + 1);
+    }
+    if (snake->score != spectate->score) {
+      message[0] |= SPECTATE_SCORE;
+      length += varint_encode(&message[length], snake->score);
+    }
+  }
+  spectate->keyframe_countdown--;
+  spectate->length = snake->length;
+  spectate->score = snake->score;
+  spectate->food = *food;
+  
+  spectate_broadcast(spectate, length, keyframe);
+  return;
+}
+
+void spectate_end(struct Spectate *spectate) {
+  // Tell every spectator that the game is over
+  
+  spectate->message[0] = SPECTATE_MESSAGE_END;
+  spectate_broadcast(spectate, 1, 1);
+  return;
+}
+
+signed int spectate_view_connect(struct SpectateView *view, const char *path) {
+  // Connect to the game streamed on the Unix domain socket at [path], and read the header
+  // Returns -1 if the memory for it could not be allocated, or -2 if the 
+  // socket could not be connected to or did not send a header.
+  
+  memset(view, 0, sizeof(struct SpectateView));
+  view->capacity = 4096;
+  view->stream.data = malloc(view->capacity);
+  if (view->stream.data == NULL) {
+    return -1;
+  }
+  
+  struct sockaddr_un address;
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  view->fd = -1;
+  if (strlen(path) < sizeof(address.sun_path)) {
+    strcpy(address.sun_path, path);
+    view->fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  }
+  if (view->fd == -1 || connect(view->fd, (struct sockaddr*)&address, sizeof(address)) == -1) {
+    spectate_view_destroy(view);
+    return -2;
+  }
+  
+  // Wait for the whole header, which comes straight away
+  uint64_t width = 0;
+  uint64_t height = 0;
+  while (1) {
+    ssize_t length = read(view->fd, view->stream.data + view->stream.length, view->capacity - view->stream.length);
+    if (length <= 0) {
+      if (length == -1 && errno == EINTR) {
+        continue;
+      }
+      spectate_view_destroy(view);
+      return -2;
+    }
+    view->stream.length += length;
+    view->stream.position = 4;
+    if (view->stream.length >= 4 &&
+        log_get_varint(&view->stream, &width) == 0 && log_get_varint(&view->stream, &height) == 0) {
+      break;
+    }
+    if (view->stream.length >= 4 + 2 * 10 ||
+        memcmp(view->stream.data, SPECTATE_MAGIC, (view->stream.length < 4) ? view->stream.length : 4) != 0) {
+      spectate_view_destroy(view);
+      return -2;
+    }
+  }
+  if (memcmp(view->stream.data, SPECTATE_MAGIC, 4) != 0 ||
+      width < STARTING_LENGTH * 2 || height < STARTING_LENGTH * 2 || width > GRID_MAX_SIDE || height > GRID_MAX_SIDE) {
+    spectate_view_destroy(view);
+    return -2;
+  }
+  view->stream.width = width;
+  view->stream.height = height;
+  
+  // Anything after the header waits to be played
+  view->stream.length -= view->stream.position;
+  memmove(view->stream.data, view->stream.data + view->stream.position, view->stream.length);
+  view->stream.position = 0;
+  if (fcntl(view->fd, F_SETFL, O_NONBLOCK) == -1) {
+    spectate_view_destroy(view);
+    return -2;
+  }
+  
+  return 0;
+}
+
+void spectate_view_destroy(struct SpectateView *view) {
+  // Disconnect [view] and free all of the memory owned by it
+  
+  if (view->fd != -1) {
+    close(view->fd);
+  }
+  if (view->synced) {
+    snake_destroy(&view->snake);
+  }
+  free(view->stream.data);
+  return;
+}
+
+signed int spectate_view_read(struct SpectateView *view) {
+  // Read everything the socket has for [view], and play it
+  // Returns -1 if the stream does not make sense or the memory for it 
+  // could not be allocated.  Otherwise returns 0, with [view->ended] set 
+  // once there is no more to come.
+  
+  while (!view->ended) {
+    if (view->stream.length == view->capacity) {
+      // Only part of a keyframe too big for the buffer fills it.  Make 
+      // room for the rest.
+      unsigned char *data = realloc(view->stream.data, view->capacity * 2);
+      if (data == NULL) {
+        return -1;
+      }
+      view->stream.data = data;
+      view->capacity *= 2;
+    }
+    ssize_t length = read(view->fd, view->stream.data + view->stream.length, view->capacity - view->stream.length);
+    if (length == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+      if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        break;
+      }
+      view->ended = 1;
+    } else if (length == 0) {
+      view->ended = 1;
+    } else {
+      view->stream.length += length;
+    }
+    if (spectate_view_play(view) == -1) {
+      return -1;
+    }
+  }
+  
+  return 0;
+}
+
+signed int spectate_view_play(struct SpectateView *view) {
+  // Play every whole message received for [view]
+  // Anything after the last whole message is kept for when the rest of 
+  // it arrives.  Returns -1 if a message does not make sense or the 
+  // memory for it could not be allocated.
+  
+  struct GameLog *stream = &view->stream;
+  unsigned long start = 0;
+  while (start < stream->length && !view->ended) {
+    stream->position = start + 1;
+    unsigned char kind = stream->data[start];
+    if        ((kind & SPECTATE_MESSAGE_MASK) == SPECTATE_MESSAGE_END) {
+      view->ended = 1;
+    } else if ((kind & SPECTATE_MESSAGE_MASK) == SPECTATE_MESSAGE_KEYFRAME) {
+      uint64_t length;
+      if (log_get_varint(stream, &length) == -1) {
+        break;
+      }
+      // Nothing sent by the game is taken on trust.  A keyframe can be no 
+      // longer than its header and a snake filling the Grid, so one that 
+      // claims to be is turned away before any room is made for it, and 
+      // log_restore() turns away a body or food that does not add up.
+      if (length > 11 * 10 + ((uint64_t)stream->width * stream->height + 2) / 4) {
+        return -1;
+      }
+      if (length > stream->length - stream->position) {
+        // Not all here yet.  Make sure it will fit when it is.
+        break;
+      }
+      struct LogRecord keyframe;
+      keyframe.position = stream->position;
+      keyframe.length = length;
+      stream->position += length;
+      if (view->synced) {
+        snake_destroy(&view->snake);
+        view->synced = 0;
+      }
+      unsigned long game;
+      if (log_restore(stream, &keyframe, &view->snake, &view->food, &game) == -1) {
+        return -1;
+      }
+      view->synced = 1;
+      view->keyframes++;
+    } else if ((kind & SPECTATE_MESSAGE_MASK) == SPECTATE_MESSAGE_TICK) {
+      uint64_t food_x = view->food.x + 1;
+      uint64_t food_y = view->food.y + 1;
+      uint64_t score = view->snake.score;
+      if (((kind & SPECTATE_FOOD_MOVED) && (log_get_varint(stream, &food_x) == -1 || log_get_varint(stream, &food_y) == -1)) ||
+          ((kind & SPECTATE_SCORE) && log_get_varint(stream, &score) == -1)) {
+        break;
+      }
+      // A tick is only ever sent after a keyframe
+      if (!view->synced || food_x > stream->width || food_y > stream->height || (food_x == 0) != (food_y == 0) ||
+          score > UINT32_MAX || spectate_view_move(view, kind & 0x3, kind & SPECTATE_TAIL_FREED) == -1) {
+        return -1;
+      }
+      view->food.x = (signed int)food_x - 1;
+      view->food.y = (signed int)food_y - 1;
+      view->snake.score = score;
+      view->ticks++;
+    } else {
+      return -1;
+    }
+    start = stream->position;
+  }
+  
+  // Keep the part of a message not yet whole, and make room for the rest
+  stream->length -= start;
+  memmove(stream->data, stream->data + start, stream->length);
+  stream->position = 0;
+  return 0;
+}
+
+signed int spectate_view_move(struct SpectateView *view, unsigned int direction, unsigned int tail_freed) {
+  // Move the head of the snake of [view] on one space towards DIR_* [direction], and the tail up after it if [tail_freed]
+  // This is snake_crawl() without the rules of the game, which were kept 
+  // by the game being watched.  Returns -1 if the move is not one that 
+  // game could have made, or the memory for it could not be allocated.
+  
+  struct Snake *snake = &view->snake;
+  struct GridCell old_head_cell = *snake_head(snake);
+  struct GridCell head_cell = old_head_cell;
+  grid_cell_step(snake, &head_cell, direction);
+  
+  if (*grid_space_links(snake, head_cell.x, head_cell.y) != 0) {
+    struct GridCell *last_cell = snake_tail(snake);
+    if (head_cell.x != last_cell->x || head_cell.y != last_cell->y || !tail_freed) {
+      return -1;
+    }
+  }
+  if ((!tail_freed && snake->length == snake->capacity && snake_grow_body(snake) == -1) ||
+      grid_reserve_space(snake, head_cell.x, head_cell.y) == -1) {
+    return -1;
+  }
+  
+  snake->direction = direction;
+  snake->new_direction = direction;
+  if (tail_freed) {
+    struct GridCell *last_cell = snake_tail(snake);
+    snake_release_cell(snake, last_cell->x, last_cell->y);
+    snake_pop_tail(snake);
+  }
+  snake_push_head(snake, &head_cell);
+  snake_occupy_cell(snake, head_cell.y);
+  
+  snake_relink_cell(snake, snake->length - 1, snake_tail(snake));
+  snake_relink_cell(snake, 1, &old_head_cell);
+  snake_relink_cell(snake, 0, &head_cell);
+  
+  return 0;
+}
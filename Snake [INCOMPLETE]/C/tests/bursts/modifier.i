@@ -0,0 +1 @@
+.dwas..
\ No newline at end of file
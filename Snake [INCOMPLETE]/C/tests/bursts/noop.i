@@ -0,0 +1 @@
+..d..s.
\ No newline at end of file
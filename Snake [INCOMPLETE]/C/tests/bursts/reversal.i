@@ -0,0 +1 @@
+.a.d.s.
\ No newline at end of file
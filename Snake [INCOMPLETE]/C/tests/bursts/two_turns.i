@@ -0,0 +1 @@
+.dw.as.
\ No newline at end of file
@@ -0,0 +1,126 @@
+/*
+ * Name: Snake in C
+ * Author: Michael T. Kloos
+ *
+ * Copyright:
+ * (C) Copyright 2022 Michael T. Kloos (http://www.michaelkloos.com/).
+ * All Rights Reserved.
+ */
+
+#include <time.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include "snake.h"
+
+// What each TRACE_THREAD_* is called in the trace viewer
+const char *const trace_thread_names[TRACE_THREAD_COUNT] = {
+  "main", "render"
+};
+
+signed int trace_init(struct Trace *trace) {
+  // Set up an empty Trace for every TRACE_THREAD_*, starting now
+  // Returns -1 if the memory for it could not be allocated.
+  
+  clock_gettime(CLOCK_MONOTONIC, &trace->start);
+  signed int failed = 0;
+  for (unsigned int thread = 0; thread < TRACE_THREAD_COUNT; thread++) {
+    struct TraceRing *ring = &trace->rings[thread];
+    ring->thread_name = trace_thread_names[thread];
+    ring->count = 0;
+    ring->start = &trace->start;
+    ring->events = malloc(TRACE_RING_SIZE * sizeof(struct TraceEvent));
+    failed |= (ring->events == NULL);
+  }
+  if (failed) {
+    trace_destroy(trace);
+    return -1;
+  }
+  
+  return 0;
+}
+
+void trace_destroy(struct Trace *trace) {
+  // Free all of the memory owned by [trace]
+  
+  for (unsigned int thread = 0; thread < TRACE_THREAD_COUNT; thread++) {
+    free(trace->rings[thread].events);
+  }
+  return;
+}
+
+uint64_t trace_now(struct TraceRing *ring) {
+  // The time now, in nanoseconds since the Trace of [ring] started
+  
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return elapsed_ns(ring->start, &now);
+}
+
+void trace_event(struct TraceRing *ring, char phase, const char *name, uint64_t start_ns, uint64_t duration_ns, uint64_t value) {
+  // Record an event of [phase] called [name] at [start_ns], on the thread of [ring]
+  // [name] must outlive the Trace, as only the pointer is kept.
+  
+  // The count is published after the event is in place, so that a thread 
+  // reading the ring never sees a slot before it has been filled in
+  unsigned long long count = ring->count;
+  struct TraceEvent *event = &ring->events[count & (TRACE_RING_SIZE - 1)];
+  event->start_ns = start_ns;
+  event->duration_ns = duration_ns;
+  event->name = name;
+  event->value = value;
+  event->phase = phase;
+  __atomic_store_n(&ring->count, count + 1, __ATOMIC_RELEASE);
+  return;
+}
+
+void trace_span(struct TraceRing *ring, const char *name, uint64_t start_ns, uint64_t value) {
+  // Record that [name] ran from [start_ns] until now, on the thread of [ring]
+  
+  trace_event(ring, 'X', name, start_ns, trace_now(ring) - start_ns, value);
+  return;
+}
+
+signed int trace_write_json(struct Trace *trace, const char *path) {
+  // Write every event kept by [trace] to a file at [path], in the Chrome trace event format
+  // Times are in microseconds, as the format has them.  The threads 
+  // recording to [trace] must have stopped.  Returns -1 if the file could 
+  // not be written.
+  
+  FILE *file = fopen(path, "w");
+  if (file == NULL) {
+    return -1;
+  }
+  
+  fprintf(file, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+  for (unsigned int thread = 0; thread < TRACE_THREAD_COUNT; thread++) {
+    struct TraceRing *ring = &trace->rings[thread];
+    fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"%s\"}}", thread ? ",\n" : "", thread + 1, ring->thread_name);
+    
+    // Only the latest TRACE_RING_SIZE events are still there
+    unsigned long long count = __atomic_load_n(&ring->count, __ATOMIC_ACQUIRE);
+    unsigned long long first = (count > TRACE_RING_SIZE) ? count - TRACE_RING_SIZE : 0;
+    for (unsigned long long n = first; n < count; n++) {
+      struct TraceEvent *event = &ring->events[n & (TRACE_RING_SIZE - 1)];
+      fprintf(file, ",\n{\"name\":\"%s\",\"ph\":\"%c\",\"pid\":1,\"tid\":%u,\"ts\":%llu.%03u", event->name, event->phase, thread + 1, (unsigned long long)(event->start_ns / 1000), (unsigned int)(event->start_ns % 1000));
+      if        (event->phase == 'X') {
+        fprintf(file, ",\"dur\":%llu.%03u", (unsigned long long)(event->duration_ns / 1000), (unsigned int)(event->duration_ns % 1000));
+      } else if (event->phase == 'i') {
+        fprintf(file, ",\"s\":\"t\"");
+      } else if (event->phase == 'f') {
+        // Finish inside the span that starts at the same time
+        fprintf(file, ",\"cat\":\"handover\",\"id\":%llu,\"bp\":\"e\"", (unsigned long long)event->value);
+      } else if (event->phase == 's') {
+        fprintf(file, ",\"cat\":\"handover\",\"id\":%llu", (unsigned long long)event->value);
+      }
+      fprintf(file, ",\"args\":{\"value\":%llu}}", (unsigned long long)event->value);
+    }
+  }
+  fprintf(file, "\n]}\n");
+  
+  signed int failed = ferror(file);
+  if (fclose(file) != 0 || failed) {
+    return -1;
+  }
+  return 0;
+}